@@ -19,6 +19,10 @@ RDialog {
     property int fileMode: openFile
     property url selectedFile
     property list<url> selectedFiles
+    // Optional proxy over the folder listing (sourceModel is set here) adding
+    // mediaProbed / mediaDuration / mediaResolution / mediaCodec / mediaPoster roles.
+    // setVisibleRange(first, last) is called as the list scrolls.
+    property QtObject infoModel: null
 
     // === Constants ===
     readonly property int openFile: 0
@@ -98,6 +102,13 @@ RDialog {
         nameFilters: control._parseNameFilter(selectedNameFilter)
     }
 
+    Binding {
+        target: control.infoModel
+        property: "sourceModel"
+        value: folderModel
+        when: control.infoModel !== null
+    }
+
     ListModel {
         id: drivesModel
     }
@@ -141,6 +152,24 @@ RDialog {
         return "file:///" + _cleanPath(path)
     }
 
+    function _formatDuration(seconds) {
+        var s = Math.round(seconds)
+        var h = Math.floor(s / 3600)
+        var m = Math.floor((s % 3600) / 60)
+        s = s % 60
+        var mm = (h > 0 && m < 10 ? "0" : "") + m
+        return (h > 0 ? h + ":" : "") + mm + ":" + (s < 10 ? "0" : "") + s
+    }
+
+    function _mediaDetails(item) {
+        if (!item.mediaProbed) return ""
+        var parts = []
+        if (item.mediaDuration > 0) parts.push(_formatDuration(item.mediaDuration))
+        if (item.mediaResolution) parts.push(item.mediaResolution)
+        if (item.mediaCodec) parts.push(item.mediaCodec)
+        return parts.join("  ·  ")
+    }
+
     // === UI ===
     ColumnLayout {
         anchors.fill: parent
@@ -302,9 +331,20 @@ RDialog {
                     id: fileListView
                     anchors.fill: parent
                     clip: true
-                    model: currentPath === "" ? drivesModel : folderModel
+                    model: currentPath === "" ? drivesModel : (control.infoModel || folderModel)
                     keyNavigationEnabled: true
 
+                    // Lets the info model probe what is on screen first and drop what scrolled away
+                    function updateVisibleRange() {
+                        if (!control.infoModel || currentPath === "" || count === 0) return
+                        var first = indexAt(0, contentY)
+                        var last = indexAt(0, contentY + height - 1)
+                        control.infoModel.setVisibleRange(first < 0 ? 0 : first, last < 0 ? count - 1 : last)
+                    }
+                    onContentYChanged: updateVisibleRange()
+                    onHeightChanged: updateVisibleRange()
+                    onCountChanged: updateVisibleRange()
+
                     property var selectedIndexes: []
 
                     function isSelected(idx) {
@@ -379,18 +419,45 @@ RDialog {
                             anchors.verticalCenter: parent.verticalCenter
                             leftPadding: Theme.spacingSmall
 
-                            Rectangle {
-                                width: 16; height: 16
-                                radius: 2
-                                color: fileIsDir ? Theme.accent : Theme.secondary
+                            // Fixed size whether or not a poster arrives, so rows never reflow while scrolling
+                            Item {
+                                width: control.infoModel ? 48 : 16
+                                height: control.infoModel ? 27 : 16
+                                anchors.verticalCenter: parent.verticalCenter
+
+                                Rectangle {
+                                    anchors.centerIn: parent
+                                    width: 16; height: 16
+                                    radius: 2
+                                    color: fileIsDir ? Theme.accent : Theme.secondary
+                                    visible: poster.status !== Image.Ready
+                                }
+
+                                Image {
+                                    id: poster
+                                    anchors.fill: parent
+                                    source: model.mediaPoster || ""
+                                    sourceSize.width: 96
+                                    fillMode: Image.PreserveAspectFit
+                                    asynchronous: true
+                                }
                             }
 
                             RLabel {
                                 text: fileName
                                 color: highlighted ? Theme.text : Theme.text // Text color on light selection
                                 elide: Text.ElideRight
+                                anchors.verticalCenter: parent.verticalCenter
                                 Layout.fillWidth: true
                             }
+
+                            RLabel {
+                                text: control._mediaDetails(model)
+                                visible: text !== ""
+                                color: Theme.secondary
+                                font.pixelSize: Theme.fontSizeSmall
+                                anchors.verticalCenter: parent.verticalCenter
+                            }
                         }
 
                         onClicked: {
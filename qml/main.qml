@@ -1,6 +1,7 @@
 import QtQuick
 import QtQuick.Controls
 import QtQuick.Layouts
+import QtCore
 import RenkoPlayer 1.0
 import RenkoUI 1.0
 
@@ -21,6 +22,34 @@ RWindow {
                 text: qsTr("Open File...")
                 onTriggered: fileDialog.open()
             }
+            RMenuItem {
+                text: player.timeShift ? qsTr("Time-Shift Live Streams: On") : qsTr("Time-Shift Live Streams: Off")
+                onTriggered: player.timeShift = !player.timeShift
+            }
+            RMenuItem {
+                text: qsTr("Export Clip...  (I / O to mark)")
+                enabled: clipIn >= 0 && clipOut > clipIn && !player.exporting
+                onTriggered: clipDialog.open()
+            }
+            RMenuItem {
+                text: smartCut ? qsTr("Exact Clip Cuts: On") : qsTr("Exact Clip Cuts: Off")
+                onTriggered: smartCut = !smartCut
+            }
+            RMenuItem {
+                text: qsTr("Cancel Clip Export")
+                enabled: player.exporting
+                onTriggered: player.cancelExport()
+            }
+            RMenuItem {
+                text: qsTr("Save Snapshot  (S)")
+                enabled: player.source !== ""
+                onTriggered: player.captureSnapshot()
+            }
+            RMenuItem {
+                text: qsTr("Save Snapshot As...")
+                enabled: player.source !== ""
+                onTriggered: snapshotDialog.open()
+            }
             MenuSeparator {
                 contentItem: Rectangle {
                     implicitWidth: 200
@@ -46,23 +75,67 @@ RWindow {
         id: fileDialog
         iconSource: "qrc:/qt/qml/RenkoPlayer/assets/icons/app.png"
         title: "Please choose a video file"
+        infoModel: MediaProbeModel {}
         nameFilters: ["Video files (*.mp4 *.avi *.mkv *.mov *.flv *.webm)", "All files (*)"]
         onAccepted: {
             var path = selectedFile.toString()
             urlField.text = path
-            
-            if (isPanorama) {
-                videoPlayer.source = ""
-                panoramaPlayer.source = path
-                panoramaPlayer.play()
-            } else {
-                panoramaPlayer.source = ""
-                videoPlayer.source = path
-                videoPlayer.play()
-            }
+            player.source = path
+            player.play()
         }
     }
 
+    // Clip marks in source milliseconds; smart cut re-encodes the partial GOPs at both ends
+    property real clipIn: -1
+    property real clipOut: -1
+    property bool smartCut: false
+
+    RFileDialog {
+        id: clipDialog
+        iconSource: "qrc:/qt/qml/RenkoPlayer/assets/icons/app.png"
+        title: qsTr("Export clip")
+        fileMode: clipDialog.saveFile
+        nameFilters: ["MP4 (*.mp4)", "Matroska (*.mkv)"]
+        onAccepted: player.exportClip(clipIn, clipOut, selectedFile, smartCut)
+    }
+
+    RMessageDialog {
+        id: exportDialog
+        iconSource: "qrc:/qt/qml/RenkoPlayer/assets/icons/app.png"
+        title: qsTr("Clip export")
+    }
+
+    RFileDialog {
+        id: snapshotDialog
+        iconSource: "qrc:/qt/qml/RenkoPlayer/assets/icons/app.png"
+        title: qsTr("Save snapshot")
+        fileMode: snapshotDialog.saveFile
+        nameFilters: ["PNG (*.png)", "JPEG (*.jpg)", "WebP (*.webp)"]
+        onAccepted: player.captureSnapshot(selectedFile)
+    }
+
+    RMessageDialog {
+        id: snapshotErrorDialog
+        iconSource: "qrc:/qt/qml/RenkoPlayer/assets/icons/app.png"
+        title: qsTr("Snapshot")
+    }
+
+    // Burst-friendly: saves to the pictures folder without asking
+    Shortcut {
+        sequence: "S"
+        onActivated: player.captureSnapshot()
+    }
+
+    Shortcut {
+        sequence: "I"
+        onActivated: clipIn = player.position
+    }
+
+    Shortcut {
+        sequence: "O"
+        onActivated: clipOut = player.position
+    }
+
     RMessageDialog {
         id: aboutDialog
         iconSource: "qrc:/qt/qml/RenkoPlayer/assets/icons/app.png"
@@ -73,20 +146,14 @@ RWindow {
     Shortcut {
         sequence: "Space"
         onActivated: {
-            if (isPanorama) {
-                if (panoramaPlayer.playing) panoramaPlayer.pause()
-                else panoramaPlayer.play()
-            } else {
-                if (videoPlayer.playing) videoPlayer.pause()
-                else videoPlayer.play()
-            }
+            if (player.playing) player.pause()
+            else player.play()
         }
     }
 
     Shortcut {
         sequence: "Left"
         onActivated: {
-            var player = isPanorama ? panoramaPlayer : videoPlayer
             var newPos = player.position - 5000
             if (newPos < 0) newPos = 0
             player.position = newPos
@@ -96,7 +163,6 @@ RWindow {
     Shortcut {
         sequence: "Right"
         onActivated: {
-            var player = isPanorama ? panoramaPlayer : videoPlayer
             var newPos = player.position + 5000
             if (newPos > player.duration) newPos = player.duration
             player.position = newPos
@@ -109,8 +175,7 @@ RWindow {
             var newVol = volumeSlider.value + 0.1
             if (newVol > 1.0) newVol = 1.0
             volumeSlider.value = newVol
-            videoPlayer.volume = newVol
-            panoramaPlayer.volume = newVol
+            player.volume = newVol
         }
     }
 
@@ -120,8 +185,7 @@ RWindow {
             var newVol = volumeSlider.value - 0.1
             if (newVol < 0.0) newVol = 0.0
             volumeSlider.value = newVol
-            videoPlayer.volume = newVol
-            panoramaPlayer.volume = newVol
+            player.volume = newVol
         }
     }
 
@@ -132,7 +196,7 @@ RWindow {
         interval: 3000
         repeat: false
         onTriggered: {
-            if ((isPanorama ? panoramaPlayer.playing : videoPlayer.playing) && !controlsPanel.isHoveringControls) {
+            if (player.playing && !controlsPanel.isHoveringControls) {
                 controlsVisible = false
             }
         }
@@ -143,6 +207,40 @@ RWindow {
         hideTimer.restart()
     }
 
+    Settings {
+        category: "RenkoPlayer/TimeShift"
+        property alias enabled: player.timeShift
+        property alias minutes: player.timeShiftMinutes
+        property alias maxGB: player.timeShiftMaxGB
+    }
+
+    // One playback session shared by the flat and the 360 view
+    MediaPlayerEngine {
+        id: player
+
+        onExportFinished: (ok, message) => {
+            exportDialog.text = ok ? qsTr("Clip saved to %1").arg(message) : message
+            exportDialog.open()
+        }
+        // Successful snapshots stay quiet so bursts are not interrupted
+        onSnapshotFinished: (ok, message) => {
+            if (ok) return
+            snapshotErrorDialog.text = message
+            snapshotErrorDialog.open()
+        }
+        onSourceChanged: {
+            clipIn = -1
+            clipOut = -1
+        }
+        onPositionChanged: {
+            if (!progressSlider.pressed) progressSlider.value = position
+        }
+        onPlayingChanged: {
+            if (!playing) showControls()
+            else hideTimer.restart()
+        }
+    }
+
     Item {
         anchors.fill: parent
 
@@ -151,62 +249,52 @@ RWindow {
             anchors.fill: parent
             color: "black" // Video background should remain black
 
-            VideoRenderItem {
-                id: videoPlayer
+            // Views are created on demand: the flat one once the window is up, the 360 one
+            // (sphere mesh, shaders, its own framebuffer) only when 360° mode is first used.
+            // A view stays loaded afterwards, so switching back and forth is instant.
+            Loader {
+                id: videoLoader
                 anchors.fill: parent
-                visible: !isPanorama
-                
-                onDurationChanged: {
-                    if (!isPanorama) progressSlider.to = duration
-                }
-                onPositionChanged: {
-                    if (!isPanorama && !progressSlider.pressed) progressSlider.value = position
-                }
-                onPlayingChanged: {
-                    if (!playing) showControls()
-                    else hideTimer.restart()
+                asynchronous: true
+                sourceComponent: VideoRenderItem {
+                    visible: !isPanorama
+                    engine: player
                 }
             }
 
-            PanoramaRenderItem {
-                id: panoramaPlayer
+            Loader {
+                id: panoramaLoader
                 anchors.fill: parent
-                visible: isPanorama
-                
-                onDurationChanged: {
-                    if (isPanorama) progressSlider.to = duration
-                }
-                onPositionChanged: {
-                    if (isPanorama && !progressSlider.pressed) progressSlider.value = position
-                }
-                onPlayingChanged: {
-                    if (!playing) showControls()
-                    else hideTimer.restart()
-                }
-
-                MouseArea {
-                    anchors.fill: parent
-                    property point lastPos
-                    onPressed: (mouse) => { 
-                        lastPos = Qt.point(mouse.x, mouse.y)
-                        showControls()
-                    }
-                    onPositionChanged: (mouse) => {
-                        showControls()
-                        var dx = mouse.x - lastPos.x
-                        var dy = mouse.y - lastPos.y
-                        panoramaPlayer.yaw -= dx * 0.2
-                        panoramaPlayer.pitch += dy * 0.2
-                        if (panoramaPlayer.pitch > 89.0) panoramaPlayer.pitch = 89.0
-                        if (panoramaPlayer.pitch < -89.0) panoramaPlayer.pitch = -89.0
-                        lastPos = Qt.point(mouse.x, mouse.y)
-                    }
-                    onWheel: (wheel) => {
-                        showControls()
-                        var newFov = panoramaPlayer.fov - wheel.angleDelta.y / 120 * 5
-                        if (newFov < 30) newFov = 30
-                        if (newFov > 120) newFov = 120
-                        panoramaPlayer.fov = newFov
+                active: false
+                sourceComponent: PanoramaRenderItem {
+                    id: panoramaPlayer
+                    visible: isPanorama
+                    engine: player
+
+                    MouseArea {
+                        anchors.fill: parent
+                        property point lastPos
+                        onPressed: (mouse) => { 
+                            lastPos = Qt.point(mouse.x, mouse.y)
+                            showControls()
+                        }
+                        onPositionChanged: (mouse) => {
+                            showControls()
+                            var dx = mouse.x - lastPos.x
+                            var dy = mouse.y - lastPos.y
+                            panoramaPlayer.yaw -= dx * 0.2
+                            panoramaPlayer.pitch += dy * 0.2
+                            if (panoramaPlayer.pitch > 89.0) panoramaPlayer.pitch = 89.0
+                            if (panoramaPlayer.pitch < -89.0) panoramaPlayer.pitch = -89.0
+                            lastPos = Qt.point(mouse.x, mouse.y)
+                        }
+                        onWheel: (wheel) => {
+                            showControls()
+                            var newFov = panoramaPlayer.fov - wheel.angleDelta.y / 120 * 5
+                            if (newFov < 30) newFov = 30
+                            if (newFov > 120) newFov = 120
+                            panoramaPlayer.fov = newFov
+                        }
                     }
                 }
             }
@@ -217,6 +305,13 @@ RWindow {
                 acceptedButtons: Qt.NoButton
                 onPositionChanged: showControls()
             }
+
+            // Opening runs in the background; the UI stays usable meanwhile
+            BusyIndicator {
+                anchors.centerIn: parent
+                running: player.loading
+                visible: running
+            }
         }
 
         // Controls Area
@@ -265,15 +360,16 @@ RWindow {
                     spacing: Theme.spacingNormal
 
                     RLabel {
-                        text: formatTime(isPanorama ? panoramaPlayer.position : videoPlayer.position)
+                        text: formatTime(player.position)
                     }
 
                     RSlider {
                         id: progressSlider
                         Layout.fillWidth: true
-                        from: 0
-                        to: isPanorama ? panoramaPlayer.duration : videoPlayer.duration
-                        value: pressed ? value : (isPanorama ? panoramaPlayer.position : videoPlayer.position)
+                        // A time-shifted live source seeks within its buffered window
+                        from: player.live ? player.liveWindowStart : 0
+                        to: player.live ? player.liveWindowEnd : player.duration
+                        value: pressed ? value : player.position
                         
                         // Enhanced visibility styling
                         trackColor: "#BDBDBD"
@@ -281,14 +377,29 @@ RWindow {
                         handleBorderWidth: 3
                         handleBorderColor: Theme.surface
                         
-                        onMoved: {
-                            if (isPanorama) panoramaPlayer.position = value
-                            else videoPlayer.position = value
-                        }
+                        // Dragging previews keyframes; the accurate seek happens on release
+                        onPressedChanged: pressed ? player.beginScrub() : player.endScrub()
+                        onMoved: player.scrubTo(value)
                     }
 
                     RLabel {
-                        text: formatTime(isPanorama ? panoramaPlayer.duration : videoPlayer.duration)
+                        text: formatTime(player.live ? player.liveWindowEnd : player.duration)
+                    }
+
+                    RProgressBar {
+                        visible: player.exporting
+                        preferredWidth: 80
+                        value: player.exportProgress
+                    }
+
+                    RButton {
+                        visible: player.live
+                        text: qsTr("LIVE")
+                        isIconOnly: false
+                        // Highlighted while playing close to the live edge
+                        highlighted: player.position > player.liveWindowEnd - 3000
+                        accentColor: Theme.error
+                        onClicked: player.jumpToLive()
                     }
                 }
 
@@ -308,15 +419,8 @@ RWindow {
 
                     RToolButton {
                         onClicked: {
-                            if (isPanorama) {
-                                videoPlayer.source = ""
-                                panoramaPlayer.source = urlField.text
-                                panoramaPlayer.play()
-                            } else {
-                                panoramaPlayer.source = ""
-                                videoPlayer.source = urlField.text
-                                videoPlayer.play()
-                            }
+                            player.source = urlField.text
+                            player.play()
                         }
                         icon.source: "../assets/icons/play.svg"
                         icon.color: Theme.success
@@ -326,10 +430,7 @@ RWindow {
                     }
 
                     RToolButton {
-                        onClicked: {
-                            if (isPanorama) panoramaPlayer.pause()
-                            else videoPlayer.pause()
-                        }
+                        onClicked: player.pause()
                         icon.source: "../assets/icons/pause.svg"
                         icon.color: Theme.warning
                         icon.width: 24
@@ -338,10 +439,7 @@ RWindow {
                     }
 
                     RToolButton {
-                        onClicked: {
-                            videoPlayer.stop()
-                            panoramaPlayer.stop()
-                        }
+                        onClicked: player.stop()
                         icon.source: "../assets/icons/stop.svg"
                         icon.color: Theme.error
                         icon.width: 24
@@ -368,36 +466,60 @@ RWindow {
                             handleBorderWidth: 3
                             handleBorderColor: Theme.surface
                             
-                            onMoved: {
-                                videoPlayer.volume = value
-                                panoramaPlayer.volume = value
-                            }
+                            onMoved: player.volume = value
                         }
                     }
 
                     RComboBox {
                         id: resolutionCombo
-                        model: ["Original", "1080p", "720p", "480p", "360p"]
+                        model: ["Original", "Auto", "1080p", "720p", "480p", "360p"]
                         currentIndex: 0
                         Layout.preferredWidth: 100
                         
                         backgroundColor: Qt.rgba(Theme.surface.r, Theme.surface.g, Theme.surface.b, 0.4)
 
                         onActivated: (index) => {
+                            // Auto: decode at the on-screen size of the player
+                            player.autoResolution = index === 1
+                            if (player.autoResolution) return
+
                             var w = 0
                             var h = 0
                             switch(index) {
                                 case 0: w = 0; h = 0; break;
-                                case 1: w = 0; h = 1080; break;
-                                case 2: w = 0; h = 720; break;
-                                case 3: w = 0; h = 480; break;
-                                case 4: w = 0; h = 360; break;
+                                case 2: w = 0; h = 1080; break;
+                                case 3: w = 0; h = 720; break;
+                                case 4: w = 0; h = 480; break;
+                                case 5: w = 0; h = 360; break;
                             }
-                            videoPlayer.setResolution(w, h)
-                            panoramaPlayer.setResolution(w, h)
+                            player.setResolution(w, h)
                         }
                     }
 
+                    RComboBox {
+                        id: audioTrackCombo
+                        visible: player.audioTracks.length > 1
+                        model: player.audioTracks
+                        currentIndex: player.audioTrack
+                        Layout.preferredWidth: 160
+
+                        backgroundColor: Qt.rgba(Theme.surface.r, Theme.surface.g, Theme.surface.b, 0.4)
+
+                        onActivated: (index) => player.audioTrack = index
+                    }
+
+                    RComboBox {
+                        id: subtitleCombo
+                        visible: !isPanorama && player.subtitleTracks.length > 0
+                        model: ["Subtitles Off"].concat(player.subtitleTracks)
+                        currentIndex: player.subtitleTrack + 1
+                        Layout.preferredWidth: 140
+
+                        backgroundColor: Qt.rgba(Theme.surface.r, Theme.surface.g, Theme.surface.b, 0.4)
+
+                        onActivated: (index) => player.subtitleTrack = index - 1
+                    }
+
                     RCheckBox {
                         id: panoramaCheckBox
                         text: "360° Mode"
@@ -423,25 +545,8 @@ RWindow {
                             }
                         }
 
-                        onCheckedChanged: {
-                            var currentPos = isPanorama ? panoramaPlayer.position : videoPlayer.position
-                            var currentSrc = isPanorama ? panoramaPlayer.source : videoPlayer.source
-                            
-                            if (isPanorama) panoramaPlayer.source = ""
-                            else videoPlayer.source = ""
-                            
-                            isPanorama = checked
-                            
-                            if (isPanorama) {
-                                panoramaPlayer.source = currentSrc
-                                panoramaPlayer.position = currentPos
-                                panoramaPlayer.play()
-                            } else {
-                                videoPlayer.source = currentSrc
-                                videoPlayer.position = currentPos
-                                videoPlayer.play()
-                            }
-                        }
+                        // Only the view changes; playback carries on where it is
+                        onCheckedChanged: isPanorama = checked
                     }
                 }
             }
@@ -449,6 +554,7 @@ RWindow {
     }
     
     property bool isPanorama: false
+    onIsPanoramaChanged: if (isPanorama) panoramaLoader.active = true
 
     function formatTime(ms) {
         var totalSeconds = Math.floor(ms / 1000);
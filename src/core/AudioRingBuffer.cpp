@@ -0,0 +1,53 @@
+#include "AudioRingBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+void AudioRingBuffer::reset(size_t capacity) {
+    if (m_data.size() != capacity) {
+        m_data.assign(capacity, 0);
+        m_data.shrink_to_fit();
+    }
+    clear();
+}
+
+void AudioRingBuffer::clear() {
+    m_readPos = 0;
+    m_size = 0;
+}
+
+size_t AudioRingBuffer::write(const uint8_t* data, size_t bytes) {
+    bytes = std::min(bytes, freeSpace());
+    if (bytes == 0) return 0;
+
+    // At most two copies: up to the end of storage, then from the start
+    const size_t writePos = (m_readPos + m_size) % m_data.size();
+    const size_t first = std::min(bytes, m_data.size() - writePos);
+    std::memcpy(m_data.data() + writePos, data, first);
+    std::memcpy(m_data.data(), data + first, bytes - first);
+    m_size += bytes;
+    return bytes;
+}
+
+size_t AudioRingBuffer::writeSilence(size_t bytes) {
+    bytes = std::min(bytes, freeSpace());
+    if (bytes == 0) return 0;
+
+    const size_t writePos = (m_readPos + m_size) % m_data.size();
+    const size_t first = std::min(bytes, m_data.size() - writePos);
+    std::memset(m_data.data() + writePos, 0, first);
+    std::memset(m_data.data(), 0, bytes - first);
+    m_size += bytes;
+    return bytes;
+}
+
+size_t AudioRingBuffer::read(uint8_t* data, size_t bytes) {
+    bytes = std::min(bytes, m_size);
+    if (bytes == 0) return 0;
+
+    const size_t first = std::min(bytes, m_data.size() - m_readPos);
+    std::memcpy(data, m_data.data() + m_readPos, first);
+    std::memcpy(data + first, m_data.data(), bytes - first);
+    m_readPos = (m_readPos + bytes) % m_data.size();
+    m_size -= bytes;
+    return bytes;
+}
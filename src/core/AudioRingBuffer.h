@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed-capacity byte FIFO for decoded PCM. Storage is allocated once by reset(), so
+// neither the decoder (writer) nor the audio device (reader) allocates during playback.
+// Not synchronized; the owner guards it with its audio mutex.
+class AudioRingBuffer {
+public:
+    void reset(size_t capacity); // Allocates and empties
+    void clear();
+
+    size_t capacity() const { return m_data.size(); }
+    size_t size() const { return m_size; }
+    size_t freeSpace() const { return m_data.size() - m_size; }
+    bool empty() const { return m_size == 0; }
+
+    // Both return the number of bytes actually copied
+    size_t write(const uint8_t* data, size_t bytes);
+    size_t read(uint8_t* data, size_t bytes);
+    // Zero bytes, which is silence for signed integer and float PCM
+    size_t writeSilence(size_t bytes);
+
+private:
+    std::vector<uint8_t> m_data;
+    size_t m_readPos = 0;
+    size_t m_size = 0;
+};
@@ -0,0 +1,611 @@
+#include "ClipExporter.h"
+#include "FFmpegInit.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+}
+
+namespace {
+
+int interruptExport(void* opaque) {
+    return static_cast<const std::stop_token*>(opaque)->stop_requested() ? 1 : 0;
+}
+
+std::string errorString(int err) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    av_strerror(err, errbuf, sizeof(errbuf));
+    return errbuf;
+}
+
+// Length field size of avcC / hvcC extradata; 0 when the track carries Annex B start codes
+int nalLengthSize(const AVCodecParameters* par) {
+    if (!par->extradata || par->extradata_size < 1 || par->extradata[0] != 1) return 0;
+    if (par->codec_id == AV_CODEC_ID_H264 && par->extradata_size >= 7) return (par->extradata[4] & 3) + 1;
+    if (par->codec_id == AV_CODEC_ID_HEVC && par->extradata_size >= 23) return (par->extradata[21] & 3) + 1;
+    return 0;
+}
+
+const uint8_t* findStartCode(const uint8_t* p, const uint8_t* end) {
+    for (; p + 3 <= end; ++p) {
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1) return p;
+    }
+    return end;
+}
+
+// Encoders emit Annex B; a track described by avcC / hvcC expects length-prefixed NAL units
+bool toLengthPrefixed(AVPacket* packet, int lengthSize) {
+    std::vector<uint8_t> out;
+    out.reserve(packet->size + 16);
+    const uint8_t* end = packet->data + packet->size;
+    const uint8_t* nal = findStartCode(packet->data, end);
+    while (nal < end) {
+        nal += 3;
+        const uint8_t* next = findStartCode(nal, end);
+        const uint8_t* nalEnd = next;
+        while (nalEnd > nal && nalEnd[-1] == 0) --nalEnd; // Leading zero of a 4-byte start code
+        const size_t size = nalEnd - nal;
+        for (int i = lengthSize - 1; i >= 0; --i) out.push_back((uint8_t)(size >> (8 * i)));
+        out.insert(out.end(), nal, nalEnd);
+        nal = next;
+    }
+
+    AVBufferRef* buffer = av_buffer_alloc(out.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!buffer) return false;
+    std::memcpy(buffer->data, out.data(), out.size());
+    std::memset(buffer->data + out.size(), 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    av_buffer_unref(&packet->buf);
+    packet->buf = buffer;
+    packet->data = buffer->data;
+    packet->size = (int)out.size();
+    return true;
+}
+
+// SPS / PPS (and VPS) of the source as the track's packets carry NAL units: length-prefixed for
+// avcC / hvcC, Annex B extradata as it is
+std::vector<uint8_t> inBandParameterSets(const AVCodecParameters* par, int lengthSize) {
+    std::vector<uint8_t> out;
+    const uint8_t* data = par->extradata;
+    const int size = par->extradata_size;
+    if (!data || size < 4) return out;
+    if (lengthSize == 0) {
+        if ((data[0] == 0 && data[1] == 0 && data[2] == 1) || (data[0] == 0 && data[1] == 0 && data[2] == 0 && data[3] == 1)) {
+            out.assign(data, data + size);
+        }
+        return out;
+    }
+
+    int pos = 0;
+    auto take = [&](int count) {
+        for (int n = 0; n < count && pos + 2 <= size; ++n) {
+            const int nalSize = (data[pos] << 8) | data[pos + 1];
+            pos += 2;
+            if (pos + nalSize > size) return false;
+            for (int i = lengthSize - 1; i >= 0; --i) out.push_back((uint8_t)(nalSize >> (8 * i)));
+            out.insert(out.end(), data + pos, data + pos + nalSize);
+            pos += nalSize;
+        }
+        return true;
+    };
+    if (par->codec_id == AV_CODEC_ID_H264) {
+        pos = 6;
+        if (!take(data[5] & 0x1f) || pos >= size) return {};
+        const int ppsCount = data[pos++];
+        if (!take(ppsCount)) return {};
+    } else {
+        // hvcC: arrays of NAL units by type
+        if (size < 23) return {};
+        const int arrays = data[22];
+        pos = 23;
+        for (int a = 0; a < arrays && pos + 3 <= size; ++a) {
+            const int count = (data[pos + 1] << 8) | data[pos + 2];
+            pos += 3;
+            if (!take(count)) return {};
+        }
+    }
+    return out;
+}
+
+bool prependBytes(AVPacket* packet, const std::vector<uint8_t>& prefix) {
+    const size_t size = prefix.size() + packet->size;
+    AVBufferRef* buffer = av_buffer_alloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!buffer) return false;
+    std::memcpy(buffer->data, prefix.data(), prefix.size());
+    std::memcpy(buffer->data + prefix.size(), packet->data, packet->size);
+    std::memset(buffer->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    av_buffer_unref(&packet->buf);
+    packet->buf = buffer;
+    packet->data = buffer->data;
+    packet->size = (int)size;
+    return true;
+}
+
+class ClipExport {
+public:
+    ClipExport(const ClipExportRequest& request, std::stop_token cancel, const ClipExportProgress& progress)
+        : m_request(request), m_cancel(cancel), m_progress(progress) {}
+    ~ClipExport();
+
+    bool run();
+    const std::string& error() const { return m_error; }
+    bool createdOutput() const { return m_outputOpened; }
+
+private:
+    bool fail(const std::string& message) {
+        if (m_error.empty()) m_error = message;
+        return false;
+    }
+    bool openInput();
+    bool openOutput();
+    void checkSmartCut();
+    bool handleVideo(AVPacket* packet);
+    bool handleOther(AVPacket* packet);
+    bool finishVideo();
+    bool allDone() const;
+    bool flushGop();
+    bool writePacket(AVPacket* packet);
+    void reportProgress(int64_t dts);
+
+    // Smart cut: decode a run of source packets and re-encode the frames in [from, to)
+    bool beginSegment();
+    bool decodePacket(const AVPacket* packet, int64_t from, int64_t to);
+    bool encodeFrame(AVFrame* frame, int64_t from, int64_t to);
+    bool endSegment(int64_t from, int64_t to);
+    bool receiveEncoded();
+
+    ClipExportRequest m_request;
+    std::stop_token m_cancel;
+    const ClipExportProgress& m_progress;
+    std::string m_error;
+
+    AVFormatContext* m_input = nullptr;
+    AVFormatContext* m_output = nullptr;
+    bool m_outputOpened = false;
+    std::vector<int> m_streamMap; // Input stream -> output stream, -1 = not exported
+    std::vector<bool> m_streamDone;
+    int m_videoIndex = -1;
+
+    // Video stream time base
+    int64_t m_inTs = 0;
+    int64_t m_outTs = 0;
+    int64_t m_startTs = AV_NOPTS_VALUE;   // Keyframe the copy starts from
+    int64_t m_clipStartUs = AV_NOPTS_VALUE; // Becomes 0 in the clip, AV_TIME_BASE units
+    int64_t m_outUs = 0;
+    int64_t m_reorderDelay = 0;           // PTS - DTS of the source keyframes
+    bool m_videoDone = false;
+    double m_lastProgress = -1.0;
+    std::vector<AVPacket*> m_pendingOther; // Audio read before the first video keyframe
+
+    bool m_smartCut = false;
+    bool m_head = false;                 // Re-encoding from the in-point to the next keyframe
+    // Past that keyframe, still re-encoding its leading pictures: open GOPs (HEVC CRA, H.264
+    // recovery points) follow the keyframe with pictures that show before it and refer to the GOP
+    // the head replaced. They are decoded from the source into the head, up to m_headEnd.
+    bool m_leading = false;
+    int64_t m_headEnd = 0;
+    std::vector<AVPacket*> m_gop;        // Copied GOP held back until the next keyframe shows it ends before the out-point
+    const AVCodec* m_encoder = nullptr;
+    AVCodecContext* m_decoderCtx = nullptr;
+    AVCodecContext* m_encoderCtx = nullptr;
+    AVFrame* m_frame = nullptr;
+    AVPacket* m_encoded = nullptr;
+    int m_lengthSize = 0;
+    // The re-encoded head carries the encoder's SPS / PPS in-band under the source's ids; the
+    // first copied keyframe after it gets the source's sets back in front of it
+    std::vector<uint8_t> m_parameterSets;
+    bool m_restoreParameterSets = false;
+};
+
+ClipExport::~ClipExport() {
+    for (AVPacket* packet : m_gop) av_packet_free(&packet);
+    for (AVPacket* packet : m_pendingOther) av_packet_free(&packet);
+    if (m_encoded) av_packet_free(&m_encoded);
+    if (m_frame) av_frame_free(&m_frame);
+    if (m_encoderCtx) avcodec_free_context(&m_encoderCtx);
+    if (m_decoderCtx) avcodec_free_context(&m_decoderCtx);
+    if (m_input) avformat_close_input(&m_input);
+    if (m_output) {
+        if (m_output->pb && !(m_output->oformat->flags & AVFMT_NOFILE)) avio_closep(&m_output->pb);
+        avformat_free_context(m_output);
+    }
+}
+
+bool ClipExport::openInput() {
+    initFFmpeg(); // The source may be a stream URL
+    m_input = avformat_alloc_context();
+    if (!m_input) return fail("Out of memory");
+    m_input->interrupt_callback.callback = interruptExport;
+    m_input->interrupt_callback.opaque = &m_cancel;
+    int ret = avformat_open_input(&m_input, m_request.source.c_str(), nullptr, nullptr);
+    if (ret != 0) return fail("Could not open source: " + m_request.source + " Error: " + errorString(ret));
+    if (avformat_find_stream_info(m_input, nullptr) < 0) return fail("Could not find stream info");
+
+    m_videoIndex = av_find_best_stream(m_input, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (m_videoIndex < 0) return fail("No video stream found");
+    return true;
+}
+
+bool ClipExport::openOutput() {
+    const std::string& path = m_request.destination;
+    int ret = avformat_alloc_output_context2(&m_output, nullptr, nullptr, path.c_str());
+    if (ret < 0 || !m_output) return fail("Unsupported clip container for " + path + " (use .mp4 or .mkv)");
+
+    m_streamMap.assign(m_input->nb_streams, -1);
+    for (unsigned int i = 0; i < m_input->nb_streams; i++) {
+        const AVStream* in = m_input->streams[i];
+        const AVMediaType type = in->codecpar->codec_type;
+        bool keep = false;
+        if (type == AVMEDIA_TYPE_VIDEO) {
+            keep = (int)i == m_videoIndex;
+        } else if (type == AVMEDIA_TYPE_AUDIO) {
+            keep = true;
+        } else if (type == AVMEDIA_TYPE_SUBTITLE) {
+            // e.g. SRT / ASS go into MKV, but MP4 only takes mov_text
+            keep = avformat_query_codec(m_output->oformat, in->codecpar->codec_id, FF_COMPLIANCE_NORMAL) == 1;
+        }
+        if (!keep) continue;
+
+        AVStream* out = avformat_new_stream(m_output, nullptr);
+        if (!out || avcodec_parameters_copy(out->codecpar, in->codecpar) < 0) return fail("Could not set up clip stream");
+        out->codecpar->codec_tag = 0;
+        out->time_base = in->time_base;
+        out->disposition = in->disposition;
+        av_dict_copy(&out->metadata, in->metadata, 0);
+        m_streamMap[i] = out->index;
+    }
+    m_streamDone.assign(m_output->nb_streams, false);
+
+    if (!(m_output->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&m_output->pb, path.c_str(), AVIO_FLAG_WRITE);
+        if (ret < 0) return fail("Could not create " + path + ": " + errorString(ret));
+    }
+    m_outputOpened = true;
+    ret = avformat_write_header(m_output, nullptr);
+    if (ret < 0) return fail("Could not write clip header: " + errorString(ret));
+    return true;
+}
+
+void ClipExport::checkSmartCut() {
+    if (!m_request.smartCut) return;
+    const AVCodecParameters* par = m_input->streams[m_videoIndex]->codecpar;
+    if (par->codec_id != AV_CODEC_ID_H264 && par->codec_id != AV_CODEC_ID_HEVC) {
+        std::cerr << "Smart cut needs H.264 or HEVC; exporting by stream copy" << std::endl;
+        return;
+    }
+    m_encoder = avcodec_find_encoder(par->codec_id);
+    const AVCodec* decoder = avcodec_find_decoder(par->codec_id);
+    if (!m_encoder || !decoder) {
+        std::cerr << "No " << avcodec_get_name(par->codec_id) << " encoder for smart cut; exporting by stream copy" << std::endl;
+        return;
+    }
+
+    m_decoderCtx = avcodec_alloc_context3(decoder);
+    if (!m_decoderCtx || avcodec_parameters_to_context(m_decoderCtx, par) < 0
+        || avcodec_open2(m_decoderCtx, decoder, nullptr) < 0) {
+        std::cerr << "Could not open decoder for smart cut; exporting by stream copy" << std::endl;
+        return;
+    }
+    m_frame = av_frame_alloc();
+    m_encoded = av_packet_alloc();
+    if (!m_frame || !m_encoded) return;
+
+    const AVCodecParameters* outPar = m_output->streams[m_streamMap[m_videoIndex]]->codecpar;
+    m_lengthSize = nalLengthSize(outPar);
+    m_parameterSets = inBandParameterSets(outPar, m_lengthSize);
+    m_smartCut = true;
+}
+
+// False when the encoder will not take this source (e.g. 10-bit into an 8-bit build): smart cut is
+// off from then on and the caller copies from the keyframe instead
+bool ClipExport::beginSegment() {
+    const AVStream* stream = m_input->streams[m_videoIndex];
+    m_encoderCtx = avcodec_alloc_context3(m_encoder);
+    if (!m_encoderCtx) {
+        m_smartCut = false;
+        return false;
+    }
+
+    m_encoderCtx->width = m_decoderCtx->width;
+    m_encoderCtx->height = m_decoderCtx->height;
+    m_encoderCtx->pix_fmt = m_decoderCtx->pix_fmt;
+    m_encoderCtx->sample_aspect_ratio = m_decoderCtx->sample_aspect_ratio;
+    m_encoderCtx->color_range = m_decoderCtx->color_range;
+    m_encoderCtx->color_primaries = m_decoderCtx->color_primaries;
+    m_encoderCtx->color_trc = m_decoderCtx->color_trc;
+    m_encoderCtx->colorspace = m_decoderCtx->colorspace;
+    m_encoderCtx->chroma_sample_location = m_decoderCtx->chroma_sample_location;
+    m_encoderCtx->time_base = stream->time_base;
+    m_encoderCtx->framerate = av_guess_frame_rate(m_input, const_cast<AVStream*>(stream), nullptr);
+    // No reordering, so the re-encoded frames take DTS = PTS - source delay and join the copied
+    // GOPs with monotonic DTS. No global header: parameter sets travel in-band with the IDR, and
+    // the copy restores the source's own before its next keyframe.
+    m_encoderCtx->max_b_frames = 0;
+    m_encoderCtx->gop_size = 600;
+    if (stream->codecpar->bit_rate > 0) m_encoderCtx->bit_rate = stream->codecpar->bit_rate;
+    else av_opt_set(m_encoderCtx->priv_data, "crf", "18", 0);
+
+    const int ret = avcodec_open2(m_encoderCtx, m_encoder, nullptr);
+    if (ret < 0) {
+        std::cerr << "Could not open encoder for smart cut: " << errorString(ret)
+                  << "; copying from the keyframe instead" << std::endl;
+        avcodec_free_context(&m_encoderCtx);
+        m_smartCut = false;
+        return false;
+    }
+    return true;
+}
+
+bool ClipExport::decodePacket(const AVPacket* packet, int64_t from, int64_t to) {
+    if (avcodec_send_packet(m_decoderCtx, packet) < 0) return true; // Damaged packet: its frame is lost
+    while (avcodec_receive_frame(m_decoderCtx, m_frame) == 0) {
+        if (!encodeFrame(m_frame, from, to)) return false;
+    }
+    return true;
+}
+
+bool ClipExport::encodeFrame(AVFrame* frame, int64_t from, int64_t to) {
+    const int64_t pts = frame->best_effort_timestamp;
+    if (pts == AV_NOPTS_VALUE || pts < from || pts >= to) {
+        av_frame_unref(frame);
+        return true;
+    }
+    frame->pts = pts;
+    frame->pict_type = AV_PICTURE_TYPE_NONE;
+    const int ret = avcodec_send_frame(m_encoderCtx, frame);
+    av_frame_unref(frame);
+    if (ret < 0) return fail("Smart cut encode failed: " + errorString(ret));
+    return receiveEncoded();
+}
+
+bool ClipExport::receiveEncoded() {
+    while (avcodec_receive_packet(m_encoderCtx, m_encoded) == 0) {
+        m_encoded->dts = m_encoded->pts - m_reorderDelay;
+        m_encoded->stream_index = m_videoIndex;
+        if (m_lengthSize > 0 && !toLengthPrefixed(m_encoded, m_lengthSize)) return fail("Out of memory");
+        if (!writePacket(m_encoded)) return false;
+    }
+    return true;
+}
+
+bool ClipExport::endSegment(int64_t from, int64_t to) {
+    avcodec_send_packet(m_decoderCtx, nullptr);
+    while (avcodec_receive_frame(m_decoderCtx, m_frame) == 0) {
+        if (!encodeFrame(m_frame, from, to)) return false;
+    }
+    avcodec_flush_buffers(m_decoderCtx);
+
+    avcodec_send_frame(m_encoderCtx, nullptr);
+    const bool ok = receiveEncoded();
+    avcodec_free_context(&m_encoderCtx);
+    return ok;
+}
+
+bool ClipExport::writePacket(AVPacket* packet) {
+    const AVStream* in = m_input->streams[packet->stream_index];
+    const int outIndex = m_streamMap[packet->stream_index];
+    const AVStream* out = m_output->streams[outIndex];
+
+    const int64_t shift = av_rescale_q(m_clipStartUs, AV_TIME_BASE_Q, in->time_base);
+    if (packet->pts != AV_NOPTS_VALUE) packet->pts -= shift;
+    if (packet->dts != AV_NOPTS_VALUE) packet->dts -= shift;
+    av_packet_rescale_ts(packet, in->time_base, out->time_base);
+    packet->stream_index = outIndex;
+    packet->pos = -1;
+
+    // Takes the packet's reference
+    const int ret = av_interleaved_write_frame(m_output, packet);
+    if (ret < 0) return fail("Could not write clip: " + errorString(ret));
+    return true;
+}
+
+void ClipExport::reportProgress(int64_t dts) {
+    if (!m_progress || dts == AV_NOPTS_VALUE || m_outTs <= m_startTs) return;
+    const double progress = std::clamp((double)(dts - m_startTs) / (m_outTs - m_startTs), 0.0, 1.0);
+    if (progress - m_lastProgress < 0.01) return;
+    m_lastProgress = progress;
+    m_progress(progress);
+}
+
+bool ClipExport::flushGop() {
+    bool ok = true;
+    for (AVPacket* packet : m_gop) {
+        if (ok) ok = writePacket(packet);
+        av_packet_free(&packet);
+    }
+    m_gop.clear();
+    return ok;
+}
+
+bool ClipExport::handleVideo(AVPacket* packet) {
+    if (m_videoDone) return true;
+    const bool keyframe = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+
+    if (m_startTs == AV_NOPTS_VALUE) {
+        // Seeking lands on the keyframe at or before the in-point; anything earlier cannot be decoded
+        if (!keyframe) return true;
+        m_startTs = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+        if (packet->pts != AV_NOPTS_VALUE && packet->dts != AV_NOPTS_VALUE) {
+            m_reorderDelay = std::max<int64_t>(0, packet->pts - packet->dts);
+        }
+        m_head = m_smartCut && m_startTs < m_inTs && beginSegment();
+
+        const AVRational tb = m_input->streams[m_videoIndex]->time_base;
+        m_clipStartUs = av_rescale_q(m_head ? m_inTs : m_startTs, tb, AV_TIME_BASE_Q);
+        for (AVPacket* pending : m_pendingOther) {
+            if (!handleOther(pending)) return false;
+        }
+        for (AVPacket* pending : m_pendingOther) av_packet_free(&pending);
+        m_pendingOther.clear();
+    }
+
+    const int64_t dts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    if (dts != AV_NOPTS_VALUE && dts >= m_outTs) return finishVideo();
+    reportProgress(dts);
+
+    if (m_head && !m_leading) {
+        if (!keyframe || packet->pts <= m_inTs) return decodePacket(packet, m_inTs, m_outTs);
+        // Next keyframe: copying takes over from its picture. It is decoded too, as the reference
+        // of any leading pictures after it.
+        m_leading = true;
+        m_headEnd = std::min(packet->pts, m_outTs);
+        if (!decodePacket(packet, m_inTs, m_headEnd)) return false;
+        m_restoreParameterSets = !m_parameterSets.empty();
+    } else if (m_head) {
+        if (packet->pts != AV_NOPTS_VALUE && packet->pts < m_headEnd) return decodePacket(packet, m_inTs, m_headEnd);
+        // Past the leading pictures; the held keyframe is written after the head
+        if (!endSegment(m_inTs, m_headEnd)) return false;
+        m_head = false;
+        m_leading = false;
+    }
+
+    if (!m_smartCut) return writePacket(packet);
+    if (keyframe && !flushGop()) return false;
+    AVPacket* clone = av_packet_clone(packet);
+    if (!clone) return fail("Out of memory");
+    m_gop.push_back(clone);
+    if (keyframe && m_restoreParameterSets) {
+        m_restoreParameterSets = false;
+        if (!prependBytes(clone, m_parameterSets)) return fail("Out of memory");
+    }
+    return true;
+}
+
+bool ClipExport::finishVideo() {
+    m_videoDone = true;
+    m_streamDone[m_streamMap[m_videoIndex]] = true;
+    if (m_head) {
+        m_head = false;
+        if (!m_leading) return endSegment(m_inTs, m_outTs); // The whole clip sits inside one GOP
+        m_leading = false;
+        if (!endSegment(m_inTs, m_headEnd)) return false;
+    }
+    if (m_gop.empty()) return true;
+
+    const int64_t from = m_gop.front()->pts;
+    const bool pastOut = std::any_of(m_gop.begin(), m_gop.end(), [this](const AVPacket* packet) {
+        return packet->pts != AV_NOPTS_VALUE && packet->pts >= m_outTs;
+    });
+    // Leading pictures need the GOP before, which is already written: decoded from the keyframe
+    // alone they would be lost, so an open last GOP is copied like a plain stream copy
+    const bool openGop = std::any_of(m_gop.begin() + 1, m_gop.end(), [from](const AVPacket* packet) {
+        return packet->pts != AV_NOPTS_VALUE && packet->pts < from;
+    });
+    // The last GOP runs past the out-point: re-encode it up to there, or copy it whole when that
+    // cannot be done
+    if (!pastOut || openGop || !beginSegment()) return flushGop();
+    bool ok = true;
+    for (AVPacket* packet : m_gop) {
+        if (ok) ok = decodePacket(packet, from, m_outTs);
+        av_packet_free(&packet);
+    }
+    m_gop.clear();
+    return ok && endSegment(from, m_outTs);
+}
+
+bool ClipExport::handleOther(AVPacket* packet) {
+    const int outIndex = m_streamMap[packet->stream_index];
+    if (outIndex < 0 || m_streamDone[outIndex]) return true;
+    if (m_clipStartUs == AV_NOPTS_VALUE) {
+        AVPacket* clone = av_packet_clone(packet);
+        if (!clone) return fail("Out of memory");
+        m_pendingOther.push_back(clone);
+        return true;
+    }
+
+    const int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    if (ts == AV_NOPTS_VALUE) return true;
+    const int64_t tsUs = av_rescale_q(ts, m_input->streams[packet->stream_index]->time_base, AV_TIME_BASE_Q);
+    if (tsUs >= m_outUs) {
+        m_streamDone[outIndex] = true;
+        return true;
+    }
+    if (tsUs < m_clipStartUs) return true;
+    return writePacket(packet);
+}
+
+bool ClipExport::allDone() const {
+    if (!m_videoDone) return false;
+    // Subtitles are sparse and may never reach the out-point; they do not hold the export open
+    for (unsigned int i = 0; i < m_input->nb_streams; i++) {
+        const int outIndex = m_streamMap[i];
+        if (outIndex >= 0 && !m_streamDone[outIndex]
+            && m_input->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ClipExport::run() {
+    if (!openInput() || !openOutput()) return false;
+    checkSmartCut();
+
+    const AVStream* video = m_input->streams[m_videoIndex];
+    m_inTs = av_rescale_q(std::llround(m_request.inSeconds * AV_TIME_BASE), AV_TIME_BASE_Q, video->time_base);
+    m_outTs = av_rescale_q(std::llround(m_request.outSeconds * AV_TIME_BASE), AV_TIME_BASE_Q, video->time_base);
+    m_outUs = std::llround(m_request.outSeconds * AV_TIME_BASE);
+    if (m_outTs <= m_inTs) return fail("The out-point must come after the in-point");
+
+    if (av_seek_frame(m_input, m_videoIndex, m_inTs, AVSEEK_FLAG_BACKWARD) < 0) {
+        // Before the first keyframe, or a source without an index: read from the start
+        av_seek_frame(m_input, m_videoIndex, 0, AVSEEK_FLAG_BACKWARD);
+    }
+
+    AVPacket* packet = av_packet_alloc();
+    if (!packet) return fail("Out of memory");
+    bool ok = true;
+    while (ok) {
+        if (m_cancel.stop_requested()) {
+            ok = false;
+            break;
+        }
+        const int ret = av_read_frame(m_input, packet);
+        if (ret == AVERROR_EOF) break;
+        if (ret < 0) {
+            ok = fail("Could not read source: " + errorString(ret));
+            break;
+        }
+        ok = packet->stream_index == m_videoIndex ? handleVideo(packet) : handleOther(packet);
+        av_packet_unref(packet);
+
+        if (allDone()) break;
+    }
+    av_packet_free(&packet);
+
+    if (ok && !m_videoDone) ok = finishVideo();
+    if (ok && m_startTs == AV_NOPTS_VALUE) ok = fail("No keyframe found before the out-point");
+    if (ok) {
+        const int ret = av_write_trailer(m_output);
+        if (ret < 0) ok = fail("Could not finish clip: " + errorString(ret));
+    }
+    if (ok && m_progress) m_progress(1.0);
+    return ok;
+}
+
+} // namespace
+
+bool remuxClip(const ClipExportRequest& request, std::stop_token cancel, const ClipExportProgress& progress,
+               std::string& error) {
+    error.clear();
+    bool ok;
+    bool createdOutput;
+    {
+        ClipExport job(request, cancel, progress);
+        ok = job.run();
+        if (!ok && !cancel.stop_requested()) error = job.error();
+        createdOutput = job.createdOutput();
+    }
+    // A half-written clip is worse than none
+    if (!ok && createdOutput) {
+        std::error_code ec;
+        std::filesystem::remove(std::filesystem::path(std::u8string(request.destination.begin(), request.destination.end())), ec);
+    }
+    return ok;
+}
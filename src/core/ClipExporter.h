@@ -0,0 +1,25 @@
+#pragma once
+
+#include <functional>
+#include <stop_token>
+#include <string>
+
+struct ClipExportRequest {
+    std::string source;
+    std::string destination; // Container follows the extension (.mp4, .mkv)
+    double inSeconds = 0.0;  // Source timeline, as frame PTS
+    double outSeconds = 0.0;
+    // Re-encode the partial GOPs at both ends so the clip starts and ends exactly on the marks.
+    // H.264 / HEVC with an encoder available; anything else falls back to stream copy.
+    bool smartCut = false;
+};
+
+// 0..1, from the exporting thread
+using ClipExportProgress = std::function<void(double)>;
+
+// Writes [inSeconds, outSeconds) of the source to the destination without decoding: video is
+// copied from the keyframe at or before the in-point up to the out-point, audio and subtitles
+// that the container can hold are copied alongside. Blocking, meant for a worker thread; a stop
+// request on cancel aborts, deletes the partial file and returns false with an empty error.
+bool remuxClip(const ClipExportRequest& request, std::stop_token cancel, const ClipExportProgress& progress,
+               std::string& error);
@@ -0,0 +1,72 @@
+#include "DecodeGovernor.h"
+#include <algorithm>
+
+namespace {
+constexpr double OverloadLoad = 0.85;  // Work above this share of the frame interval is too close to call
+constexpr double HeadroomLoad = 0.5;
+constexpr auto OverloadHold = std::chrono::milliseconds(500);
+constexpr auto MaxRecoveryHold = std::chrono::milliseconds(30000);
+constexpr auto RelapseWindow = std::chrono::milliseconds(5000);
+} // namespace
+
+void DecodeGovernor::report(double work, double interval, double lateness, size_t queued) {
+    if (interval <= 0.0) return;
+
+    m_load += (work / interval - m_load) * 0.125;
+    const Clock::time_point now = Clock::now();
+
+    // Behind the clock with nothing buffered: the viewer already sees stalls or late frames
+    const bool starved = lateness > interval && queued == 0;
+    const bool overloaded = m_load > OverloadLoad || starved;
+    const bool headroom = m_load < HeadroomLoad && lateness <= 0.0 && queued > 0;
+
+    if (overloaded) {
+        m_headroom = false;
+        if (!m_overloaded) {
+            m_overloaded = true;
+            m_overloadedSince = now;
+        } else if (now - m_overloadedSince >= OverloadHold) {
+            step(1, now);
+        }
+    } else if (headroom) {
+        m_overloaded = false;
+        if (!m_headroom) {
+            m_headroom = true;
+            m_headroomSince = now;
+        } else if (now - m_headroomSince >= m_recoveryHold) {
+            step(-1, now);
+        }
+    } else {
+        m_overloaded = false;
+        m_headroom = false;
+    }
+}
+
+void DecodeGovernor::step(int direction, Clock::time_point now) {
+    const int current = static_cast<int>(m_level.load());
+    const int next = std::clamp(current + direction, 0, LevelCount - 1);
+    m_overloaded = false;
+    m_headroom = false;
+    if (next == current) return;
+
+    if (direction > 0) {
+        // Falling back soon after recovering: the last level was too ambitious, wait longer next time
+        if (m_lastStepUp != Clock::time_point() && now - m_lastStepUp < RelapseWindow) {
+            m_recoveryHold = std::min(m_recoveryHold * 2, MaxRecoveryHold);
+        }
+    } else {
+        m_lastStepUp = now;
+    }
+    // The old average was measured at the other level
+    m_load = (OverloadLoad + HeadroomLoad) / 2.0;
+    m_level = static_cast<Level>(next);
+}
+
+void DecodeGovernor::reset() {
+    m_level = Level::Full;
+    m_load = 0.0;
+    m_overloaded = false;
+    m_headroom = false;
+    m_lastStepUp = Clock::time_point();
+    m_recoveryHold = std::chrono::milliseconds(3000);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+// Trades picture quality for keeping up when the decode thread cannot sustain the frame rate.
+// The decode thread reports every frame it produces; sustained overload (decode work close to
+// the frame interval, or frames arriving after they were due with nothing queued) steps one
+// level down, and sustained headroom steps one level back up. Recovery waits longer each time
+// a step up is followed by overload again, so a box on the edge does not oscillate.
+class DecodeGovernor {
+public:
+    // Cumulative: every level keeps the savings of the ones above it
+    enum class Level {
+        Full,
+        FastScaler,        // SWS_FAST_BILINEAR for swscale conversions
+        SkipLoopFilter,    // No in-loop deblocking
+        SkipNonReference,  // Non-reference frames are not decoded at all
+        ReducedResolution  // Output at half the requested size
+    };
+    static constexpr int LevelCount = 5;
+
+    Level level() const { return m_level; }
+    // Smoothed decode work as a share of the frame interval; decode thread
+    double load() const { return m_load; }
+
+    // Decode thread. work: seconds spent decoding and converting the frame (waiting for a free
+    // output buffer excluded); interval: nominal frame duration; lateness: clock time minus the
+    // frame's PTS when it was queued; queued: frames waiting for presentation.
+    void report(double work, double interval, double lateness, size_t queued);
+
+    // Back to full quality, e.g. for a new source
+    void reset();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void step(int direction, Clock::time_point now);
+
+    std::atomic<Level> m_level{Level::Full};
+    double m_load = 0.0; // Smoothed work / interval
+    Clock::time_point m_overloadedSince;
+    Clock::time_point m_headroomSince;
+    Clock::time_point m_lastStepUp;
+    bool m_overloaded = false;
+    bool m_headroom = false;
+    std::chrono::milliseconds m_recoveryHold{3000};
+};
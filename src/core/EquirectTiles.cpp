@@ -0,0 +1,93 @@
+#include "EquirectTiles.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr int kSamples = 33; // samples per frustum axis, dense enough to hit every tile
+
+double radians(double degrees) { return degrees * kPi / 180.0; }
+
+struct Vec3 {
+    double x, y, z;
+};
+
+// Same rotation order as the panorama fragment shader: pitch around X, then yaw around Y
+Vec3 viewDirection(double ndcX, double ndcY, double tanHalfX, double tanHalfY, double cp, double sp, double cy, double sy) {
+    Vec3 ray{ndcX * tanHalfX, ndcY * tanHalfY, -1.0};
+    double len = std::sqrt(ray.x * ray.x + ray.y * ray.y + ray.z * ray.z);
+    ray = {ray.x / len, ray.y / len, ray.z / len};
+
+    Vec3 r1{ray.x, ray.y * cp - ray.z * sp, ray.y * sp + ray.z * cp};
+    return {r1.x * cy + r1.z * sy, r1.y, -r1.x * sy + r1.z * cy};
+}
+
+} // namespace
+
+EquirectTiles::Mask EquirectTiles::visibleTiles(const View& view, double marginDegrees) {
+    const double maxHalf = radians(89.0);
+    double halfY = std::min(radians(view.fov) / 2.0 + radians(marginDegrees), maxHalf);
+    double halfX = std::min(std::atan(view.aspect * std::tan(radians(view.fov) / 2.0)) + radians(marginDegrees), maxHalf);
+    double tanHalfX = std::tan(halfX);
+    double tanHalfY = std::tan(halfY);
+
+    double cp = std::cos(radians(view.pitch));
+    double sp = std::sin(radians(view.pitch));
+    double cy = std::cos(radians(view.yaw));
+    double sy = std::sin(radians(view.yaw));
+
+    Mask mask;
+    for (int j = 0; j < kSamples; ++j) {
+        double ndcY = -1.0 + 2.0 * j / (kSamples - 1);
+        for (int i = 0; i < kSamples; ++i) {
+            double ndcX = -1.0 + 2.0 * i / (kSamples - 1);
+            Vec3 dir = viewDirection(ndcX, ndcY, tanHalfX, tanHalfY, cp, sp, cy, sy);
+
+            double u = 0.5 + std::atan2(dir.z, dir.x) / (2.0 * kPi);
+            double t = 0.5 + std::asin(std::clamp(dir.y, -1.0, 1.0)) / kPi;
+            int column = ((int)std::floor(u * Columns) % Columns + Columns) % Columns;
+            int row = std::clamp((int)std::floor(t * Rows), 0, Rows - 1);
+            mask.set(index(column, row));
+        }
+    }
+
+    // A pole inside the frustum sees every longitude of its polar row
+    Vec3 centre = viewDirection(0.0, 0.0, tanHalfX, tanHalfY, cp, sp, cy, sy);
+    double cornerAngle = std::atan(std::sqrt(tanHalfX * tanHalfX + tanHalfY * tanHalfY));
+    bool seesUpPole = std::acos(std::clamp(centre.y, -1.0, 1.0)) < cornerAngle;
+    bool seesDownPole = std::acos(std::clamp(-centre.y, -1.0, 1.0)) < cornerAngle;
+
+    for (int row = 0; row < Rows; ++row) {
+        if ((row == 0 && seesDownPole) || (row == Rows - 1 && seesUpPole)) {
+            for (int column = 0; column < Columns; ++column) mask.set(index(column, row));
+            continue;
+        }
+
+        // Near the poles longitude changes fast between samples; the frustum's footprint on
+        // a latitude band is one arc, so cover everything outside the largest empty gap.
+        int gapStart = -1;
+        int gapLength = 0;
+        int marked = 0;
+        for (int column = 0; column < Columns; ++column) {
+            if (mask.test(index(column, row))) ++marked;
+        }
+        if (marked == 0 || marked == Columns) continue;
+
+        for (int start = 0; start < Columns; ++start) {
+            if (mask.test(index(start, row))) continue;
+            int length = 0;
+            while (length < Columns && !mask.test(index((start + length) % Columns, row))) ++length;
+            if (length > gapLength) {
+                gapLength = length;
+                gapStart = start;
+            }
+        }
+        for (int k = 0; k < Columns; ++k) {
+            int column = (gapStart + k) % Columns;
+            if (k >= gapLength) mask.set(index(column, row));
+        }
+    }
+
+    return mask;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <bitset>
+
+// Tile grid over an equirectangular frame, used to convert and upload only the part
+// of a 360 frame that the panorama view can currently see.
+// The direction -> (u, v) mapping mirrors PanoramaRenderer's shader exactly.
+class EquirectTiles {
+public:
+    static constexpr int Columns = 16; // 22.5 degrees of longitude each
+    static constexpr int Rows = 8;     // 22.5 degrees of latitude each
+    using Mask = std::bitset<Columns * Rows>;
+
+    struct View {
+        double yaw = 0.0;        // degrees
+        double pitch = 0.0;      // degrees
+        double fov = 90.0;       // vertical, degrees
+        double aspect = 16.0 / 9.0;
+    };
+
+    static int index(int column, int row) { return row * Columns + column; }
+
+    // Tiles touched by the view frustum widened by marginDegrees on every side
+    static Mask visibleTiles(const View& view, double marginDegrees);
+};
@@ -0,0 +1,11 @@
+#include "FFmpegInit.h"
+#include <mutex>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+void initFFmpeg() {
+    static std::once_flag once;
+    std::call_once(once, []() { avformat_network_init(); });
+}
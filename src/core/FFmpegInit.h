@@ -0,0 +1,6 @@
+#pragma once
+
+// Process-wide FFmpeg setup (network protocols and their TLS library), done once.
+// Cheap after the first call; the first may take tens of milliseconds, so main() warms it up
+// on a pool thread while the window comes up, and whoever opens a source first waits for it.
+void initFFmpeg();
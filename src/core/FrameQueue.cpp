@@ -0,0 +1,127 @@
+#include "FrameQueue.h"
+
+FrameQueue::FrameQueue(size_t poolSize, size_t reserved) : m_pool(std::make_shared<Pool>()) {
+    m_pool->capacity = poolSize;
+    m_pool->reserved = reserved < poolSize ? reserved : poolSize - 1;
+}
+
+FrameQueue::FramePtr FrameQueue::take(std::unique_lock<std::mutex>& lock, int width, int height, size_t bytes,
+                                      bool wait) {
+    Pool& pool = *m_pool;
+    auto available = [&pool] { return pool.free.size() + (pool.capacity - pool.allocated); };
+    if (wait) {
+        pool.available.wait(lock, [&] { return pool.aborted || available() > pool.reserved; });
+    }
+    if (pool.aborted || available() == 0) return nullptr;
+
+    std::unique_ptr<VideoFrame> frame;
+    if (!pool.free.empty()) {
+        frame = std::move(pool.free.back());
+        pool.free.pop_back();
+    } else {
+        frame = std::make_unique<VideoFrame>();
+        ++pool.allocated;
+    }
+    lock.unlock();
+
+    // The buffer keeps its capacity across uses, so steady-state playback does not allocate
+    frame->width = width;
+    frame->height = height;
+    frame->linesize = width * 4;
+    frame->pixels.resize(bytes ? bytes : (size_t)frame->linesize * height);
+    frame->regions.clear();
+    frame->refresh = false;
+    frame->pts = 0.0;
+    frame->format = VideoFrame::PixelFormat::Rgba8;
+    frame->bitDepth = 8;
+    frame->msbAligned = false;
+    frame->color = VideoFrame::Colorimetry();
+    {
+        std::lock_guard<std::mutex> queueLock(m_mutex);
+        frame->serial = m_serial;
+    }
+
+    // The deleter holds the pool alive, so frames may outlive the queue
+    std::shared_ptr<Pool> owner = m_pool;
+    return FramePtr(frame.release(), [owner](VideoFrame* released) {
+        released->source.reset(); // Hand the decoder its buffer back now rather than on reuse
+        std::lock_guard<std::mutex> poolLock(owner->mutex);
+        owner->free.emplace_back(released);
+        owner->available.notify_one();
+    });
+}
+
+FrameQueue::FramePtr FrameQueue::acquire(int width, int height, size_t bytes) {
+    std::unique_lock<std::mutex> lock(m_pool->mutex);
+    return take(lock, width, height, bytes, true);
+}
+
+FrameQueue::FramePtr FrameQueue::tryAcquire(int width, int height, size_t bytes) {
+    std::unique_lock<std::mutex> lock(m_pool->mutex);
+    return take(lock, width, height, bytes, false);
+}
+
+void FrameQueue::push(FramePtr frame) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (frame->serial != m_serial) {
+        lock.unlock();
+        return; // Decoded before a flush, drop (returns to the pool outside the lock)
+    }
+    m_frames.push_back(std::move(frame));
+}
+
+std::vector<FrameQueue::FramePtr> FrameQueue::takeDue(double time) {
+    std::vector<FramePtr> due;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_frames.begin(); it != m_frames.end();) {
+        if ((*it)->refresh || (*it)->pts <= time) {
+            due.push_back(std::move(*it));
+            it = m_frames.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return due;
+}
+
+FrameQueue::FramePtr FrameQueue::takeFirst() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_frames.empty()) return nullptr;
+    FramePtr frame = std::move(m_frames.front());
+    m_frames.pop_front();
+    return frame;
+}
+
+bool FrameQueue::empty() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_frames.empty();
+}
+
+size_t FrameQueue::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_frames.size();
+}
+
+void FrameQueue::flush() {
+    std::deque<FramePtr> dropped;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        dropped.swap(m_frames);
+        ++m_serial;
+    }
+    // dropped is released here, outside m_mutex; the pool deleters take the pool mutex
+}
+
+void FrameQueue::abort() {
+    {
+        std::lock_guard<std::mutex> lock(m_pool->mutex);
+        m_pool->aborted = true;
+    }
+    m_pool->available.notify_all();
+    flush();
+}
+
+void FrameQueue::reset() {
+    std::lock_guard<std::mutex> lock(m_pool->mutex);
+    m_pool->aborted = false;
+}
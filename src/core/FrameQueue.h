@@ -0,0 +1,106 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct AVFrame;
+
+struct VideoFrame {
+    struct Region {
+        int x = 0;
+        int y = 0;
+        int width = 0;
+        int height = 0;
+    };
+
+    // Rgba8 is converted on the CPU. The 16-bit layouts carry untouched high-bit-depth 4:2:0
+    // samples for the renderer to convert (and tone map) on the GPU.
+    enum class PixelFormat {
+        Rgba8,
+        Yuv420P16, // Three planes of 16-bit words
+        P016       // Y plane + interleaved UV plane of 16-bit words
+    };
+
+    struct Colorimetry {
+        enum class Matrix { Bt601, Bt709, Bt2020 };
+        enum class Transfer { Sdr, Pq, Hlg };
+
+        Matrix matrix = Matrix::Bt709;
+        Transfer transfer = Transfer::Sdr;
+        bool bt2020Primaries = false;
+        bool fullRange = false;
+        float peakLuminance = 1000.0f; // cd/m2, from content light level or mastering metadata
+    };
+
+    int width = 0;
+    int height = 0;
+    double pts = 0.0;
+    std::vector<uint8_t> pixels;   // RGBA rows, or the planes described below
+    int linesize = 0;
+    std::vector<Region> regions;   // Updated areas; empty means the whole frame
+
+    PixelFormat format = PixelFormat::Rgba8;
+    int planeOffset[3] = {0, 0, 0}; // Byte offsets into pixels (16-bit layouts)
+    int planeStride[3] = {0, 0, 0};
+    int bitDepth = 8;
+    bool msbAligned = false;        // Samples in the high bits of each word (P010 style)
+    Colorimetry color;
+
+    bool refresh = false;          // Tiles re-converted for a view change while paused, shown as soon as possible
+    uint64_t serial = 0;
+
+    // The decoded picture this frame was converted from, at source resolution and held by reference
+    // (no copy) for snapshots. Dropped when the frame goes back to the pool.
+    std::shared_ptr<const AVFrame> source;
+};
+
+// Decoded frames waiting for presentation, oldest first, each tagged with its PTS.
+// Frames come from a fixed pool and go back to it when the last reference is dropped,
+// so a consumer that falls behind throttles the decoder instead of growing memory.
+class FrameQueue {
+public:
+    using FramePtr = std::shared_ptr<VideoFrame>;
+
+    // The reserved frames are only handed out by tryAcquire(), so a consumer that holds
+    // the regular frames (e.g. while paused) can still get refresh frames
+    explicit FrameQueue(size_t poolSize = 4, size_t reserved = 0);
+
+    // Decoder side. acquire() blocks until a regular pooled frame is free and returns nullptr once aborted.
+    // The buffer holds width x height RGBA pixels unless a byte size is given.
+    FramePtr acquire(int width, int height, size_t bytes = 0);
+    FramePtr tryAcquire(int width, int height, size_t bytes = 0);
+    // Frames acquired before the last flush() are silently dropped
+    void push(FramePtr frame);
+
+    // Presentation side: every frame with pts <= time (plus refresh frames), oldest first
+    std::vector<FramePtr> takeDue(double time);
+    FramePtr takeFirst();
+    bool empty() const;
+    size_t size() const;
+
+    void flush();  // Drop queued frames, e.g. after a seek
+    void abort();  // Wake and fail every pending acquire()
+    void reset();  // Leave the aborted state for a new session
+
+private:
+    struct Pool {
+        std::mutex mutex;
+        std::condition_variable available;
+        std::vector<std::unique_ptr<VideoFrame>> free;
+        size_t allocated = 0;
+        size_t capacity = 0;
+        size_t reserved = 0;
+        bool aborted = false;
+    };
+
+    FramePtr take(std::unique_lock<std::mutex>& lock, int width, int height, size_t bytes, bool wait);
+
+    std::shared_ptr<Pool> m_pool;
+    mutable std::mutex m_mutex;
+    std::deque<FramePtr> m_frames;
+    uint64_t m_serial = 0;
+};
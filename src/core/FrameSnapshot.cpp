@@ -0,0 +1,171 @@
+#include "FrameSnapshot.h"
+#include <algorithm>
+#include <cmath>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/mastering_display_metadata.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+namespace {
+
+int swsColorspace(const AVFrame* src) {
+    switch (src->colorspace) {
+    case AVCOL_SPC_BT2020_NCL:
+    case AVCOL_SPC_BT2020_CL:
+        return SWS_CS_BT2020;
+    case AVCOL_SPC_BT709:
+        return SWS_CS_ITU709;
+    case AVCOL_SPC_BT470BG:
+    case AVCOL_SPC_SMPTE170M:
+        return SWS_CS_ITU601;
+    default:
+        return src->height > 576 ? SWS_CS_ITU709 : SWS_CS_ITU601;
+    }
+}
+
+enum class Transfer { Sdr, Pq, Hlg };
+
+// Content peak in cd/m2: MaxCLL, else the mastering display peak, else 1000
+double peakLuminance(const AVFrame* src) {
+    if (const AVFrameSideData* sd = av_frame_get_side_data(src, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL)) {
+        const AVContentLightMetadata* light = reinterpret_cast<const AVContentLightMetadata*>(sd->data);
+        if (light->MaxCLL > 0) return light->MaxCLL;
+    } else if (const AVFrameSideData* sd = av_frame_get_side_data(src, AV_FRAME_DATA_MASTERING_DISPLAY_METADATA)) {
+        const AVMasteringDisplayMetadata* mastering = reinterpret_cast<const AVMasteringDisplayMetadata*>(sd->data);
+        if (mastering->has_luminance && av_q2d(mastering->max_luminance) > 0.0) return av_q2d(mastering->max_luminance);
+    }
+    return 1000.0;
+}
+
+// The display mapping of VideoFrameTexture's sampling shader, on RGBA64 in place: PQ / HLG to
+// linear relative to 203 cd/m2 reference white, BT.2020 -> BT.709 primaries, extended Reinhard
+// on the largest channel, gamma 2.2. SDR BT.2020 only has its primaries converted (gamma 2.4).
+void mapToSdr(std::vector<uint8_t>& pixels, int width, int height, int bytesPerLine, Transfer transfer,
+              bool bt2020, double peak) {
+    static const double toBt709[3][3] = {{1.6605, -0.5876, -0.0728},
+                                         {-0.1246, 1.1329, -0.0083},
+                                         {-0.0182, -0.1006, 1.1187}};
+    // Signal -> linear per 16-bit code value; HLG stays scene light here, the OOTF needs all channels
+    std::vector<float> toLinear(65536);
+    for (int i = 0; i < 65536; ++i) {
+        const double e = i / 65535.0;
+        double l;
+        if (transfer == Transfer::Pq) {
+            const double p = std::pow(e, 1.0 / 78.84375);
+            l = std::pow(std::max(p - 0.8359375, 0.0) / (18.8515625 - 18.6875 * p), 1.0 / 0.1593017578125) * (10000.0 / 203.0);
+        } else if (transfer == Transfer::Hlg) {
+            l = e <= 0.5 ? e * e / 3.0 : (std::exp((e - 0.55991073) / 0.17883277) + 0.28466892) / 12.0;
+        } else {
+            l = std::pow(e, 2.4);
+        }
+        toLinear[i] = (float)l;
+    }
+    const double white = std::max(peak / 203.0, 1.0);
+    const double outGamma = transfer == Transfer::Sdr ? 1.0 / 2.4 : 1.0 / 2.2;
+
+    for (int y = 0; y < height; ++y) {
+        uint16_t* row = reinterpret_cast<uint16_t*>(pixels.data() + (size_t)y * bytesPerLine);
+        for (int x = 0; x < width; ++x) {
+            uint16_t* px = row + x * 4;
+            double c[3] = {toLinear[px[0]], toLinear[px[1]], toLinear[px[2]]};
+            if (transfer == Transfer::Hlg) {
+                const double luma = 0.2627 * c[0] + 0.6780 * c[1] + 0.0593 * c[2];
+                const double gain = std::pow(std::max(luma, 1e-6), 0.2) * (1000.0 / 203.0);
+                for (double& v : c) v *= gain;
+            }
+            if (bt2020) {
+                double m[3];
+                for (int i = 0; i < 3; ++i) m[i] = toBt709[i][0] * c[0] + toBt709[i][1] * c[1] + toBt709[i][2] * c[2];
+                for (int i = 0; i < 3; ++i) c[i] = std::max(m[i], 0.0);
+            }
+            if (transfer != Transfer::Sdr) {
+                const double peakChannel = std::max({c[0], c[1], c[2]});
+                if (peakChannel > 0.0) {
+                    const double scale = (1.0 + peakChannel / (white * white)) / (1.0 + peakChannel);
+                    for (double& v : c) v *= scale;
+                }
+            }
+            for (int i = 0; i < 3; ++i) {
+                px[i] = (uint16_t)std::lround(std::pow(std::clamp(c[i], 0.0, 1.0), outGamma) * 65535.0);
+            }
+        }
+    }
+}
+
+// RGBA64 -> RGBA8888 in place (rows shrink to half)
+void narrowTo8Bit(std::vector<uint8_t>& pixels, int width, int height, int srcBytesPerLine, int dstBytesPerLine) {
+    for (int y = 0; y < height; ++y) {
+        const uint16_t* src = reinterpret_cast<const uint16_t*>(pixels.data() + (size_t)y * srcBytesPerLine);
+        uint8_t* dst = pixels.data() + (size_t)y * dstBytesPerLine;
+        for (int i = 0; i < width * 4; ++i) dst[i] = (uint8_t)((src[i] * 255u + 32767u) / 65535u);
+    }
+    pixels.resize((size_t)dstBytesPerLine * height);
+}
+
+} // namespace
+
+bool convertSnapshot(const AVFrame* src, bool allowDeep, SnapshotImage& image, std::string& error) {
+    image = SnapshotImage();
+    if (!src || src->width <= 0 || src->height <= 0) {
+        error = "No decoded frame to capture";
+        return false;
+    }
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)src->format);
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM))) {
+        error = "Unsupported frame format for a snapshot";
+        return false;
+    }
+
+    int width = src->width;
+    if (src->sample_aspect_ratio.num > 0 && src->sample_aspect_ratio.den > 0
+        && src->sample_aspect_ratio.num != src->sample_aspect_ratio.den) {
+        width = (int)(src->width * av_q2d(src->sample_aspect_ratio) + 0.5);
+        width = (width + 1) & ~1;
+    }
+    const int height = src->height;
+
+    const Transfer transfer = src->color_trc == AVCOL_TRC_SMPTE2084 ? Transfer::Pq
+                            : src->color_trc == AVCOL_TRC_ARIB_STD_B67 ? Transfer::Hlg : Transfer::Sdr;
+    const bool bt2020 = src->color_primaries == AVCOL_PRI_BT2020;
+    // HDR and wide gamut are mapped to SDR BT.709 the way the views show them, at 16 bits
+    const bool mapped = transfer != Transfer::Sdr || bt2020;
+
+    image.deep = allowDeep && desc->comp[0].depth > 8;
+    const AVPixelFormat dstFormat = image.deep || mapped ? AV_PIX_FMT_RGBA64 : AV_PIX_FMT_RGBA;
+    // Full quality regardless of the playback quality level: a snapshot is converted once
+    SwsContext* sws = sws_getContext(src->width, src->height, (AVPixelFormat)src->format, width, height,
+                                     dstFormat, SWS_BICUBIC | SWS_ACCURATE_RND | SWS_FULL_CHR_H_INT,
+                                     nullptr, nullptr, nullptr);
+    if (!sws) {
+        error = "Could not create a scaler for the snapshot";
+        return false;
+    }
+    if (!(desc->flags & AV_PIX_FMT_FLAG_RGB)) {
+        const int* coefficients = sws_getCoefficients(swsColorspace(src));
+        const int srcRange = src->color_range == AVCOL_RANGE_JPEG ? 1 : 0;
+        sws_setColorspaceDetails(sws, coefficients, srcRange, sws_getCoefficients(SWS_CS_DEFAULT), 1,
+                                 0, 1 << 16, 1 << 16);
+    }
+
+    image.width = width;
+    image.height = height;
+    const int scaledBytesPerLine = width * (dstFormat == AV_PIX_FMT_RGBA64 ? 8 : 4);
+    image.pixels.resize((size_t)scaledBytesPerLine * height);
+    uint8_t* dstData[4] = {image.pixels.data(), nullptr, nullptr, nullptr};
+    int dstLinesize[4] = {scaledBytesPerLine, 0, 0, 0};
+    sws_scale(sws, (const uint8_t* const*)src->data, src->linesize, 0, src->height, dstData, dstLinesize);
+    sws_freeContext(sws);
+
+    image.bytesPerLine = scaledBytesPerLine;
+    if (mapped) {
+        mapToSdr(image.pixels, width, height, scaledBytesPerLine, transfer, bt2020, peakLuminance(src));
+        if (!image.deep) {
+            image.bytesPerLine = width * 4;
+            narrowTo8Bit(image.pixels, width, height, scaledBytesPerLine, image.bytesPerLine);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct AVFrame;
+
+// A decoded picture converted for saving as an image file
+struct SnapshotImage {
+    int width = 0;
+    int height = 0;
+    bool deep = false;  // 16 bits per channel (RGBA64, native byte order) instead of RGBA8888
+    int bytesPerLine = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Converts a decoded frame to packed RGBA at the source resolution; anamorphic sources are
+// stretched horizontally to their display aspect. The YUV matrix and range follow the frame's
+// tags (untagged SD is 601, anything larger 709). With allowDeep, sources above 8 bits keep
+// 16 bits per channel. PQ / HLG and BT.2020 frames are tone mapped to SDR BT.709 the same way the
+// views display them, so the file needs no colour metadata. Thread-safe: every call uses its own
+// scaler, so it can run on any worker.
+bool convertSnapshot(const AVFrame* src, bool allowDeep, SnapshotImage& image, std::string& error);
@@ -0,0 +1,168 @@
+#include "IoBenchmark.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avio.h>
+#include <libavutil/dict.h>
+}
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr int DemuxerReadSize = 32 * 1024; // Typical avio_read request of a demuxer
+constexpr int RandomReads = 256;
+constexpr int RandomReadSize = 256 * 1024;  // About what a seek reads before the first keyframe decodes
+
+#ifndef _WIN32
+void evictFromPageCache(const char* path) {
+#ifdef POSIX_FADV_DONTNEED
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+#else
+    (void)path;
+#endif
+}
+
+// Share of the file's pages in the page cache, -1 if it cannot be told
+double residentFraction(const char* path) {
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return -1.0;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        ::close(fd);
+        return -1.0;
+    }
+    void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) return -1.0;
+
+    const long page = sysconf(_SC_PAGESIZE);
+    const size_t pages = (size_t)((info.st_size + page - 1) / page);
+    std::vector<unsigned char> resident(pages);
+#ifdef __APPLE__
+    const int ret = mincore(data, (size_t)info.st_size, reinterpret_cast<char*>(resident.data()));
+#else
+    const int ret = mincore(data, (size_t)info.st_size, resident.data());
+#endif
+    munmap(data, (size_t)info.st_size);
+    if (ret != 0) return -1.0;
+    const size_t count = std::count_if(resident.begin(), resident.end(), [](unsigned char v) { return v & 1; });
+    return (double)count / pages;
+}
+#else
+void evictFromPageCache(const char*) {}
+double residentFraction(const char*) { return -1.0; }
+#endif
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// MiB/s reading [0, limit) in demuxer-sized requests
+double sequentialPass(AVIOContext* io, int64_t limit) {
+    std::vector<unsigned char> buffer(DemuxerReadSize);
+    avio_seek(io, 0, SEEK_SET);
+    int64_t total = 0;
+    const auto start = std::chrono::steady_clock::now();
+    while (total < limit) {
+        const int ret = avio_read(io, buffer.data(), (int)std::min<int64_t>(DemuxerReadSize, limit - total));
+        if (ret <= 0) break;
+        total += ret;
+    }
+    const double seconds = secondsSince(start);
+    return seconds > 0.0 ? total / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+// Milliseconds per seek-and-read at the given offsets
+double randomPass(AVIOContext* io, const std::vector<int64_t>& offsets) {
+    std::vector<unsigned char> buffer(RandomReadSize);
+    const auto start = std::chrono::steady_clock::now();
+    for (int64_t offset : offsets) {
+        if (avio_seek(io, offset, SEEK_SET) < 0) break;
+        avio_read(io, buffer.data(), RandomReadSize);
+    }
+    return secondsSince(start) * 1000.0 / offsets.size();
+}
+
+void printResidency(const char* path) {
+    const double resident = residentFraction(path);
+    if (resident >= 0.0) {
+        std::printf("  page cache holds %5.1f%% of the file\n", resident * 100.0);
+    } else {
+        std::printf("\n");
+    }
+}
+
+} // namespace
+
+int runIoBenchmark(const char* path, int64_t limitMegabytes) {
+    AVIOContext* fileIo = nullptr;
+    AVDictionary* options = nullptr;
+    av_dict_set(&options, "buffer_size", "1024000", 0);
+    const int ret = avio_open2(&fileIo, path, AVIO_FLAG_READ, nullptr, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        std::fprintf(stderr, "Could not open %s\n", path);
+        return 1;
+    }
+
+    // Mapped afresh for every pass: pages still mapped by this process cannot be evicted
+    const std::string name(path);
+    const std::filesystem::path mappedPath(std::u8string(name.begin(), name.end()));
+    MappedFile mapped;
+    std::string error;
+    if (!mapped.open(mappedPath, error)) {
+        std::fprintf(stderr, "Could not map %s: %s\n", path, error.c_str());
+        avio_closep(&fileIo);
+        return 1;
+    }
+    const int64_t size = mapped.size();
+    mapped.close();
+    const int64_t limit = std::min(size, limitMegabytes * 1024 * 1024);
+    std::mt19937_64 random(42);
+    std::vector<int64_t> offsets(RandomReads);
+    for (int64_t& offset : offsets) offset = (int64_t)(random() % (uint64_t)std::max<int64_t>(1, size - RandomReadSize));
+
+    std::printf("%s: %.1f GiB, sequential pass over %.1f GiB\n", path, size / (1024.0 * 1024.0 * 1024.0),
+                limit / (1024.0 * 1024.0 * 1024.0));
+#ifdef _WIN32
+    std::printf("(page cache cannot be dropped here: only the first pass reads cold)\n");
+#endif
+
+    evictFromPageCache(path);
+    std::printf("file protocol  sequential %8.1f MiB/s", sequentialPass(fileIo, limit));
+    printResidency(path);
+    evictFromPageCache(path);
+    mapped.open(mappedPath, error);
+    AVIOContext* mappedIo = mapped.createReader();
+    std::printf("mmap           sequential %8.1f MiB/s", sequentialPass(mappedIo, limit));
+    printResidency(path);
+    MappedFile::freeReader(mappedIo);
+    mapped.close();
+
+    evictFromPageCache(path);
+    std::printf("file protocol  %d seeks    %8.2f ms each\n", RandomReads, randomPass(fileIo, offsets));
+    evictFromPageCache(path);
+    mapped.open(mappedPath, error);
+    mappedIo = mapped.createReader();
+    mapped.setAccess(MappedFile::Access::Random);
+    std::printf("mmap           %d seeks    %8.2f ms each\n", RandomReads, randomPass(mappedIo, offsets));
+
+    MappedFile::freeReader(mappedIo);
+    avio_closep(&fileIo);
+    return 0;
+}
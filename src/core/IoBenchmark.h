@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+// `RenkoPlayer --io-benchmark <file> [MiB]`: reads the file through FFmpeg's file protocol (with the
+// buffer size the decoder used to set) and through MappedFile, sequentially up to MiB (default 2048)
+// and as scattered seek-and-read bursts, and prints throughput. The file is dropped from the page
+// cache before each pass where the OS allows it (POSIX); elsewhere only the first pass is cold.
+// On POSIX the share of the file left in the page cache after each sequential pass is printed too.
+int runIoBenchmark(const char* path, int64_t limitMegabytes = 2048);
@@ -0,0 +1,296 @@
+#include "MappedFile.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Only a staging buffer for the demuxer: every byte is copied once, straight out of the mapping
+constexpr int ReaderBufferSize = 256 * 1024;
+// Sequential window requested ahead of the read position, re-issued every half window
+constexpr int64_t ReadAheadBytes = 16LL * 1024 * 1024;
+// Files at least this large release pages once the read position is far enough past them
+constexpr int64_t DropBehindThreshold = 8LL * 1024 * 1024 * 1024;
+constexpr int64_t DropBehindBytes = 256LL * 1024 * 1024;
+constexpr int64_t DropBehindChunk = 64LL * 1024 * 1024;
+
+#ifndef _WIN32
+int64_t pageSize() {
+    static const int64_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+// madvise wants page aligned ranges
+void advise(const uint8_t* data, int64_t size, int64_t offset, int64_t length, int advice) {
+    const int64_t begin = offset - offset % pageSize();
+    const int64_t end = std::min(size, offset + length);
+    if (end <= begin) return;
+    madvise(const_cast<uint8_t*>(data) + begin, (size_t)(end - begin), advice);
+}
+#endif
+} // namespace
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::isLocalPath(const std::string& url) {
+    if (url.empty()) return false;
+    const size_t colon = url.find(':');
+    if (colon == std::string::npos) return true;
+    // "C:\video.mp4" is a path; "file:", "pipe:", "concat:" or "http://" are FFmpeg protocols
+    if (colon == 1 && std::isalpha((unsigned char)url[0])) return true;
+    return !std::all_of(url.begin(), url.begin() + colon, [](unsigned char c) { return std::isalnum(c) || c == '+'; });
+}
+
+bool MappedFile::open(const std::filesystem::path& path, std::string& error) {
+    close();
+    m_path = path;
+
+#ifdef _WIN32
+    // Shared for writing and deleting, so a recorder can keep appending and the file can be removed
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        error = "Could not open file for mapping";
+        return false;
+    }
+    m_file = file;
+    LARGE_INTEGER size;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size)) {
+        error = "Not a regular file";
+        close();
+        return false;
+    }
+    m_size = size.QuadPart;
+#else
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        error = "Could not open file for mapping: " + std::string(std::strerror(errno));
+        return false;
+    }
+    struct stat info;
+    if (fstat(m_fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        error = "Not a regular file";
+        close();
+        return false;
+    }
+    m_size = info.st_size;
+#endif
+
+    if (m_size <= 0) {
+        error = "Empty file";
+        close();
+        return false;
+    }
+    if (!map(error)) {
+        close();
+        return false;
+    }
+    setAccess(Access::Sequential);
+    return true;
+}
+
+void MappedFile::close() {
+    unmap();
+#ifdef _WIN32
+    if (m_file) CloseHandle(m_file);
+    m_file = nullptr;
+#else
+    if (m_fd >= 0) ::close(m_fd);
+    m_fd = -1;
+#endif
+    m_size = 0;
+    m_readPos = 0;
+    m_prefetchedTo = 0;
+    m_droppedTo = 0;
+}
+
+bool MappedFile::map(std::string& error) {
+    // The whole file in one view: 64-bit address space fits any recording, 32-bit does not
+    if ((uint64_t)m_size > (uint64_t)SIZE_MAX / 2) {
+        error = "File too large to map";
+        return false;
+    }
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        error = "Could not create file mapping";
+        return false;
+    }
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping);
+        error = "Could not map file";
+        return false;
+    }
+    m_mapping = mapping;
+    m_data = static_cast<const uint8_t*>(data);
+#else
+    void* data = mmap(nullptr, (size_t)m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED) {
+        error = "Could not map file: " + std::string(std::strerror(errno));
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(data);
+#endif
+    return true;
+}
+
+void MappedFile::unmap() {
+    if (!m_data) return;
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+    m_mapping = nullptr;
+#else
+    munmap(const_cast<uint8_t*>(m_data), (size_t)m_size);
+#endif
+    m_data = nullptr;
+}
+
+bool MappedFile::grow() {
+    // A recording still being written: map what has been appended since
+    int64_t size = 0;
+#ifdef _WIN32
+    LARGE_INTEGER current;
+    if (!GetFileSizeEx(m_file, &current)) return false;
+    size = current.QuadPart;
+#else
+    struct stat info;
+    if (fstat(m_fd, &info) != 0) return false;
+    size = info.st_size;
+#endif
+    if (size <= m_size) return false;
+
+    unmap();
+    m_size = size;
+    std::string error;
+    if (!map(error)) {
+        m_size = 0;
+        return false;
+    }
+    setAccess(m_access);
+    return true;
+}
+
+AVIOContext* MappedFile::createReader() {
+    if (!m_data) return nullptr;
+    auto* buffer = static_cast<unsigned char*>(av_malloc(ReaderBufferSize));
+    if (!buffer) return nullptr;
+    AVIOContext* reader = avio_alloc_context(buffer, ReaderBufferSize, 0, this, readPacket, nullptr, seekReader);
+    if (!reader) {
+        av_free(buffer);
+        return nullptr;
+    }
+    m_readPos = 0;
+    m_prefetchedTo = 0;
+    return reader;
+}
+
+void MappedFile::freeReader(AVIOContext*& reader) {
+    if (!reader) return;
+    av_freep(&reader->buffer); // May have been reallocated by the demuxer
+    avio_context_free(&reader);
+}
+
+void MappedFile::setAccess(Access access) {
+    m_access = access;
+    if (!m_data) return;
+#ifndef _WIN32
+    madvise(const_cast<uint8_t*>(m_data), (size_t)m_size, access == Access::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+#endif
+    // Readahead restarts from wherever playback resumes
+    if (access == Access::Sequential) m_prefetchedTo = m_readPos;
+}
+
+void MappedFile::prefetch(int64_t offset, int64_t length) {
+    if (!m_data || offset < 0 || offset >= m_size || length <= 0) return;
+    length = std::min(length, m_size - offset);
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = const_cast<uint8_t*>(m_data) + offset;
+    range.NumberOfBytes = (SIZE_T)length;
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    advise(m_data, m_size, offset, length, MADV_WILLNEED);
+#endif
+}
+
+void MappedFile::readAhead() {
+    if (m_readPos + ReadAheadBytes / 2 > m_prefetchedTo) {
+        const int64_t from = std::max(m_prefetchedTo, m_readPos);
+        const int64_t to = std::min(m_size, m_readPos + ReadAheadBytes);
+        if (to > from) prefetch(from, to - from);
+        m_prefetchedTo = to;
+    }
+
+#ifndef _WIN32
+    // Played pages of a huge file are unlikely to be needed again soon; let the cache keep other data
+    if (m_size >= DropBehindThreshold && m_readPos - DropBehindBytes >= m_droppedTo + DropBehindChunk) {
+        const int64_t begin = m_droppedTo - m_droppedTo % pageSize();
+        const int64_t end = m_readPos - DropBehindBytes;
+        // Unmapped from this process first, or the page cache could not evict them
+        advise(m_data, m_size, begin, end - begin, MADV_DONTNEED);
+#ifdef POSIX_FADV_DONTNEED
+        posix_fadvise(m_fd, begin, end - begin, POSIX_FADV_DONTNEED);
+#endif
+        m_droppedTo = end;
+    }
+#endif
+}
+
+int MappedFile::readPacket(void* opaque, uint8_t* buf, int size) {
+    auto* self = static_cast<MappedFile*>(opaque);
+    if (self->m_readPos >= self->m_size && !self->grow()) return AVERROR_EOF;
+    if (!self->m_data) return AVERROR(EIO);
+
+    const int count = (int)std::min<int64_t>(size, self->m_size - self->m_readPos);
+    std::memcpy(buf, self->m_data + self->m_readPos, (size_t)count);
+    self->m_readPos += count;
+    if (self->m_access == Access::Sequential) self->readAhead();
+    return count;
+}
+
+int64_t MappedFile::seekReader(void* opaque, int64_t offset, int whence) {
+    auto* self = static_cast<MappedFile*>(opaque);
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE) return self->m_size;
+
+    int64_t target;
+    switch (whence) {
+    case SEEK_SET: target = offset; break;
+    case SEEK_CUR: target = self->m_readPos + offset; break;
+    case SEEK_END: target = self->m_size + offset; break;
+    default: return AVERROR(EINVAL);
+    }
+    if (target < 0) return AVERROR(EINVAL);
+
+    // Small hops of an interleaved demuxer stay within the readahead window
+    if (target > self->m_prefetchedTo || target + ReadAheadBytes < self->m_prefetchedTo) {
+        self->m_prefetchedTo = target;
+    }
+    self->m_droppedTo = std::min(self->m_droppedTo, target);
+    self->m_readPos = target;
+    return target;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+// Local media file mapped into memory and handed to the demuxer through an AVIOContext, in place
+// of FFmpeg's file protocol. Reads are one memcpy out of the page cache into the demuxer's buffer,
+// with no read() call per buffer, and the kernel's readahead is steered with access hints:
+//  - Sequential during playback: the kernel reads ahead aggressively, and a window ahead of the
+//    read position is requested explicitly (WILLNEED) so spinning disks stream in large requests
+//  - Random while a seek probes the file, so index lookups do not drag in megabytes of readahead
+//  - prefetch() for regions the caller knows are next, e.g. the GOPs after a seek target
+// Very large recordings drop the pages well behind the read position from the page cache, so
+// playing a 50 GB file does not evict everything else.
+//
+// The mapping follows a file that is still being written: a read at the end remaps if the file
+// has grown (a file truncated while mapped faults on POSIX, as with any mmap reader). On Windows
+// the access hints are no-ops and prefetch uses PrefetchVirtualMemory.
+// One reader per file, used from one thread (the decode thread); not thread-safe.
+class MappedFile {
+public:
+    enum class Access { Sequential, Random };
+
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Plain paths only (no URL scheme); false for anything that cannot be mapped, such as pipes,
+    // devices, empty files or files larger than the address space, which then go through FFmpeg
+    bool open(const std::filesystem::path& path, std::string& error);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+    int64_t size() const { return m_size; }
+
+    // Reader for a demuxer opened with AVFMT_FLAG_CUSTOM_IO. Free with freeReader() after closing it.
+    AVIOContext* createReader();
+    static void freeReader(AVIOContext*& reader);
+
+    void setAccess(Access access);
+    // Starts reading [offset, offset + length) in the background; returns at once
+    void prefetch(int64_t offset, int64_t length);
+
+    // A local path as opposed to a URL (Windows drive letters are not schemes)
+    static bool isLocalPath(const std::string& url);
+
+private:
+    bool map(std::string& error);
+    void unmap();
+    bool grow();
+    void readAhead();
+
+    static int readPacket(void* opaque, uint8_t* buf, int size);
+    static int64_t seekReader(void* opaque, int64_t offset, int whence);
+
+    std::filesystem::path m_path;
+    const uint8_t* m_data = nullptr;
+    int64_t m_size = 0;
+    int64_t m_readPos = 0;
+    Access m_access = Access::Sequential;
+    int64_t m_prefetchedTo = 0; // End of the last sequential readahead request
+    int64_t m_droppedTo = 0;    // Pages before this were released from the page cache
+
+#ifdef _WIN32
+    void* m_file = nullptr;    // HANDLE
+    void* m_mapping = nullptr; // HANDLE
+#else
+    int m_fd = -1;
+#endif
+};
@@ -0,0 +1,148 @@
+#include "MediaProbe.h"
+#include <algorithm>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+namespace {
+
+// Packets read while looking for the poster frame before giving up
+constexpr int MaxPosterPackets = 512;
+
+int interruptProbe(void* opaque) {
+    return static_cast<const std::stop_token*>(opaque)->stop_requested() ? 1 : 0;
+}
+
+struct ProbeResources {
+    AVFormatContext* formatCtx = nullptr;
+    AVCodecContext* codecCtx = nullptr;
+    AVPacket* packet = nullptr;
+    AVFrame* frame = nullptr;
+    SwsContext* swsCtx = nullptr;
+
+    ~ProbeResources() {
+        if (swsCtx) sws_freeContext(swsCtx);
+        if (frame) av_frame_free(&frame);
+        if (packet) av_packet_free(&packet);
+        if (codecCtx) avcodec_free_context(&codecCtx);
+        if (formatCtx) avformat_close_input(&formatCtx);
+    }
+};
+
+// Sends packets of the video stream until the decoder hands out a frame
+bool decodeFirstFrame(ProbeResources& res, int streamIndex, const AVPacket* attachedPic) {
+    if (attachedPic) {
+        if (avcodec_send_packet(res.codecCtx, attachedPic) < 0) return false;
+        avcodec_send_packet(res.codecCtx, nullptr);
+        return avcodec_receive_frame(res.codecCtx, res.frame) == 0;
+    }
+
+    for (int i = 0; i < MaxPosterPackets; ++i) {
+        int ret = av_read_frame(res.formatCtx, res.packet);
+        if (ret < 0) {
+            // Drain what the decoder still holds
+            avcodec_send_packet(res.codecCtx, nullptr);
+            return avcodec_receive_frame(res.codecCtx, res.frame) == 0;
+        }
+        if (res.packet->stream_index == streamIndex) {
+            ret = avcodec_send_packet(res.codecCtx, res.packet);
+            av_packet_unref(res.packet);
+            if (ret < 0 && ret != AVERROR(EAGAIN)) return false;
+            if (avcodec_receive_frame(res.codecCtx, res.frame) == 0) return true;
+        } else {
+            av_packet_unref(res.packet);
+        }
+    }
+    return false;
+}
+
+bool extractPoster(ProbeResources& res, int streamIndex, int posterWidth, MediaInfo& info) {
+    const AVStream* stream = res.formatCtx->streams[streamIndex];
+    const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) return false;
+
+    res.codecCtx = avcodec_alloc_context3(codec);
+    if (!res.codecCtx || avcodec_parameters_to_context(res.codecCtx, stream->codecpar) < 0) return false;
+    // Probes run side by side on a pool; one frame does not need codec threads
+    res.codecCtx->thread_count = 1;
+    if (avcodec_open2(res.codecCtx, codec, nullptr) < 0) return false;
+
+    res.packet = av_packet_alloc();
+    res.frame = av_frame_alloc();
+    if (!res.packet || !res.frame) return false;
+
+    const bool coverArt = (stream->disposition & AV_DISPOSITION_ATTACHED_PIC) != 0;
+    if (!coverArt && info.duration > 10.0) {
+        // Opening frames are often black; any keyframe near 10% will do
+        const int64_t ts = (int64_t)(info.duration * 0.1 * AV_TIME_BASE);
+        avformat_seek_file(res.formatCtx, -1, INT64_MIN, ts, INT64_MAX, 0);
+    }
+    if (!decodeFirstFrame(res, streamIndex, coverArt ? &stream->attached_pic : nullptr)) return false;
+
+    const AVFrame* src = res.frame;
+    if (src->width <= 0 || src->height <= 0) return false;
+    double aspect = (double)src->width / src->height;
+    if (src->sample_aspect_ratio.num > 0 && src->sample_aspect_ratio.den > 0) {
+        aspect *= av_q2d(src->sample_aspect_ratio);
+    }
+    const int width = std::min(posterWidth, src->width);
+    const int height = std::max(2, (int)(width / aspect + 0.5));
+
+    res.swsCtx = sws_getContext(src->width, src->height, (AVPixelFormat)src->format, width, height,
+                                AV_PIX_FMT_RGBA, SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!res.swsCtx) return false;
+
+    info.poster.resize((size_t)width * height * 4);
+    uint8_t* dstData[4] = {info.poster.data(), nullptr, nullptr, nullptr};
+    int dstLinesize[4] = {width * 4, 0, 0, 0};
+    sws_scale(res.swsCtx, (const uint8_t* const*)src->data, src->linesize, 0, src->height, dstData, dstLinesize);
+    info.posterWidth = width;
+    info.posterHeight = height;
+    return true;
+}
+
+} // namespace
+
+bool probeMedia(const std::string& path, std::stop_token cancel, int posterWidth, MediaInfo& info) {
+    info = MediaInfo();
+    ProbeResources res;
+
+    res.formatCtx = avformat_alloc_context();
+    if (!res.formatCtx) return false;
+    res.formatCtx->interrupt_callback.callback = interruptProbe;
+    res.formatCtx->interrupt_callback.opaque = &cancel;
+
+    // avformat_open_input frees the context on failure
+    if (avformat_open_input(&res.formatCtx, path.c_str(), nullptr, nullptr) != 0) return false;
+    if (avformat_find_stream_info(res.formatCtx, nullptr) < 0 || cancel.stop_requested()) return false;
+
+    if (res.formatCtx->duration != AV_NOPTS_VALUE && res.formatCtx->duration > 0) {
+        info.duration = (double)res.formatCtx->duration / AV_TIME_BASE;
+    }
+
+    const int videoIndex = av_find_best_stream(res.formatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    const int audioIndex = av_find_best_stream(res.formatCtx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    if (videoIndex < 0 && audioIndex < 0) return false;
+
+    if (audioIndex >= 0) {
+        info.audioCodec = avcodec_get_name(res.formatCtx->streams[audioIndex]->codecpar->codec_id);
+    }
+    if (videoIndex >= 0) {
+        const AVCodecParameters* par = res.formatCtx->streams[videoIndex]->codecpar;
+        info.videoCodec = avcodec_get_name(par->codec_id);
+        info.width = par->width;
+        info.height = par->height;
+
+        // A file whose poster cannot be decoded is still worth listing with its metadata
+        if (posterWidth > 0 && !extractPoster(res, videoIndex, posterWidth, info)) {
+            info.poster.clear();
+            info.posterWidth = 0;
+            info.posterHeight = 0;
+        }
+    }
+    return !cancel.stop_requested();
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+// What a file browser shows about a media file without opening it for playback
+struct MediaInfo {
+    double duration = 0.0; // seconds, 0 if unknown
+    int width = 0;
+    int height = 0;
+    std::string videoCodec;
+    std::string audioCodec;
+
+    // Poster frame: cover art if the file has one, else a keyframe about 10% in. RGBA rows.
+    int posterWidth = 0;
+    int posterHeight = 0;
+    std::vector<uint8_t> poster;
+};
+
+// Opens its own demuxer and a single-threaded decoder, so any number of probes can run side by
+// side on worker threads. A stop request on cancel aborts blocking reads through the demuxer's
+// interrupt callback. Returns false for files without audio or video streams, and when cancelled.
+// posterWidth <= 0 skips the poster.
+bool probeMedia(const std::string& path, std::stop_token cancel, int posterWidth, MediaInfo& info);
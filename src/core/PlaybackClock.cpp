@@ -0,0 +1,58 @@
+#include "PlaybackClock.h"
+#include <cmath>
+
+double PlaybackClock::elapsedLocked() const {
+    if (m_paused) return 0.0;
+    return std::chrono::duration<double>(Clock::now() - m_baseTime).count();
+}
+
+bool PlaybackClock::isStarted() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_started;
+}
+
+double PlaybackClock::time() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_basePts + elapsedLocked();
+}
+
+void PlaybackClock::start(double pts) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_started = true;
+    m_basePts = pts;
+    m_baseTime = Clock::now();
+}
+
+void PlaybackClock::invalidate() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_started = false;
+}
+
+void PlaybackClock::setPaused(bool paused) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_paused == paused) return;
+    // Fold the running time into the base so pausing freezes the clock where it is
+    m_basePts += elapsedLocked();
+    m_baseTime = Clock::now();
+    m_paused = paused;
+}
+
+bool PlaybackClock::isPaused() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_paused;
+}
+
+void PlaybackClock::sync(double reference) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_started || m_paused) return;
+
+    double now = m_basePts + elapsedLocked();
+    double drift = reference - now;
+    if (std::abs(drift) > 0.2) {
+        // Far off (e.g. audio restarted after a seek): jump
+        m_basePts = reference;
+        m_baseTime = Clock::now();
+    } else {
+        m_basePts += drift * 0.1;
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+
+// Master presentation clock in media seconds.
+// Runs on the steady clock once started and can be slaved to the audio output position.
+class PlaybackClock {
+public:
+    // Not started until the first frame after open/seek sets it
+    bool isStarted() const;
+    double time() const;
+
+    void start(double pts);
+    void invalidate();
+    void setPaused(bool paused);
+    bool isPaused() const;
+
+    // Pull the clock towards an external reference (the audio position).
+    // Small drift is corrected gradually so jitter in the reference does not jerk video.
+    void sync(double reference);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    double elapsedLocked() const;
+
+    mutable std::mutex m_mutex;
+    bool m_started = false;
+    bool m_paused = false;
+    double m_basePts = 0.0;
+    Clock::time_point m_baseTime;
+};
@@ -0,0 +1,75 @@
+#include "SubtitleQueue.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr double RetainSeconds = 30.0; // Finished events kept behind the newest one
+constexpr size_t MaxEvents = 256;
+} // namespace
+
+void SubtitleQueue::push(SubtitleEvent event) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Kept across a seek, or pre-rolled, and then read again from the landing keyframe
+    for (const EventPtr& queued : m_events) {
+        const bool samePlacement = std::equal(queued->bitmaps.begin(), queued->bitmaps.end(),
+                                              event.bitmaps.begin(), event.bitmaps.end(),
+                                              [](const SubtitleBitmap& a, const SubtitleBitmap& b) {
+                                                  return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+                                              });
+        if (queued->start == event.start && queued->text == event.text && samePlacement) {
+            return;
+        }
+    }
+
+    for (EventPtr& previous : m_events) {
+        if (std::isinf(previous->end) && previous->start <= event.start) {
+            // Consumers may still hold the old event, so it is replaced rather than modified
+            auto closed = std::make_shared<SubtitleEvent>(*previous);
+            closed->end = event.start;
+            previous = std::move(closed);
+        }
+    }
+
+    if (event.text.empty() && event.bitmaps.empty()) return;
+
+    // active() only prunes while a view is drawing subtitles; without one (360 view, flat view not
+    // loaded yet) finished events would pile up. Decoding runs ahead of the clock, so keep a margin.
+    const double expired = event.start - RetainSeconds;
+    m_events.erase(std::remove_if(m_events.begin(), m_events.end(),
+                                  [expired](const EventPtr& queued) { return queued->end <= expired; }),
+                   m_events.end());
+    if (m_events.size() >= MaxEvents) m_events.erase(m_events.begin());
+
+    event.id = m_nextId++;
+    m_events.push_back(std::make_shared<const SubtitleEvent>(std::move(event)));
+}
+
+std::vector<SubtitleQueue::EventPtr> SubtitleQueue::active(double time) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_events.erase(std::remove_if(m_events.begin(), m_events.end(),
+                                  [time](const EventPtr& event) { return event->end <= time; }),
+                   m_events.end());
+
+    std::vector<EventPtr> visible;
+    for (const EventPtr& event : m_events) {
+        if (event->start <= time) visible.push_back(event);
+    }
+    return visible;
+}
+
+void SubtitleQueue::flush() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.clear();
+}
+
+void SubtitleQueue::seek(double time) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Open-ended events are left out: whatever closes them may lie anywhere before the target
+    m_events.erase(std::remove_if(m_events.begin(), m_events.end(),
+                                  [time](const EventPtr& event) {
+                                      return event->start > time || event->end <= time || std::isinf(event->end);
+                                  }),
+                   m_events.end());
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct SubtitleBitmap {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> pixels; // Premultiplied 0xAARRGGBB, tightly packed rows
+};
+
+// One decoded subtitle: plain text (lines separated by '\n') or bitmaps placed on a
+// canvasWidth x canvasHeight canvas (PGS, DVB, VobSub)
+struct SubtitleEvent {
+    uint64_t id = 0;
+    double start = 0.0;
+    double end = std::numeric_limits<double>::infinity(); // Open until the next event replaces it
+    std::string text;
+    std::vector<SubtitleBitmap> bitmaps;
+    int canvasWidth = 0;
+    int canvasHeight = 0;
+};
+
+// Decoded subtitle events of the selected stream, in decode order.
+// Filled from the decode thread ahead of presentation; the view asks for what is
+// visible at the playback clock.
+class SubtitleQueue {
+public:
+    using EventPtr = std::shared_ptr<const SubtitleEvent>;
+
+    // Open-ended events are closed at the start of the next one.
+    // An event with neither text nor bitmaps only clears the screen (e.g. PGS end segments).
+    void push(SubtitleEvent event);
+
+    // Events visible at time, oldest first; events that ended before it are dropped
+    std::vector<EventPtr> active(double time);
+
+    void flush();            // After a stream change
+    void seek(double time);  // After a seek: keeps only the events still showing at time
+
+private:
+    std::mutex m_mutex;
+    std::vector<EventPtr> m_events;
+    uint64_t m_nextId = 1;
+};
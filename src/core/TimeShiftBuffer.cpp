@@ -0,0 +1,399 @@
+#include "TimeShiftBuffer.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <utility>
+
+extern "C" {
+#include <libavutil/opt.h>
+#include <libavutil/time.h>
+}
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr double SegmentSeconds = 2.0;   // Segments are cut on the first keyframe after this long
+constexpr int ReaderBufferSize = 64 * 1024;
+
+// FFmpeg's file protocol takes UTF-8 paths on every platform
+std::string toUtf8(const fs::path& path) {
+    const std::u8string utf8 = path.u8string();
+    return std::string(utf8.begin(), utf8.end());
+}
+
+std::string errorString(int err) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    av_strerror(err, errbuf, sizeof(errbuf));
+    return errbuf;
+}
+} // namespace
+
+TimeShiftBuffer::~TimeShiftBuffer() {
+    stop();
+}
+
+int TimeShiftBuffer::interruptCapture(void* opaque) {
+    auto* self = static_cast<TimeShiftBuffer*>(opaque);
+    return self->m_openCancel.stop_requested() || self->m_captureStop.stop_requested() ? 1 : 0;
+}
+
+bool TimeShiftBuffer::start(const std::string& url, const fs::path& parentDirectory, const Retention& retention,
+                            std::stop_token cancel, std::string& error) {
+    error.clear();
+    m_retention = retention;
+    m_openCancel = cancel;
+    m_captureStop = std::stop_source();
+    auto fail = [this, &cancel, &error](const std::string& message) {
+        if (!cancel.stop_requested()) error = message;
+        stop();
+        return false;
+    };
+
+    std::error_code ec;
+    m_directory = parentDirectory / ("timeshift-" + std::to_string(av_gettime()));
+    fs::create_directories(m_directory, ec);
+    if (ec) return fail("Could not create time-shift directory: " + toUtf8(m_directory));
+
+    m_input = avformat_alloc_context();
+    m_input->interrupt_callback.callback = interruptCapture;
+    m_input->interrupt_callback.opaque = this;
+
+    AVDictionary* options = nullptr;
+    av_dict_set(&options, "rw_timeout", "30000000", 0);
+    av_dict_set(&options, "stimeout", "30000000", 0);
+    av_dict_set(&options, "buffer_size", "1024000", 0);
+    int ret = avformat_open_input(&m_input, url.c_str(), nullptr, &options);
+    av_dict_free(&options);
+    if (ret != 0) return fail("Could not open source: " + url + " Error: " + errorString(ret));
+    if (avformat_find_stream_info(m_input, nullptr) < 0) return fail("Could not find stream info");
+
+    ret = avformat_alloc_output_context2(&m_output, nullptr, "mpegts", nullptr);
+    if (ret < 0) return fail("Could not create time-shift muxer: " + errorString(ret));
+
+    // Video and audio are kept; subtitle and data streams rarely survive a remux to TS
+    m_streamMap.assign(m_input->nb_streams, -1);
+    for (unsigned int i = 0; i < m_input->nb_streams; i++) {
+        const AVStream* in = m_input->streams[i];
+        const AVMediaType type = in->codecpar->codec_type;
+        if (type == AVMEDIA_TYPE_VIDEO) {
+            if (m_videoStream >= 0) continue;
+            m_videoStream = i;
+        } else if (type != AVMEDIA_TYPE_AUDIO) {
+            continue;
+        }
+        AVStream* out = avformat_new_stream(m_output, nullptr);
+        if (!out || avcodec_parameters_copy(out->codecpar, in->codecpar) < 0) return fail("Could not set up time-shift stream");
+        out->codecpar->codec_tag = 0;
+        out->time_base = {1, 90000};
+        out->disposition = in->disposition;
+        av_dict_copy(&out->metadata, in->metadata, 0); // Language and title for the track lists
+        m_streamMap[i] = out->index;
+    }
+    if (m_videoStream < 0) return fail("No video stream found");
+
+    if (!openSegment(0, 0.0)) return fail("Could not write time-shift segment in " + toUtf8(m_directory));
+    ret = avformat_write_header(m_output, nullptr);
+    if (ret < 0) return fail("Could not start time-shift muxer: " + errorString(ret));
+
+    m_openCancel = std::stop_token();
+    m_captureThread = std::jthread([this, stop = m_captureStop.get_token()] { captureLoop(stop); });
+
+    // Playback opens the buffer next; give its demuxer a keyframe to start from
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_keyframes.empty() || m_written <= m_keyframes.front().offset) {
+        if (m_captureDone || cancel.stop_requested()) {
+            const std::string captureError = m_captureError;
+            lock.unlock();
+            return fail(captureError.empty() ? "Live source ended before the first keyframe" : captureError);
+        }
+        m_dataCondition.wait_for(lock, std::chrono::milliseconds(100));
+    }
+    return true;
+}
+
+bool TimeShiftBuffer::openSegment(int64_t begin, double start) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "segment-%06d.ts", m_segmentIndex++);
+    Segment segment;
+    segment.path = m_directory / name;
+    segment.begin = begin;
+    segment.start = start;
+    segment.end = start;
+    if (avio_open(&m_output->pb, toUtf8(segment.path).c_str(), AVIO_FLAG_WRITE) < 0) return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_segments.push_back(std::move(segment));
+    return true;
+}
+
+void TimeShiftBuffer::captureLoop(std::stop_token stop) {
+    AVPacket* packet = av_packet_alloc();
+    bool started = false;
+
+    while (packet && !stop.stop_requested()) {
+        int ret = av_read_frame(m_input, packet);
+        if (ret == AVERROR(EAGAIN)) continue;
+        if (ret < 0) {
+            if (!stop.stop_requested()) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_captureError = ret == AVERROR_EOF ? "Live source ended" : "Live source lost: " + errorString(ret);
+            }
+            break;
+        }
+
+        const int inIndex = packet->stream_index;
+        const int outIndex = inIndex < (int)m_streamMap.size() ? m_streamMap[inIndex] : -1;
+        const bool keyframe = inIndex == m_videoStream && (packet->flags & AV_PKT_FLAG_KEY);
+        // Nothing before the first keyframe could be decoded from the buffer anyway
+        if (outIndex < 0 || (!started && !keyframe)) {
+            av_packet_unref(packet);
+            continue;
+        }
+        started = true;
+
+        const AVRational inTb = m_input->streams[inIndex]->time_base;
+        if (m_tsOffset == AV_NOPTS_VALUE) {
+            const int64_t first = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+            m_tsOffset = AV_TIME_BASE - (first != AV_NOPTS_VALUE ? av_rescale_q(first, inTb, AV_TIME_BASE_Q) : 0);
+        }
+        auto rebase = [&](int64_t ts) {
+            return ts == AV_NOPTS_VALUE ? ts : av_rescale_q(ts, inTb, AV_TIME_BASE_Q) + m_tsOffset;
+        };
+        const int64_t pts = rebase(packet->pts);
+        const int64_t dts = rebase(packet->dts);
+        const int64_t ts = pts != AV_NOPTS_VALUE ? pts : dts;
+        Segment& current = m_segments.back();
+        const double seconds = ts != AV_NOPTS_VALUE ? (double)ts / AV_TIME_BASE : current.end;
+        if (current.size == 0 && m_segments.size() == 1) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            current.start = current.end = seconds; // The window starts at the first keyframe
+        }
+
+        if (keyframe && current.size > 0 && seconds - current.start >= SegmentSeconds) {
+            // Pending audio goes to the old segment; the new one opens with PAT/PMT and this keyframe
+            av_write_frame(m_output, nullptr);
+            avio_flush(m_output->pb);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                current.size = avio_tell(m_output->pb);
+                m_written = current.begin + current.size;
+            }
+            avio_closep(&m_output->pb);
+            if (!openSegment(m_written, seconds)) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_captureError = "Could not write time-shift segment in " + toUtf8(m_directory);
+                break;
+            }
+            av_opt_set(m_output->priv_data, "mpegts_flags", "+resend_headers", 0);
+            prune();
+        }
+
+        Segment& segment = m_segments.back();
+        if (keyframe) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_keyframes.push_back({seconds, segment.begin + avio_tell(m_output->pb)});
+        }
+
+        const AVRational outTb = m_output->streams[outIndex]->time_base;
+        packet->pts = pts == AV_NOPTS_VALUE ? pts : av_rescale_q(pts, AV_TIME_BASE_Q, outTb);
+        packet->dts = dts == AV_NOPTS_VALUE ? dts : av_rescale_q(dts, AV_TIME_BASE_Q, outTb);
+        packet->duration = av_rescale_q(packet->duration, inTb, outTb);
+        packet->stream_index = outIndex;
+        packet->pos = -1;
+        // A glitch in the live timestamps (e.g. non-monotonic DTS) only costs that packet
+        av_write_frame(m_output, packet);
+        av_packet_unref(packet);
+        avio_flush(m_output->pb);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            segment.size = avio_tell(m_output->pb);
+            segment.end = std::max(segment.end, seconds);
+            m_written = segment.begin + segment.size;
+        }
+        m_dataCondition.notify_all();
+    }
+
+    if (m_output->pb) {
+        av_write_trailer(m_output);
+        avio_flush(m_output->pb);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Segment& segment = m_segments.back();
+        segment.size = avio_tell(m_output->pb);
+        m_written = segment.begin + segment.size;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_captureDone = true;
+    }
+    m_dataCondition.notify_all();
+    av_packet_free(&packet);
+}
+
+void TimeShiftBuffer::prune() {
+    std::vector<fs::path> remove;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // The segment being written and the one before it always stay
+        while (m_segments.size() > 2) {
+            const double span = m_segments.back().end - m_segments.front().start;
+            const int64_t bytes = m_written - m_segments.front().begin;
+            if (span <= m_retention.maxSeconds && bytes <= m_retention.maxBytes) break;
+
+            const int64_t next = m_segments[1].begin;
+            while (!m_keyframes.empty() && m_keyframes.front().offset < next) m_keyframes.pop_front();
+            remove.push_back(m_segments.front().path);
+            m_segments.pop_front();
+        }
+        remove.insert(remove.end(), m_staleFiles.begin(), m_staleFiles.end());
+        m_staleFiles.clear();
+    }
+    if (remove.empty()) return;
+
+    std::vector<fs::path> stale;
+    for (const fs::path& path : remove) {
+        std::error_code ec;
+        fs::remove(path, ec);
+        if (ec) stale.push_back(path);
+    }
+    if (!stale.empty()) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_staleFiles.insert(m_staleFiles.end(), stale.begin(), stale.end());
+    }
+}
+
+void TimeShiftBuffer::stop() {
+    m_captureStop.request_stop();
+    if (m_captureThread.joinable()) m_captureThread.join();
+    cleanup();
+}
+
+void TimeShiftBuffer::cleanup() {
+    if (m_input) avformat_close_input(&m_input);
+    if (m_output) {
+        if (m_output->pb) avio_closep(&m_output->pb);
+        avformat_free_context(m_output);
+        m_output = nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_captureDone = true;
+        m_segments.clear();
+        m_keyframes.clear();
+        m_staleFiles.clear();
+    }
+    m_dataCondition.notify_all();
+    if (!m_directory.empty()) {
+        std::error_code ec;
+        fs::remove_all(m_directory, ec);
+        m_directory.clear();
+    }
+}
+
+AVIOContext* TimeShiftBuffer::createReader(std::function<bool()> abort) {
+    auto* buffer = static_cast<unsigned char*>(av_malloc(ReaderBufferSize));
+    if (!buffer) return nullptr;
+    AVIOContext* reader = avio_alloc_context(buffer, ReaderBufferSize, 0, this, readPacket, nullptr, seekReader);
+    if (!reader) {
+        av_free(buffer);
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_readerAbort = std::move(abort);
+    m_readPos = m_keyframes.empty() ? 0 : m_keyframes.front().offset;
+    m_discontinuity = false;
+    return reader;
+}
+
+void TimeShiftBuffer::freeReader(AVIOContext*& reader) {
+    if (!reader) return;
+    av_freep(&reader->buffer); // May have been reallocated by the demuxer
+    avio_context_free(&reader);
+}
+
+int TimeShiftBuffer::readPacket(void* opaque, uint8_t* buf, int size) {
+    auto* self = static_cast<TimeShiftBuffer*>(opaque);
+    std::unique_lock<std::mutex> lock(self->m_mutex);
+    for (;;) {
+        if (!self->m_segments.empty() && self->m_readPos < self->m_segments.front().begin) {
+            // Paused past the retention window: carry on from the oldest keyframe left
+            self->m_readPos = self->m_segments.front().begin;
+            self->m_discontinuity = true;
+        }
+        if (self->m_readPos >= self->m_written || self->m_segments.empty()) {
+            if (self->m_captureDone) return AVERROR_EOF;
+            if (self->m_readerAbort && self->m_readerAbort()) return AVERROR_EXIT;
+            self->m_dataCondition.wait_for(lock, std::chrono::milliseconds(100));
+            continue;
+        }
+
+        auto it = std::upper_bound(self->m_segments.begin(), self->m_segments.end(), self->m_readPos,
+                                   [](int64_t pos, const Segment& segment) { return pos < segment.begin; });
+        --it;
+        const int64_t offset = self->m_readPos - it->begin;
+        const int count = (int)std::min<int64_t>(size, it->size - offset);
+        const fs::path path = it->path;
+        if (count <= 0) {
+            self->m_readPos = it->begin + it->size; // Past an emptied segment
+            continue;
+        }
+
+        lock.unlock();
+        std::ifstream file(path, std::ios::binary);
+        file.seekg(offset);
+        file.read(reinterpret_cast<char*>(buf), count);
+        const int64_t got = file.gcount();
+        lock.lock();
+
+        // Zero: pruned while unlocked, the loop snaps to the window
+        if (got > 0) {
+            self->m_readPos += got;
+            return (int)got;
+        }
+    }
+}
+
+int64_t TimeShiftBuffer::seekReader(void* opaque, int64_t offset, int whence) {
+    auto* self = static_cast<TimeShiftBuffer*>(opaque);
+    std::lock_guard<std::mutex> lock(self->m_mutex);
+    if (whence & AVSEEK_SIZE) return AVERROR(ENOSYS); // Still growing
+    int64_t position;
+    switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET: position = offset; break;
+    case SEEK_CUR: position = self->m_readPos + offset; break;
+    case SEEK_END: position = self->m_written + offset; break;
+    default: return AVERROR(EINVAL);
+    }
+    if (position < 0) return AVERROR(EINVAL);
+    self->m_readPos = position;
+    return position;
+}
+
+int64_t TimeShiftBuffer::keyframeOffset(double seconds) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_keyframes.empty()) return m_segments.empty() ? 0 : m_segments.front().begin;
+    auto it = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), seconds,
+                               [](double s, const Keyframe& keyframe) { return s < keyframe.seconds; });
+    if (it == m_keyframes.begin()) return it->offset;
+    return std::prev(it)->offset;
+}
+
+TimeShiftBuffer::Window TimeShiftBuffer::window() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Window window;
+    if (m_segments.empty()) return window;
+    window.start = m_keyframes.empty() ? m_segments.front().start : m_keyframes.front().seconds;
+    window.end = m_segments.back().end;
+    window.lastKeyframe = m_keyframes.empty() ? window.start : m_keyframes.back().seconds;
+    return window;
+}
+
+bool TimeShiftBuffer::takeDiscontinuity() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::exchange(m_discontinuity, false);
+}
+
+std::string TimeShiftBuffer::captureError() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_captureError;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+// Disk ring buffer that lets a live source be paused and rewound. A capture thread keeps reading
+// the live input and remuxes its packets, without decoding, into MPEG-TS segment files; segments
+// start on video keyframes and the oldest ones are deleted once the window exceeds the retention
+// limits. Playback demuxes the segments back through an AVIOContext as one continuous byte stream
+// (reads at the live edge block until more arrives) and seeks through an in-memory keyframe index.
+//
+// Timestamps are rebased so the first packet sits at 1 s; positions, the window and the keyframe
+// index all use that timeline, which is also what the demuxer reading the buffer reports.
+class TimeShiftBuffer {
+public:
+    struct Retention {
+        double maxSeconds = 30.0 * 60.0;
+        int64_t maxBytes = 4LL * 1024 * 1024 * 1024;
+    };
+
+    struct Window {
+        double start = 0.0;        // Oldest keyframe still on disk
+        double end = 0.0;          // Newest packet written
+        double lastKeyframe = 0.0; // Where "jump to live" lands
+    };
+
+    TimeShiftBuffer() = default;
+    ~TimeShiftBuffer();
+
+    // Opens the live input and starts capturing into a fresh directory under parentDirectory.
+    // Blocks until the first keyframe is on disk, so the buffer can be demuxed right away; meant
+    // for the thread that opens the source. A stop request on cancel aborts and returns false
+    // with an empty error.
+    bool start(const std::string& url, const std::filesystem::path& parentDirectory, const Retention& retention,
+               std::stop_token cancel, std::string& error);
+    // Ends the capture and deletes the segments. Readers get EOF.
+    void stop();
+
+    // Reader over the buffered bytes for a demuxer opened with AVFMT_FLAG_CUSTOM_IO. abort is
+    // polled while a read waits at the live edge. Free with freeReader() after closing the demuxer.
+    AVIOContext* createReader(std::function<bool()> abort);
+    static void freeReader(AVIOContext*& reader);
+
+    // Byte offset of the last keyframe at or before seconds, clamped to the window
+    int64_t keyframeOffset(double seconds) const;
+    Window window() const;
+    // The reader fell behind the retention window and skipped ahead to the oldest keyframe
+    bool takeDiscontinuity();
+    // Capture error (source lost); empty while capturing
+    std::string captureError() const;
+
+private:
+    struct Segment {
+        std::filesystem::path path;
+        int64_t begin = 0; // Offset of its first byte in the stream
+        int64_t size = 0;
+        double start = 0.0;
+        double end = 0.0;
+    };
+    struct Keyframe {
+        double seconds = 0.0;
+        int64_t offset = 0;
+    };
+
+    void captureLoop(std::stop_token stop);
+    bool openSegment(int64_t begin, double start);
+    void prune();
+    void cleanup();
+
+    static int interruptCapture(void* opaque);
+    static int readPacket(void* opaque, uint8_t* buf, int size);
+    static int64_t seekReader(void* opaque, int64_t offset, int whence);
+
+    // Capture thread (and start() before it runs)
+    AVFormatContext* m_input = nullptr;
+    AVFormatContext* m_output = nullptr;
+    std::vector<int> m_streamMap;       // Input stream -> output stream, -1 = dropped
+    int m_videoStream = -1;             // Input index
+    int64_t m_tsOffset = AV_NOPTS_VALUE; // Added to every timestamp, AV_TIME_BASE units
+    int m_segmentIndex = 0;
+    std::filesystem::path m_directory;
+    Retention m_retention;
+    std::stop_token m_openCancel; // Only consulted until the capture thread runs
+    // Set up before the capture thread exists: its interrupt callback must not read m_captureThread,
+    // which start() is still assigning when the first read runs
+    std::stop_source m_captureStop;
+    std::jthread m_captureThread;
+
+    // Shared with the reader
+    mutable std::mutex m_mutex;
+    std::condition_variable m_dataCondition;
+    std::deque<Segment> m_segments;
+    std::deque<Keyframe> m_keyframes;
+    std::vector<std::filesystem::path> m_staleFiles; // Could not be deleted yet (still open on Windows)
+    int64_t m_written = 0;                 // End offset of the stream
+    bool m_captureDone = false;
+    std::string m_captureError;
+    int64_t m_readPos = 0;
+    bool m_discontinuity = false;
+    std::function<bool()> m_readerAbort;
+};
@@ -0,0 +1,204 @@
+#include "TimecodeClip.h"
+#include <algorithm>
+#include <cmath>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+namespace {
+
+constexpr int ClickMilliseconds = 5;
+constexpr int AudioFrameSamples = 1024;
+
+int channelLevel(int bits) {
+    return 16 + 32 * bits;
+}
+
+std::string errorString(int err) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    av_strerror(err, errbuf, sizeof(errbuf));
+    return errbuf;
+}
+
+struct ClipWriter {
+    AVFormatContext* output = nullptr;
+    AVCodecContext* video = nullptr;
+    AVCodecContext* audio = nullptr;
+    AVFrame* frame = nullptr;
+    AVPacket* packet = nullptr;
+    bool fileOpened = false;
+
+    ~ClipWriter() {
+        if (packet) av_packet_free(&packet);
+        if (frame) av_frame_free(&frame);
+        if (video) avcodec_free_context(&video);
+        if (audio) avcodec_free_context(&audio);
+        if (output) {
+            if (fileOpened) avio_closep(&output->pb);
+            avformat_free_context(output);
+        }
+    }
+
+    // Sends one frame (nullptr flushes) and writes what the encoder returns
+    int encode(AVCodecContext* codec, AVStream* stream, AVFrame* input) {
+        int ret = avcodec_send_frame(codec, input);
+        if (ret < 0) return ret;
+        while ((ret = avcodec_receive_packet(codec, packet)) == 0) {
+            av_packet_rescale_ts(packet, codec->time_base, stream->time_base);
+            packet->stream_index = stream->index;
+            ret = av_interleaved_write_frame(output, packet);
+            if (ret < 0) return ret;
+        }
+        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+    }
+};
+
+// BT.601 limited range, the decoder's interpretation of untagged SD
+void fillTimecode(AVFrame* frame, int number) {
+    const int code = number % TimecodeModulus;
+    const double r = channelLevel((code >> 6) & 7);
+    const double g = channelLevel((code >> 3) & 7);
+    const double b = channelLevel(code & 7);
+    const int y = (int)std::lround(16.0 + (65.481 * r + 128.553 * g + 24.966 * b) / 255.0);
+    const int u = (int)std::lround(128.0 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255.0);
+    const int v = (int)std::lround(128.0 + (112.0 * r - 93.786 * g - 18.214 * b) / 255.0);
+    const int values[3] = {y, u, v};
+    for (int plane = 0; plane < 3; ++plane) {
+        const int rows = plane == 0 ? frame->height : (frame->height + 1) / 2;
+        const int columns = plane == 0 ? frame->width : (frame->width + 1) / 2;
+        for (int row = 0; row < rows; ++row) {
+            std::fill_n(frame->data[plane] + (ptrdiff_t)row * frame->linesize[plane], columns,
+                        (uint8_t)std::clamp(values[plane], 0, 255));
+        }
+    }
+}
+
+} // namespace
+
+int readTimecode(uint8_t r, uint8_t g, uint8_t b) {
+    // Levels sit at 16 + 32k, so each one owns [32k, 32k + 31]
+    auto bits = [](uint8_t level) { return std::min(level / 32, 7); };
+    return (bits(r) << 6) | (bits(g) << 3) | bits(b);
+}
+
+bool writeTimecodeClip(const std::string& path, const TimecodeClipSpec& spec, std::string& error) {
+    ClipWriter w;
+    int ret = avformat_alloc_output_context2(&w.output, nullptr, "nut", path.c_str());
+    if (ret < 0 || !w.output) {
+        error = "Could not create the NUT muxer: " + errorString(ret);
+        return false;
+    }
+
+    const AVCodec* videoCodec = avcodec_find_encoder(AV_CODEC_ID_RAWVIDEO);
+    const AVCodec* audioCodec = avcodec_find_encoder(AV_CODEC_ID_PCM_S16LE);
+    if (!videoCodec || !audioCodec) {
+        error = "Raw video or PCM encoder missing";
+        return false;
+    }
+
+    w.video = avcodec_alloc_context3(videoCodec);
+    w.video->width = spec.width;
+    w.video->height = spec.height;
+    w.video->pix_fmt = AV_PIX_FMT_YUV420P;
+    w.video->time_base = AVRational{1, spec.fps};
+    w.video->framerate = AVRational{spec.fps, 1};
+    w.audio = avcodec_alloc_context3(audioCodec);
+    w.audio->sample_fmt = AV_SAMPLE_FMT_S16;
+    w.audio->sample_rate = spec.sampleRate;
+    av_channel_layout_default(&w.audio->ch_layout, 2);
+    w.audio->time_base = AVRational{1, spec.sampleRate};
+    if (w.output->oformat->flags & AVFMT_GLOBALHEADER) {
+        w.video->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        w.audio->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    if ((ret = avcodec_open2(w.video, videoCodec, nullptr)) < 0 || (ret = avcodec_open2(w.audio, audioCodec, nullptr)) < 0) {
+        error = "Could not open the clip encoders: " + errorString(ret);
+        return false;
+    }
+
+    AVStream* videoStream = avformat_new_stream(w.output, nullptr);
+    AVStream* audioStream = avformat_new_stream(w.output, nullptr);
+    if (!videoStream || !audioStream) {
+        error = "Could not add clip streams";
+        return false;
+    }
+    avcodec_parameters_from_context(videoStream->codecpar, w.video);
+    avcodec_parameters_from_context(audioStream->codecpar, w.audio);
+    videoStream->time_base = w.video->time_base;
+    audioStream->time_base = w.audio->time_base;
+
+    if ((ret = avio_open(&w.output->pb, path.c_str(), AVIO_FLAG_WRITE)) < 0) {
+        error = "Could not create " + path + ": " + errorString(ret);
+        return false;
+    }
+    w.fileOpened = true;
+    if ((ret = avformat_write_header(w.output, nullptr)) < 0) {
+        error = "Could not write the clip header: " + errorString(ret);
+        return false;
+    }
+
+    w.frame = av_frame_alloc();
+    w.packet = av_packet_alloc();
+    if (!w.frame || !w.packet) {
+        error = "Out of memory";
+        return false;
+    }
+
+    const int64_t totalFrames = (int64_t)spec.fps * spec.seconds;
+    const int64_t totalSamples = (int64_t)spec.sampleRate * spec.seconds;
+    const int clickSamples = spec.sampleRate * ClickMilliseconds / 1000;
+    int64_t videoNext = 0;
+    int64_t audioNext = 0;
+    // Interleave by time so the muxer does not have to buffer a whole stream
+    while (videoNext < totalFrames || audioNext < totalSamples) {
+        const bool videoFirst = audioNext >= totalSamples
+            || (videoNext < totalFrames && videoNext * spec.sampleRate <= audioNext * spec.fps);
+        av_frame_unref(w.frame);
+        if (videoFirst) {
+            w.frame->format = AV_PIX_FMT_YUV420P;
+            w.frame->width = spec.width;
+            w.frame->height = spec.height;
+            if (av_frame_get_buffer(w.frame, 0) < 0) {
+                error = "Out of memory";
+                return false;
+            }
+            fillTimecode(w.frame, (int)videoNext);
+            w.frame->pts = videoNext++;
+            ret = w.encode(w.video, videoStream, w.frame);
+        } else {
+            const int samples = (int)std::min<int64_t>(AudioFrameSamples, totalSamples - audioNext);
+            w.frame->format = AV_SAMPLE_FMT_S16;
+            w.frame->sample_rate = spec.sampleRate;
+            w.frame->nb_samples = samples;
+            av_channel_layout_copy(&w.frame->ch_layout, &w.audio->ch_layout);
+            if (av_frame_get_buffer(w.frame, 0) < 0) {
+                error = "Out of memory";
+                return false;
+            }
+            auto* pcm = reinterpret_cast<int16_t*>(w.frame->data[0]);
+            for (int i = 0; i < samples; ++i) {
+                // Square wave at a quarter of the sample rate, starting loud on the second boundary
+                const int64_t inSecond = (audioNext + i) % spec.sampleRate;
+                const int16_t value = inSecond < clickSamples ? (int16_t)((inSecond / 2) % 2 ? -24000 : 24000) : 0;
+                pcm[2 * i] = value;
+                pcm[2 * i + 1] = value;
+            }
+            w.frame->pts = audioNext;
+            audioNext += samples;
+            ret = w.encode(w.audio, audioStream, w.frame);
+        }
+        if (ret < 0) {
+            error = "Could not write the clip: " + errorString(ret);
+            return false;
+        }
+    }
+
+    if ((ret = w.encode(w.video, videoStream, nullptr)) < 0 || (ret = w.encode(w.audio, audioStream, nullptr)) < 0
+        || (ret = av_write_trailer(w.output)) < 0) {
+        error = "Could not finish the clip: " + errorString(ret);
+        return false;
+    }
+    return true;
+}
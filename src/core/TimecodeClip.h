@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Synthetic clip for measuring presentation: every frame is one flat colour that encodes its
+// frame number, so any pixel read back from the screen identifies the frame on display whatever
+// the view does to the geometry (letterboxing, panorama projection). Three bits per channel on
+// levels 32 apart survive the YUV round trip with a wide margin; numbers wrap at TimecodeModulus.
+// The audio is silence with a short full-scale click at every whole second, i.e. on the frames
+// whose number is a multiple of fps.
+struct TimecodeClipSpec {
+    int width = 320;
+    int height = 240; // SD, so the decoder picks BT.601 as the clip was written with
+    int fps = 60;
+    int seconds = 20;
+    int sampleRate = 48000;
+};
+
+constexpr int TimecodeModulus = 512;
+
+// Raw YUV 4:2:0 and PCM in NUT, so no encoder beyond FFmpeg's built-in ones is needed
+bool writeTimecodeClip(const std::string& path, const TimecodeClipSpec& spec, std::string& error);
+
+// Frame number modulo TimecodeModulus for a displayed colour
+int readTimecode(uint8_t r, uint8_t g, uint8_t b);
+
+// Click onsets: the first sample of each click is louder than this, the silence in between is 0
+constexpr int TimecodeClickThreshold = 8000;
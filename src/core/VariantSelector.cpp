@@ -0,0 +1,275 @@
+#include "VariantSelector.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/mem.h>
+#include <libavutil/time.h>
+}
+
+namespace {
+constexpr int MeterBufferSize = 64 * 1024;
+// Playlists and keys are too small to say anything about the link
+constexpr int64_t MinSampleBytes = 16 * 1024;
+// Share of the estimate a variant may use: going up, and before stepping down
+constexpr double UpSafety = 0.75;
+constexpr double DownSafety = 0.9;
+// While the pipeline runs dry, and for the first pick with only probing to go by
+constexpr double LowBufferSafety = 0.5;
+// Projected decode load (work / frame interval) a larger variant may reach
+constexpr double MaxProjectedLoad = 0.7;
+constexpr auto EvaluationInterval = std::chrono::milliseconds(500);
+constexpr auto DownHold = std::chrono::milliseconds(2000);
+constexpr auto UpConfirm = std::chrono::milliseconds(4000);
+constexpr auto MaxUpHold = std::chrono::milliseconds(60000);
+constexpr auto RelapseWindow = std::chrono::milliseconds(15000);
+
+// A demuxer read, timed. Wraps the AVIOContext FFmpeg opened; the wrapper has no AVClass, so
+// protocol options (cookies, redirects) are not visible through it.
+struct MeteredIo {
+    AVIOContext* inner = nullptr;
+    int64_t bytes = 0;
+    int64_t readMicroseconds = 0;
+};
+
+int readMetered(void* opaque, uint8_t* buf, int size) {
+    auto* io = static_cast<MeteredIo*>(opaque);
+    const int64_t start = av_gettime_relative();
+    const int ret = avio_read_partial(io->inner, buf, size);
+    io->readMicroseconds += av_gettime_relative() - start;
+    if (ret > 0) io->bytes += ret;
+    return ret == 0 ? AVERROR_EOF : ret;
+}
+
+int64_t seekMetered(void* opaque, int64_t offset, int whence) {
+    auto* io = static_cast<MeteredIo*>(opaque);
+    if (whence & AVSEEK_SIZE) return avio_size(io->inner);
+    return avio_seek(io->inner, offset, whence & ~AVSEEK_FORCE);
+}
+
+int64_t variantBitrate(const AVFormatContext* ctx, const AVStream* stream) {
+    // HLS tags both the stream and its program; DASH tags the stream
+    if (const AVDictionaryEntry* entry = av_dict_get(stream->metadata, "variant_bitrate", nullptr, 0)) {
+        return std::strtoll(entry->value, nullptr, 10);
+    }
+    for (unsigned int i = 0; i < ctx->nb_programs; i++) {
+        const AVProgram* program = ctx->programs[i];
+        for (unsigned int j = 0; j < program->nb_stream_indexes; j++) {
+            if ((int)program->stream_index[j] != stream->index) continue;
+            if (const AVDictionaryEntry* entry = av_dict_get(program->metadata, "variant_bitrate", nullptr, 0)) {
+                return std::strtoll(entry->value, nullptr, 10);
+            }
+        }
+    }
+    return stream->codecpar->bit_rate;
+}
+} // namespace
+
+void VariantSelector::Average::add(double weight, double value) {
+    const double alpha = std::pow(0.5, weight / halfLife);
+    estimate = value * (1.0 - alpha) + estimate * alpha;
+    totalWeight += weight;
+}
+
+double VariantSelector::Average::value() const {
+    const double zeroFactor = 1.0 - std::pow(0.5, totalWeight / halfLife);
+    return zeroFactor > 0.0 ? estimate / zeroFactor : 0.0;
+}
+
+void VariantSelector::attach(AVFormatContext* ctx) {
+    m_defaultOpen = ctx->io_open;
+    m_defaultClose = ctx->io_close2;
+    ctx->opaque = this;
+    ctx->io_open = ioOpen;
+    ctx->io_close2 = ioClose;
+}
+
+int VariantSelector::ioOpen(AVFormatContext* s, AVIOContext** pb, const char* url, int flags, AVDictionary** options) {
+    auto* self = static_cast<VariantSelector*>(s->opaque);
+    const int ret = self->m_defaultOpen(s, pb, url, flags, options);
+    // The top-level input is opened before the format is known; HLS and DASH open the rest
+    if (ret < 0 || !s->iformat || (flags & AVIO_FLAG_WRITE)) return ret;
+
+    auto* io = new MeteredIo;
+    io->inner = *pb;
+    auto* buffer = static_cast<unsigned char*>(av_malloc(MeterBufferSize));
+    AVIOContext* outer = buffer ? avio_alloc_context(buffer, MeterBufferSize, 0, io, readMetered, nullptr, seekMetered)
+                                : nullptr;
+    if (!outer) {
+        // Still readable, just not measured
+        av_free(buffer);
+        delete io;
+        return ret;
+    }
+    outer->seekable = io->inner->seekable;
+    *pb = outer;
+    return ret;
+}
+
+int VariantSelector::ioClose(AVFormatContext* s, AVIOContext* pb) {
+    auto* self = static_cast<VariantSelector*>(s->opaque);
+    if (!pb || pb->read_packet != readMetered) return self->m_defaultClose(s, pb);
+
+    auto* io = static_cast<MeteredIo*>(pb->opaque);
+    self->reportDownload(io->bytes, io->readMicroseconds / 1e6);
+    AVIOContext* inner = io->inner;
+    delete io;
+    av_freep(&pb->buffer);
+    avio_context_free(&pb);
+    return self->m_defaultClose(s, inner);
+}
+
+void VariantSelector::reportDownload(int64_t bytes, double seconds) {
+    // Reads served from socket buffers that filled while the pipeline was full look faster than
+    // the link; the starving check in update() catches an estimate that is too optimistic
+    if (bytes < MinSampleBytes || seconds <= 0.0) return;
+    seconds = std::max(seconds, 0.001);
+    const double bitsPerSecond = bytes * 8.0 / seconds;
+    std::lock_guard<std::mutex> lock(m_throughputMutex);
+    m_fast.add(seconds, bitsPerSecond);
+    m_slow.add(seconds, bitsPerSecond);
+}
+
+double VariantSelector::throughput() const {
+    std::lock_guard<std::mutex> lock(m_throughputMutex);
+    return std::min(m_fast.value(), m_slow.value());
+}
+
+bool VariantSelector::setVariants(AVFormatContext* ctx) {
+    m_variants.clear();
+    const char* name = ctx->iformat ? ctx->iformat->name : "";
+    if (std::strcmp(name, "hls") != 0 && std::strcmp(name, "dash") != 0) return false;
+
+    for (unsigned int i = 0; i < ctx->nb_streams; i++) {
+        AVStream* stream = ctx->streams[i];
+        if (stream->codecpar->codec_type != AVMEDIA_TYPE_VIDEO) continue;
+        if (stream->disposition & AV_DISPOSITION_ATTACHED_PIC) continue;
+
+        Variant variant;
+        variant.streamIndex = (int)i;
+        variant.bitrate = variantBitrate(ctx, stream);
+        variant.width = stream->codecpar->width;
+        variant.height = stream->codecpar->height;
+        const AVRational rate = av_guess_frame_rate(ctx, stream, nullptr);
+        variant.fps = rate.num > 0 && rate.den > 0 ? av_q2d(rate) : 0.0;
+        if (variant.bitrate <= 0) {
+            // Without bitrates there is nothing to choose by
+            m_variants.clear();
+            return false;
+        }
+        m_variants.push_back(variant);
+    }
+    std::stable_sort(m_variants.begin(), m_variants.end(),
+                     [](const Variant& a, const Variant& b) { return a.bitrate < b.bitrate; });
+    if (m_variants.size() < 2) m_variants.clear();
+    return isAdaptive();
+}
+
+int VariantSelector::viewCap(int viewWidth, int viewHeight) const {
+    const int last = (int)m_variants.size() - 1;
+    if (viewWidth <= 0 || viewHeight <= 0) return last;
+    for (int i = 0; i < last; ++i) {
+        if (m_variants[i].width >= viewWidth || m_variants[i].height >= viewHeight) return i;
+    }
+    return last;
+}
+
+double VariantSelector::pixelRate(int variant) const {
+    const Variant& v = m_variants[variant];
+    return (double)v.width * v.height * (v.fps > 0.0 ? v.fps : 30.0);
+}
+
+int VariantSelector::initialVariant(int viewWidth, int viewHeight) const {
+    // Probing fetched a segment or two; too few samples to bet on more than half of it
+    const double usable = throughput() * LowBufferSafety;
+    int choice = 0;
+    for (int i = 0; i < (int)m_variants.size(); ++i) {
+        if (m_variants[i].bitrate <= usable) choice = i;
+    }
+    return std::min(choice, viewCap(viewWidth, viewHeight));
+}
+
+int VariantSelector::update(int current, bool starving, double decodeLoad, DecodeGovernor::Level level,
+                            int viewWidth, int viewHeight) {
+    const Clock::time_point now = Clock::now();
+    if (now - m_lastEvaluation < EvaluationInterval) return -1;
+    m_lastEvaluation = now;
+    // A slow segment request is a blip; a pipeline that stays dry is not
+    m_starvedEvaluations = starving ? m_starvedEvaluations + 1 : 0;
+    starving = m_starvedEvaluations >= 2;
+    const int count = (int)m_variants.size();
+    if (current < 0 || current >= count) return -1;
+    const bool settled = now - m_lastSwitch >= DownHold;
+
+    // The governor is already degrading this variant: a smaller picture is the better trade
+    if (level != DecodeGovernor::Level::Full && current > 0) {
+        m_upPending = false;
+        return settled ? current - 1 : -1;
+    }
+
+    const double estimate = throughput();
+    if (estimate <= 0.0) return -1;
+
+    // Down as far as the link requires
+    const double sustainable = estimate * (starving ? LowBufferSafety : DownSafety);
+    if (current > 0 && m_variants[current].bitrate > sustainable && (starving || settled)) {
+        int target = 0;
+        for (int i = 0; i < current; ++i) {
+            if (m_variants[i].bitrate <= sustainable) target = i;
+        }
+        m_upPending = false;
+        return target;
+    }
+    // The view shrank, e.g. a window restored from full screen
+    const int cap = viewCap(viewWidth, viewHeight);
+    if (current > cap && settled) {
+        m_upPending = false;
+        return cap;
+    }
+
+    // Up one rung when the link, the decoder and the view all have room for it
+    const int next = current + 1;
+    const bool room = next < count && next <= cap && !starving
+        && m_variants[next].bitrate <= estimate * UpSafety
+        && (decodeLoad <= 0.0 || decodeLoad * pixelRate(next) / pixelRate(current) < MaxProjectedLoad);
+    if (!room) {
+        m_upPending = false;
+        return -1;
+    }
+    if (!m_upPending) {
+        m_upPending = true;
+        m_upSince = now;
+    }
+    if (now - m_upSince < UpConfirm || now - m_lastSwitch < m_upHold) return -1;
+    m_upPending = false;
+    return next;
+}
+
+void VariantSelector::switched(int from, int to) {
+    const Clock::time_point now = Clock::now();
+    if (to > from) {
+        m_lastUpSwitch = now;
+    } else if (m_lastUpSwitch != Clock::time_point() && now - m_lastUpSwitch < RelapseWindow) {
+        // Came straight back down: that rung was too ambitious, wait longer before the next try
+        m_upHold = std::min(m_upHold * 2, MaxUpHold);
+    }
+    m_lastSwitch = now;
+    m_upPending = false;
+}
+
+void VariantSelector::reset() {
+    m_variants.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_throughputMutex);
+        m_fast = Average{m_fast.halfLife};
+        m_slow = Average{m_slow.halfLife};
+    }
+    m_lastEvaluation = Clock::time_point();
+    m_lastSwitch = Clock::time_point();
+    m_lastUpSwitch = Clock::time_point();
+    m_upPending = false;
+    m_starvedEvaluations = 0;
+    m_upHold = std::chrono::milliseconds(10000);
+}
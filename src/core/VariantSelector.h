@@ -0,0 +1,107 @@
+#pragma once
+
+#include "DecodeGovernor.h"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+// Adaptive bitrate for HLS and DASH. FFmpeg exposes every variant (HLS) or representation (DASH)
+// as a video stream of its own, downloads only the streams that are not discarded, and fetches a
+// stream that is enabled again from the segment at the current position. The decoder keeps one
+// variant enabled and switches at the new variant's first keyframe; this class picks the variant:
+//  - download throughput is measured on everything the demuxer opens itself (segments,
+//    playlists), as bytes over the time spent inside reads, smoothed by a fast and a slow
+//    average of which the lower one counts
+//  - the pipeline running dry (packets read after their frames were due) steps down at once
+//  - decode headroom: a variant the DecodeGovernor has to degrade for is left for a smaller one,
+//    and a larger one is only tried when the load, scaled by its pixel rate, still fits
+//  - nothing larger than the first variant that covers the view's output size
+// Up-switches go one rung at a time and wait for the estimate to hold; down-switches do not.
+//
+// To try it against a local server, e.g. a three-rung ladder written by the ffmpeg CLI:
+//     ffmpeg -i in.mp4 -map 0:v -map 0:a -map 0:v -map 0:a -map 0:v -map 0:a -c:v libx264 -g 48 -c:a aac
+//         -s:v:0 640x360 -b:v:0 800k -s:v:1 1280x720 -b:v:1 3M -s:v:2 1920x1080 -b:v:2 6M
+//         -f hls -hls_time 4 -hls_playlist_type vod -master_pl_name master.m3u8
+//         -var_stream_map "v:0,a:0 v:1,a:1 v:2,a:2" v%v/index.m3u8
+//     python3 -m http.server 8000
+// then open http://localhost:8000/master.m3u8 and throttle loopback (tc ... netem rate 2mbit) or
+// load the CPU, and watch the engine's streamVariant property.
+class VariantSelector {
+public:
+    struct Variant {
+        int streamIndex = -1;
+        int64_t bitrate = 0; // Bits per second, as advertised by the playlist or manifest
+        int width = 0;
+        int height = 0;
+        double fps = 0.0;
+    };
+
+    // Meters downloads of a context; call before avformat_open_input(). Only opens made by the
+    // demuxer itself are measured, not the top-level input. The selector must outlive the context.
+    void attach(AVFormatContext* ctx);
+
+    // After avformat_find_stream_info(): true when the source is HLS or DASH with at least two
+    // video variants of known bitrate. Clears the previous source's variants either way.
+    bool setVariants(AVFormatContext* ctx);
+    bool isAdaptive() const { return m_variants.size() > 1; }
+    // Ascending bitrate
+    const std::vector<Variant>& variants() const { return m_variants; }
+    // Index into variants() to start on: what the downloads while probing support (0 if nothing
+    // was measured), within the view size if known
+    int initialVariant(int viewWidth, int viewHeight) const;
+
+    // Decode thread, on packets of the current variant; evaluates twice a second. starving:
+    // packets arrive after their frames were due, i.e. the (shallow) pipeline ran dry; it counts
+    // once it holds for two evaluations. decodeLoad: DecodeGovernor::load(). Returns the variant
+    // to switch to, or -1 to stay.
+    int update(int current, bool starving, double decodeLoad, DecodeGovernor::Level level,
+               int viewWidth, int viewHeight);
+    // The switch has been made
+    void switched(int from, int to);
+
+    // Smoothed download throughput in bits per second, 0 until measured; any thread
+    double throughput() const;
+
+    void reset();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Exponentially weighted by download time, corrected for the bias of an empty history
+    struct Average {
+        double halfLife;
+        double estimate = 0.0;
+        double totalWeight = 0.0;
+
+        void add(double weight, double value);
+        double value() const;
+    };
+
+    void reportDownload(int64_t bytes, double seconds);
+    int viewCap(int viewWidth, int viewHeight) const;
+    double pixelRate(int variant) const;
+
+    static int ioOpen(AVFormatContext* s, AVIOContext** pb, const char* url, int flags, AVDictionary** options);
+    static int ioClose(AVFormatContext* s, AVIOContext* pb);
+
+    decltype(AVFormatContext::io_open) m_defaultOpen = nullptr;
+    decltype(AVFormatContext::io_close2) m_defaultClose = nullptr;
+
+    mutable std::mutex m_throughputMutex; // Downloads are metered on the opening and decode threads
+    Average m_fast{2.0};
+    Average m_slow{5.0};
+
+    std::vector<Variant> m_variants;
+    Clock::time_point m_lastEvaluation;
+    Clock::time_point m_lastSwitch;
+    Clock::time_point m_lastUpSwitch;
+    Clock::time_point m_upSince; // Up-switch candidate first seen
+    bool m_upPending = false;
+    int m_starvedEvaluations = 0;
+    std::chrono::milliseconds m_upHold{10000};
+};
@@ -1,13 +1,19 @@
 #include "VideoDecoder.h"
+#include "FFmpegInit.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <iostream>
 
 extern "C" {
+#include <libavutil/mastering_display_metadata.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/spherical.h>
+#include <libavutil/stereo3d.h>
 }
 
 VideoDecoder::VideoDecoder() {
-    // Initialize network if needed (older ffmpeg versions)
-    avformat_network_init();
     m_stopThread = true; // Initially stopped
 }
 
@@ -19,42 +25,156 @@ VideoDecoder::~VideoDecoder() {
 void VideoDecoder::freeResources() {
     if (m_codecCtx) avcodec_free_context(&m_codecCtx);
     if (m_audioCodecCtx) avcodec_free_context(&m_audioCodecCtx);
+    if (m_subtitleCodecCtx) avcodec_free_context(&m_subtitleCodecCtx);
     if (m_formatCtx) avformat_close_input(&m_formatCtx);
+    m_variants.reset(); // After the demuxer: its downloads are metered until it is closed
+    // Custom IO: the demuxer leaves the reader to us; the buffer stops capturing and deletes its segments
+    TimeShiftBuffer::freeReader(m_timeShiftReader);
+    MappedFile::freeReader(m_mappedReader);
+    m_mappedFile.reset();
+    std::shared_ptr<TimeShiftBuffer> timeShift;
+    {
+        std::lock_guard<std::mutex> lock(m_timeShiftMutex);
+        timeShift = std::move(m_timeShift);
+    }
+    timeShift.reset();
     if (m_frame) av_frame_free(&m_frame);
     if (m_packet) av_packet_free(&m_packet);
+    if (m_heldPacket) av_packet_free(&m_heldPacket);
     if (m_swsCtx) sws_freeContext(m_swsCtx);
+    if (m_tileSwsCtx) sws_freeContext(m_tileSwsCtx);
+    if (m_lastVideoFrame) av_frame_free(&m_lastVideoFrame);
     if (m_swrCtx) swr_free(&m_swrCtx);
     
     m_codecCtx = nullptr;
     m_audioCodecCtx = nullptr;
+    m_subtitleCodecCtx = nullptr;
     m_formatCtx = nullptr;
     m_frame = nullptr;
     m_packet = nullptr;
     m_swsCtx = nullptr;
+    m_tileSwsCtx = nullptr;
     m_swrCtx = nullptr;
     m_duration = 0.0;
     m_audioStreamIndex = -1;
     m_videoStreamIndex = -1;
+    m_subtitleStreamIndex = -1;
+    m_activeSubtitle = -1;
+    m_requestedSubtitle = -1;
+    m_activeAudio = -1;
+    m_requestedAudio = -1;
+    m_audioResync = false;
     m_skipUntilPts = -1.0;
+    m_variant = -1;
+    m_pendingVariant = -1;
+    m_pendingAudioStreamIndex = -1;
+    m_lastReadVideoPts = -1.0;
+    m_lastQueuedVideoPts = -1.0;
+    m_variantSkipPts = -1.0;
+    m_variantAudioSkipPts = -1.0;
+    {
+        std::lock_guard<std::mutex> lock(m_variantMutex);
+        m_currentVariant = VariantSelector::Variant();
+    }
+    m_peakLuminance = 1000.0f;
+    m_frameQueue.flush();
+    m_clock.invalidate();
+    m_subtitles.flush();
+    {
+        std::lock_guard<std::mutex> lock(m_subtitleMutex);
+        m_subtitleStreams.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_audioMutex);
+        m_audioStreams.clear();
+    }
     
     std::lock_guard<std::mutex> lock(m_audioMutex);
     m_audioBuffer.clear();
+    m_audioClock = -1.0;
 }
 
 void VideoDecoder::setTargetResolution(int width, int height) {
+    {
+        std::lock_guard<std::mutex> lock(m_autoSizeMutex);
+        m_pendingAutoWidth = 0;
+        m_pendingAutoHeight = 0;
+    }
+    m_autoWidth = 0;
+    m_autoHeight = 0;
     m_targetWidth = width;
     m_targetHeight = height;
 }
 
-bool VideoDecoder::open(const std::string& url) {
+void VideoDecoder::requestOutputSize(int width, int height) {
+    if (width <= 0 || height <= 0) return;
+
+    // Hysteresis on what the decode loop would actually output for a box (source aspect fitted
+    // in, never upscaled): grow as soon as more pixels are needed, shrink only below 80% of the
+    // reference. A box that only gets narrower still shrinks the output when width is the limit.
+    const int sourceWidth = m_width;
+    const int sourceHeight = m_height;
+    auto fitted = [sourceWidth, sourceHeight](int boxWidth, int boxHeight) {
+        if (sourceWidth <= 0 || sourceHeight <= 0) return std::make_pair((double)boxWidth, (double)boxHeight);
+        const double scale = std::min({(double)boxWidth / sourceWidth, (double)boxHeight / sourceHeight, 1.0});
+        return std::make_pair(sourceWidth * scale, sourceHeight * scale);
+    };
+    const auto requested = fitted(width, height);
+    auto withinBand = [&](int refWidth, int refHeight) {
+        const auto reference = fitted(refWidth, refHeight);
+        bool grows = requested.first > reference.first || requested.second > reference.second;
+        bool shrinks = requested.first < reference.first * 0.8 || requested.second < reference.second * 0.8;
+        return !grows && !shrinks;
+    };
+
+    std::lock_guard<std::mutex> lock(m_autoSizeMutex);
+    if (m_autoWidth > 0 && withinBand(m_autoWidth, m_autoHeight)) {
+        // Back within range of what is already applied, drop any pending change
+        m_pendingAutoWidth = 0;
+        m_pendingAutoHeight = 0;
+        return;
+    }
+    if (m_pendingAutoWidth > 0 && withinBand(m_pendingAutoWidth, m_pendingAutoHeight)) return;
+
+    m_pendingAutoWidth = width;
+    m_pendingAutoHeight = height;
+    m_pendingAutoSince = av_gettime();
+
+    // First request applies immediately so the first frame already has the right size
+    if (m_autoWidth == 0) {
+        m_autoWidth = width;
+        m_autoHeight = height;
+        m_pendingAutoWidth = 0;
+        m_pendingAutoHeight = 0;
+    }
+}
+
+void VideoDecoder::commitPendingOutputSize() {
+    std::lock_guard<std::mutex> lock(m_autoSizeMutex);
+    if (m_pendingAutoWidth <= 0) return;
+    if (av_gettime() - m_pendingAutoSince < m_autoSizeDebounceMicroseconds) return;
+
+    m_autoWidth = m_pendingAutoWidth;
+    m_autoHeight = m_pendingAutoHeight;
+    m_pendingAutoWidth = 0;
+    m_pendingAutoHeight = 0;
+}
+
+bool VideoDecoder::open(const std::string& url, std::stop_token cancel) {
     std::lock_guard<std::mutex> lock(m_apiMutex);
-    
+    if (cancel.stop_requested()) return false;
+    initFFmpeg(); // Usually done by now; never on the GUI thread
+
     // Stop previous playback internally
     m_stopThread = true;
+    wakeDecodeThread();
+    m_frameQueue.abort();
     if (m_decodeThread.joinable()) {
         m_decodeThread.join();
     }
     freeResources();
+    m_frameQueue.reset();
+    m_clock.setPaused(false);
 
     // Reset stop flag for new playback
     m_stopThread = false;
@@ -64,6 +184,18 @@ bool VideoDecoder::open(const std::string& url) {
     m_formatCtx = avformat_alloc_context();
     
     // Setup interrupt callback
+    // The cancel token is only consulted while opening; the decode thread only sees m_stopThread
+    m_openCancel = cancel;
+    struct OpenCancelReset {
+        std::stop_token& token;
+        ~OpenCancelReset() { token = std::stop_token(); }
+    } openCancelReset{m_openCancel};
+    // Leaves the decoder stopped, as if open() had never been called
+    auto cancelled = [this]() {
+        m_stopThread = true;
+        freeResources();
+        return false;
+    };
     m_lastPacketTime = av_gettime();
     m_formatCtx->interrupt_callback.callback = interrupt_cb;
     m_formatCtx->interrupt_callback.opaque = this;
@@ -75,9 +207,64 @@ bool VideoDecoder::open(const std::string& url) {
     // Increase buffer size for HTTP
     av_dict_set(&options, "buffer_size", "1024000", 0);
     
-    int ret = avformat_open_input(&m_formatCtx, url.c_str(), nullptr, &options);
+    bool timeShift;
+    TimeShiftBuffer::Retention retention;
+    std::filesystem::path timeShiftDirectory;
+    {
+        std::lock_guard<std::mutex> lock(m_timeShiftMutex);
+        timeShift = m_timeShiftEnabled && isLiveUrl(url);
+        retention = m_timeShiftRetention;
+        timeShiftDirectory = m_timeShiftDirectory;
+    }
+
+    int ret;
+    if (timeShift) {
+        // The live input is read by the buffer's capture thread; playback demuxes what it wrote
+        auto buffer = std::make_shared<TimeShiftBuffer>();
+        std::string error;
+        if (!buffer->start(url, timeShiftDirectory, retention, cancel, error)) {
+            av_dict_free(&options);
+            if (cancel.stop_requested()) return cancelled();
+            std::cerr << error << std::endl;
+            std::lock_guard<std::mutex> lock(m_callbackMutex);
+            if (m_onError) m_onError(error);
+            return false;
+        }
+        m_timeShiftReader = buffer->createReader([this, cancel]() { return m_stopThread || cancel.stop_requested(); });
+        {
+            std::lock_guard<std::mutex> lock(m_timeShiftMutex);
+            m_timeShift = std::move(buffer);
+        }
+        m_formatCtx->pb = m_timeShiftReader;
+        m_formatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+        ret = avformat_open_input(&m_formatCtx, nullptr, av_find_input_format("mpegts"), &options);
+    } else {
+        if (MappedFile::isLocalPath(url)) {
+            // Anything that cannot be mapped (pipes, devices, 32-bit address space) keeps the file protocol
+            auto file = std::make_unique<MappedFile>();
+            std::string error;
+            if (file->open(std::filesystem::path(std::u8string(url.begin(), url.end())), error)) {
+                m_mappedReader = file->createReader();
+            } else {
+                std::cerr << "Memory mapping unavailable, reading through FFmpeg: " << error << std::endl;
+            }
+            if (m_mappedReader) {
+                m_mappedFile = std::move(file);
+                m_formatCtx->pb = m_mappedReader;
+                m_formatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+            }
+        } else {
+            // Segment downloads of HLS / DASH feed the variant choice. Keep-alive reuses the
+            // connection behind FFmpeg's own AVIOContext, which the metering wraps, so it is off.
+            m_variants.attach(m_formatCtx);
+            av_dict_set(&options, "http_persistent", "0", 0);
+        }
+        // With a mapped reader the name only serves format probing by extension
+        ret = avformat_open_input(&m_formatCtx, url.c_str(), nullptr, &options);
+    }
     av_dict_free(&options);
     
+    if (ret != 0 && cancel.stop_requested()) return cancelled(); // Superseded, nobody waits for an error
     if (ret != 0) {
         char errbuf[1024];
         av_strerror(ret, errbuf, sizeof(errbuf));
@@ -90,6 +277,7 @@ bool VideoDecoder::open(const std::string& url) {
     }
 
     if (avformat_find_stream_info(m_formatCtx, nullptr) < 0) {
+        if (cancel.stop_requested()) return cancelled();
         std::string errorMsg = "Could not find stream info";
         std::cerr << errorMsg << std::endl;
         std::lock_guard<std::mutex> lock(m_callbackMutex);
@@ -99,20 +287,85 @@ bool VideoDecoder::open(const std::string& url) {
 
     // Find Video Stream
     m_videoStreamIndex = -1;
-    for (unsigned int i = 0; i < m_formatCtx->nb_streams; i++) {
-        if (m_formatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            m_videoStreamIndex = i;
-            break;
+    if (m_variants.setVariants(m_formatCtx)) {
+        // Adaptive source: start on what the downloads while probing support
+        m_variant = m_variants.initialVariant(m_autoWidth, m_autoHeight);
+        const VariantSelector::Variant& variant = m_variants.variants()[m_variant];
+        m_videoStreamIndex = variant.streamIndex;
+        std::lock_guard<std::mutex> lock(m_variantMutex);
+        m_currentVariant = variant;
+    } else {
+        for (unsigned int i = 0; i < m_formatCtx->nb_streams; i++) {
+            if (m_formatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+                m_videoStreamIndex = i;
+                break;
+            }
         }
     }
 
-    // Find Audio Stream
+    // Audio streams are listed for selection; decoding starts on the default one, else the first
     m_audioStreamIndex = -1;
-    for (unsigned int i = 0; i < m_formatCtx->nb_streams; i++) {
-        if (m_formatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-            m_audioStreamIndex = i;
-            break;
+    {
+        std::lock_guard<std::mutex> lock(m_audioMutex);
+        m_audioStreams.clear();
+        int selected = -1;
+        for (unsigned int i = 0; i < m_formatCtx->nb_streams; i++) {
+            const AVStream* stream = m_formatCtx->streams[i];
+            if (stream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) continue;
+
+            AudioStream info;
+            info.streamIndex = i;
+            if (const AVDictionaryEntry* entry = av_dict_get(stream->metadata, "language", nullptr, 0)) {
+                info.language = entry->value;
+            }
+            if (const AVDictionaryEntry* entry = av_dict_get(stream->metadata, "title", nullptr, 0)) {
+                info.title = entry->value;
+            }
+            info.channels = stream->codecpar->ch_layout.nb_channels;
+            info.sampleRate = stream->codecpar->sample_rate;
+
+            if (selected < 0 && (stream->disposition & AV_DISPOSITION_DEFAULT)) {
+                selected = (int)m_audioStreams.size();
+            }
+            m_audioStreams.push_back(info);
+        }
+        if (selected < 0 && !m_audioStreams.empty()) selected = 0;
+        if (m_variant >= 0) {
+            // The audio that comes with the starting variant, so no other playlist is fetched for it
+            const int streamIndex = audioStreamForVariant(m_variant);
+            for (size_t i = 0; i < m_audioStreams.size(); ++i) {
+                if (m_audioStreams[i].streamIndex == streamIndex) selected = (int)i;
+            }
+        }
+        m_requestedAudio = selected;
+        m_activeAudio = selected;
+    }
+
+    // Subtitle streams are listed for selection; decoding starts on the default one
+    {
+        std::lock_guard<std::mutex> lock(m_subtitleMutex);
+        int selected = -1;
+        for (unsigned int i = 0; i < m_formatCtx->nb_streams; i++) {
+            const AVStream* stream = m_formatCtx->streams[i];
+            if (stream->codecpar->codec_type != AVMEDIA_TYPE_SUBTITLE) continue;
+
+            SubtitleStream info;
+            info.streamIndex = i;
+            if (const AVDictionaryEntry* entry = av_dict_get(stream->metadata, "language", nullptr, 0)) {
+                info.language = entry->value;
+            }
+            if (const AVDictionaryEntry* entry = av_dict_get(stream->metadata, "title", nullptr, 0)) {
+                info.title = entry->value;
+            }
+            const AVCodecDescriptor* desc = avcodec_descriptor_get(stream->codecpar->codec_id);
+            info.bitmap = desc && (desc->props & AV_CODEC_PROP_BITMAP_SUB);
+
+            if (selected < 0 && (stream->disposition & AV_DISPOSITION_DEFAULT)) {
+                selected = (int)m_subtitleStreams.size();
+            }
+            m_subtitleStreams.push_back(info);
         }
+        m_requestedSubtitle = selected;
     }
 
     if (m_videoStreamIndex == -1) {
@@ -124,59 +377,28 @@ bool VideoDecoder::open(const std::string& url) {
     }
 
     // Init Video Codec
-    AVCodecParameters* codecPar = m_formatCtx->streams[m_videoStreamIndex]->codecpar;
-    m_codec = avcodec_find_decoder(codecPar->codec_id);
-    if (!m_codec) {
-        std::string errorMsg = "Unsupported video codec";
-        std::cerr << errorMsg << std::endl;
-        std::lock_guard<std::mutex> lock(m_callbackMutex);
-        if (m_onError) m_onError(errorMsg);
-        return false;
-    }
-
-    m_codecCtx = avcodec_alloc_context3(m_codec);
-    avcodec_parameters_to_context(m_codecCtx, codecPar);
-
-    if (avcodec_open2(m_codecCtx, m_codec, nullptr) < 0) {
-        std::string errorMsg = "Could not open video codec";
-        std::cerr << errorMsg << std::endl;
+    std::string videoError;
+    if (!openVideoStream(m_videoStreamIndex, videoError)) {
+        std::cerr << videoError << std::endl;
         std::lock_guard<std::mutex> lock(m_callbackMutex);
-        if (m_onError) m_onError(errorMsg);
+        if (m_onError) m_onError(videoError);
         return false;
     }
-
-    m_width = m_codecCtx->width;
-    m_height = m_codecCtx->height;
+    m_governor.reset();
 
     // Init Audio Codec
-    if (m_audioStreamIndex >= 0) {
-        AVCodecParameters* audioCodecPar = m_formatCtx->streams[m_audioStreamIndex]->codecpar;
-        m_audioCodec = avcodec_find_decoder(audioCodecPar->codec_id);
-        if (m_audioCodec) {
-            m_audioCodecCtx = avcodec_alloc_context3(m_audioCodec);
-            avcodec_parameters_to_context(m_audioCodecCtx, audioCodecPar);
-            if (avcodec_open2(m_audioCodecCtx, m_audioCodec, nullptr) == 0) {
-                // Init SwrContext for resampling to Stereo S16LE 44100Hz
-                m_swrCtx = swr_alloc();
-                
-                // Input properties
-                av_opt_set_chlayout(m_swrCtx, "in_chlayout", &m_audioCodecCtx->ch_layout, 0);
-                av_opt_set_int(m_swrCtx, "in_sample_rate", m_audioCodecCtx->sample_rate, 0);
-                av_opt_set_sample_fmt(m_swrCtx, "in_sample_fmt", m_audioCodecCtx->sample_fmt, 0);
-                
-                // Output properties (Stereo, 44100, S16)
-                AVChannelLayout out_layout = AV_CHANNEL_LAYOUT_STEREO;
-                av_opt_set_chlayout(m_swrCtx, "out_chlayout", &out_layout, 0);
-                av_opt_set_int(m_swrCtx, "out_sample_rate", 44100, 0);
-                av_opt_set_sample_fmt(m_swrCtx, "out_sample_fmt", AV_SAMPLE_FMT_S16, 0);
-                
-                swr_init(m_swrCtx);
-            } else {
-                std::cerr << "Could not open audio codec" << std::endl;
-                m_audioStreamIndex = -1; // Disable audio
-            }
+    if (m_activeAudio >= 0) {
+        int streamIndex;
+        {
+            std::lock_guard<std::mutex> lock(m_audioMutex);
+            streamIndex = m_audioStreams[m_activeAudio].streamIndex;
+        }
+        if (openAudioStream(streamIndex)) {
+            openAudioOutput(true);
         }
     }
+    // Everything not decoded is skipped by the demuxer instead of being read and dropped
+    updateStreamDiscard();
 
     if (m_width <= 0 || m_height <= 0) {
         std::string errorMsg = "Invalid video dimensions";
@@ -196,27 +418,117 @@ bool VideoDecoder::open(const std::string& url) {
     }
 
     m_frame = av_frame_alloc();
+    m_lastVideoFrame = av_frame_alloc();
     m_packet = av_packet_alloc();
+    m_heldPacket = av_packet_alloc();
+
+    if (cancel.stop_requested()) return cancelled();
 
     // Start decoding thread
     // m_stopThread is already false
     m_isPlaying = true;
-    m_seekTarget = -1.0;
+    {
+        std::lock_guard<std::mutex> controlLock(m_controlMutex);
+        m_seekTarget = -1.0;
+        m_commandPending = false;
+    }
     m_decodeThread = std::thread(&VideoDecoder::decodeLoop, this);
 
     return true;
 }
 
+void VideoDecoder::detectSphericalLayout(const AVCodecParameters* codecPar) {
+    m_spherical = SphericalInfo();
+
+    const AVPacketSideData* sphericalData = av_packet_side_data_get(
+        codecPar->coded_side_data, codecPar->nb_coded_side_data, AV_PKT_DATA_SPHERICAL);
+    if (sphericalData && sphericalData->size >= sizeof(AVSphericalMapping)) {
+        const AVSphericalMapping* mapping = reinterpret_cast<const AVSphericalMapping*>(sphericalData->data);
+        switch (mapping->projection) {
+        case AV_SPHERICAL_EQUIRECTANGULAR:
+            m_spherical.projection = Projection::Equirectangular;
+            break;
+        case AV_SPHERICAL_EQUIRECTANGULAR_TILE: {
+            // Bounds are 0.32 fixed point fractions of the full projection
+            const double left = mapping->bound_left / 4294967296.0;
+            const double top = mapping->bound_top / 4294967296.0;
+            const double right = mapping->bound_right / 4294967296.0;
+            const double bottom = mapping->bound_bottom / 4294967296.0;
+            if (left + right < 1.0 && top + bottom < 1.0) {
+                m_spherical.projection = Projection::Equirectangular;
+                m_spherical.boundLeft = left;
+                m_spherical.boundTop = top;
+                m_spherical.boundRight = right;
+                m_spherical.boundBottom = bottom;
+            }
+            break;
+        }
+        case AV_SPHERICAL_CUBEMAP:
+            // The Google spherical spec's cubemap in the wild is YouTube's equi-angular 3x2 layout
+            m_spherical.projection = Projection::EquiAngularCubemap;
+            break;
+        default:
+            break;
+        }
+    }
+
+    const AVPacketSideData* stereoData = av_packet_side_data_get(
+        codecPar->coded_side_data, codecPar->nb_coded_side_data, AV_PKT_DATA_STEREO3D);
+    if (stereoData && stereoData->size >= sizeof(AVStereo3D)) {
+        const AVStereo3D* stereo = reinterpret_cast<const AVStereo3D*>(stereoData->data);
+        if (stereo->type == AV_STEREO3D_TOPBOTTOM) {
+            m_spherical.stereo = StereoLayout::TopBottom;
+        } else if (stereo->type == AV_STEREO3D_SIDEBYSIDE) {
+            m_spherical.stereo = StereoLayout::SideBySide;
+        }
+        m_spherical.rightEyeFirst = (stereo->flags & AV_STEREO3D_FLAG_INVERT) != 0;
+    }
+}
+
 void VideoDecoder::close() {
     stop();
 }
 
+void VideoDecoder::setTimeShift(bool enabled, const TimeShiftBuffer::Retention& retention,
+                                const std::filesystem::path& directory) {
+    std::lock_guard<std::mutex> lock(m_timeShiftMutex);
+    m_timeShiftEnabled = enabled;
+    m_timeShiftRetention = retention;
+    m_timeShiftDirectory = directory;
+}
+
+bool VideoDecoder::isTimeShifting() const {
+    std::lock_guard<std::mutex> lock(m_timeShiftMutex);
+    return m_timeShift != nullptr;
+}
+
+TimeShiftBuffer::Window VideoDecoder::timeShiftWindow() const {
+    std::shared_ptr<TimeShiftBuffer> timeShift;
+    {
+        std::lock_guard<std::mutex> lock(m_timeShiftMutex);
+        timeShift = m_timeShift;
+    }
+    return timeShift ? timeShift->window() : TimeShiftBuffer::Window();
+}
+
+bool VideoDecoder::isLiveUrl(const std::string& url) {
+    const size_t end = url.find("://");
+    if (end == std::string::npos) return false;
+    std::string scheme = url.substr(0, end);
+    std::transform(scheme.begin(), scheme.end(), scheme.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    static const char* const liveSchemes[] = {"rtsp", "rtsps", "rtmp", "rtmps", "udp", "rtp", "srt", "tcp"};
+    return std::any_of(std::begin(liveSchemes), std::end(liveSchemes),
+                       [&scheme](const char* live) { return scheme == live; });
+}
+
 void VideoDecoder::play() {
     std::string urlToOpen;
     {
         std::lock_guard<std::mutex> lock(m_apiMutex);
         if (!m_stopThread) {
             m_isPlaying = true;
+            m_clock.setPaused(false);
+            wakeDecodeThread();
             return;
         }
         if (m_url.empty()) {
@@ -231,12 +543,15 @@ void VideoDecoder::play() {
 void VideoDecoder::pause() {
     std::lock_guard<std::mutex> lock(m_apiMutex);
     m_isPlaying = false;
+    m_clock.setPaused(true);
 }
 
 void VideoDecoder::stop() {
     std::lock_guard<std::mutex> lock(m_apiMutex);
     m_isPlaying = false;
     m_stopThread = true;
+    wakeDecodeThread();
+    m_frameQueue.abort(); // Wake the decode thread if it waits for a free frame
     if (m_decodeThread.joinable()) {
         m_decodeThread.join();
     }
@@ -248,13 +563,231 @@ double VideoDecoder::getDuration() const {
     return m_duration;
 }
 
-void VideoDecoder::seek(double seconds) {
-    if (seconds < 0.0 || (m_duration > 0.0 && seconds > m_duration)) return; // Out of bounds
+void VideoDecoder::seek(double seconds, SeekMode mode) {
+    const double duration = getDuration();
+    if (seconds < 0.0 || (duration > 0.0 && seconds > duration)) return; // Out of bounds
     {
         std::lock_guard<std::mutex> lock(m_audioMutex);
         m_audioBuffer.clear(); // Clear audio buffer on seek
+        m_audioClock = -1.0;
+    }
+    // Drop what is queued (this also frees a blocked decoder) and restart the timeline
+    // with the first frame after the seek
+    m_frameQueue.flush();
+    m_clock.invalidate();
+    m_subtitles.seek(seconds);
+    {
+        // A seek still pending is simply replaced
+        std::lock_guard<std::mutex> lock(m_controlMutex);
+        m_seekTarget = seconds;
+        m_seekMode = mode;
+        m_commandPending = true;
+    }
+    m_controlCondition.notify_one();
+}
+
+void VideoDecoder::wakeDecodeThread() {
+    {
+        std::lock_guard<std::mutex> lock(m_controlMutex);
+        m_commandPending = true;
+    }
+    m_controlCondition.notify_one();
+}
+
+double VideoDecoder::takeCommands(SeekMode& mode) {
+    // State read after this point is at least as new as the commands taken here,
+    // so a command arriving later leaves m_commandPending set and is not missed
+    std::lock_guard<std::mutex> lock(m_controlMutex);
+    m_commandPending = false;
+    const double target = m_seekTarget;
+    mode = m_seekMode;
+    m_seekTarget = -1.0;
+    return target;
+}
+
+void VideoDecoder::waitForCommand(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_controlMutex);
+    auto ready = [this]() { return m_commandPending || m_stopThread; };
+    if (timeout.count() > 0) {
+        m_controlCondition.wait_for(lock, timeout, ready);
+    } else {
+        m_controlCondition.wait(lock, ready);
+    }
+}
+
+std::vector<VideoDecoder::SubtitleStream> VideoDecoder::subtitleStreams() const {
+    std::lock_guard<std::mutex> lock(m_subtitleMutex);
+    return m_subtitleStreams;
+}
+
+void VideoDecoder::setSubtitleStream(int index) {
+    {
+        std::lock_guard<std::mutex> lock(m_subtitleMutex);
+        m_requestedSubtitle = (index >= 0 && index < (int)m_subtitleStreams.size()) ? index : -1;
+    }
+    wakeDecodeThread();
+}
+
+void VideoDecoder::applySubtitleSelection() {
+    const int requested = m_requestedSubtitle;
+    if (requested == m_activeSubtitle) return;
+
+    m_activeSubtitle = requested;
+    if (m_subtitleCodecCtx) avcodec_free_context(&m_subtitleCodecCtx);
+    m_subtitleStreamIndex = -1;
+    m_subtitles.flush();
+    updateStreamDiscard();
+
+    int streamIndex = -1;
+    {
+        std::lock_guard<std::mutex> lock(m_subtitleMutex);
+        if (requested >= 0 && requested < (int)m_subtitleStreams.size()) {
+            streamIndex = m_subtitleStreams[requested].streamIndex;
+        }
+    }
+    if (streamIndex < 0) return;
+
+    const AVStream* stream = m_formatCtx->streams[streamIndex];
+    const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        std::cerr << "Unsupported subtitle codec" << std::endl;
+        return;
+    }
+    m_subtitleCodecCtx = avcodec_alloc_context3(codec);
+    avcodec_parameters_to_context(m_subtitleCodecCtx, stream->codecpar);
+    m_subtitleCodecCtx->pkt_timebase = stream->time_base;
+    if (avcodec_open2(m_subtitleCodecCtx, codec, nullptr) < 0) {
+        std::cerr << "Could not open subtitle codec" << std::endl;
+        avcodec_free_context(&m_subtitleCodecCtx);
+        return;
+    }
+    m_subtitleStreamIndex = streamIndex;
+    updateStreamDiscard();
+}
+
+// ASS event lines are "ReadOrder,Layer,Style,Name,MarginL,MarginR,MarginV,Effect,Text".
+// Only the text is kept: override blocks are dropped and \N / \h become a line break / space.
+static std::string plainTextFromAss(const char* ass) {
+    const char* text = ass;
+    for (int field = 0; field < 8 && text; ++field) {
+        text = std::strchr(text, ',');
+        if (text) ++text;
+    }
+    if (!text) return std::string();
+
+    std::string plain;
+    bool inOverride = false;
+    for (const char* c = text; *c; ++c) {
+        if (inOverride) {
+            if (*c == '}') inOverride = false;
+        } else if (*c == '{') {
+            inOverride = true;
+        } else if (*c == '\\' && (c[1] == 'N' || c[1] == 'n')) {
+            plain += '\n';
+            ++c;
+        } else if (*c == '\\' && c[1] == 'h') {
+            plain += ' ';
+            ++c;
+        } else if (*c != '\r') {
+            plain += *c;
+        }
+    }
+    return plain;
+}
+
+void VideoDecoder::decodeSubtitle(AVPacket* packet) {
+    AVSubtitle sub;
+    int gotSubtitle = 0;
+    if (avcodec_decode_subtitle2(m_subtitleCodecCtx, &sub, &gotSubtitle, packet) < 0 || !gotSubtitle) return;
+
+    const AVRational tb = m_formatCtx->streams[m_subtitleStreamIndex]->time_base;
+    double base = 0.0;
+    if (sub.pts != AV_NOPTS_VALUE) {
+        base = (double)sub.pts / AV_TIME_BASE;
+    } else if (packet->pts != AV_NOPTS_VALUE) {
+        base = packet->pts * av_q2d(tb);
+    }
+
+    SubtitleEvent event;
+    event.start = base + sub.start_display_time / 1000.0;
+    if (sub.end_display_time > sub.start_display_time && sub.end_display_time != UINT32_MAX) {
+        event.end = base + sub.end_display_time / 1000.0;
+    } else if (packet->duration > 0) {
+        event.end = event.start + packet->duration * av_q2d(tb);
+    }
+    // Bitmap positions refer to the subtitle canvas, which defaults to the video size
+    event.canvasWidth = m_subtitleCodecCtx->width > 0 ? m_subtitleCodecCtx->width : m_width.load();
+    event.canvasHeight = m_subtitleCodecCtx->height > 0 ? m_subtitleCodecCtx->height : m_height.load();
+
+    for (unsigned int i = 0; i < sub.num_rects; ++i) {
+        const AVSubtitleRect* rect = sub.rects[i];
+        if (rect->type == SUBTITLE_BITMAP && rect->w > 0 && rect->h > 0 && rect->data[0] && rect->data[1]) {
+            // PAL8 with a 0xAARRGGBB palette, premultiplied once here so the view can upload it as is
+            const uint32_t* palette = reinterpret_cast<const uint32_t*>(rect->data[1]);
+            SubtitleBitmap bitmap;
+            bitmap.x = rect->x;
+            bitmap.y = rect->y;
+            bitmap.width = rect->w;
+            bitmap.height = rect->h;
+            bitmap.pixels.resize((size_t)rect->w * rect->h);
+            for (int y = 0; y < rect->h; ++y) {
+                const uint8_t* src = rect->data[0] + (size_t)y * rect->linesize[0];
+                uint32_t* dst = bitmap.pixels.data() + (size_t)y * rect->w;
+                for (int x = 0; x < rect->w; ++x) {
+                    const uint32_t c = palette[src[x]];
+                    const uint32_t a = c >> 24;
+                    const uint32_t r = (((c >> 16) & 0xff) * a + 127) / 255;
+                    const uint32_t g = (((c >> 8) & 0xff) * a + 127) / 255;
+                    const uint32_t b = ((c & 0xff) * a + 127) / 255;
+                    dst[x] = (a << 24) | (r << 16) | (g << 8) | b;
+                }
+            }
+            event.bitmaps.push_back(std::move(bitmap));
+        } else if (rect->type == SUBTITLE_ASS && rect->ass) {
+            std::string line = plainTextFromAss(rect->ass);
+            if (!line.empty()) event.text += (event.text.empty() ? "" : "\n") + line;
+        } else if (rect->type == SUBTITLE_TEXT && rect->text) {
+            event.text += (event.text.empty() ? "" : "\n") + std::string(rect->text);
+        }
+    }
+    avsubtitle_free(&sub);
+
+    m_subtitles.push(std::move(event));
+}
+
+// A text cue showing at a seek target usually started before the keyframe the demuxer lands on
+// and is not read again. With an index on the subtitle stream (MKV cues, MP4 sample tables) the
+// cues just before the target are read first; the seek that follows repositions every stream.
+void VideoDecoder::preRollSubtitles(double target) {
+    if (!m_subtitleCodecCtx || m_subtitleStreamIndex < 0 || m_timeShift) return;
+    AVStream* stream = m_formatCtx->streams[m_subtitleStreamIndex];
+    const AVCodecDescriptor* descriptor = avcodec_descriptor_get(stream->codecpar->codec_id);
+    if (!descriptor || !(descriptor->props & AV_CODEC_PROP_TEXT_SUB)) return;
+    if (avformat_index_get_entries_count(stream) <= 0) return;
+
+    const int64_t ts = av_rescale_q((int64_t)(target * AV_TIME_BASE), AV_TIME_BASE_Q, stream->time_base);
+    int entry = av_index_search_timestamp(stream, ts, AVSEEK_FLAG_BACKWARD);
+    if (entry < 0) return;
+    // A few earlier cues as well: a long line can still be showing under shorter ones after it
+    entry = std::max(0, entry - m_subtitlePreRollCues);
+    const AVIndexEntry* indexEntry = avformat_index_get_entry(stream, entry);
+    if (!indexEntry || av_seek_frame(m_formatCtx, m_subtitleStreamIndex, indexEntry->timestamp, AVSEEK_FLAG_BACKWARD) < 0) return;
+    m_subtitles.flush(); // Everything showing at the target is read again below
+
+    // Only the subtitle stream is read; the demuxer skips over everything else
+    for (unsigned int i = 0; i < m_formatCtx->nb_streams; i++) {
+        if ((int)i != m_subtitleStreamIndex) m_formatCtx->streams[i]->discard = AVDISCARD_ALL;
+    }
+    AVPacket* packet = av_packet_alloc();
+    for (int read = 0; packet && read < m_subtitlePreRollPackets && av_read_frame(m_formatCtx, packet) >= 0; ++read) {
+        const bool cue = packet->stream_index == m_subtitleStreamIndex;
+        const bool past = cue && packet->pts != AV_NOPTS_VALUE && packet->pts > ts;
+        if (cue && !past) decodeSubtitle(packet);
+        av_packet_unref(packet);
+        if (past) break;
     }
-    m_seekTarget.store(seconds, std::memory_order_relaxed); // Set seek target
+    av_packet_free(&packet);
+    updateStreamDiscard();
 }
 
 void VideoDecoder::setFrameCallback(FrameCallback callback) {
@@ -274,17 +807,545 @@ void VideoDecoder::setEndCallback(EndCallback callback) {
 
 int VideoDecoder::getAudioData(uint8_t* data, int max_size) {
     std::lock_guard<std::mutex> lock(m_audioMutex);
-    if (m_audioBuffer.empty()) return 0;
-    
-    int to_copy = std::min((int)m_audioBuffer.size(), max_size);
-    memcpy(data, m_audioBuffer.data(), to_copy);
-    
-    // Remove read data
-    m_audioBuffer.erase(m_audioBuffer.begin(), m_audioBuffer.begin() + to_copy);
+    max_size -= max_size % m_audioFormat.bytesPerFrame(); // Whole sample frames only
+    if (m_audioBuffer.empty() || max_size <= 0) return 0;
+
+    int to_copy = (int)m_audioBuffer.read(data, (size_t)max_size);
+    m_audioClock = m_audioBufferEndPts - (double)m_audioBuffer.size() / m_audioFormat.bytesPerSecond();
     
     return to_copy;
 }
 
+void VideoDecoder::setAudioDeviceFormat(const AudioFormat& preferred, int maxChannels) {
+    std::lock_guard<std::mutex> lock(m_audioMutex);
+    m_deviceAudioFormat = preferred;
+    m_deviceMaxChannels = std::max(maxChannels, preferred.channels);
+}
+
+VideoDecoder::AudioFormat VideoDecoder::audioFormat() const {
+    std::lock_guard<std::mutex> lock(m_audioMutex);
+    return m_audioFormat;
+}
+
+static AVSampleFormat toAVSampleFormat(VideoDecoder::AudioFormat::SampleType type) {
+    switch (type) {
+    case VideoDecoder::AudioFormat::SampleType::Int32: return AV_SAMPLE_FMT_S32;
+    case VideoDecoder::AudioFormat::SampleType::Float: return AV_SAMPLE_FMT_FLT;
+    default: return AV_SAMPLE_FMT_S16;
+    }
+}
+
+bool VideoDecoder::openAudioStream(int streamIndex) {
+    if (m_audioCodecCtx) avcodec_free_context(&m_audioCodecCtx);
+    m_audioStreamIndex = -1;
+
+    AVCodecParameters* audioCodecPar = m_formatCtx->streams[streamIndex]->codecpar;
+    m_audioCodec = avcodec_find_decoder(audioCodecPar->codec_id);
+    if (!m_audioCodec) {
+        std::cerr << "Unsupported audio codec" << std::endl;
+        return false;
+    }
+    m_audioCodecCtx = avcodec_alloc_context3(m_audioCodec);
+    avcodec_parameters_to_context(m_audioCodecCtx, audioCodecPar);
+    if (avcodec_open2(m_audioCodecCtx, m_audioCodec, nullptr) < 0) {
+        std::cerr << "Could not open audio codec" << std::endl;
+        avcodec_free_context(&m_audioCodecCtx);
+        return false;
+    }
+    m_audioStreamIndex = streamIndex;
+    return true;
+}
+
+void VideoDecoder::openAudioOutput(bool negotiate) {
+    const AVChannelLayout& inLayout = m_audioCodecCtx->ch_layout;
+    if (m_swrCtx) swr_free(&m_swrCtx);
+
+    AudioFormat format;
+    {
+        std::lock_guard<std::mutex> lock(m_audioMutex);
+        if (negotiate) {
+            format = m_deviceAudioFormat;
+            // Multichannel sources pass through when the device has the channels for them
+            if (inLayout.nb_channels > 0 && inLayout.nb_channels <= m_deviceMaxChannels) {
+                format.channels = inLayout.nb_channels;
+            }
+        } else {
+            // Track switch: the sink keeps running, so the new track is converted to its format
+            format = m_audioFormat;
+        }
+    }
+
+    AVChannelLayout outLayout = {};
+    if (format.channels == inLayout.nb_channels) {
+        av_channel_layout_copy(&outLayout, &inLayout);
+    } else {
+        av_channel_layout_default(&outLayout, format.channels);
+    }
+    const AVSampleFormat outSampleFmt = toAVSampleFormat(format.sampleType);
+
+    // Already what the device plays: decoded frames go into the ring buffer untouched
+    const bool passthrough = m_audioCodecCtx->sample_rate == format.sampleRate
+        && m_audioCodecCtx->sample_fmt == outSampleFmt
+        && av_channel_layout_compare(&inLayout, &outLayout) == 0;
+
+    if (!passthrough) {
+        if (swr_alloc_set_opts2(&m_swrCtx, &outLayout, outSampleFmt, format.sampleRate,
+                                &inLayout, m_audioCodecCtx->sample_fmt, m_audioCodecCtx->sample_rate, 0, nullptr) < 0
+            || swr_init(m_swrCtx) < 0) {
+            std::cerr << "Could not init audio resampler" << std::endl;
+            if (m_swrCtx) swr_free(&m_swrCtx);
+            m_audioStreamIndex = -1; // Disable audio
+            av_channel_layout_uninit(&outLayout);
+            return;
+        }
+        // Sized for a typical decoded frame up front; queueAudio() only grows it for larger ones
+        m_audioConvertBuffer.resize((size_t)format.bytesPerFrame() * 8192);
+    }
+    av_channel_layout_uninit(&outLayout);
+    if (!negotiate) return;
+
+    std::lock_guard<std::mutex> lock(m_audioMutex);
+    m_audioFormat = format;
+    m_audioBuffer.reset((size_t)(format.bytesPerSecond() * m_audioBufferSeconds));
+}
+
+std::vector<VideoDecoder::AudioStream> VideoDecoder::audioStreams() const {
+    std::lock_guard<std::mutex> lock(m_audioMutex);
+    return m_audioStreams;
+}
+
+void VideoDecoder::setAudioStream(int index) {
+    {
+        std::lock_guard<std::mutex> lock(m_audioMutex);
+        if (index >= 0 && index < (int)m_audioStreams.size()) {
+            m_requestedAudio = index;
+        }
+    }
+    wakeDecodeThread();
+}
+
+void VideoDecoder::applyAudioSelection() {
+    const int requested = m_requestedAudio;
+    if (requested == m_activeAudio || requested < 0) return;
+
+    int streamIndex;
+    {
+        std::lock_guard<std::mutex> lock(m_audioMutex);
+        streamIndex = m_audioStreams[requested].streamIndex;
+    }
+    m_activeAudio = requested;
+
+    // Only the audio side restarts; video, subtitles and the clock keep running
+    if (openAudioStream(streamIndex)) {
+        openAudioOutput(false);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_audioMutex);
+        m_audioBuffer.clear();
+        m_audioClock = -1.0;
+    }
+    m_audioResync = true;
+    updateStreamDiscard();
+}
+
+void VideoDecoder::updateStreamDiscard() {
+    const int pendingVideo = m_pendingVariant >= 0 ? m_variants.variants()[m_pendingVariant].streamIndex : -1;
+    for (unsigned int i = 0; i < m_formatCtx->nb_streams; i++) {
+        const int index = (int)i;
+        const bool used = index == m_videoStreamIndex || index == m_audioStreamIndex || index == m_subtitleStreamIndex
+            || index == pendingVideo || index == m_pendingAudioStreamIndex;
+        m_formatCtx->streams[i]->discard = used ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+}
+
+bool VideoDecoder::openVideoStream(int streamIndex, std::string& error) {
+    // The new decoder is opened before the old one is dropped, so a failed variant switch keeps playing
+    AVCodecParameters* codecPar = m_formatCtx->streams[streamIndex]->codecpar;
+    const AVCodec* codec = avcodec_find_decoder(codecPar->codec_id);
+    if (!codec) {
+        error = "Unsupported video codec";
+        return false;
+    }
+    AVCodecContext* codecCtx = avcodec_alloc_context3(codec);
+    avcodec_parameters_to_context(codecCtx, codecPar);
+    if (avcodec_open2(codecCtx, codec, nullptr) < 0) {
+        avcodec_free_context(&codecCtx);
+        error = "Could not open video codec";
+        return false;
+    }
+
+    if (m_codecCtx) avcodec_free_context(&m_codecCtx);
+    m_codec = codec;
+    m_codecCtx = codecCtx;
+    m_videoStreamIndex = streamIndex;
+    m_width = m_codecCtx->width;
+    m_height = m_codecCtx->height;
+    detectSphericalLayout(codecPar);
+
+    AVRational frameRate = av_guess_frame_rate(m_formatCtx, m_formatCtx->streams[streamIndex], nullptr);
+    m_frameInterval = (frameRate.num > 0 && frameRate.den > 0) ? av_q2d(av_inv_q(frameRate)) : 1.0 / 30.0;
+    return true;
+}
+
+VariantSelector::Variant VideoDecoder::streamVariant() const {
+    std::lock_guard<std::mutex> lock(m_variantMutex);
+    return m_currentVariant;
+}
+
+int VideoDecoder::audioStreamForVariant(int variant) const {
+    // HLS puts every variant into a program with the audio it plays with; audio renditions shared
+    // between variants are in several programs, and DASH has a single program for everything
+    const unsigned int videoStream = (unsigned int)m_variants.variants()[variant].streamIndex;
+    for (unsigned int i = 0; i < m_formatCtx->nb_programs; i++) {
+        const AVProgram* program = m_formatCtx->programs[i];
+        const unsigned int* begin = program->stream_index;
+        const unsigned int* end = begin + program->nb_stream_indexes;
+        if (std::find(begin, end, videoStream) == end) continue;
+        if (m_audioStreamIndex >= 0 && std::find(begin, end, (unsigned int)m_audioStreamIndex) != end) {
+            return m_audioStreamIndex;
+        }
+
+        // The variant's own copy of the track: same language if tagged, else its first audio
+        const AVDictionaryEntry* language = m_audioStreamIndex >= 0
+            ? av_dict_get(m_formatCtx->streams[m_audioStreamIndex]->metadata, "language", nullptr, 0) : nullptr;
+        int first = -1;
+        for (const unsigned int* index = begin; index != end; ++index) {
+            const AVStream* stream = m_formatCtx->streams[*index];
+            if (stream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) continue;
+            if (first < 0) first = (int)*index;
+            const AVDictionaryEntry* entry = av_dict_get(stream->metadata, "language", nullptr, 0);
+            if (language && entry && std::strcmp(language->value, entry->value) == 0) return (int)*index;
+        }
+        if (first >= 0) return first;
+    }
+    return m_audioStreamIndex;
+}
+
+void VideoDecoder::requestVariant(int variant) {
+    m_pendingVariant = variant;
+    m_pendingVariantSince = av_gettime_relative();
+    const int audio = audioStreamForVariant(variant);
+    m_pendingAudioStreamIndex = audio != m_audioStreamIndex ? audio : -1;
+    // The demuxer fetches the variant from the segment at the current position; the old one keeps
+    // playing until the new one's first keyframe arrives
+    updateStreamDiscard();
+}
+
+void VideoDecoder::cancelVariantSwitch() {
+    if (m_pendingVariant < 0) return;
+    av_packet_unref(m_heldPacket);
+    m_pendingVariant = -1;
+    m_pendingAudioStreamIndex = -1;
+    updateStreamDiscard();
+}
+
+void VideoDecoder::completeVariantSwitch() {
+    // The old decoder has been drained; its last frames are queued
+    const int from = m_variant;
+    const int to = m_pendingVariant;
+    const VariantSelector::Variant variant = m_variants.variants()[to];
+    std::string error;
+    if (!openVideoStream(variant.streamIndex, error)) {
+        // Stays on the old variant, which picks up again at its next keyframe
+        std::cerr << "Variant switch failed: " << error << std::endl;
+        avcodec_flush_buffers(m_codecCtx);
+        cancelVariantSwitch();
+        return;
+    }
+    m_variant = to;
+    // The new variant starts at a segment boundary, usually before what the old one already showed
+    m_variantSkipPts = m_lastQueuedVideoPts;
+
+    if (m_pendingAudioStreamIndex >= 0 && openAudioStream(m_pendingAudioStreamIndex)) {
+        // The sink keeps running in its format; the new track continues where the buffer ends
+        openAudioOutput(false);
+        std::lock_guard<std::mutex> lock(m_audioMutex);
+        m_variantAudioSkipPts = m_audioBufferEndPts;
+        for (size_t i = 0; i < m_audioStreams.size(); ++i) {
+            if (m_audioStreams[i].streamIndex != m_audioStreamIndex) continue;
+            m_activeAudio = (int)i;
+            m_requestedAudio = (int)i;
+        }
+    }
+    m_pendingVariant = -1;
+    m_pendingAudioStreamIndex = -1;
+    updateStreamDiscard();
+
+    // New picture size: the scaler is set up again, and the governor measures the new variant afresh
+    if (m_swsCtx) sws_freeContext(m_swsCtx);
+    m_swsCtx = nullptr;
+    av_frame_unref(m_lastVideoFrame);
+    m_governor.reset();
+    m_variants.switched(from, to);
+    {
+        std::lock_guard<std::mutex> lock(m_variantMutex);
+        m_currentVariant = variant;
+    }
+}
+
+void VideoDecoder::setViewWindow(double yaw, double pitch, double fov, double aspect) {
+    {
+        std::lock_guard<std::mutex> lock(m_viewMutex);
+        m_viewWindow.yaw = yaw;
+        m_viewWindow.pitch = pitch;
+        m_viewWindow.fov = fov;
+        m_viewWindow.aspect = aspect;
+    }
+    m_viewWindowEnabled = true;
+    m_viewWindowChanged = true;
+    wakeDecodeThread();
+}
+
+void VideoDecoder::clearViewWindow() {
+    m_viewWindowEnabled = false;
+    m_viewWindowChanged = true;
+    wakeDecodeThread();
+}
+
+bool VideoDecoder::visibleTiles(int dstWidth, int dstHeight, EquirectTiles::Mask& tiles) const {
+    if (!m_viewWindowEnabled) return false;
+
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(m_codecCtx->pix_fmt);
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_PAL))) {
+        return false;
+    }
+    // Packed subsampled formats (e.g. YUYV) cannot be cropped per plane
+    if ((desc->log2_chroma_w || desc->log2_chroma_h) && !(desc->flags & AV_PIX_FMT_FLAG_PLANAR)) {
+        return false;
+    }
+    // Source tiles must start on chroma sample boundaries, destination tiles must be whole pixels
+    if (m_width % (EquirectTiles::Columns << desc->log2_chroma_w) != 0 ||
+        m_height % (EquirectTiles::Rows << desc->log2_chroma_h) != 0 ||
+        dstWidth % EquirectTiles::Columns != 0 || dstHeight % EquirectTiles::Rows != 0) {
+        return false;
+    }
+
+    EquirectTiles::View view;
+    {
+        std::lock_guard<std::mutex> lock(m_viewMutex);
+        view = m_viewWindow;
+    }
+    tiles = EquirectTiles::visibleTiles(view, m_viewMarginDegrees);
+    return true;
+}
+
+void VideoDecoder::prefetchGops(double seconds) {
+    // The container's keyframe index says where the next GOPs sit, so the disk can fetch them in
+    // one go before the demuxer gets there. Sources without an index rely on the file's readahead.
+    AVStream* stream = m_formatCtx->streams[m_videoStreamIndex];
+    const int count = avformat_index_get_entries_count(stream);
+    if (count <= 0) return;
+    const int64_t ts = av_rescale_q((int64_t)(seconds * AV_TIME_BASE), AV_TIME_BASE_Q, stream->time_base);
+    const int first = av_index_search_timestamp(stream, ts, AVSEEK_FLAG_BACKWARD);
+    if (first < 0) return;
+    const int64_t begin = avformat_index_get_entry(stream, first)->pos;
+
+    int64_t end = -1;
+    int keyframes = 0;
+    for (int i = first + 1; i < count; ++i) {
+        const AVIndexEntry* entry = avformat_index_get_entry(stream, i);
+        if (!(entry->flags & AVINDEX_KEYFRAME)) continue;
+        end = entry->pos;
+        if (++keyframes == m_prefetchGops) break;
+    }
+    if (end <= begin) end = begin + m_maxPrefetchBytes; // Last GOPs, or an index out of file order
+    m_mappedFile->prefetch(begin, std::min(end - begin, m_maxPrefetchBytes));
+}
+
+static YuvConverter::Format yuvFormatFor(AVPixelFormat format) {
+    switch (format) {
+    case AV_PIX_FMT_YUV420P: return YuvConverter::Format::Yuv420p;
+    case AV_PIX_FMT_YUVJ420P: return YuvConverter::Format::Yuvj420p;
+    case AV_PIX_FMT_NV12: return YuvConverter::Format::Nv12;
+    case AV_PIX_FMT_YUV420P10LE: return YuvConverter::Format::Yuv420p10le;
+    default: return YuvConverter::Format::Unsupported;
+    }
+}
+
+bool VideoDecoder::convertVideoFrame(const AVFrame* src, AVFrame* dst, int dstWidth, int dstHeight,
+                                     bool onlyMissingTiles, std::vector<Frame::Region>& regions) {
+    regions.clear();
+
+    EquirectTiles::Mask tiles;
+    if (!visibleTiles(dstWidth, dstHeight, tiles)) {
+        if (onlyMissingTiles) return false;
+        // 1:1 and 2:1 of the common formats go through the SIMD kernels, everything else through swscale
+        if (!m_yuvConverter.convert(yuvFormatFor(m_codecCtx->pix_fmt), src->data, src->linesize, m_width, m_height,
+                                    dst->data[0], dst->linesize[0], dstWidth, dstHeight)) {
+            sws_scale(m_swsCtx, (const uint8_t* const*)src->data, src->linesize, 0, m_height,
+                      dst->data, dst->linesize);
+        }
+        return true;
+    }
+
+    if (onlyMissingTiles) {
+        tiles &= ~m_convertedTiles;
+        m_convertedTiles |= tiles;
+    } else {
+        m_convertedTiles = tiles;
+    }
+    if (tiles.none()) return false; // Nothing to convert, the frame would carry no content
+
+    const int srcTileWidth = m_width / EquirectTiles::Columns;
+    const int srcTileHeight = m_height / EquirectTiles::Rows;
+    const int dstTileWidth = dstWidth / EquirectTiles::Columns;
+    const int dstTileHeight = dstHeight / EquirectTiles::Rows;
+
+    m_tileSwsCtx = sws_getCachedContext(m_tileSwsCtx, srcTileWidth, srcTileHeight, m_codecCtx->pix_fmt,
+                                        dstTileWidth, dstTileHeight, AV_PIX_FMT_RGBA,
+                                        m_scaleFlags, nullptr, nullptr, nullptr);
+    if (!m_tileSwsCtx) return false;
+
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(m_codecCtx->pix_fmt);
+    int pixelSteps[4] = {0};
+    av_image_fill_max_pixsteps(pixelSteps, nullptr, desc);
+
+    for (int row = 0; row < EquirectTiles::Rows; ++row) {
+        int runStart = -1;
+        for (int column = 0; column <= EquirectTiles::Columns; ++column) {
+            bool converted = column < EquirectTiles::Columns && tiles.test(EquirectTiles::index(column, row));
+            if (converted) {
+                int srcX = column * srcTileWidth;
+                int srcY = row * srcTileHeight;
+                const uint8_t* srcData[4] = {nullptr};
+                for (int plane = 0; plane < 4 && src->data[plane]; ++plane) {
+                    bool chroma = plane == 1 || plane == 2;
+                    int shiftX = chroma ? desc->log2_chroma_w : 0;
+                    int shiftY = chroma ? desc->log2_chroma_h : 0;
+                    srcData[plane] = src->data[plane] + (ptrdiff_t)(srcY >> shiftY) * src->linesize[plane]
+                                     + (ptrdiff_t)(srcX >> shiftX) * pixelSteps[plane];
+                }
+                uint8_t* dstData[4] = {dst->data[0] + (ptrdiff_t)row * dstTileHeight * dst->linesize[0]
+                                       + (ptrdiff_t)column * dstTileWidth * 4, nullptr, nullptr, nullptr};
+                sws_scale(m_tileSwsCtx, srcData, src->linesize, 0, srcTileHeight, dstData, dst->linesize);
+
+                if (runStart < 0) runStart = column;
+            } else if (runStart >= 0) {
+                // Merge horizontally adjacent tiles so the renderer uploads one rect per run
+                regions.push_back({runStart * dstTileWidth, row * dstTileHeight,
+                                   (column - runStart) * dstTileWidth, dstTileHeight});
+                runStart = -1;
+            }
+        }
+    }
+    return true;
+}
+
+bool VideoDecoder::isHighBitDepthFormat(int format) {
+    switch (format) {
+    case AV_PIX_FMT_YUV420P10LE:
+    case AV_PIX_FMT_YUV420P12LE:
+    case AV_PIX_FMT_P010LE:
+    case AV_PIX_FMT_P016LE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+size_t VideoDecoder::planarFrameSize(const AVFrame* src) {
+    // 16-bit luma plus two 16-bit chroma samples per 2x2 block, whatever the plane layout
+    size_t chromaSamples = (size_t)((src->width + 1) / 2) * ((src->height + 1) / 2);
+    return 2 * ((size_t)src->width * src->height + 2 * chromaSamples);
+}
+
+void VideoDecoder::fillPlanarFrame(const AVFrame* src, Frame& dst) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)src->format);
+    const int chromaWidth = (src->width + 1) / 2;
+    const int chromaHeight = (src->height + 1) / 2;
+    const bool interleaved = desc->comp[1].plane == desc->comp[2].plane;
+
+    dst.format = interleaved ? Frame::PixelFormat::P016 : Frame::PixelFormat::Yuv420P16;
+    dst.bitDepth = desc->comp[0].depth;
+    dst.msbAligned = desc->comp[0].shift > 0;
+    dst.width = src->width;
+    dst.height = src->height;
+
+    dst.planeOffset[0] = 0;
+    dst.planeStride[0] = src->width * 2;
+    dst.planeOffset[1] = dst.planeStride[0] * src->height;
+    dst.planeStride[1] = chromaWidth * (interleaved ? 4 : 2);
+    dst.planeOffset[2] = interleaved ? 0 : dst.planeOffset[1] + dst.planeStride[1] * chromaHeight;
+    dst.planeStride[2] = interleaved ? 0 : chromaWidth * 2;
+    dst.linesize = dst.planeStride[0];
+
+    const int planes = interleaved ? 2 : 3;
+    for (int plane = 0; plane < planes; ++plane) {
+        av_image_copy_plane(dst.pixels.data() + dst.planeOffset[plane], dst.planeStride[plane],
+                            src->data[plane], src->linesize[plane],
+                            dst.planeStride[plane], plane == 0 ? src->height : chromaHeight);
+    }
+    dst.color = describeColor(src);
+}
+
+VideoDecoder::Frame::Colorimetry VideoDecoder::describeColor(const AVFrame* src) {
+    using Colorimetry = Frame::Colorimetry;
+    Colorimetry color;
+
+    switch (src->colorspace) {
+    case AVCOL_SPC_BT2020_NCL:
+    case AVCOL_SPC_BT2020_CL:
+        color.matrix = Colorimetry::Matrix::Bt2020;
+        break;
+    case AVCOL_SPC_BT709:
+        color.matrix = Colorimetry::Matrix::Bt709;
+        break;
+    case AVCOL_SPC_BT470BG:
+    case AVCOL_SPC_SMPTE170M:
+        color.matrix = Colorimetry::Matrix::Bt601;
+        break;
+    default:
+        // Untagged: SD is 601, everything larger 709
+        color.matrix = src->height > 576 ? Colorimetry::Matrix::Bt709 : Colorimetry::Matrix::Bt601;
+        break;
+    }
+
+    if (src->color_trc == AVCOL_TRC_SMPTE2084) {
+        color.transfer = Colorimetry::Transfer::Pq;
+    } else if (src->color_trc == AVCOL_TRC_ARIB_STD_B67) {
+        color.transfer = Colorimetry::Transfer::Hlg;
+    }
+    color.bt2020Primaries = src->color_primaries == AVCOL_PRI_BT2020;
+    color.fullRange = src->color_range == AVCOL_RANGE_JPEG;
+
+    // Prefer MaxCLL, fall back to the mastering display peak
+    if (const AVFrameSideData* sd = av_frame_get_side_data(src, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL)) {
+        const AVContentLightMetadata* light = reinterpret_cast<const AVContentLightMetadata*>(sd->data);
+        if (light->MaxCLL > 0) m_peakLuminance = (float)light->MaxCLL;
+    } else if (const AVFrameSideData* sd = av_frame_get_side_data(src, AV_FRAME_DATA_MASTERING_DISPLAY_METADATA)) {
+        const AVMasteringDisplayMetadata* mastering = reinterpret_cast<const AVMasteringDisplayMetadata*>(sd->data);
+        if (mastering->has_luminance && av_q2d(mastering->max_luminance) > 0.0) {
+            m_peakLuminance = (float)av_q2d(mastering->max_luminance);
+        }
+    }
+    color.peakLuminance = m_peakLuminance;
+    return color;
+}
+
+void VideoDecoder::applyQualityLevel(DecodeGovernor::Level level) {
+    m_scaleFlags = level >= DecodeGovernor::Level::FastScaler ? SWS_FAST_BILINEAR : SWS_BILINEAR;
+    // Both are read by the codec per frame (and copied to frame threads), so they apply mid-stream
+    m_codecCtx->skip_loop_filter = level >= DecodeGovernor::Level::SkipLoopFilter ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    m_codecCtx->skip_frame = level >= DecodeGovernor::Level::SkipNonReference ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+}
+
+std::shared_ptr<const AVFrame> VideoDecoder::shareFrame(const AVFrame* frame) {
+    // A new reference to the decoder's buffers, not a copy of the pixels
+    AVFrame* ref = av_frame_clone(frame);
+    if (!ref) return nullptr;
+    return std::shared_ptr<const AVFrame>(ref, [](const AVFrame* released) {
+        AVFrame* owned = const_cast<AVFrame*>(released);
+        av_frame_free(&owned);
+    });
+}
+
+void VideoDecoder::queueFrame(FramePtr frame) {
+    if (!frame->refresh) m_lastQueuedVideoPts = frame->pts;
+    m_frameQueue.push(std::move(frame));
+    std::lock_guard<std::mutex> lock(m_callbackMutex);
+    if (m_onFrame) m_onFrame();
+}
+
 int VideoDecoder::interrupt_cb(void* ctx) {
     VideoDecoder* decoder = static_cast<VideoDecoder*>(ctx);
     return decoder->checkTimeout() ? 1 : 0;
@@ -292,6 +1353,7 @@ int VideoDecoder::interrupt_cb(void* ctx) {
 
 bool VideoDecoder::checkTimeout() const {
     if (m_stopThread) return true;
+    if (m_openCancel.stop_requested()) return true;
     
     int64_t currentTime = av_gettime();
     if (currentTime - m_lastPacketTime > m_timeoutMicroseconds) {
@@ -300,6 +1362,62 @@ bool VideoDecoder::checkTimeout() const {
     return false;
 }
 
+void VideoDecoder::queueAudio(AVFrame* frame, double pts) {
+    AudioFormat format;
+    {
+        // 先检查音频缓冲区是否已满（避免 OOM）
+        std::lock_guard<std::mutex> lock(m_audioMutex);
+        if (m_audioBuffer.freeSpace() == 0) return;
+        format = m_audioFormat;
+    }
+
+    // After a track switch the new stream is lined up with the picture: frames that are
+    // already behind it are dropped and a gap before the first one is filled with silence
+    if (m_audioResync) {
+        if (pts < 0.0 || !m_clock.isStarted()) {
+            m_audioResync = false;
+        } else {
+            const double now = m_clock.time();
+            if (frame->sample_rate > 0 && pts + (double)frame->nb_samples / frame->sample_rate <= now) return;
+            m_audioResync = false;
+            if (pts > now) {
+                std::lock_guard<std::mutex> lock(m_audioMutex);
+                m_audioBuffer.writeSilence((size_t)((pts - now) * format.sampleRate) * format.bytesPerFrame());
+                m_audioBufferEndPts = pts;
+            }
+        }
+    }
+
+    const uint8_t* samples = frame->data[0];
+    int sampleCount = frame->nb_samples;
+    if (m_swrCtx) {
+        // 计算输出样本数（包含重采样器内部延迟）
+        int64_t delay = swr_get_delay(m_swrCtx, m_audioCodecCtx->sample_rate);
+        int dstSamples = (int)av_rescale_rnd(delay + frame->nb_samples, format.sampleRate,
+                                             m_audioCodecCtx->sample_rate, AV_ROUND_UP);
+        if (dstSamples <= 0) return;
+
+        // 输出缓冲区只在不够大时增长，之后一直复用
+        size_t needed = (size_t)dstSamples * format.bytesPerFrame();
+        if (m_audioConvertBuffer.size() < needed) m_audioConvertBuffer.resize(needed);
+
+        uint8_t* output = m_audioConvertBuffer.data();
+        sampleCount = swr_convert(m_swrCtx, &output, dstSamples, (const uint8_t**)frame->data, frame->nb_samples);
+        samples = output;
+    }
+    if (sampleCount <= 0) return;
+
+    size_t bytes = (size_t)sampleCount * format.bytesPerFrame();
+    std::lock_guard<std::mutex> lock(m_audioMutex);
+    if (bytes <= m_audioBuffer.freeSpace()) {
+        m_audioBuffer.write(samples, bytes);
+        // Track the PTS at the end of the buffer for the audio clock
+        double startPts = pts >= 0.0 ? pts : m_audioBufferEndPts;
+        m_audioBufferEndPts = startPts + (double)sampleCount / format.sampleRate;
+    }
+    // 缓冲区放不下时静默丢弃（避免 OOM）
+}
+
 void VideoDecoder::decodeLoop() {
     if (!m_formatCtx || !m_codecCtx) return;
 
@@ -308,45 +1426,128 @@ void VideoDecoder::decodeLoop() {
 
     int currentDstWidth = 0;
     int currentDstHeight = 0;
-    uint8_t* buffer = nullptr;
+    DecodeGovernor::Level currentLevel = DecodeGovernor::Level::Full;
+    applyQualityLevel(currentLevel);
+
+    // Feeds the governor once a frame is queued; work excludes waiting for a free pooled frame
+    auto reportFrame = [this](double work, double pts) {
+        if (!m_isPlaying || m_scrubbing) return; // Single frames after a seek say nothing about load
+        const double lateness = m_clock.isStarted() ? m_clock.time() - pts : 0.0;
+        m_governor.report(work, m_frameInterval, lateness, m_frameQueue.size());
+    };
+
+    bool ended = false;     // At EOF, m_onEnd has fired; nothing to do until a seek
+    bool stepFrame = false; // Paused seek: decode up to the first frame at the new position
 
     while (!m_stopThread) {
         // 处理 seek 请求
-        double target = m_seekTarget.exchange(-1.0, std::memory_order_relaxed);
+        SeekMode seekMode = SeekMode::Accurate;
+        double target = takeCommands(seekMode);
         if (target >= 0.0) {
+            ended = false;
+            stepFrame = !m_isPlaying;
             int64_t ts = (int64_t)(target * AV_TIME_BASE); // 转为 AV_TIME_BASE 单位
 
+            // Seeks probe the file (index lookups, bisection) rather than stream through it
+            if (m_mappedFile) m_mappedFile->setAccess(MappedFile::Access::Random);
+            preRollSubtitles(target);
+
             // Seek 整个文件（所有流）
-            // Use AVSEEK_FLAG_BACKWARD to ensure we land before the target
-            if (avformat_seek_file(m_formatCtx, -1, INT64_MIN, ts, ts, AVSEEK_FLAG_BACKWARD) < 0) {
-                 // Fallback
-                 avformat_seek_file(m_formatCtx, -1, INT64_MIN, ts, INT64_MAX, 0);
+            if (m_timeShift) {
+                // The buffer has no duration to bisect; its keyframe index gives the byte offset
+                av_seek_frame(m_formatCtx, -1, m_timeShift->keyframeOffset(target), AVSEEK_FLAG_BYTE);
+            } else if (seekMode == SeekMode::Keyframe) {
+                // Nearest keyframe on either side; its frame is shown as is
+                avformat_seek_file(m_formatCtx, -1, INT64_MIN, ts, INT64_MAX, 0);
+            } else {
+                // Use AVSEEK_FLAG_BACKWARD to ensure we land before the target
+                if (avformat_seek_file(m_formatCtx, -1, INT64_MIN, ts, ts, AVSEEK_FLAG_BACKWARD) < 0) {
+                     // Fallback
+                     avformat_seek_file(m_formatCtx, -1, INT64_MIN, ts, INT64_MAX, 0);
+                }
+            }
+            if (m_mappedFile) {
+                m_mappedFile->setAccess(MappedFile::Access::Sequential);
+                prefetchGops(target);
             }
 
             avcodec_flush_buffers(m_codecCtx);
             if (m_audioCodecCtx) {
                 avcodec_flush_buffers(m_audioCodecCtx);
             }
-            m_lastVideoPts = -1.0; // 重置视频 PTS
-            m_skipUntilPts = target; // Set skip target
+            if (m_subtitleCodecCtx) {
+                avcodec_flush_buffers(m_subtitleCodecCtx);
+            }
+            m_subtitles.seek(target);
+            m_skipUntilPts = seekMode == SeekMode::Accurate ? target : -1.0; // Set skip target
+            m_audioResync = false;    // The skip target lines audio up instead
+            // A variant switch in flight starts over from the new position
+            cancelVariantSwitch();
+            m_lastReadVideoPts = -1.0;
+            m_variantSkipPts = -1.0;
+            m_variantAudioSkipPts = -1.0;
+
+            // Frames decoded between seek() and here are from before the target
+            m_frameQueue.flush();
+            m_clock.invalidate();
             
             // Clear audio buffer to avoid playing old audio
             {
                 std::lock_guard<std::mutex> lock(m_audioMutex);
                 m_audioBuffer.clear();
+                m_audioClock = -1.0;
             }
         }
 
-        if (!m_isPlaying) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        applySubtitleSelection();
+        applyAudioSelection();
+
+        if (!m_isPlaying && !stepFrame) {
+            // While paused, tiles that rotate into view are converted lazily from the last frame
+            bool retryRefresh = false;
+            if (m_viewWindowChanged.exchange(false) && m_swsCtx && m_lastVideoFrame->data[0]) {
+                // Never block here: while paused the queue only drains through refresh frames
+                FramePtr f = m_frameQueue.tryAcquire(currentDstWidth, currentDstHeight);
+                if (!f) {
+                    m_viewWindowChanged = true; // Retry once a frame is back in the pool
+                    retryRefresh = true;
+                } else {
+                    AVRational tb = m_formatCtx->streams[m_videoStreamIndex]->time_base;
+                    f->pts = (tb.num && tb.den) ? m_lastVideoFrame->best_effort_timestamp * av_q2d(tb) : 0.0;
+                    f->refresh = true;
+                    f->source = shareFrame(m_lastVideoFrame);
+                    av_image_fill_arrays(pFrameRGB->data, pFrameRGB->linesize, f->pixels.data(), AV_PIX_FMT_RGBA,
+                                         currentDstWidth, currentDstHeight, 1);
+
+                    // Once the view window is dropped (e.g. a flat view took over) the whole frame is
+                    // converted again, since only the tiles that were in view are valid on screen
+                    const bool full = !m_viewWindowEnabled
+                        && !(m_highBitDepthOutput && isHighBitDepthFormat(m_lastVideoFrame->format));
+                    if (convertVideoFrame(m_lastVideoFrame, pFrameRGB, currentDstWidth, currentDstHeight, !full, f->regions)
+                        && (full || !f->regions.empty())) {
+                        queueFrame(std::move(f));
+                    }
+                }
+            }
+            // Sleep until play, seek, stop or a view change; only a refresh waiting for
+            // a pooled frame to come back polls
+            waitForCommand(retryRefresh ? std::chrono::milliseconds(10) : std::chrono::milliseconds(0));
             continue;
         }
 
         // Determine target size
+        commitPendingOutputSize();
         int dstWidth = m_targetWidth;
         int dstHeight = m_targetHeight;
-
-        if (dstHeight > 0 && dstWidth == 0) {
+        int autoWidth = m_autoWidth;
+        int autoHeight = m_autoHeight;
+
+        if (autoWidth > 0 && autoHeight > 0) {
+             // Fit the source aspect into the requested box, never upscaling
+             double scale = std::min({(double)autoWidth / m_width, (double)autoHeight / m_height, 1.0});
+             dstWidth = std::max(2, ((int)(m_width * scale) + 1) & ~1);
+             dstHeight = std::max(2, ((int)(m_height * scale) + 1) & ~1);
+        } else if (dstHeight > 0 && dstWidth == 0) {
              // Calculate width from aspect ratio
              if (m_height > 0) {
                 dstWidth = (int)((int64_t)m_width * dstHeight / m_height);
@@ -363,191 +1564,216 @@ void VideoDecoder::decodeLoop() {
              dstHeight = m_height;
         }
 
-        // Check if we need to (re)initialize context and buffers
-        if (dstWidth != currentDstWidth || dstHeight != currentDstHeight || !m_swsCtx) {
-            if (buffer) av_free(buffer);
+        // Quality governor: codec switches apply right away, scaler changes re-init below
+        const DecodeGovernor::Level level = m_scrubbing ? DecodeGovernor::Level::ReducedResolution : m_governor.level();
+        const bool scalerChanged = (level >= DecodeGovernor::Level::FastScaler) != (currentLevel >= DecodeGovernor::Level::FastScaler);
+        if (level != currentLevel) {
+            applyQualityLevel(level);
+            currentLevel = level;
+        }
+        if (level >= DecodeGovernor::Level::ReducedResolution) {
+             dstWidth = std::max(2, (dstWidth / 2 + 1) & ~1);
+             dstHeight = std::max(2, (dstHeight / 2 + 1) & ~1);
+        }
+
+        if (m_viewWindowEnabled) {
+             // Tile conversion needs the output to split evenly into the tile grid
+             dstWidth = std::max(EquirectTiles::Columns, dstWidth - dstWidth % EquirectTiles::Columns);
+             dstHeight = std::max(EquirectTiles::Rows, dstHeight - dstHeight % EquirectTiles::Rows);
+        }
+
+        // Check if we need to (re)initialize the scaler; output buffers come from the frame pool
+        if (dstWidth != currentDstWidth || dstHeight != currentDstHeight || !m_swsCtx || scalerChanged) {
             if (m_swsCtx) sws_freeContext(m_swsCtx);
             
             currentDstWidth = dstWidth;
             currentDstHeight = dstHeight;
-
-            int numBytes = av_image_get_buffer_size(AV_PIX_FMT_RGBA, currentDstWidth, currentDstHeight, 1);
-            buffer = (uint8_t*)av_malloc(numBytes * sizeof(uint8_t));
-
-            if (!buffer) {
-                std::string errorMsg = "Failed to allocate output frame buffer";
-                std::cerr << errorMsg << std::endl;
-                std::lock_guard<std::mutex> lock(m_callbackMutex);
-                if (m_onError) m_onError(errorMsg);
-                break; // 退出 decodeLoop
-            }
-            
-            av_image_fill_arrays(pFrameRGB->data, pFrameRGB->linesize, buffer, AV_PIX_FMT_RGBA, currentDstWidth, currentDstHeight, 1);
+            m_convertedTiles.reset();
 
             m_swsCtx = sws_getContext(m_width, m_height, m_codecCtx->pix_fmt,
                                       currentDstWidth, currentDstHeight, AV_PIX_FMT_RGBA,
-                                      SWS_BILINEAR, nullptr, nullptr, nullptr);
+                                      m_scaleFlags, nullptr, nullptr, nullptr);
             
             if (!m_swsCtx) {
                 std::string errorMsg = "Could not initialize SWS context";
                 std::cerr << errorMsg << std::endl;
                 std::lock_guard<std::mutex> lock(m_callbackMutex);
                 if (m_onError) m_onError(errorMsg);
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                waitForCommand(std::chrono::milliseconds(100));
                 continue; // 跳过本次解码
             }
         }
 
-        int readRet = av_read_frame(m_formatCtx, m_packet);
+        int readRet;
+        if (m_heldPacket->data) {
+            // The new variant's first keyframe, now that the scaler is set up for its size
+            av_packet_move_ref(m_packet, m_heldPacket);
+            readRet = 0;
+        } else {
+            readRet = av_read_frame(m_formatCtx, m_packet);
+        }
         
         // Update last packet time on successful read
         if (readRet >= 0) {
             m_lastPacketTime = av_gettime();
         }
 
+        if (readRet >= 0 && m_timeShift && m_timeShift->takeDiscontinuity()) {
+            // Paused past the retention window: the buffer skipped ahead to its oldest keyframe
+            avcodec_flush_buffers(m_codecCtx);
+            if (m_audioCodecCtx) avcodec_flush_buffers(m_audioCodecCtx);
+            m_frameQueue.flush();
+            m_clock.invalidate();
+            std::lock_guard<std::mutex> lock(m_audioMutex);
+            m_audioBuffer.clear();
+            m_audioClock = -1.0;
+        }
+
         if (readRet >= 0) {
+            if (m_pendingVariant >= 0 && m_packet->stream_index == m_variants.variants()[m_pendingVariant].streamIndex) {
+                if (!(m_packet->flags & AV_PKT_FLAG_KEY)) {
+                    av_packet_unref(m_packet);
+                    continue;
+                }
+                // The new variant takes over at its first keyframe. It is held back while an empty
+                // packet drains the old decoder, so the frames still inside it are shown too.
+                av_packet_move_ref(m_heldPacket, m_packet);
+                m_packet->stream_index = m_videoStreamIndex;
+            }
+
             if (m_packet->stream_index == m_videoStreamIndex) {
+                if (m_mappedFile && (m_packet->flags & AV_PKT_FLAG_KEY) && m_packet->pts != AV_NOPTS_VALUE) {
+                    prefetchGops(m_packet->pts * av_q2d(m_formatCtx->streams[m_videoStreamIndex]->time_base));
+                }
+                if (m_variant >= 0 && m_packet->data) {
+                    if (m_packet->pts != AV_NOPTS_VALUE) {
+                        m_lastReadVideoPts = m_packet->pts * av_q2d(m_formatCtx->streams[m_videoStreamIndex]->time_base);
+                    }
+                    if (m_pendingVariant >= 0
+                        && av_gettime_relative() - m_pendingVariantSince > m_variantSwitchTimeoutMicroseconds) {
+                        // No keyframe arrived on the new variant; stay on the old one
+                        cancelVariantSwitch();
+                    }
+                    if (m_pendingVariant < 0 && m_isPlaying && !m_scrubbing) {
+                        // Read after its frame was due: the network, not the decoder, is holding playback up
+                        const bool starving = m_clock.isStarted() && m_lastReadVideoPts >= 0.0
+                            && m_lastReadVideoPts - m_clock.time() < m_frameInterval;
+                        const int next = m_variants.update(m_variant, starving, m_governor.load(), m_governor.level(),
+                                                           m_autoWidth, m_autoHeight);
+                        if (next >= 0 && next != m_variant) requestVariant(next);
+                    }
+                }
+                int64_t workStart = av_gettime_relative();
                 if (avcodec_send_packet(m_codecCtx, m_packet) == 0) {
                     while (avcodec_receive_frame(m_codecCtx, m_frame) == 0) {
-                        // Convert to RGBA
+                        int64_t work = av_gettime_relative() - workStart;
                         if (m_swsCtx) {
-                            sws_scale(m_swsCtx, (const uint8_t* const*)m_frame->data,
-                                    m_frame->linesize, 0, m_height,
-                                    pFrameRGB->data, pFrameRGB->linesize);
-
-                            // 1. 准备 Frame 数据
-                            Frame f;
-                            f.width = currentDstWidth;
-                            f.height = currentDstHeight;
-                            f.linesize = currentDstWidth * 4; // RGBA: 4 bytes/pixel
-
-                            // 2. 获取 PTS
+                            // 1. 获取 PTS
                             AVRational tb = m_formatCtx->streams[m_videoStreamIndex]->time_base;
-                            f.pts = (tb.num && tb.den) ? m_frame->best_effort_timestamp * av_q2d(tb) : 0.0;
+                            double pts = (tb.num && tb.den) ? m_frame->best_effort_timestamp * av_q2d(tb) : 0.0;
 
-                            // Check if we need to skip
+                            // Check if we need to skip (before converting, skipped frames are never shown)
                             if (m_skipUntilPts >= 0.0) {
-                                if (f.pts < m_skipUntilPts - 0.05) { // Allow small tolerance
+                                if (pts < m_skipUntilPts - 0.05) { // Allow small tolerance
+                                    workStart = av_gettime_relative();
                                     continue; // Skip this frame
                                 }
                                 m_skipUntilPts = -1.0; // Reached target, stop skipping
                             }
-
-                            // 3. 深拷贝像素数据（逐行，避免 linesize padding 问题）
-                            int totalBytes = f.linesize * f.height;
-                            f.rgba.resize(totalBytes);
-                            for (int y = 0; y < f.height; ++y) {
-                                const uint8_t* src = pFrameRGB->data[0] + y * pFrameRGB->linesize[0];
-                                uint8_t* dst = f.rgba.data() + y * f.linesize;
-                                std::memcpy(dst, src, f.linesize); // 只拷有效像素（width * 4）
+                            if (m_variantSkipPts >= 0.0) {
+                                if (pts <= m_variantSkipPts + 0.001) { // Already shown by the previous variant
+                                    workStart = av_gettime_relative();
+                                    continue;
+                                }
+                                m_variantSkipPts = -1.0;
                             }
 
-                            // 4. 回调（线程安全）
-                            {
-                                std::lock_guard<std::mutex> lock(m_callbackMutex);
-                                if (m_onFrame) {
-                                    m_onFrame(f);
-                                }
+                            // High-bit-depth sources skip the CPU conversion when the renderer takes 16-bit planes
+                            if (m_highBitDepthOutput && isHighBitDepthFormat(m_frame->format)) {
+                                FramePtr f = m_frameQueue.acquire(m_frame->width, m_frame->height,
+                                                                  planarFrameSize(m_frame));
+                                if (!f) break; // Aborted by stop()
+                                f->pts = pts;
+                                f->source = shareFrame(m_frame);
+                                const int64_t copyStart = av_gettime_relative();
+                                fillPlanarFrame(m_frame, *f);
+                                work += av_gettime_relative() - copyStart;
+                                av_frame_unref(m_lastVideoFrame); // Paused tile refresh is RGBA only
+                                queueFrame(std::move(f));
+                                reportFrame(work / 1e6, pts);
+                                stepFrame = false;
+                                workStart = av_gettime_relative();
+                                continue;
                             }
 
-                            // 5. 基于 PTS 的简单同步（替代固定 33ms）
-                            if (m_lastVideoPts >= 0.0 && f.pts > m_lastVideoPts) {
-                                double delay = f.pts - m_lastVideoPts;
-                                int64_t sleepMs = static_cast<int64_t>(delay * 1000);
-                                if (sleepMs > 0 && sleepMs < 500) { // 防异常值
-                                    std::this_thread::sleep_for(std::chrono::milliseconds(sleepMs));
-                                }
+                            // 2. 从帧池取输出缓冲；队列满时在这里等待，由显示端的消费节奏限速
+                            FramePtr f = m_frameQueue.acquire(currentDstWidth, currentDstHeight);
+                            if (!f) break; // Aborted by stop()
+                            f->pts = pts;
+                            f->source = shareFrame(m_frame);
+                            av_image_fill_arrays(pFrameRGB->data, pFrameRGB->linesize, f->pixels.data(), AV_PIX_FMT_RGBA,
+                                                 currentDstWidth, currentDstHeight, 1);
+
+                            // 3. Convert to RGBA (only the visible tiles when a view window is set)
+                            const int64_t convertStart = av_gettime_relative();
+                            bool converted = convertVideoFrame(m_frame, pFrameRGB, currentDstWidth, currentDstHeight,
+                                                               false, f->regions);
+                            work += av_gettime_relative() - convertStart;
+                            if (m_viewWindowEnabled) {
+                                av_frame_unref(m_lastVideoFrame);
+                                av_frame_ref(m_lastVideoFrame, m_frame);
                             }
-                            m_lastVideoPts = f.pts;
+                            workStart = av_gettime_relative();
+                            if (!converted) continue;
+
+                            // 4. 入队并通知（线程安全）；何时显示由 PTS 和播放时钟决定
+                            queueFrame(std::move(f));
+                            reportFrame(work / 1e6, pts);
+                            stepFrame = false;
                         }
                     }
                 }
             } else if (m_packet->stream_index == m_audioStreamIndex) {
                 if (avcodec_send_packet(m_audioCodecCtx, m_packet) == 0) {
                     while (avcodec_receive_frame(m_audioCodecCtx, m_frame) == 0) {
+                        AVRational tb = m_formatCtx->streams[m_audioStreamIndex]->time_base;
+                        bool hasPts = tb.num && tb.den && m_frame->pts != AV_NOPTS_VALUE;
+                        double audioPts = hasPts ? m_frame->pts * av_q2d(tb) : -1.0;
+
                         // Check if we need to skip audio
                         if (m_skipUntilPts >= 0.0) {
-                             AVRational tb = m_formatCtx->streams[m_audioStreamIndex]->time_base;
-                             double audioPts = (tb.num && tb.den) ? m_frame->pts * av_q2d(tb) : 0.0;
                              if (audioPts < m_skipUntilPts - 0.1) {
                                  continue;
                              }
                         }
-
-                        if (m_swrCtx) {
-                            // 1. 先检查音频缓冲区是否过大（避免 OOM）
-                            {
-                                std::lock_guard<std::mutex> lock(m_audioMutex);
-                                if (m_audioBuffer.size() > 5 * 1024 * 1024) { // 5MB threshold
-                                    continue; // 跳过重采样
-                                }
-                            }
-
-                            // 2. 计算输出样本数
-                            int64_t delay = swr_get_delay(m_swrCtx, m_audioCodecCtx->sample_rate);
-                            int dst_samples = (int)av_rescale_rnd(
-                                delay + m_frame->nb_samples,
-                                44100,
-                                m_audioCodecCtx->sample_rate,
-                                AV_ROUND_UP
-                            );
-
-                            if (dst_samples <= 0) {
-                                continue;
-                            }
-
-                            // 3. 分配输出缓冲区
-                            uint8_t* output_buffer = nullptr;
-                            int ret = av_samples_alloc(
-                                &output_buffer, nullptr,
-                                2,
-                                dst_samples,
-                                AV_SAMPLE_FMT_S16,
-                                0
-                            );
-                            if (ret < 0) {
-                                std::cerr << "av_samples_alloc failed" << std::endl;
-                                continue;
-                            }
-
-                            // 4. 重采样
-                            int converted_samples = swr_convert(
-                                m_swrCtx,
-                                &output_buffer,
-                                dst_samples,
-                                (const uint8_t**)m_frame->data,
-                                m_frame->nb_samples
-                            );
-
-                            if (converted_samples > 0) {
-                                int buffer_size = av_samples_get_buffer_size(
-                                    nullptr, 2, converted_samples, AV_SAMPLE_FMT_S16, 1
-                                );
-
-                                // 5. 写入音频缓冲区
-                                std::lock_guard<std::mutex> lock(m_audioMutex);
-                                if (m_audioBuffer.size() + buffer_size <= 10 * 1024 * 1024) { // 硬上限 10MB
-                                    size_t old_size = m_audioBuffer.size();
-                                    m_audioBuffer.resize(old_size + buffer_size);
-                                    memcpy(m_audioBuffer.data() + old_size, output_buffer, buffer_size);
-                                }
-                                // 如果超过 10MB，静默丢弃（避免 OOM）
-                            }
-
-                            // 6. 释放输出缓冲区（必须）
-                            av_freep(&output_buffer);
+                        // New variant's track: what the old one already buffered is dropped
+                        if (m_variantAudioSkipPts >= 0.0 && hasPts && m_frame->sample_rate > 0) {
+                            const double duration = (double)m_frame->nb_samples / m_frame->sample_rate;
+                            if (audioPts + duration / 2 <= m_variantAudioSkipPts) continue;
+                            m_variantAudioSkipPts = -1.0;
                         }
+
+                        queueAudio(m_frame, audioPts);
                     }
                 }
+            } else if (m_packet->stream_index == m_subtitleStreamIndex) {
+                decodeSubtitle(m_packet);
             }
             av_packet_unref(m_packet);
+            if (m_heldPacket->data && m_pendingVariant >= 0) completeVariantSwitch();
         } else {
             if (readRet == AVERROR_EOF) {
-                {
+                stepFrame = false;
+                if (!ended) {
+                    ended = true;
+                    // A time-shifted source only ends when the capture does; say why
+                    const std::string captureError = m_timeShift ? m_timeShift->captureError() : std::string();
                     std::lock_guard<std::mutex> lock(m_callbackMutex);
+                    if (!captureError.empty() && m_onError) m_onError(captureError);
                     if(m_onEnd) m_onEnd();
                 }
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                // Queued frames keep playing out; the thread sleeps until a seek or stop
+                waitForCommand();
                 continue;
             } else {
                 // Handle other errors (e.g. timeout, network error)
@@ -556,8 +1782,8 @@ void VideoDecoder::decodeLoop() {
                 std::cerr << "av_read_frame error: " << errbuf << std::endl;
                 
                 // If it's a timeout or critical error, we might want to stop or reconnect
-                // For now, just sleep to avoid busy loop
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                // For now, back off before retrying (stop() cuts the wait short)
+                waitForCommand(std::chrono::milliseconds(100));
                 
                 // If timeout detected by our callback, we should probably stop
                 if (checkTimeout()) {
@@ -571,6 +1797,5 @@ void VideoDecoder::decodeLoop() {
         }
     }
 
-    if (buffer) av_free(buffer);
     av_frame_free(&pFrameRGB);
 }
@@ -3,9 +3,24 @@
 #include <string>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <stop_token>
 #include <vector>
+#include "DecodeGovernor.h"
+#include "EquirectTiles.h"
+#include "FrameQueue.h"
+#include "MappedFile.h"
+#include "AudioRingBuffer.h"
+#include "PlaybackClock.h"
+#include "SubtitleQueue.h"
+#include "TimeShiftBuffer.h"
+#include "VariantSelector.h"
+#include "YuvConvert.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -18,34 +33,106 @@ extern "C" {
 
 class VideoDecoder {
 public:
-    struct Frame {
-        int width = 0;
-        int height = 0;
-        double pts = 0.0;
-        std::vector<uint8_t> rgba;
-        int linesize = 0;
+    using Frame = VideoFrame;
+    using FramePtr = FrameQueue::FramePtr;
+
+    // 360 layout signalled by the stream's spherical / stereo 3D side data
+    enum class Projection { Unknown, Equirectangular, Cubemap, EquiAngularCubemap };
+    enum class StereoLayout { Mono, TopBottom, SideBySide };
+    struct SphericalInfo {
+        Projection projection = Projection::Unknown;
+        StereoLayout stereo = StereoLayout::Mono;
+        bool rightEyeFirst = false;
+        // Equirect tile: share of the full sphere image cropped away on each side (e.g. 180 video)
+        double boundLeft = 0.0;
+        double boundTop = 0.0;
+        double boundRight = 0.0;
+        double boundBottom = 0.0;
+    };
+
+    struct SubtitleStream {
+        int streamIndex = -1;
+        std::string language;
+        std::string title;
+        bool bitmap = false; // PGS / DVB / VobSub rather than text
+    };
+
+    struct AudioStream {
+        int streamIndex = -1;
+        std::string language;
+        std::string title;
+        int channels = 0;
+        int sampleRate = 0;
+    };
+
+    // Interleaved PCM layout handed out by getAudioData()
+    struct AudioFormat {
+        enum class SampleType { Int16, Int32, Float };
+        int sampleRate = 44100;
+        int channels = 2;
+        SampleType sampleType = SampleType::Int16;
+
+        int bytesPerSample() const { return sampleType == SampleType::Int16 ? 2 : 4; }
+        int bytesPerFrame() const { return bytesPerSample() * channels; }
+        int bytesPerSecond() const { return bytesPerFrame() * sampleRate; }
     };
 
     VideoDecoder();
     ~VideoDecoder();
 
-    bool open(const std::string& url);
+    // Blocking (network sources can take seconds); meant for a worker thread. A stop request on
+    // cancel aborts the open from the demuxer's interrupt callback and returns false without
+    // reporting an error. stop() and close() join the decode thread, so they belong there too.
+    bool open(const std::string& url, std::stop_token cancel = {});
     void close();
     void play();
     void pause();
     void stop();
 
     // Time control
+    // Accurate decodes from the keyframe before the target and drops frames until it is reached.
+    // Keyframe lands on the nearest keyframe and shows it as is: cheap enough to follow a mouse drag.
+    // While paused the frame at the new position is still decoded and shown.
+    enum class SeekMode { Accurate, Keyframe };
     double getDuration() const;
-    void seek(double seconds);
+    void seek(double seconds, SeekMode mode = SeekMode::Accurate);
+    // Scrubbing: frames are decoded at reduced quality and resolution (as DecodeGovernor's lowest
+    // level) and the governor is left alone, since scrub seeks say nothing about sustained load
+    void setScrubbing(bool scrubbing) { m_scrubbing = scrubbing; }
 
     // Audio Support
+    // Copies buffered PCM straight into the caller's buffer; safe to call from the audio device thread
     int getAudioData(uint8_t* data, int max_size);
     bool hasAudio() const { return m_audioStreamIndex >= 0; }
+    // Format the output device mixes in, taken into account by the next open(). The source keeps
+    // its channel count when the device can take it (up to maxChannels); rate and sample type
+    // always follow the device so the system mixer does not resample a second time.
+    void setAudioDeviceFormat(const AudioFormat& preferred, int maxChannels);
+    // Negotiated output format of the open source
+    AudioFormat audioFormat() const;
+    // Audio streams of the open source. The selection (index into audioStreams()) starts on the
+    // stream flagged as default and can change during playback: the decode thread swaps the
+    // audio decoder in place and lines the new track up with the running clock.
+    std::vector<AudioStream> audioStreams() const;
+    int audioStream() const { return m_requestedAudio; }
+    void setAudioStream(int index);
+    // PTS of the next audio byte handed out by getAudioData, -1 until audio has been read
     double getAudioClock() const { return m_audioClock; }
 
-    // Callback for new frames
-    using FrameCallback = std::function<void(const Frame&)>;
+    // Decoded frames wait here for the view to present them on vsync against clock()
+    FrameQueue& frameQueue() { return m_frameQueue; }
+    PlaybackClock& clock() { return m_clock; }
+
+    // Subtitle streams of the open source. The selection (index into subtitleStreams(), -1 = off)
+    // is applied by the decode thread; it starts on the stream flagged as default, if any.
+    std::vector<SubtitleStream> subtitleStreams() const;
+    int subtitleStream() const { return m_requestedSubtitle; }
+    void setSubtitleStream(int index);
+    // Decoded events of the selected stream, timed against clock()
+    SubtitleQueue& subtitles() { return m_subtitles; }
+
+    // Called from the decode thread after a frame has been queued
+    using FrameCallback = std::function<void()>;
     void setFrameCallback(FrameCallback callback);
     
     // Add error callback
@@ -59,25 +146,95 @@ public:
     bool isStopped() const { return m_stopThread; }
     int getWidth() const { return m_width; }
     int getHeight() const { return m_height; }
+    SphericalInfo getSphericalInfo() const { return m_spherical; }
 
     // Resolution control
     void setTargetResolution(int width, int height);
+    // Auto mode: views report the pixel box they need; the decoder fits the source aspect
+    // into it (never upscaling) and only re-inits the scaler once the size has settled
+    void requestOutputSize(int width, int height);
+
+    // Renderers that can sample 16-bit textures take 10/12/16-bit 4:2:0 frames as raw planes
+    // (PixelFormat::Yuv420P16 / P016) and do conversion and tone mapping on the GPU.
+    // Scaling then happens on the GPU too, so the target resolution does not apply to those frames.
+    void setHighBitDepthOutput(bool enabled) { m_highBitDepthOutput = enabled; }
+
+    // Equirect view window: only the tiles visible from this view (plus a margin) are converted.
+    // Tiles outside keep older content and are refreshed lazily once they rotate into view.
+    void setViewWindow(double yaw, double pitch, double fov, double aspect);
+    void clearViewWindow();
+
+    // Current degradation step of the decode quality governor (see DecodeGovernor::Level)
+    DecodeGovernor::Level qualityLevel() const { return m_governor.level(); }
+
+    // HLS / DASH sources with several variants switch between them during playback, without
+    // reopening (see VariantSelector). The variant playing now; bitrate 0 for other sources.
+    VariantSelector::Variant streamVariant() const;
+    // Measured download throughput of the open source in bits per second, 0 if not measured
+    double downloadThroughput() const { return m_variants.throughput(); }
+
+    // Live time shift, taken into account by the next open(). Network live sources (rtsp, rtmp,
+    // udp, rtp, srt, tcp) are then captured into a TimeShiftBuffer under directory and played
+    // from there: pausing keeps recording, and seek() works anywhere in the buffered window.
+    void setTimeShift(bool enabled, const TimeShiftBuffer::Retention& retention, const std::filesystem::path& directory);
+    bool isTimeShifting() const;
+    // Buffered range on the playback timeline, all zero when not time-shifting
+    TimeShiftBuffer::Window timeShiftWindow() const;
 
 private:
     static int interrupt_cb(void* ctx);
+    static bool isLiveUrl(const std::string& url);
     bool checkTimeout() const;
 
     void decodeLoop();
+    void wakeDecodeThread();
+    double takeCommands(SeekMode& mode);
+    void waitForCommand(std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
     void freeResources();
+    void commitPendingOutputSize();
+    void detectSphericalLayout(const AVCodecParameters* codecPar);
+    bool visibleTiles(int dstWidth, int dstHeight, EquirectTiles::Mask& tiles) const;
+    void prefetchGops(double seconds);
+    bool convertVideoFrame(const AVFrame* src, AVFrame* dst, int dstWidth, int dstHeight,
+                           bool onlyMissingTiles, std::vector<Frame::Region>& regions);
+    static bool isHighBitDepthFormat(int format);
+    static size_t planarFrameSize(const AVFrame* src);
+    void fillPlanarFrame(const AVFrame* src, Frame& dst);
+    Frame::Colorimetry describeColor(const AVFrame* src);
+    static std::shared_ptr<const AVFrame> shareFrame(const AVFrame* frame);
+    void queueFrame(FramePtr frame);
+    void applyQualityLevel(DecodeGovernor::Level level);
+    bool openAudioStream(int streamIndex);
+    void openAudioOutput(bool negotiate);
+    void queueAudio(AVFrame* frame, double pts);
+    void applyAudioSelection();
+    void updateStreamDiscard();
+    bool openVideoStream(int streamIndex, std::string& error);
+    int audioStreamForVariant(int variant) const;
+    void requestVariant(int variant);
+    void completeVariantSwitch();
+    void cancelVariantSwitch();
+    void applySubtitleSelection();
+    void decodeSubtitle(AVPacket* packet);
+    void preRollSubtitles(double target);
 
     std::string m_url;
     std::atomic<bool> m_isPlaying{false};
     std::atomic<bool> m_stopThread{false};
     std::thread m_decodeThread;
 
+    // Control plane: API calls update state and wake the decode thread, which blocks while paused
+    // or at the end instead of polling. Seeks coalesce: only the latest target reaches the demuxer.
+    std::mutex m_controlMutex;
+    std::condition_variable m_controlCondition;
+    bool m_commandPending = false; // Guarded by m_controlMutex
+    double m_seekTarget = -1.0;    // Guarded by m_controlMutex
+    SeekMode m_seekMode = SeekMode::Accurate;
+
     // Timeout handling
     std::atomic<int64_t> m_lastPacketTime{0};
     const int64_t m_timeoutMicroseconds = 30000000; // 30 seconds
+    std::stop_token m_openCancel; // Only set while open() runs, on the opening thread
 
     // FFmpeg context
     AVFormatContext* m_formatCtx = nullptr;
@@ -88,25 +245,103 @@ private:
     AVFrame* m_frame = nullptr;
     AVPacket* m_packet = nullptr;
     SwsContext* m_swsCtx = nullptr;
+    YuvConverter m_yuvConverter; // Native kernels for common 4:2:0 formats, swscale handles the rest
     int m_videoStreamIndex = -1;
-    int m_width = 0;
-    int m_height = 0;
-    int m_targetWidth = 0;
-    int m_targetHeight = 0;
+    std::atomic<bool> m_highBitDepthOutput{false};
+    float m_peakLuminance = 1000.0f; // Last content light level seen; SEI is usually only sent on keyframes
+    std::atomic<int> m_width{0}; // Also read by requestOutputSize() on the GUI thread
+    std::atomic<int> m_height{0};
+    SphericalInfo m_spherical;
+    double m_frameInterval = 1.0 / 30.0; // Nominal, from the stream's frame rate
+    DecodeGovernor m_governor;
+    std::atomic<bool> m_scrubbing{false};
+    int m_scaleFlags = SWS_BILINEAR; // Decode thread only, follows the quality level
+    // Adaptive variants (decode thread, set up by open())
+    VariantSelector m_variants;
+    int m_variant = -1;                  // Index into m_variants.variants(), -1 when not adaptive
+    int m_pendingVariant = -1;           // Enabled in the demuxer, taken over at its first keyframe
+    int m_pendingAudioStreamIndex = -1;  // Its program's audio, when that differs from the current one
+    int64_t m_pendingVariantSince = 0;
+    const int64_t m_variantSwitchTimeoutMicroseconds = 10000000; // No keyframe by then: given up
+    AVPacket* m_heldPacket = nullptr;    // The new variant's keyframe while the old decoder drains
+    double m_lastReadVideoPts = -1.0;
+    double m_lastQueuedVideoPts = -1.0;
+    double m_variantSkipPts = -1.0;      // The new variant's frames up to here were shown by the old one
+    double m_variantAudioSkipPts = -1.0; // Same for its audio
+    mutable std::mutex m_variantMutex;
+    VariantSelector::Variant m_currentVariant; // Guarded by m_variantMutex, for other threads
+    std::atomic<int> m_targetWidth{0};
+    std::atomic<int> m_targetHeight{0};
+
+    // Auto output size (0 = disabled); pending values are committed after the debounce interval
+    std::atomic<int> m_autoWidth{0};
+    std::atomic<int> m_autoHeight{0};
+    std::mutex m_autoSizeMutex;
+    int m_pendingAutoWidth = 0;
+    int m_pendingAutoHeight = 0;
+    int64_t m_pendingAutoSince = 0;
+    const int64_t m_autoSizeDebounceMicroseconds = 250000; // 250 ms
+
+    // View window (panorama partial conversion)
+    mutable std::mutex m_viewMutex;
+    EquirectTiles::View m_viewWindow;
+    std::atomic<bool> m_viewWindowEnabled{false};
+    std::atomic<bool> m_viewWindowChanged{false};
+    const double m_viewMarginDegrees = 10.0;
+    SwsContext* m_tileSwsCtx = nullptr;
+    AVFrame* m_lastVideoFrame = nullptr;
+    EquirectTiles::Mask m_convertedTiles;
     mutable std::mutex m_durationMutex;
     double m_duration = 0.0;
-    double m_lastVideoPts = -1.0;
-    std::atomic<double> m_seekTarget{-1.0};
     double m_skipUntilPts = -1.0;
 
     // Audio
     int m_audioStreamIndex = -1;
     AVCodecContext* m_audioCodecCtx = nullptr;
     const AVCodec* m_audioCodec = nullptr;
-    SwrContext* m_swrCtx = nullptr;
-    std::vector<uint8_t> m_audioBuffer;
-    std::mutex m_audioMutex;
-    std::atomic<double> m_audioClock{0.0};
+    SwrContext* m_swrCtx = nullptr;            // Null when decoded frames already match m_audioFormat
+    std::vector<uint8_t> m_audioConvertBuffer; // swr output, grown on demand and reused
+    AudioFormat m_deviceAudioFormat;
+    int m_deviceMaxChannels = 2;
+    AudioFormat m_audioFormat;                 // Guarded by m_audioMutex
+    AudioRingBuffer m_audioBuffer;
+    mutable std::mutex m_audioMutex;
+    static constexpr double m_audioBufferSeconds = 30.0; // Ring capacity, allocated once per open
+    std::atomic<double> m_audioClock{-1.0};
+    double m_audioBufferEndPts = 0.0;          // PTS at the end of m_audioBuffer
+    std::vector<AudioStream> m_audioStreams;   // Guarded by m_audioMutex
+    std::atomic<int> m_requestedAudio{-1};
+    int m_activeAudio = -1;                    // Decode thread only
+    bool m_audioResync = false;                // Next decoded audio is aligned to clock() first
+
+    // Subtitles
+    mutable std::mutex m_subtitleMutex;
+    std::vector<SubtitleStream> m_subtitleStreams;
+    std::atomic<int> m_requestedSubtitle{-1};
+    int m_activeSubtitle = -1;         // Decode thread only
+    int m_subtitleStreamIndex = -1;
+    AVCodecContext* m_subtitleCodecCtx = nullptr;
+    SubtitleQueue m_subtitles;
+
+    // Time shift
+    mutable std::mutex m_timeShiftMutex; // Settings, and the buffer pointer for other threads
+    bool m_timeShiftEnabled = false;
+    TimeShiftBuffer::Retention m_timeShiftRetention;
+    std::filesystem::path m_timeShiftDirectory;
+    std::shared_ptr<TimeShiftBuffer> m_timeShift; // Set while the open source plays from the buffer
+    AVIOContext* m_timeShiftReader = nullptr;
+
+    // Local files are read through a memory mapping rather than the file protocol
+    std::unique_ptr<MappedFile> m_mappedFile;
+    AVIOContext* m_mappedReader = nullptr;
+    static constexpr int m_prefetchGops = 2;                         // Keyframe intervals requested ahead
+    static constexpr int64_t m_maxPrefetchBytes = 64LL * 1024 * 1024; // Per request, for very long GOPs
+    static constexpr int m_subtitlePreRollCues = 4;      // Indexed cues read back from a seek target
+    static constexpr int m_subtitlePreRollPackets = 256; // Upper bound on packets read for them
+
+    // Presentation
+    FrameQueue m_frameQueue{4, 1}; // Converting + queued + on screen, one kept back for paused tile refreshes
+    PlaybackClock m_clock;
 
     FrameCallback m_onFrame;
     ErrorCallback m_onError;
@@ -0,0 +1,98 @@
+#include "YuvBenchmark.h"
+#include "YuvConvert.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+namespace {
+
+struct Case {
+    const char* name;
+    AVPixelFormat pixelFormat;
+    YuvConverter::Format format;
+};
+
+template <typename Fn>
+double millisecondsPerFrame(int iterations, Fn&& fn) {
+    fn(); // Warm up caches and lazily initialised state
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) fn();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+} // namespace
+
+int runYuvBenchmark(int width, int height, int iterations) {
+    const Case cases[] = {
+        {"yuv420p", AV_PIX_FMT_YUV420P, YuvConverter::Format::Yuv420p},
+        {"yuvj420p", AV_PIX_FMT_YUVJ420P, YuvConverter::Format::Yuvj420p},
+        {"nv12", AV_PIX_FMT_NV12, YuvConverter::Format::Nv12},
+        {"yuv420p10le", AV_PIX_FMT_YUV420P10LE, YuvConverter::Format::Yuv420p10le},
+    };
+
+    YuvConverter converter;
+    const YuvConverter::Isa best = YuvConverter::detectIsa();
+    std::printf("YUV -> RGBA, %dx%d source, %d iterations, best ISA: %s\n", width, height, iterations,
+                YuvConverter::isaName(best));
+
+    std::mt19937 random(42);
+    for (const Case& c : cases) {
+        AVFrame* frame = av_frame_alloc();
+        frame->format = c.pixelFormat;
+        frame->width = width;
+        frame->height = height;
+        if (av_frame_get_buffer(frame, 0) < 0) {
+            av_frame_free(&frame);
+            continue;
+        }
+        // Noise; 10-bit samples are kept in range
+        const bool highBitDepth = c.pixelFormat == AV_PIX_FMT_YUV420P10LE;
+        for (int plane = 0; plane < 4 && frame->data[plane]; ++plane) {
+            const int rows = plane == 0 ? height : (height + 1) / 2;
+            for (int y = 0; y < rows; ++y) {
+                uint8_t* row = frame->data[plane] + (ptrdiff_t)y * frame->linesize[plane];
+                for (int x = 0; x < frame->linesize[plane]; ++x) {
+                    row[x] = (uint8_t)(highBitDepth && (x & 1) ? random() & 0x03 : random());
+                }
+            }
+        }
+
+        for (int divisor : {1, 2}) {
+            const int dstWidth = width / divisor;
+            const int dstHeight = height / divisor;
+            std::vector<uint8_t> rgba((size_t)dstWidth * dstHeight * 4);
+            uint8_t* dstData[4] = {rgba.data(), nullptr, nullptr, nullptr};
+            int dstLinesize[4] = {dstWidth * 4, 0, 0, 0};
+
+            SwsContext* sws = sws_getContext(width, height, c.pixelFormat, dstWidth, dstHeight, AV_PIX_FMT_RGBA,
+                                             SWS_BILINEAR, nullptr, nullptr, nullptr);
+            double swsMs = millisecondsPerFrame(iterations, [&] {
+                sws_scale(sws, (const uint8_t* const*)frame->data, frame->linesize, 0, height, dstData, dstLinesize);
+            });
+            sws_freeContext(sws);
+            std::printf("%-12s 1/%d  swscale %7.3f ms", c.name, divisor, swsMs);
+
+            for (YuvConverter::Isa isa : {YuvConverter::Isa::Scalar, YuvConverter::Isa::Sse41, YuvConverter::Isa::Avx2}) {
+                if ((int)isa > (int)best) break;
+                converter.setIsa(isa);
+                double ms = millisecondsPerFrame(iterations, [&] {
+                    converter.convert(c.format, frame->data, frame->linesize, width, height,
+                                      rgba.data(), dstWidth * 4, dstWidth, dstHeight);
+                });
+                std::printf("  %s %7.3f ms (x%.1f)", YuvConverter::isaName(isa), ms, swsMs / ms);
+            }
+            std::printf("\n");
+        }
+        av_frame_free(&frame);
+    }
+    return 0;
+}
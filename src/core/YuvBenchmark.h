@@ -0,0 +1,5 @@
+#pragma once
+
+// `RenkoPlayer --yuv-benchmark`: times the native YUV -> RGBA kernels of every ISA this CPU
+// supports against swscale (SWS_BILINEAR, as used by the decoder) and prints ms per frame
+int runYuvBenchmark(int width = 1920, int height = 1080, int iterations = 100);
@@ -0,0 +1,186 @@
+#include "YuvConvert.h"
+#include "YuvConvertKernels.h"
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(RENKO_YUV_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+using namespace YuvConvertKernels;
+
+YuvConverter::YuvConverter() {
+    m_isa = detectIsa();
+
+    // Allows comparing the paths on one machine
+    const char* forced = std::getenv("RENKO_YUV_ISA");
+    if (forced) {
+        std::string value(forced);
+        if (value == "off") {
+            m_enabled = false;
+        } else if (value == "scalar") {
+            setIsa(Isa::Scalar);
+        } else if (value == "sse41") {
+            setIsa(Isa::Sse41);
+        } else if (value == "avx2") {
+            setIsa(Isa::Avx2);
+        }
+    }
+}
+
+YuvConverter::Isa YuvConverter::detectIsa() {
+#if defined(RENKO_YUV_X86) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return Isa::Avx2;
+    if (__builtin_cpu_supports("sse4.1")) return Isa::Sse41;
+#elif defined(RENKO_YUV_X86) && defined(_MSC_VER)
+    int info[4] = {0};
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    bool avx2 = false;
+    if (osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    if (avx2) return Isa::Avx2;
+    if (sse41) return Isa::Sse41;
+#endif
+    return Isa::Scalar;
+}
+
+void YuvConverter::setIsa(Isa isa) {
+    // Never go beyond what the CPU can run
+    const Isa best = detectIsa();
+    m_isa = (int)isa <= (int)best ? isa : best;
+}
+
+const char* YuvConverter::isaName(Isa isa) {
+    switch (isa) {
+    case Isa::Avx2: return "avx2";
+    case Isa::Sse41: return "sse4.1";
+    default: return "scalar";
+    }
+}
+
+bool YuvConverter::supports(Format format, int srcWidth, int srcHeight, int dstWidth, int dstHeight) {
+    if (format == Format::Unsupported || dstWidth <= 0 || dstHeight <= 0) return false;
+    const bool sameSize = srcWidth == dstWidth && srcHeight == dstHeight;
+    const bool halfSize = srcWidth == dstWidth * 2 && srcHeight == dstHeight * 2;
+    return sameSize || halfSize;
+}
+
+template <YuvConverter::Format F, bool Downscale>
+void YuvConverter::convertFrame(const uint8_t* const data[4], const int linesize[4], uint8_t* dst, int dstStride,
+                                int width, int height) {
+    constexpr bool HighBitDepth = F == Format::Yuv420p10le;
+    constexpr bool SemiPlanar = F == Format::Nv12;
+    // 1:1 keeps 4:2:0 chroma at half width; at 2:1 every output pixel has its own chroma sample
+    constexpr bool ChromaHalf = !Downscale;
+
+    const Coefficients& c = F == Format::Yuvj420p ? FullRange : LimitedRange;
+    const int chromaWidth = ChromaHalf ? (width + 1) / 2 : width;
+
+    RowKernel kernel = convertRowScalar<ChromaHalf>;
+#ifdef RENKO_YUV_X86
+    if (m_isa == Isa::Avx2) {
+        kernel = convertRowAvx2<ChromaHalf>;
+    } else if (m_isa == Isa::Sse41) {
+        kernel = convertRowSse41<ChromaHalf>;
+    }
+#endif
+
+    m_yRow.resize(width);
+    m_uRow.resize(chromaWidth);
+    m_vRow.resize(chromaWidth);
+
+    auto sample16 = [](const uint8_t* row, int x) {
+        uint16_t value;
+        std::memcpy(&value, row + x * 2, sizeof(value));
+        return (int)value;
+    };
+
+    for (int row = 0; row < height; ++row) {
+        const int chromaRow = Downscale ? row : row / 2;
+        const uint8_t* y = nullptr;
+        const uint8_t* u = nullptr;
+        const uint8_t* v = nullptr;
+
+        // Luma: 8-bit rows at 1:1 are used in place, everything else is gathered into scratch
+        if constexpr (!Downscale && !HighBitDepth) {
+            y = data[0] + (ptrdiff_t)row * linesize[0];
+        } else {
+            const uint8_t* top = data[0] + (ptrdiff_t)row * (Downscale ? 2 : 1) * linesize[0];
+            const uint8_t* bottom = Downscale ? top + linesize[0] : top;
+            uint8_t* out = m_yRow.data();
+            for (int x = 0; x < width; ++x) {
+                if constexpr (HighBitDepth && Downscale) {
+                    int sum = sample16(top, 2 * x) + sample16(top, 2 * x + 1)
+                            + sample16(bottom, 2 * x) + sample16(bottom, 2 * x + 1);
+                    out[x] = clampToByte((sum + 8) >> 4);
+                } else if constexpr (HighBitDepth) {
+                    out[x] = clampToByte((sample16(top, x) + 2) >> 2);
+                } else {
+                    out[x] = (uint8_t)((top[2 * x] + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1] + 2) >> 2);
+                }
+            }
+            y = out;
+        }
+
+        // Chroma: planar 8-bit is used in place, NV12 is deinterleaved and 10-bit is narrowed
+        if constexpr (!SemiPlanar && !HighBitDepth) {
+            u = data[1] + (ptrdiff_t)chromaRow * linesize[1];
+            v = data[2] + (ptrdiff_t)chromaRow * linesize[2];
+        } else if constexpr (SemiPlanar) {
+            const uint8_t* uv = data[1] + (ptrdiff_t)chromaRow * linesize[1];
+            for (int x = 0; x < chromaWidth; ++x) {
+                m_uRow[x] = uv[2 * x];
+                m_vRow[x] = uv[2 * x + 1];
+            }
+            u = m_uRow.data();
+            v = m_vRow.data();
+        } else {
+            const uint8_t* uSrc = data[1] + (ptrdiff_t)chromaRow * linesize[1];
+            const uint8_t* vSrc = data[2] + (ptrdiff_t)chromaRow * linesize[2];
+            for (int x = 0; x < chromaWidth; ++x) {
+                m_uRow[x] = clampToByte((sample16(uSrc, x) + 2) >> 2);
+                m_vRow[x] = clampToByte((sample16(vSrc, x) + 2) >> 2);
+            }
+            u = m_uRow.data();
+            v = m_vRow.data();
+        }
+
+        kernel(y, u, v, dst + (ptrdiff_t)row * dstStride, width, c);
+    }
+}
+
+bool YuvConverter::convert(Format format, const uint8_t* const data[4], const int linesize[4], int srcWidth,
+                           int srcHeight, uint8_t* dst, int dstStride, int dstWidth, int dstHeight) {
+    if (!m_enabled || !supports(format, srcWidth, srcHeight, dstWidth, dstHeight)) return false;
+
+    const bool downscale = srcWidth != dstWidth;
+    switch (format) {
+    case Format::Yuv420p:
+        downscale ? convertFrame<Format::Yuv420p, true>(data, linesize, dst, dstStride, dstWidth, dstHeight)
+                  : convertFrame<Format::Yuv420p, false>(data, linesize, dst, dstStride, dstWidth, dstHeight);
+        return true;
+    case Format::Yuvj420p:
+        downscale ? convertFrame<Format::Yuvj420p, true>(data, linesize, dst, dstStride, dstWidth, dstHeight)
+                  : convertFrame<Format::Yuvj420p, false>(data, linesize, dst, dstStride, dstWidth, dstHeight);
+        return true;
+    case Format::Nv12:
+        downscale ? convertFrame<Format::Nv12, true>(data, linesize, dst, dstStride, dstWidth, dstHeight)
+                  : convertFrame<Format::Nv12, false>(data, linesize, dst, dstStride, dstWidth, dstHeight);
+        return true;
+    case Format::Yuv420p10le:
+        downscale ? convertFrame<Format::Yuv420p10le, true>(data, linesize, dst, dstStride, dstWidth, dstHeight)
+                  : convertFrame<Format::Yuv420p10le, false>(data, linesize, dst, dstStride, dstWidth, dstHeight);
+        return true;
+    default:
+        return false;
+    }
+}
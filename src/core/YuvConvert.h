@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// In-tree YUV -> RGBA8 conversion for the formats that dominate real files.
+// Kernels are specialised per source format at compile time and dispatched at runtime
+// between AVX2, SSE4.1 and scalar; anything else (other formats or scale factors) is left to swscale.
+// Colour math matches swscale's defaults (BT.601, range implied by the format).
+class YuvConverter {
+public:
+    enum class Format { Unsupported, Yuv420p, Yuvj420p, Nv12, Yuv420p10le };
+    enum class Isa { Scalar, Sse41, Avx2 };
+
+    // Picks the best ISA of this CPU; RENKO_YUV_ISA=scalar|sse41|avx2|off overrides (off = always swscale)
+    YuvConverter();
+
+    // Only 1:1 and exact 2:1 downscales are handled
+    static bool supports(Format format, int srcWidth, int srcHeight, int dstWidth, int dstHeight);
+
+    // Returns false without touching dst when the conversion is not supported or disabled
+    bool convert(Format format, const uint8_t* const data[4], const int linesize[4], int srcWidth, int srcHeight,
+                 uint8_t* dst, int dstStride, int dstWidth, int dstHeight);
+
+    bool isEnabled() const { return m_enabled; }
+    Isa isa() const { return m_isa; }
+    void setIsa(Isa isa);
+    static Isa detectIsa();
+    static const char* isaName(Isa isa);
+
+private:
+    template <Format F, bool Downscale>
+    void convertFrame(const uint8_t* const data[4], const int linesize[4], uint8_t* dst, int dstStride,
+                      int width, int height);
+
+    Isa m_isa = Isa::Scalar;
+    bool m_enabled = true;
+
+    // Row scratch for formats whose planes cannot be fed to the kernels directly
+    std::vector<uint8_t> m_yRow;
+    std::vector<uint8_t> m_uRow;
+    std::vector<uint8_t> m_vRow;
+};
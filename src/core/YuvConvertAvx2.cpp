@@ -0,0 +1,65 @@
+// Built with -mavx2 (see CMakeLists.txt); only called after a runtime CPU check
+#include "YuvConvertKernels.h"
+#include <immintrin.h>
+#include <cstring>
+
+namespace YuvConvertKernels {
+
+namespace {
+
+inline __m256i load8(const uint8_t* p) {
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+}
+
+inline __m256i load4Doubled(const uint8_t* p) {
+    int32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    __m256i c = _mm256_cvtepu8_epi32(_mm_cvtsi32_si128(v));
+    return _mm256_permutevar8x32_epi32(c, _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3));
+}
+
+inline __m256i clamp(__m256i v) {
+    return _mm256_min_epi32(_mm256_max_epi32(v, _mm256_setzero_si256()), _mm256_set1_epi32(255));
+}
+
+} // namespace
+
+template <bool ChromaHalf>
+void convertRowAvx2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int width,
+                    const Coefficients& c) {
+    const __m256i yOffset = _mm256_set1_epi32(c.yOffset);
+    const __m256i yScale = _mm256_set1_epi32(c.y);
+    const __m256i rv = _mm256_set1_epi32(c.rv);
+    const __m256i gu = _mm256_set1_epi32(c.gu);
+    const __m256i gv = _mm256_set1_epi32(c.gv);
+    const __m256i bu = _mm256_set1_epi32(c.bu);
+    const __m256i half = _mm256_set1_epi32(128);
+    const __m256i alpha = _mm256_set1_epi32((int)0xFF000000u);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i luma = load8(y + x);
+        __m256i cb = ChromaHalf ? load4Doubled(u + x / 2) : load8(u + x);
+        __m256i cr = ChromaHalf ? load4Doubled(v + x / 2) : load8(v + x);
+
+        luma = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(luma, yOffset), yScale), half);
+        cb = _mm256_sub_epi32(cb, half);
+        cr = _mm256_sub_epi32(cr, half);
+
+        __m256i r = _mm256_srai_epi32(_mm256_add_epi32(luma, _mm256_mullo_epi32(cr, rv)), 8);
+        __m256i g = _mm256_srai_epi32(_mm256_sub_epi32(luma, _mm256_add_epi32(_mm256_mullo_epi32(cb, gu),
+                                                                              _mm256_mullo_epi32(cr, gv))), 8);
+        __m256i b = _mm256_srai_epi32(_mm256_add_epi32(luma, _mm256_mullo_epi32(cb, bu)), 8);
+
+        // Little-endian RGBA: R in the low byte
+        __m256i rgba = _mm256_or_si256(_mm256_or_si256(clamp(r), _mm256_slli_epi32(clamp(g), 8)),
+                                       _mm256_or_si256(_mm256_slli_epi32(clamp(b), 16), alpha));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), rgba);
+    }
+    convertRowScalar<ChromaHalf>(y, u, v, dst, x, width, c);
+}
+
+template void convertRowAvx2<true>(const uint8_t*, const uint8_t*, const uint8_t*, uint8_t*, int, const Coefficients&);
+template void convertRowAvx2<false>(const uint8_t*, const uint8_t*, const uint8_t*, uint8_t*, int, const Coefficients&);
+
+} // namespace YuvConvertKernels
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+
+// Row kernels shared by the per-ISA translation units (YuvConvertSse41.cpp, YuvConvertAvx2.cpp).
+// Each converts one output row from 8-bit Y, U and V rows; U/V are either half the output width
+// (4:2:0 at 1:1) or full width (4:2:0 at 2:1, where every output pixel has its own chroma sample).
+namespace YuvConvertKernels {
+
+// Fixed point with 8 fractional bits
+struct Coefficients {
+    int yOffset;
+    int y;
+    int rv;
+    int gu;
+    int gv;
+    int bu;
+};
+
+// BT.601 limited range (16-235 / 16-240)
+constexpr Coefficients LimitedRange{16, 298, 409, 100, 208, 516};
+// BT.601 full range (JPEG)
+constexpr Coefficients FullRange{0, 256, 359, 88, 183, 454};
+
+using RowKernel = void (*)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int width,
+                           const Coefficients& c);
+
+inline uint8_t clampToByte(int value) {
+    return (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+// Reference implementation, also used for the tails the SIMD loops leave behind.
+// The SIMD kernels use the same integer math, so all paths produce identical pixels.
+template <bool ChromaHalf>
+inline void convertRowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst,
+                             int begin, int width, const Coefficients& c) {
+    for (int x = begin; x < width; ++x) {
+        const int chroma = ChromaHalf ? x >> 1 : x;
+        const int luma = c.y * (y[x] - c.yOffset) + 128;
+        const int cb = u[chroma] - 128;
+        const int cr = v[chroma] - 128;
+        dst[x * 4 + 0] = clampToByte((luma + c.rv * cr) >> 8);
+        dst[x * 4 + 1] = clampToByte((luma - c.gu * cb - c.gv * cr) >> 8);
+        dst[x * 4 + 2] = clampToByte((luma + c.bu * cb) >> 8);
+        dst[x * 4 + 3] = 255;
+    }
+}
+
+template <bool ChromaHalf>
+void convertRowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int width,
+                      const Coefficients& c) {
+    convertRowScalar<ChromaHalf>(y, u, v, dst, 0, width, c);
+}
+
+#ifdef RENKO_YUV_X86
+template <bool ChromaHalf>
+void convertRowSse41(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int width,
+                     const Coefficients& c);
+template <bool ChromaHalf>
+void convertRowAvx2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int width,
+                    const Coefficients& c);
+#endif
+
+} // namespace YuvConvertKernels
@@ -0,0 +1,67 @@
+// Built with -msse4.1 (see CMakeLists.txt); only called after a runtime CPU check
+#include "YuvConvertKernels.h"
+#include <smmintrin.h>
+#include <cstring>
+
+namespace YuvConvertKernels {
+
+namespace {
+
+inline __m128i load4(const uint8_t* p) {
+    int32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v));
+}
+
+inline __m128i load2Doubled(const uint8_t* p) {
+    uint16_t v;
+    std::memcpy(&v, p, sizeof(v));
+    __m128i c = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v));
+    return _mm_unpacklo_epi32(c, c); // c0 c0 c1 c1
+}
+
+inline __m128i clamp(__m128i v) {
+    return _mm_min_epi32(_mm_max_epi32(v, _mm_setzero_si128()), _mm_set1_epi32(255));
+}
+
+} // namespace
+
+template <bool ChromaHalf>
+void convertRowSse41(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* dst, int width,
+                     const Coefficients& c) {
+    const __m128i yOffset = _mm_set1_epi32(c.yOffset);
+    const __m128i yScale = _mm_set1_epi32(c.y);
+    const __m128i rv = _mm_set1_epi32(c.rv);
+    const __m128i gu = _mm_set1_epi32(c.gu);
+    const __m128i gv = _mm_set1_epi32(c.gv);
+    const __m128i bu = _mm_set1_epi32(c.bu);
+    const __m128i half = _mm_set1_epi32(128);
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000u);
+
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i luma = load4(y + x);
+        __m128i cb = ChromaHalf ? load2Doubled(u + x / 2) : load4(u + x);
+        __m128i cr = ChromaHalf ? load2Doubled(v + x / 2) : load4(v + x);
+
+        luma = _mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(luma, yOffset), yScale), half);
+        cb = _mm_sub_epi32(cb, half);
+        cr = _mm_sub_epi32(cr, half);
+
+        __m128i r = _mm_srai_epi32(_mm_add_epi32(luma, _mm_mullo_epi32(cr, rv)), 8);
+        __m128i g = _mm_srai_epi32(_mm_sub_epi32(luma, _mm_add_epi32(_mm_mullo_epi32(cb, gu),
+                                                                     _mm_mullo_epi32(cr, gv))), 8);
+        __m128i b = _mm_srai_epi32(_mm_add_epi32(luma, _mm_mullo_epi32(cb, bu)), 8);
+
+        // Little-endian RGBA: R in the low byte
+        __m128i rgba = _mm_or_si128(_mm_or_si128(clamp(r), _mm_slli_epi32(clamp(g), 8)),
+                                    _mm_or_si128(_mm_slli_epi32(clamp(b), 16), alpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), rgba);
+    }
+    convertRowScalar<ChromaHalf>(y, u, v, dst, x, width, c);
+}
+
+template void convertRowSse41<true>(const uint8_t*, const uint8_t*, const uint8_t*, uint8_t*, int, const Coefficients&);
+template void convertRowSse41<false>(const uint8_t*, const uint8_t*, const uint8_t*, uint8_t*, int, const Coefficients&);
+
+} // namespace YuvConvertKernels
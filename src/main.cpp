@@ -3,10 +3,44 @@
 #include <QIcon>
 #include <QQuickWindow>
 #include <QQuickStyle>
+#include <QThreadPool>
+#include "ui/MediaPlayerEngine.h"
 #include "ui/VideoRenderItem.h"
 #include "ui/PanoramaRenderItem.h"
+#include "ui/MediaProbeModel.h"
+#include "ui/MediaProbeCache.h"
+#include "ui/PacingHarness.h"
+#include "ui/StartupTrace.h"
+#include "core/FFmpegInit.h"
+#include "core/IoBenchmark.h"
+#include "core/YuvBenchmark.h"
+#include <cstdlib>
+#include <cstring>
 
 int main(int argc, char *argv[]) {
+    bool startupTrace = false;
+    const char* startupSource = nullptr;
+    // Diagnostic modes that do not need a window
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--startup-trace") == 0) {
+            startupTrace = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') startupSource = argv[i + 1];
+        }
+        if (std::strcmp(argv[i], "--yuv-benchmark") == 0) {
+            return runYuvBenchmark();
+        }
+        if (std::strcmp(argv[i], "--io-benchmark") == 0 && i + 1 < argc) {
+            return i + 2 < argc ? runIoBenchmark(argv[i + 1], std::atoll(argv[i + 2])) : runIoBenchmark(argv[i + 1]);
+        }
+    }
+    StartupTrace::begin(startupTrace);
+
+    // Network and TLS setup overlaps with bringing up the window; the first open waits for it if needed
+    QThreadPool::globalInstance()->start([]() {
+        initFFmpeg();
+        StartupTrace::mark("ffmpeg initialised");
+    });
+
     // Force OpenGL backend for QQuickFramebufferObject support
     // Windows defaults to Direct3D 11 in Qt 6, which breaks QOpenGL* classes
     QQuickWindow::setGraphicsApi(QSGRendererInterface::OpenGL);
@@ -26,6 +60,7 @@ int main(int argc, char *argv[]) {
     QCoreApplication::setApplicationName("RenkoPlayer");
 
     QGuiApplication app(argc, argv);
+    StartupTrace::mark("application created");
 
     // Explicitly set Fusion style to avoid default windows style
     QQuickStyle::setStyle("Fusion");
@@ -34,14 +69,18 @@ int main(int argc, char *argv[]) {
     // Default prefix is /qt/qml/<URI>/...
     app.setWindowIcon(QIcon(":/qt/qml/RenkoPlayer/assets/icons/app.ico"));
 
+    qmlRegisterType<MediaPlayerEngine>("RenkoPlayer", 1, 0, "MediaPlayerEngine");
     qmlRegisterType<VideoRenderItem>("RenkoPlayer", 1, 0, "VideoRenderItem");
     qmlRegisterType<PanoramaRenderItem>("RenkoPlayer", 1, 0, "PanoramaRenderItem");
+    qmlRegisterType<MediaProbeModel>("RenkoPlayer", 1, 0, "MediaProbeModel");
 
-    QQmlApplicationEngine engine;
+    // Needs the GUI application and the registered view types, but none of the QML UI
+    if (app.arguments().contains(QStringLiteral("--pacing-harness"))) {
+        return runPacingHarness(app.arguments());
+    }
 
-    // Debug: Print import paths
-    qDebug() << "QML Import Paths:" << engine.importPathList();
-    qDebug() << "QML2_IMPORT_PATH env:" << qgetenv("QML2_IMPORT_PATH");
+    QQmlApplicationEngine engine;
+    engine.addImageProvider("mediaprobe", new MediaPosterProvider);
 
     // Updated path for Qt 6 Standard Policy (QTP0001)
     const QUrl url(u"qrc:/qt/qml/RenkoPlayer/qml/main.qml"_qs);
@@ -52,7 +91,26 @@ int main(int argc, char *argv[]) {
             QCoreApplication::exit(-1);
     }, Qt::QueuedConnection);
 
+    if (StartupTrace::enabled()) {
+        QObject::connect(&engine, &QQmlApplicationEngine::objectCreated, &app, [](QObject* obj) {
+            StartupTrace::mark("qml loaded");
+            if (auto* window = qobject_cast<QQuickWindow*>(obj)) {
+                QObject::connect(window, &QQuickWindow::frameSwapped, window, []() {
+                    StartupTrace::mark("first window frame");
+                }, Qt::DirectConnection);
+            }
+        });
+    }
+
     engine.load(url);
 
+    // `--startup-trace <file>` plays it right away, so time to first frame is measured end to end
+    if (startupSource && !engine.rootObjects().isEmpty()) {
+        if (auto* player = engine.rootObjects().first()->findChild<MediaPlayerEngine*>()) {
+            player->setSource(QUrl::fromLocalFile(QString::fromLocal8Bit(startupSource)).toString());
+            player->play();
+        }
+    }
+
     return app.exec();
 }
\ No newline at end of file
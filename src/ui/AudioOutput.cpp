@@ -0,0 +1,238 @@
+#include "AudioOutput.h"
+#include "StartupTrace.h"
+#include <QAudioSink>
+#include <QDebug>
+#include <QIODevice>
+#include <QMediaDevices>
+#include <QTimer>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// The device the sink pulls from. Reads land directly in the sink's buffer; gaps are
+// filled with silence so the sink never stalls. The audio clock stays right because the
+// next real sample is still queued behind that silence.
+class DecoderAudioSource : public QIODevice {
+public:
+    DecoderAudioSource(VideoDecoder& decoder, int bytesPerFrame, std::function<void()> onUnderrun,
+                       std::function<void(const char*, int)> onConsumed, QObject* parent)
+        : QIODevice(parent), m_decoder(decoder), m_bytesPerFrame(std::max(bytesPerFrame, 1)),
+          m_onUnderrun(std::move(onUnderrun)), m_onConsumed(std::move(onConsumed)) {}
+
+    bool isSequential() const override { return true; }
+    // Always readable, see readData()
+    qint64 bytesAvailable() const override { return std::numeric_limits<int>::max(); }
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override {
+        // Whole sample frames only, or the silence below would shift the channels
+        maxSize -= maxSize % m_bytesPerFrame;
+        if (maxSize <= 0) return 0;
+        // After open or a seek nothing has been decoded yet; that wait is not an underrun
+        const bool started = m_decoder.getAudioClock() >= 0.0;
+        const int request = (int)std::min<qint64>(maxSize, std::numeric_limits<int>::max());
+        const int read = m_decoder.getAudioData(reinterpret_cast<uint8_t*>(data), request);
+        if (read > 0) m_onConsumed(data, read);
+
+        if (read < request) {
+            std::memset(data + read, 0, (size_t)(request - read)); // Silence for signed and float PCM
+            if (started && !m_starved) {
+                m_starved = true;
+                m_onUnderrun();
+            }
+        } else {
+            m_starved = false;
+        }
+        return request;
+    }
+
+    qint64 writeData(const char*, qint64) override { return -1; }
+
+private:
+    VideoDecoder& m_decoder;
+    int m_bytesPerFrame;
+    std::function<void()> m_onUnderrun;
+    std::function<void(const char*, int)> m_onConsumed;
+    bool m_starved = false;
+};
+
+} // namespace
+
+class AudioOutput::Worker : public QObject {
+public:
+    Worker(VideoDecoder& decoder, AudioOutput* owner) : m_decoder(decoder), m_owner(owner) {
+        m_syncTimer = new QTimer(this);
+        m_syncTimer->setInterval(10);
+        connect(m_syncTimer, &QTimer::timeout, this, [this]() { syncClock(); });
+    }
+
+    void start(const QAudioDevice& device, const QAudioFormat& format) {
+        stop();
+        if (!device.isFormatSupported(format)) {
+            qWarning() << "Audio device rejects negotiated format" << format;
+        }
+        m_source = new DecoderAudioSource(m_decoder, format.bytesPerFrame(), [this]() {
+            ++m_owner->m_underruns;
+            emit m_owner->underrunsChanged();
+        }, [this](const char* data, int bytes) { reportConsumed(data, bytes); }, this);
+        m_source->open(QIODevice::ReadOnly);
+
+        m_sink = new QAudioSink(device, format, this);
+        m_sink->setVolume(m_owner->m_volume);
+        m_sink->start(m_source);
+        m_syncTimer->start();
+        StartupTrace::mark("audio sink started");
+    }
+
+    void stop() {
+        m_syncTimer->stop();
+        if (m_sink) {
+            m_sink->stop();
+            delete m_sink;
+            m_sink = nullptr;
+        }
+        delete m_source;
+        m_source = nullptr;
+    }
+
+    void suspend() {
+        if (m_sink && (m_sink->state() == QAudio::ActiveState || m_sink->state() == QAudio::IdleState)) {
+            m_sink->suspend();
+        }
+    }
+
+    void resume() {
+        if (m_sink && m_sink->state() == QAudio::SuspendedState) {
+            m_sink->resume();
+        }
+    }
+
+    void setVolume(qreal volume) {
+        if (m_sink) m_sink->setVolume(volume);
+    }
+
+private:
+    void reportConsumed(const char* data, int bytes) {
+        std::lock_guard<std::mutex> lock(m_owner->m_observerMutex);
+        if (!m_owner->m_consumeObserver || !m_sink) return;
+        const qint64 pending = m_sink->bufferSize() - m_sink->bytesFree();
+        const qint64 bytesPerSecond = m_sink->format().bytesForDuration(1000000);
+        const double delay = bytesPerSecond > 0 ? (double)pending / bytesPerSecond : 0.0;
+        m_owner->m_consumeObserver(reinterpret_cast<const uint8_t*>(data), bytes, delay);
+    }
+
+    // Audio is the master: bytes handed to the sink but not played yet are still ahead of the speaker
+    void syncClock() {
+        double audioClock = m_decoder.getAudioClock();
+        if (!m_sink || audioClock < 0.0 || m_sink->state() != QAudio::ActiveState) return;
+
+        qint64 pending = m_sink->bufferSize() - m_sink->bytesFree();
+        qint64 bytesPerSecond = m_sink->format().bytesForDuration(1000000);
+        if (bytesPerSecond > 0) {
+            m_decoder.clock().sync(audioClock - (double)pending / bytesPerSecond);
+        }
+    }
+
+    VideoDecoder& m_decoder;
+    AudioOutput* m_owner;
+    QAudioSink* m_sink = nullptr;
+    DecoderAudioSource* m_source = nullptr;
+    QTimer* m_syncTimer = nullptr;
+};
+
+AudioOutput::AudioOutput(VideoDecoder& decoder, QObject* parent) : QObject(parent), m_decoder(decoder) {
+    m_worker = new Worker(m_decoder, this);
+    m_worker->moveToThread(&m_thread);
+    m_thread.setObjectName("RenkoAudio");
+    m_thread.start(QThread::HighPriority);
+}
+
+AudioOutput::~AudioOutput() {
+    QMetaObject::invokeMethod(m_worker, [this]() { m_worker->stop(); }, Qt::BlockingQueuedConnection);
+    m_thread.quit();
+    m_thread.wait();
+    delete m_worker;
+}
+
+void AudioOutput::configure(const QAudioDevice& device) {
+    m_device = device;
+    const QAudioFormat preferred = device.preferredFormat();
+
+    VideoDecoder::AudioFormat format;
+    if (preferred.isValid()) {
+        format.sampleRate = preferred.sampleRate();
+        format.channels = preferred.channelCount();
+        switch (preferred.sampleFormat()) {
+        case QAudioFormat::Float: format.sampleType = VideoDecoder::AudioFormat::SampleType::Float; break;
+        case QAudioFormat::Int32: format.sampleType = VideoDecoder::AudioFormat::SampleType::Int32; break;
+        default: format.sampleType = VideoDecoder::AudioFormat::SampleType::Int16; break;
+        }
+    }
+    m_decoder.setAudioDeviceFormat(format, device.maximumChannelCount());
+}
+
+void AudioOutput::configureDefaultDevice() {
+    // Enumerating devices can take a while on the first call (PulseAudio, WASAPI)
+    QMetaObject::invokeMethod(m_worker, [this]() { configure(QMediaDevices::defaultAudioOutput()); },
+                              Qt::BlockingQueuedConnection);
+}
+
+void AudioOutput::start() {
+    const VideoDecoder::AudioFormat decoded = m_decoder.audioFormat();
+    QAudioFormat format;
+    format.setSampleRate(decoded.sampleRate);
+    format.setChannelCount(decoded.channels);
+    format.setChannelConfig(QAudioFormat::defaultChannelConfigForChannelCount(decoded.channels));
+    switch (decoded.sampleType) {
+    case VideoDecoder::AudioFormat::SampleType::Float: format.setSampleFormat(QAudioFormat::Float); break;
+    case VideoDecoder::AudioFormat::SampleType::Int32: format.setSampleFormat(QAudioFormat::Int32); break;
+    default: format.setSampleFormat(QAudioFormat::Int16); break;
+    }
+    const QAudioDevice device = m_device;
+    QMetaObject::invokeMethod(m_worker, [this, device, format]() { m_worker->start(device, format); });
+}
+
+void AudioOutput::stop() {
+    QMetaObject::invokeMethod(m_worker, [this]() { m_worker->stop(); });
+}
+
+void AudioOutput::suspend() {
+    QMetaObject::invokeMethod(m_worker, [this]() { m_worker->suspend(); });
+}
+
+void AudioOutput::resume() {
+    QMetaObject::invokeMethod(m_worker, [this]() { m_worker->resume(); });
+}
+
+void AudioOutput::setConsumeObserver(ConsumeObserver observer) {
+    std::lock_guard<std::mutex> lock(m_observerMutex);
+    m_consumeObserver = std::move(observer);
+}
+
+void AudioOutput::setVolume(qreal volume) {
+    m_volume = volume;
+    QMetaObject::invokeMethod(m_worker, [this, volume]() { m_worker->setVolume(volume); });
+}
+
+QStringList AudioOutput::trackLabels(const std::vector<VideoDecoder::AudioStream>& streams) {
+    QStringList labels;
+    for (size_t i = 0; i < streams.size(); ++i) {
+        QString label = QString::fromStdString(streams[i].title);
+        QStringList details;
+        if (!streams[i].language.empty()) details << QString::fromStdString(streams[i].language);
+        switch (streams[i].channels) {
+        case 0: break;
+        case 1: details << QStringLiteral("mono"); break;
+        case 2: details << QStringLiteral("stereo"); break;
+        case 6: details << QStringLiteral("5.1"); break;
+        case 8: details << QStringLiteral("7.1"); break;
+        default: details << QStringLiteral("%1 ch").arg(streams[i].channels); break;
+        }
+        if (label.isEmpty()) label = QStringLiteral("Track %1").arg(i + 1);
+        if (!details.isEmpty()) label += QStringLiteral(" (%1)").arg(details.join(QStringLiteral(", ")));
+        labels.append(label);
+    }
+    return labels;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QObject>
+#include <QThread>
+#include <QAudioDevice>
+#include <QAudioFormat>
+#include <QStringList>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include "../core/VideoDecoder.h"
+
+// Plays the decoder's audio through a QAudioSink in pull mode. The sink and the device it
+// pulls from live on a dedicated thread and read straight from the decoder's ring buffer,
+// so a busy GUI thread can no longer starve the audio device.
+// Control calls are thread-safe and take effect asynchronously on the audio thread.
+class AudioOutput : public QObject {
+    Q_OBJECT
+
+public:
+    explicit AudioOutput(VideoDecoder& decoder, QObject* parent = nullptr);
+    ~AudioOutput(); // Stops playback and joins the audio thread
+
+    // Hands the device's native format to the decoder; call before VideoDecoder::open()
+    void configure(const QAudioDevice& device);
+    // configure() with the default output, looked up on the audio thread. Blocks until done, so
+    // it belongs on the thread that opens the decoder, not the GUI thread.
+    void configureDefaultDevice();
+    // (Re)creates the sink in the format the decoder negotiated; the volume set before carries over
+    void start();
+    void stop();
+    void suspend();
+    void resume();
+    void setVolume(qreal volume);
+
+    // Times the device asked for more data than was decoded (counted once per gap)
+    int underruns() const { return m_underruns; }
+
+    // Diagnostics: called on the audio thread with each block of decoded PCM handed to the device
+    // (in the decoder's audioFormat()) and the estimated delay until its first sample plays, i.e.
+    // what is still queued in the sink. Latency inside the system mixer and hardware is not included.
+    using ConsumeObserver = std::function<void(const uint8_t* data, int bytes, double delaySeconds)>;
+    void setConsumeObserver(ConsumeObserver observer);
+
+    // Display names for the decoder's audio streams, e.g. "Commentary (eng, 5.1)"
+    static QStringList trackLabels(const std::vector<VideoDecoder::AudioStream>& streams);
+
+signals:
+    void underrunsChanged();
+
+private:
+    class Worker;
+
+    VideoDecoder& m_decoder;
+    QAudioDevice m_device;
+    QThread m_thread;
+    Worker* m_worker = nullptr;
+    std::atomic<qreal> m_volume{1.0};
+    std::atomic<int> m_underruns{0};
+    std::mutex m_observerMutex;
+    ConsumeObserver m_consumeObserver;
+};
@@ -0,0 +1,99 @@
+#include "FramePacer.h"
+#include <QQuickWindow>
+#include <QScreen>
+#include <cmath>
+
+FramePacer::FramePacer(VideoDecoder& decoder, FrameHandler handler, QObject* parent)
+    : QObject(parent), m_decoder(decoder), m_handler(std::move(handler)) {
+    m_timer.start();
+    m_intervals.reserve(IntervalHistory);
+}
+
+void FramePacer::setWindow(QQuickWindow* window) {
+    if (m_window == window) return;
+    disconnect(m_swapConnection);
+    m_window = window;
+    if (m_window) {
+        // frameSwapped is emitted on the render thread; the queued hop lands right after the swap
+        m_swapConnection = connect(m_window, &QQuickWindow::frameSwapped, this, &FramePacer::onFrameSwapped,
+                                   Qt::QueuedConnection);
+        kick();
+    }
+}
+
+void FramePacer::kick() {
+    if (m_window) m_window->update();
+}
+
+void FramePacer::reset() {
+    m_lastPresentNs = -1;
+}
+
+double FramePacer::refreshInterval() const {
+    QScreen* screen = m_window ? m_window->screen() : nullptr;
+    qreal rate = screen ? screen->refreshRate() : 60.0;
+    return 1.0 / (rate > 1.0 ? rate : 60.0);
+}
+
+void FramePacer::onFrameSwapped() {
+    FrameQueue& queue = m_decoder.frameQueue();
+    PlaybackClock& clock = m_decoder.clock();
+
+    std::vector<VideoDecoder::FramePtr> due;
+    if (!clock.isStarted()) {
+        // The first frame after open/seek defines the timeline
+        if (VideoDecoder::FramePtr first = queue.takeFirst()) {
+            clock.start(first->pts);
+            due.push_back(std::move(first));
+        }
+    } else {
+        // Whatever is picked now becomes visible at the next swap
+        due = queue.takeDue(clock.time() + refreshInterval());
+    }
+
+    if (!due.empty()) {
+        int shown = 0;
+        for (const VideoDecoder::FramePtr& frame : due) {
+            if (!frame->refresh) ++shown;
+        }
+        if (shown > 0) {
+            m_droppedFrames += shown - 1;
+            recordPresentation();
+        }
+        m_handler(due);
+    }
+
+    // Keep vsync ticks coming while playing; when paused only the first frame after a seek
+    // is still waiting, later refresh frames kick() on their own
+    if (m_decoder.isPlaying() || (!clock.isStarted() && !queue.empty())) {
+        kick();
+    }
+}
+
+void FramePacer::recordPresentation() {
+    const qint64 now = m_timer.nsecsElapsed();
+    if (m_lastPresentNs >= 0 && !m_decoder.clock().isPaused()) {
+        double interval = (now - m_lastPresentNs) / 1e6;
+        if ((int)m_intervals.size() < IntervalHistory) {
+            m_intervals.push_back(interval);
+        } else {
+            m_intervals[m_intervalIndex] = interval;
+            m_intervalIndex = (m_intervalIndex + 1) % IntervalHistory;
+        }
+    }
+    m_lastPresentNs = now;
+
+    // QML only needs a few updates per second
+    if (now - m_lastStatsNs < 250000000 || m_intervals.empty()) return;
+    m_lastStatsNs = now;
+
+    double sum = 0.0;
+    for (double interval : m_intervals) sum += interval;
+    double mean = sum / m_intervals.size();
+    double variance = 0.0;
+    for (double interval : m_intervals) variance += (interval - mean) * (interval - mean);
+
+    m_displayIntervalMs = mean;
+    m_displayJitterMs = std::sqrt(variance / m_intervals.size());
+    emit statsChanged();
+}
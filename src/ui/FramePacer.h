@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+#include <QElapsedTimer>
+#include <functional>
+#include <vector>
+#include "../core/VideoDecoder.h"
+
+class QQuickWindow;
+
+// Presents decoded frames on the display's vsync cadence instead of the decoder's sleep timing.
+// Every QQuickWindow::frameSwapped (delivered to the GUI thread) it takes the frames that are due
+// by the next swap according to the playback clock, and keeps the window rendering while playing.
+class FramePacer : public QObject {
+    Q_OBJECT
+
+public:
+    // Receives the due frames oldest first; frames that were due but superseded are included
+    // so partial (tile) updates are never lost
+    using FrameHandler = std::function<void(std::vector<VideoDecoder::FramePtr>& frames)>;
+
+    FramePacer(VideoDecoder& decoder, FrameHandler handler, QObject* parent = nullptr);
+
+    void setWindow(QQuickWindow* window);
+    // A frame was queued or playback resumed: make sure the next vsync tick comes
+    void kick();
+    // Seek, pause or new source: the next interval would not be a real display interval
+    void reset();
+
+    qreal displayIntervalMs() const { return m_displayIntervalMs; }
+    qreal displayJitterMs() const { return m_displayJitterMs; }
+    int droppedFrames() const { return m_droppedFrames; }
+
+signals:
+    void statsChanged();
+
+private:
+    void onFrameSwapped();
+    void recordPresentation();
+    double refreshInterval() const;
+
+    static constexpr int IntervalHistory = 120;
+
+    VideoDecoder& m_decoder;
+    FrameHandler m_handler;
+    QPointer<QQuickWindow> m_window;
+    QMetaObject::Connection m_swapConnection;
+
+    QElapsedTimer m_timer;
+    qint64 m_lastPresentNs = -1;
+    qint64 m_lastStatsNs = 0;
+    std::vector<double> m_intervals;
+    int m_intervalIndex = 0;
+    qreal m_displayIntervalMs = 0.0;
+    qreal m_displayJitterMs = 0.0;
+    int m_droppedFrames = 0;
+};
@@ -0,0 +1,742 @@
+#include "MediaPlayerEngine.h"
+#include "StartupTrace.h"
+#include <QQuickWindow>
+#include <QStandardPaths>
+#include <QUrl>
+#include <QDebug>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QThread>
+#include <QTime>
+#include "../core/ClipExporter.h"
+#include "../core/FrameSnapshot.h"
+#include <algorithm>
+
+namespace {
+// Snapshots queued or encoding at once; each holds one decoded picture
+constexpr int MaxPendingSnapshots = 8;
+} // namespace
+
+MediaPlayerEngine::MediaPlayerEngine(QObject* parent) : QObject(parent) {
+    // Encoding a 4K PNG takes longer than a frame interval; keep it off the cores decoding needs
+    m_snapshotPool.setMaxThreadCount(std::clamp(QThread::idealThreadCount() / 4, 1, 2));
+    m_snapshotPool.setThreadPriority(QThread::LowPriority);
+
+    m_pacer = new FramePacer(m_decoder, [this](std::vector<VideoDecoder::FramePtr>& frames) {
+        this->presentFrames(frames);
+    }, this);
+    connect(m_pacer, &FramePacer::statsChanged, this, &MediaPlayerEngine::statsChanged);
+
+    // Frames are presented on vsync by the pacer; the decoder only signals that one is queued
+    m_decoder.setFrameCallback([this]() {
+        QMetaObject::invokeMethod(m_pacer, &FramePacer::kick, Qt::QueuedConnection);
+    });
+
+    m_decoder.setErrorCallback([this](const std::string& msg) {
+        this->handleError(msg);
+    });
+
+    // Audio is pulled by the sink on its own thread
+    m_audioOutput = new AudioOutput(m_decoder, this);
+    connect(m_audioOutput, &AudioOutput::underrunsChanged, this, &MediaPlayerEngine::statsChanged);
+
+    // A scrub seek that never shows a frame (e.g. past the last keyframe) must not block the next one
+    m_scrubTimeout = new QTimer(this);
+    m_scrubTimeout->setSingleShot(true);
+    m_scrubTimeout->setInterval(250);
+    connect(m_scrubTimeout, &QTimer::timeout, this, [this]() {
+        m_scrubInFlight = false;
+        serveScrub();
+    });
+
+    // The window of a time-shifted source grows at the live edge and drops its oldest segments
+    m_liveWindowTimer = new QTimer(this);
+    m_liveWindowTimer->setInterval(500);
+    connect(m_liveWindowTimer, &QTimer::timeout, this, &MediaPlayerEngine::updateLiveWindow);
+    applyTimeShift();
+
+    m_sessionThread = std::jthread([this](std::stop_token stop) {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_jobMutex);
+                if (!m_jobCondition.wait(lock, stop, [this]() { return !m_jobs.empty(); })) return;
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+            job();
+        }
+    });
+}
+
+MediaPlayerEngine::~MediaPlayerEngine() {
+    // Snapshots only touch their own copy of the frame reference
+    m_snapshotPool.waitForDone();
+
+    // Cancelled exports return from their next read
+    m_exportThread.request_stop();
+    if (m_exportThread.joinable()) {
+        m_exportThread.join();
+    }
+
+    // An open in flight gives up at its next interrupt check; queued jobs are dropped
+    m_openStop.request_stop();
+    m_sessionThread.request_stop();
+    if (m_sessionThread.joinable()) {
+        m_sessionThread.join();
+    }
+
+    // The audio thread reads from the decoder, so it goes first
+    delete m_audioOutput;
+    m_audioOutput = nullptr;
+
+    m_decoder.stop();
+}
+
+void MediaPlayerEngine::postSessionJob(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(m_jobMutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_jobCondition.notify_one();
+}
+
+void MediaPlayerEngine::setSource(const QString& source) {
+    if (m_source == source) return;
+    m_source = source;
+
+    stopScrub();
+    m_lastFrame.reset();
+    m_duration = 0;
+    m_position = 0;
+    m_pacer->reset();
+    m_audioTracks.clear();
+    m_subtitleTracks.clear();
+    m_audioOutput->stop();
+    m_liveWindowTimer->stop();
+    m_live = false;
+    m_liveWindowStart = 0;
+    m_liveWindowEnd = 0;
+
+    // Views drop what they show on sourceChanged
+    emit sourceChanged();
+    emit durationChanged();
+    emit positionChanged();
+    emit audioTracksChanged();
+    emit audioTrackChanged();
+    emit subtitleTracksChanged();
+    emit subtitleTrackChanged();
+    emit liveWindowChanged();
+
+    if (!m_source.isEmpty()) {
+        StartupTrace::mark("source set");
+        open(false);
+    } else {
+        close();
+    }
+}
+
+void MediaPlayerEngine::open(bool autoPlay) {
+    // Handle file:// URLs
+    QString path = m_source;
+    QUrl url(m_source);
+    if (url.isLocalFile()) {
+        path = url.toLocalFile();
+    }
+
+    // Whatever is still opening is superseded
+    m_openStop.request_stop();
+    m_openStop = std::stop_source();
+    const quint64 generation = ++m_generation;
+
+    m_playWhenOpened = autoPlay;
+    m_pauseWhenOpened = false;
+    m_closing = false; // A close still queued runs first; open() stops the previous source anyway
+    setLoading(true);
+
+    // Run in background to avoid blocking UI
+    std::string stdPath = path.toStdString();
+    std::stop_token cancel = m_openStop.get_token();
+    postSessionJob([this, stdPath, cancel, generation]() {
+        m_audioOutput->configureDefaultDevice();
+        StartupTrace::mark("audio device configured");
+        const bool opened = m_decoder.open(stdPath, cancel);
+        if (opened) StartupTrace::mark("source opened");
+        QMetaObject::invokeMethod(this, [this, generation, opened]() { onOpened(generation, opened); });
+    });
+}
+
+void MediaPlayerEngine::close() {
+    m_openStop.request_stop();
+    const quint64 generation = ++m_generation;
+
+    m_playWhenOpened = false;
+    m_closing = true;
+    setLoading(false);
+
+    // Joins the decode thread, which may sit in a blocking read until its interrupt check fires
+    postSessionJob([this, generation]() {
+        m_decoder.stop();
+        QMetaObject::invokeMethod(this, [this, generation]() { onClosed(generation); });
+    });
+}
+
+void MediaPlayerEngine::onOpened(quint64 generation, bool opened) {
+    if (generation != m_generation) return; // Superseded by a newer open or close
+    setLoading(false);
+    if (!opened) return;
+
+    m_duration = m_decoder.getDuration() * 1000;
+    emit durationChanged();
+    m_live = m_decoder.isTimeShifting();
+    if (m_live) {
+        m_liveWindowTimer->start();
+    } else {
+        m_liveWindowTimer->stop();
+    }
+    updateLiveWindow();
+    updateTracks();
+    emit mediaInfoChanged();
+
+    // Video first: the first frame starts the clock and goes up while the sink is still being
+    // created on the audio thread, which then syncs to that clock
+    if (m_playWhenOpened) {
+        m_decoder.play();
+        m_pacer->kick();
+        emit playingChanged();
+    }
+
+    if (m_decoder.hasAudio()) {
+        m_audioOutput->start();
+    }
+    // After start(), so the suspend is queued behind the sink it applies to
+    if (!m_playWhenOpened && m_pauseWhenOpened) {
+        pause();
+    }
+}
+
+void MediaPlayerEngine::onClosed(quint64 generation) {
+    if (generation != m_generation) return;
+    m_closing = false;
+    emit playingChanged();
+}
+
+void MediaPlayerEngine::setTimeShift(bool enabled) {
+    if (m_timeShift == enabled) return;
+    m_timeShift = enabled;
+    applyTimeShift();
+    emit timeShiftChanged();
+}
+
+void MediaPlayerEngine::setTimeShiftMinutes(int minutes) {
+    minutes = std::max(1, minutes);
+    if (m_timeShiftMinutes == minutes) return;
+    m_timeShiftMinutes = minutes;
+    applyTimeShift();
+    emit timeShiftChanged();
+}
+
+void MediaPlayerEngine::setTimeShiftMaxGB(qreal gigabytes) {
+    gigabytes = std::max<qreal>(0.1, gigabytes);
+    if (qFuzzyCompare(m_timeShiftMaxGB, gigabytes)) return;
+    m_timeShiftMaxGB = gigabytes;
+    applyTimeShift();
+    emit timeShiftChanged();
+}
+
+void MediaPlayerEngine::applyTimeShift() {
+    TimeShiftBuffer::Retention retention;
+    retention.maxSeconds = m_timeShiftMinutes * 60.0;
+    retention.maxBytes = (int64_t)(m_timeShiftMaxGB * 1024.0 * 1024.0 * 1024.0);
+    const QString directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    m_decoder.setTimeShift(m_timeShift, retention, std::filesystem::path(directory.toStdWString()));
+}
+
+void MediaPlayerEngine::updateLiveWindow() {
+    const TimeShiftBuffer::Window window = m_decoder.timeShiftWindow();
+    const qint64 start = window.start * 1000;
+    const qint64 end = window.end * 1000;
+    if (start == m_liveWindowStart && end == m_liveWindowEnd) return;
+    m_liveWindowStart = start;
+    m_liveWindowEnd = end;
+    emit liveWindowChanged();
+}
+
+void MediaPlayerEngine::jumpToLive() {
+    if (!m_live) return;
+    stopScrub();
+    // The newest keyframe is shown as is; an accurate seek would wait for the edge to move on
+    m_decoder.seek(m_decoder.timeShiftWindow().lastKeyframe, VideoDecoder::SeekMode::Keyframe);
+    m_pacer->reset();
+    if (!isPlaying()) play();
+}
+
+void MediaPlayerEngine::exportClip(qint64 inMs, qint64 outMs, const QString& path, bool smartCut) {
+    if (m_exporting) {
+        emit exportFinished(false, tr("A clip export is already running"));
+        return;
+    }
+    if (m_source.isEmpty() || m_live) {
+        // A live source would be read again from its current position
+        emit exportFinished(false, tr("Clip export needs a recorded source"));
+        return;
+    }
+    if (outMs <= inMs) {
+        emit exportFinished(false, tr("The out-point must come after the in-point"));
+        return;
+    }
+
+    QString source = m_source;
+    if (QUrl(m_source).isLocalFile()) source = QUrl(m_source).toLocalFile();
+    QString destination = path;
+    if (QUrl(path).isLocalFile()) destination = QUrl(path).toLocalFile();
+    if (QFileInfo(destination).suffix().isEmpty()) destination += ".mp4";
+
+    ClipExportRequest request;
+    request.source = source.toStdString();
+    request.destination = destination.toStdString();
+    request.inSeconds = inMs / 1000.0;
+    request.outSeconds = outMs / 1000.0;
+    request.smartCut = smartCut;
+
+    m_exporting = true;
+    m_exportProgress = 0.0;
+    emit exportingChanged();
+    emit exportProgressChanged();
+
+    // The previous export has already reported back, so this join does not wait
+    if (m_exportThread.joinable()) m_exportThread.join();
+    m_exportThread = std::jthread([this, request, destination](std::stop_token stop) {
+        std::string error;
+        const bool ok = remuxClip(request, stop, [this](double progress) {
+            QMetaObject::invokeMethod(this, [this, progress]() {
+                if (!m_exporting) return;
+                m_exportProgress = progress;
+                emit exportProgressChanged();
+            });
+        }, error);
+        const bool cancelled = stop.stop_requested();
+        QMetaObject::invokeMethod(this, [this, ok, cancelled, error, destination]() {
+            m_exporting = false;
+            emit exportingChanged();
+            if (ok) {
+                emit exportFinished(true, destination);
+            } else {
+                emit exportFinished(false, cancelled ? tr("Clip export cancelled") : QString::fromStdString(error));
+            }
+        });
+    });
+}
+
+void MediaPlayerEngine::cancelExport() {
+    m_exportThread.request_stop();
+}
+
+void MediaPlayerEngine::captureSnapshot(const QString& path, const QString& format) {
+    // Only the decoded picture is kept, not the pooled display frame, so the frame queue never
+    // runs dry while snapshots wait for the encoder
+    std::shared_ptr<const AVFrame> picture = m_lastFrame ? m_lastFrame->source : nullptr;
+    if (!picture) {
+        emit snapshotFinished(false, tr("There is no frame to capture"));
+        return;
+    }
+    if (m_snapshotsPending >= MaxPendingSnapshots) {
+        emit snapshotFinished(false, tr("Too many snapshots are still being saved"));
+        return;
+    }
+
+    QString destination = path;
+    if (QUrl(path).isLocalFile()) destination = QUrl(path).toLocalFile();
+
+    QString imageFormat = format.toLower();
+    if (imageFormat.isEmpty()) imageFormat = QFileInfo(destination).suffix().toLower();
+    if (imageFormat == "jpeg") imageFormat = "jpg";
+    if (imageFormat.isEmpty()) imageFormat = "png";
+    if (imageFormat != "png" && imageFormat != "jpg" && imageFormat != "webp") {
+        emit snapshotFinished(false, tr("Unsupported snapshot format: %1").arg(imageFormat));
+        return;
+    }
+    // WebP comes from the Qt image formats plugin, which may not be deployed
+    if (!QImageWriter::supportedImageFormats().contains(imageFormat.toLatin1())) {
+        emit snapshotFinished(false, tr("This build cannot write %1 images").arg(imageFormat.toUpper()));
+        return;
+    }
+
+    if (destination.isEmpty()) {
+        const QUrl sourceUrl(m_source);
+        QString base = QFileInfo(sourceUrl.isLocalFile() ? sourceUrl.toLocalFile() : sourceUrl.path()).completeBaseName();
+        if (base.isEmpty()) base = "snapshot";
+        // Position plus wall clock, so a burst on a paused frame does not overwrite itself
+        const QString name = QString("%1_%2_%3.%4").arg(base,
+            QTime::fromMSecsSinceStartOfDay((int)(m_position % (24LL * 3600 * 1000))).toString("HH-mm-ss-zzz"),
+            QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss-zzz"), imageFormat);
+        destination = QDir(QStandardPaths::writableLocation(QStandardPaths::PicturesLocation)).filePath(name);
+    } else if (QFileInfo(destination).suffix().isEmpty()) {
+        destination += "." + imageFormat;
+    }
+
+    ++m_snapshotsPending;
+    m_snapshotPool.start([this, picture, destination, imageFormat]() {
+        SnapshotImage image;
+        std::string error;
+        // Only PNG keeps 16 bits per channel
+        bool ok = convertSnapshot(picture.get(), imageFormat == "png", image, error);
+        QString message = ok ? destination : QString::fromStdString(error);
+        if (ok) {
+            const QImage frame(image.pixels.data(), image.width, image.height, image.bytesPerLine,
+                               image.deep ? QImage::Format_RGBA64 : QImage::Format_RGBA8888);
+            QDir().mkpath(QFileInfo(destination).absolutePath());
+            // Written to a temporary file and renamed, so a watcher never picks up half an image
+            QSaveFile file(destination);
+            QImageWriter writer(&file, imageFormat.toLatin1());
+            if (imageFormat != "png") writer.setQuality(92);
+            if (!file.open(QIODevice::WriteOnly)) {
+                ok = false;
+                message = file.errorString();
+            } else if (!writer.write(frame)) {
+                ok = false;
+                message = writer.errorString();
+            } else if (!file.commit()) {
+                ok = false;
+                message = file.errorString();
+            }
+        }
+        QMetaObject::invokeMethod(this, [this, ok, message]() {
+            --m_snapshotsPending;
+            emit snapshotFinished(ok, ok ? message : tr("Snapshot failed: %1").arg(message));
+        });
+    });
+}
+
+void MediaPlayerEngine::setLoading(bool loading) {
+    if (m_loading == loading) return;
+    m_loading = loading;
+    emit loadingChanged();
+}
+
+void MediaPlayerEngine::setPosition(qint64 position) {
+    if (m_position == position) return;
+    // m_position follows the frames as they are presented
+    m_decoder.seek(position / 1000.0);
+    m_pacer->reset();
+}
+
+QString MediaPlayerEngine::streamVariant() const {
+    const VariantSelector::Variant variant = m_decoder.streamVariant();
+    if (variant.bitrate <= 0) return QString();
+    return QStringLiteral("%1x%2, %3 Mb/s (link %4 Mb/s)")
+        .arg(variant.width)
+        .arg(variant.height)
+        .arg(variant.bitrate / 1e6, 0, 'f', 1)
+        .arg(m_decoder.downloadThroughput() / 1e6, 0, 'f', 1);
+}
+
+bool MediaPlayerEngine::isPlaying() const {
+    return m_decoder.isPlaying();
+}
+
+void MediaPlayerEngine::play() {
+    if (m_loading) {
+        // Starts as soon as the source is open
+        m_playWhenOpened = true;
+        m_pauseWhenOpened = false;
+        return;
+    }
+    // Stopped (or about to be): the source has to be opened again
+    if (m_closing || m_decoder.isStopped()) {
+        if (!m_source.isEmpty()) open(true);
+        return;
+    }
+    m_decoder.play();
+    m_audioOutput->resume();
+    m_pacer->kick();
+    emit playingChanged();
+}
+
+void MediaPlayerEngine::pause() {
+    m_playWhenOpened = false;
+    // Nothing is playing yet, and the decoder API would wait for the session thread
+    if (m_loading || m_closing) {
+        m_pauseWhenOpened = m_loading;
+        return;
+    }
+    m_decoder.pause();
+    m_pacer->reset();
+    m_audioOutput->suspend();
+    emit playingChanged();
+}
+
+void MediaPlayerEngine::stop() {
+    close();
+    m_audioOutput->stop();
+    if (m_live) {
+        // Closing deletes the buffer; a new open starts a fresh window
+        m_liveWindowTimer->stop();
+        m_live = false;
+        emit liveWindowChanged();
+    }
+    emit playingChanged();
+}
+
+void MediaPlayerEngine::beginScrub() {
+    if (m_scrubbing || m_loading || m_closing || m_decoder.isStopped()) return;
+    m_resumeAfterScrub = isPlaying();
+    if (m_resumeAfterScrub) pause();
+    m_scrubbing = true;
+    m_scrubPosition = -1;
+    m_decoder.setScrubbing(true);
+    emit scrubbingChanged();
+}
+
+void MediaPlayerEngine::scrubTo(qint64 position) {
+    if (!m_scrubbing) {
+        setPosition(position);
+        return;
+    }
+    m_scrubTarget = position;
+    m_scrubPosition = position;
+    serveScrub();
+}
+
+void MediaPlayerEngine::serveScrub() {
+    // A newer seek would throw away the keyframe being decoded, so targets wait until it is shown;
+    // only the latest one is kept meanwhile
+    if (m_scrubTarget < 0 || m_scrubInFlight) return;
+    m_decoder.seek(m_scrubTarget / 1000.0, VideoDecoder::SeekMode::Keyframe);
+    m_pacer->reset();
+    m_scrubTarget = -1;
+    m_scrubInFlight = true;
+    m_scrubTimeout->start();
+}
+
+void MediaPlayerEngine::endScrub() {
+    if (!m_scrubbing) return;
+    const qint64 position = m_scrubPosition;
+    const bool resume = m_resumeAfterScrub;
+    stopScrub();
+
+    if (position >= 0) {
+        m_decoder.seek(position / 1000.0);
+        m_pacer->reset();
+    }
+    if (resume) play();
+}
+
+void MediaPlayerEngine::stopScrub() {
+    if (!m_scrubbing) return;
+    m_scrubbing = false;
+    m_resumeAfterScrub = false;
+    m_scrubInFlight = false;
+    m_scrubTarget = -1;
+    m_scrubPosition = -1;
+    m_scrubTimeout->stop();
+    m_decoder.setScrubbing(false);
+    emit scrubbingChanged();
+}
+
+void MediaPlayerEngine::setVolume(qreal volume) {
+    if (qFuzzyCompare(m_volume, volume)) return;
+    m_volume = volume;
+    m_audioOutput->setVolume(m_volume);
+    emit volumeChanged();
+}
+
+void MediaPlayerEngine::setAudioTrack(int index) {
+    if (index == m_decoder.audioStream()) return;
+    m_decoder.setAudioStream(index);
+    emit audioTrackChanged();
+}
+
+void MediaPlayerEngine::setSubtitleTrack(int index) {
+    if (index == m_decoder.subtitleStream()) return;
+    m_decoder.setSubtitleStream(index);
+    emit subtitleTrackChanged();
+}
+
+void MediaPlayerEngine::updateTracks() {
+    m_audioTracks = AudioOutput::trackLabels(m_decoder.audioStreams());
+
+    m_subtitleTracks.clear();
+    const std::vector<VideoDecoder::SubtitleStream> streams = m_decoder.subtitleStreams();
+    for (size_t i = 0; i < streams.size(); ++i) {
+        QString label = QString::fromStdString(streams[i].title);
+        const QString language = QString::fromStdString(streams[i].language);
+        if (label.isEmpty()) label = language.isEmpty() ? QString("Track %1").arg(i + 1) : language;
+        else if (!language.isEmpty()) label += QString(" (%1)").arg(language);
+        m_subtitleTracks.append(label);
+    }
+
+    emit audioTracksChanged();
+    emit audioTrackChanged();
+    emit subtitleTracksChanged();
+    emit subtitleTrackChanged();
+}
+
+void MediaPlayerEngine::setResolution(int width, int height) {
+    m_manualWidth = width;
+    m_manualHeight = height;
+    if (!m_autoResolution) {
+        m_decoder.setTargetResolution(width, height);
+    }
+}
+
+void MediaPlayerEngine::setAutoResolution(bool enabled) {
+    if (m_autoResolution == enabled) return;
+    m_autoResolution = enabled;
+    if (m_autoResolution) {
+        applyDecoderSettings();
+    } else {
+        m_decoder.setTargetResolution(m_manualWidth, m_manualHeight);
+    }
+    emit autoResolutionChanged();
+}
+
+void MediaPlayerEngine::attachView(QQuickItem* view, FramePacer::FrameHandler handler) {
+    if (!view || findView(view)) return;
+
+    View entry;
+    entry.item = view;
+    entry.handler = std::move(handler);
+    m_views.push_back(std::move(entry));
+    StartupTrace::mark("view attached");
+
+    connect(view, &QQuickItem::visibleChanged, this, &MediaPlayerEngine::updateViews);
+    connect(view, &QQuickItem::windowChanged, this, &MediaPlayerEngine::updateViews);
+    updateViews();
+}
+
+void MediaPlayerEngine::detachView(QQuickItem* view) {
+    disconnect(view, nullptr, this, nullptr);
+    m_views.erase(std::remove_if(m_views.begin(), m_views.end(), [view](const View& v) { return v.item == view; }),
+                  m_views.end());
+    updateViews();
+}
+
+void MediaPlayerEngine::setViewOutputSize(QQuickItem* view, const QSize& size) {
+    View* entry = findView(view);
+    if (!entry || entry->outputSize == size) return;
+    entry->outputSize = size;
+    applyDecoderSettings();
+}
+
+void MediaPlayerEngine::setViewWindow(QQuickItem* view, double yaw, double pitch, double fov, double aspect) {
+    View* entry = findView(view);
+    if (!entry) return;
+    entry->hasViewWindow = true;
+    entry->yaw = yaw;
+    entry->pitch = pitch;
+    entry->fov = fov;
+    entry->aspect = aspect;
+    applyDecoderSettings();
+}
+
+void MediaPlayerEngine::clearViewWindow(QQuickItem* view) {
+    View* entry = findView(view);
+    if (!entry || !entry->hasViewWindow) return;
+    entry->hasViewWindow = false;
+    applyDecoderSettings();
+}
+
+void MediaPlayerEngine::setViewHighBitDepth(QQuickItem* view, bool supported) {
+    View* entry = findView(view);
+    if (!entry || entry->highBitDepth == (supported ? 1 : 0)) return;
+    entry->highBitDepth = supported ? 1 : 0;
+    applyDecoderSettings();
+}
+
+MediaPlayerEngine::View* MediaPlayerEngine::findView(QQuickItem* view) {
+    for (View& v : m_views) {
+        if (v.item == view) return &v;
+    }
+    return nullptr;
+}
+
+void MediaPlayerEngine::updateViews() {
+    // Views destroyed without detaching leave a null QPointer behind
+    m_views.erase(std::remove_if(m_views.begin(), m_views.end(), [](const View& v) { return v.item.isNull(); }),
+                  m_views.end());
+
+    QQuickWindow* window = nullptr;
+    for (View& v : m_views) {
+        const bool shown = v.item->isVisible() && v.item->window();
+        if (shown && !window) window = v.item->window();
+
+        // A view that comes into sight starts from the frame on screen, not from black.
+        // Frames with regions only carry the tiles in view and are not worth replaying.
+        if (shown && !v.shown && m_lastFrame && m_lastFrame->regions.empty()) {
+            std::vector<VideoDecoder::FramePtr> frames{m_lastFrame};
+            v.handler(frames);
+        }
+        v.shown = shown;
+    }
+    m_pacer->setWindow(window);
+    applyDecoderSettings();
+}
+
+void MediaPlayerEngine::applyDecoderSettings() {
+    std::vector<const View*> visible;
+    for (const View& v : m_views) {
+        if (v.shown && v.item) visible.push_back(&v);
+    }
+
+    // Tiles outside the view window are only skipped while nothing else needs the full frame
+    if (visible.size() == 1 && visible.front()->hasViewWindow) {
+        const View& v = *visible.front();
+        m_decoder.setViewWindow(v.yaw, v.pitch, v.fov, v.aspect);
+        m_viewWindowActive = true;
+    } else if (m_viewWindowActive) {
+        m_decoder.clearViewWindow();
+        m_viewWindowActive = false;
+    }
+
+    bool highBitDepth = false;
+    for (const View* v : visible) {
+        if (v->highBitDepth == 0) {
+            highBitDepth = false;
+            break;
+        }
+        if (v->highBitDepth == 1) highBitDepth = true;
+    }
+    m_decoder.setHighBitDepthOutput(highBitDepth);
+
+    if (m_autoResolution) {
+        QSize size;
+        for (const View* v : visible) size = size.expandedTo(v->outputSize);
+        if (!size.isEmpty()) m_decoder.requestOutputSize(size.width(), size.height());
+    }
+}
+
+void MediaPlayerEngine::presentFrames(std::vector<VideoDecoder::FramePtr>& frames) {
+    m_lastFrame = frames.back();
+    for (View& v : m_views) {
+        if (v.shown && v.item) v.handler(frames);
+    }
+    StartupTrace::mark("first video frame presented");
+
+    // Refresh frames re-convert tiles of the paused frame and do not move the position
+    double pts = -1.0;
+    for (const VideoDecoder::FramePtr& frame : frames) {
+        if (!frame->refresh) pts = frame->pts;
+    }
+    if (pts >= 0.0) {
+        m_position = pts * 1000;
+        emit positionChanged();
+
+        if (m_scrubInFlight) {
+            m_scrubInFlight = false;
+            m_scrubTimeout->stop();
+            serveScrub();
+        }
+    }
+}
+
+void MediaPlayerEngine::handleError(const std::string& message) {
+    // Reported from the loading or decode thread
+    const QString error = QString::fromStdString(message);
+    qDebug() << "Video Error:" << error;
+    QMetaObject::invokeMethod(this, [this, error]() { emit errorOccurred(error); }, Qt::QueuedConnection);
+}
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+#include <QQuickItem>
+#include <QSize>
+#include <QTimer>
+#include <QStringList>
+#include <QThreadPool>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+#include "../core/VideoDecoder.h"
+#include "AudioOutput.h"
+#include "FramePacer.h"
+
+// Owns one playback session: the decoder, its clock, the audio output and the frame pacer.
+// Render items are only views attached to an engine, so switching between the flat and the
+// 360 view (or showing both) never reopens the source. Frames are handed to every visible
+// view; decoder output settings are resolved across the visible views:
+//  - the decode size in auto mode is the largest one any view asks for
+//  - tile culling is only used while a single view with a view window is shown
+//  - 16-bit planar frames are only produced when every visible renderer can draw them
+// Opening and closing the source run on a session thread and report back through signals,
+// so the GUI thread never waits on the network or on the decode thread; a new source cancels
+// an open that is still in flight.
+class MediaPlayerEngine : public QObject {
+    Q_OBJECT
+    Q_PROPERTY(QString source READ source WRITE setSource NOTIFY sourceChanged)
+    Q_PROPERTY(qint64 duration READ duration NOTIFY durationChanged)
+    Q_PROPERTY(qint64 position READ position WRITE setPosition NOTIFY positionChanged)
+    Q_PROPERTY(qreal volume READ volume WRITE setVolume NOTIFY volumeChanged)
+    Q_PROPERTY(bool playing READ isPlaying NOTIFY playingChanged)
+    Q_PROPERTY(bool loading READ isLoading NOTIFY loadingChanged)
+    Q_PROPERTY(bool scrubbing READ isScrubbing NOTIFY scrubbingChanged)
+    Q_PROPERTY(bool autoResolution READ autoResolution WRITE setAutoResolution NOTIFY autoResolutionChanged)
+    Q_PROPERTY(qreal displayIntervalMs READ displayIntervalMs NOTIFY statsChanged)
+    Q_PROPERTY(qreal displayJitterMs READ displayJitterMs NOTIFY statsChanged)
+    Q_PROPERTY(int droppedFrames READ droppedFrames NOTIFY statsChanged)
+    Q_PROPERTY(int audioUnderruns READ audioUnderruns NOTIFY statsChanged)
+    Q_PROPERTY(int qualityLevel READ qualityLevel NOTIFY statsChanged)
+    Q_PROPERTY(QString streamVariant READ streamVariant NOTIFY statsChanged)
+    Q_PROPERTY(QStringList audioTracks READ audioTracks NOTIFY audioTracksChanged)
+    Q_PROPERTY(int audioTrack READ audioTrack WRITE setAudioTrack NOTIFY audioTrackChanged)
+    Q_PROPERTY(QStringList subtitleTracks READ subtitleTracks NOTIFY subtitleTracksChanged)
+    Q_PROPERTY(int subtitleTrack READ subtitleTrack WRITE setSubtitleTrack NOTIFY subtitleTrackChanged)
+    Q_PROPERTY(bool timeShift READ timeShift WRITE setTimeShift NOTIFY timeShiftChanged)
+    Q_PROPERTY(int timeShiftMinutes READ timeShiftMinutes WRITE setTimeShiftMinutes NOTIFY timeShiftChanged)
+    Q_PROPERTY(qreal timeShiftMaxGB READ timeShiftMaxGB WRITE setTimeShiftMaxGB NOTIFY timeShiftChanged)
+    Q_PROPERTY(bool live READ isLive NOTIFY liveWindowChanged)
+    Q_PROPERTY(qint64 liveWindowStart READ liveWindowStart NOTIFY liveWindowChanged)
+    Q_PROPERTY(qint64 liveWindowEnd READ liveWindowEnd NOTIFY liveWindowChanged)
+    Q_PROPERTY(bool exporting READ isExporting NOTIFY exportingChanged)
+    Q_PROPERTY(qreal exportProgress READ exportProgress NOTIFY exportProgressChanged)
+
+public:
+    explicit MediaPlayerEngine(QObject* parent = nullptr);
+    ~MediaPlayerEngine();
+
+    QString source() const { return m_source; }
+    void setSource(const QString& source);
+
+    qint64 duration() const { return m_duration; }
+    qint64 position() const { return m_position; }
+    void setPosition(qint64 position);
+
+    qreal volume() const { return m_volume; }
+    void setVolume(qreal volume);
+
+    bool isPlaying() const;
+    // An open is in flight on the session thread
+    bool isLoading() const { return m_loading; }
+
+    bool autoResolution() const { return m_autoResolution; }
+    void setAutoResolution(bool enabled);
+
+    qreal displayIntervalMs() const { return m_pacer->displayIntervalMs(); }
+    qreal displayJitterMs() const { return m_pacer->displayJitterMs(); }
+    int droppedFrames() const { return m_pacer->droppedFrames(); }
+    int audioUnderruns() const { return m_audioOutput->underruns(); }
+    // 0 = full quality; each step up trades more quality for decode speed (see DecodeGovernor::Level)
+    int qualityLevel() const { return static_cast<int>(m_decoder.qualityLevel()); }
+    // Adaptive HLS / DASH: the variant playing and the measured throughput, e.g.
+    // "1280x720, 3.0 Mb/s (link 8.4 Mb/s)"; empty for other sources
+    QString streamVariant() const;
+
+    // Index into audioTracks; switches without reopening the source
+    QStringList audioTracks() const { return m_audioTracks; }
+    int audioTrack() const { return m_decoder.audioStream(); }
+    void setAudioTrack(int index);
+
+    // Index into subtitleTracks, -1 = off
+    QStringList subtitleTracks() const { return m_subtitleTracks; }
+    int subtitleTrack() const { return m_decoder.subtitleStream(); }
+    void setSubtitleTrack(int index);
+
+    // Time shift for live sources, applied on the next open (see VideoDecoder::setTimeShift).
+    // Retention is whichever of the two limits is hit first.
+    bool timeShift() const { return m_timeShift; }
+    void setTimeShift(bool enabled);
+    int timeShiftMinutes() const { return m_timeShiftMinutes; }
+    void setTimeShiftMinutes(int minutes);
+    qreal timeShiftMaxGB() const { return m_timeShiftMaxGB; }
+    void setTimeShiftMaxGB(qreal gigabytes);
+
+    // The open source plays from the time-shift buffer; position and seeks move within the
+    // window [liveWindowStart, liveWindowEnd], which slides as the live source advances
+    bool isLive() const { return m_live; }
+    qint64 liveWindowStart() const { return m_liveWindowStart; }
+    qint64 liveWindowEnd() const { return m_liveWindowEnd; }
+    Q_INVOKABLE void jumpToLive();
+
+    // Clip export: [inMs, outMs) of the current source to path (.mp4 / .mkv) by stream copy,
+    // starting at the keyframe at or before inMs (see remuxClip). Runs on its own thread
+    // alongside playback; exportFinished reports the written path or the error.
+    bool isExporting() const { return m_exporting; }
+    qreal exportProgress() const { return m_exportProgress; }
+    Q_INVOKABLE void exportClip(qint64 inMs, qint64 outMs, const QString& path, bool smartCut = false);
+    Q_INVOKABLE void cancelExport();
+
+    // Saves the frame on screen at source resolution, whatever the decode size. The decoded
+    // picture is taken by reference; conversion and encoding run on a worker pool, so neither
+    // the decode nor the render thread waits on them. format is png, jpg or webp (empty: from
+    // the suffix, png without one); an empty path picks a name in the pictures folder.
+    // snapshotFinished reports the written path or the error.
+    Q_INVOKABLE void captureSnapshot(const QString& path = QString(), const QString& format = QString());
+
+    Q_INVOKABLE void play();
+    Q_INVOKABLE void pause();
+    Q_INVOKABLE void stop();
+    Q_INVOKABLE void setResolution(int width, int height);
+
+    // Slider drags. While scrubbing, scrubTo() shows the keyframe nearest to the latest target
+    // at reduced quality, with one seek in flight at a time so each one gets to show a frame.
+    // endScrub() seeks accurately to where the drag ended and resumes playback if it was running.
+    bool isScrubbing() const { return m_scrubbing; }
+    Q_INVOKABLE void beginScrub();
+    Q_INVOKABLE void scrubTo(qint64 position);
+    Q_INVOKABLE void endScrub();
+
+    // View side. Views attach with a handler that receives the due frames (see FramePacer);
+    // a view that becomes visible is handed the frame on screen right away.
+    VideoDecoder& decoder() { return m_decoder; }
+    AudioOutput& audioOutput() { return *m_audioOutput; }
+    VideoDecoder::SphericalInfo sphericalInfo() const { return m_decoder.getSphericalInfo(); }
+    void attachView(QQuickItem* view, FramePacer::FrameHandler handler);
+    void detachView(QQuickItem* view);
+    // Decode size the view wants in auto mode, in pixels
+    void setViewOutputSize(QQuickItem* view, const QSize& size);
+    void setViewWindow(QQuickItem* view, double yaw, double pitch, double fov, double aspect);
+    void clearViewWindow(QQuickItem* view);
+    // Called by the view's renderer, which runs while the GUI thread is blocked in synchronize()
+    void setViewHighBitDepth(QQuickItem* view, bool supported);
+
+signals:
+    void sourceChanged();
+    void durationChanged();
+    void positionChanged();
+    void volumeChanged();
+    void playingChanged();
+    void loadingChanged();
+    void scrubbingChanged();
+    void autoResolutionChanged();
+    void statsChanged();
+    void audioTracksChanged();
+    void audioTrackChanged();
+    void subtitleTracksChanged();
+    void subtitleTrackChanged();
+    void timeShiftChanged();
+    void liveWindowChanged();
+    void exportingChanged();
+    void exportProgressChanged();
+    void exportFinished(bool ok, QString message);
+    void snapshotFinished(bool ok, QString message);
+    void mediaInfoChanged(); // Spherical layout and tracks are known after open
+    void errorOccurred(QString message);
+
+private:
+    struct View {
+        QPointer<QQuickItem> item;
+        FramePacer::FrameHandler handler;
+        QSize outputSize;
+        bool hasViewWindow = false;
+        double yaw = 0.0;
+        double pitch = 0.0;
+        double fov = 90.0;
+        double aspect = 1.0;
+        int highBitDepth = -1; // Unknown until the renderer reports
+        bool shown = false;
+    };
+
+    View* findView(QQuickItem* view);
+    void updateViews();
+    void applyDecoderSettings();
+    void open(bool autoPlay);
+    void close();
+    void onOpened(quint64 generation, bool opened);
+    void onClosed(quint64 generation);
+    void setLoading(bool loading);
+    void serveScrub();
+    void stopScrub();
+    void postSessionJob(std::function<void()> job);
+    void applyTimeShift();
+    void updateLiveWindow();
+    void updateTracks();
+    void presentFrames(std::vector<VideoDecoder::FramePtr>& frames);
+    void handleError(const std::string& message);
+
+    QString m_source;
+    VideoDecoder m_decoder;
+    FramePacer* m_pacer = nullptr;
+    AudioOutput* m_audioOutput = nullptr;
+    std::vector<View> m_views;
+    VideoDecoder::FramePtr m_lastFrame; // Replayed to views that become visible
+    bool m_viewWindowActive = false;
+    QStringList m_audioTracks;
+    QStringList m_subtitleTracks;
+    qint64 m_duration = 0;
+    qint64 m_position = 0;
+    qreal m_volume = 1.0;
+    bool m_autoResolution = false;
+    int m_manualWidth = 0;
+    int m_manualHeight = 0;
+    bool m_loading = false;        // Open in flight on the session thread
+    bool m_closing = false;        // Close in flight on the session thread
+    bool m_playWhenOpened = false; // play() arrived while opening
+    bool m_pauseWhenOpened = false; // pause() arrived while opening
+    bool m_scrubbing = false;
+    bool m_resumeAfterScrub = false;
+    bool m_scrubInFlight = false;  // A keyframe seek has not shown its frame yet
+    qint64 m_scrubTarget = -1;     // Latest target not sent to the decoder yet
+    qint64 m_scrubPosition = -1;   // Latest target, for the accurate seek on release
+    QTimer* m_scrubTimeout = nullptr;
+    bool m_timeShift = false;
+    int m_timeShiftMinutes = 30;
+    qreal m_timeShiftMaxGB = 4.0;
+    bool m_live = false;
+    qint64 m_liveWindowStart = 0;
+    qint64 m_liveWindowEnd = 0;
+    QTimer* m_liveWindowTimer = nullptr;
+    bool m_exporting = false;
+    qreal m_exportProgress = 0.0;
+    std::jthread m_exportThread;
+    QThreadPool m_snapshotPool;
+    int m_snapshotsPending = 0;    // Queued or encoding; bounds the frames held by a burst
+    quint64 m_generation = 0;      // Bumped per open/close; stale completions are ignored
+    std::stop_source m_openStop;   // Cancels the open in flight
+
+    // Session thread: runs open/close jobs in order, the only place that may block on the decoder
+    std::mutex m_jobMutex;
+    std::condition_variable_any m_jobCondition;
+    std::deque<std::function<void()>> m_jobs;
+    std::jthread m_sessionThread;
+};
@@ -0,0 +1,104 @@
+#include "MediaProbeCache.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+constexpr quint32 CacheMagic = 0x524d5042; // "RMPB"
+constexpr quint16 CacheVersion = 1;
+constexpr int MemoryBudgetKiB = 32 * 1024;
+} // namespace
+
+MediaProbeCache& MediaProbeCache::instance() {
+    static MediaProbeCache cache;
+    return cache;
+}
+
+MediaProbeCache::MediaProbeCache()
+    : m_entries(MemoryBudgetKiB) {
+    m_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/probe";
+    QDir().mkpath(m_directory);
+}
+
+QString MediaProbeCache::key(const QString& path, qint64 size, qint64 modifiedMs) {
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(path.toUtf8());
+    hash.addData(QByteArray::number(size));
+    hash.addData(QByteArray::number(modifiedMs));
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+QString MediaProbeCache::diskPath(const QString& key) const {
+    return m_directory + '/' + key + ".bin";
+}
+
+bool MediaProbeCache::find(const QString& key, Entry& entry) const {
+    QMutexLocker locker(&m_mutex);
+    const Entry* cached = m_entries.object(key);
+    if (!cached) return false;
+    entry = *cached;
+    return true;
+}
+
+void MediaProbeCache::insert(const QString& key, const Entry& entry) {
+    QMutexLocker locker(&m_mutex);
+    m_entries.insert(key, new Entry(entry), 1 + (int)(entry.poster.sizeInBytes() / 1024));
+}
+
+bool MediaProbeCache::load(const QString& key, Entry& entry) {
+    if (find(key, entry)) return true;
+
+    QFile file(diskPath(key));
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint16 version = 0;
+    in >> magic >> version;
+    if (magic != CacheMagic || version != CacheVersion) return false;
+
+    Entry loaded;
+    in >> loaded.media >> loaded.duration >> loaded.width >> loaded.height
+       >> loaded.videoCodec >> loaded.audioCodec >> loaded.poster;
+    if (in.status() != QDataStream::Ok) return false;
+
+    insert(key, loaded);
+    entry = loaded;
+    return true;
+}
+
+void MediaProbeCache::store(const QString& key, const Entry& entry) {
+    insert(key, entry);
+
+    // QSaveFile: a crash mid-write must not leave a truncated entry behind
+    QSaveFile file(diskPath(key));
+    if (!file.open(QIODevice::WriteOnly)) return;
+    QDataStream out(&file);
+    out << CacheMagic << CacheVersion;
+    out << entry.media << entry.duration << entry.width << entry.height
+        << entry.videoCodec << entry.audioCodec << entry.poster;
+    if (out.status() == QDataStream::Ok) {
+        file.commit();
+    } else {
+        file.cancelWriting();
+    }
+}
+
+MediaPosterProvider::MediaPosterProvider()
+    : QQuickImageProvider(QQuickImageProvider::Image) {
+}
+
+QImage MediaPosterProvider::requestImage(const QString& id, QSize* size, const QSize& requestedSize) {
+    MediaProbeCache::Entry entry;
+    if (!MediaProbeCache::instance().load(id, entry) || entry.poster.isNull()) return QImage();
+
+    QImage image = entry.poster;
+    if (requestedSize.isValid() && requestedSize.width() < image.width()) {
+        image = image.scaled(requestedSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    if (size) *size = image.size();
+    return image;
+}
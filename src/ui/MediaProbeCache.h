@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QQuickImageProvider>
+#include <QString>
+
+// Probe results shared by MediaProbeModel and the poster image provider. Entries are kept in
+// memory and under the cache directory, keyed by path, size and modification time, so a
+// folder is only probed once and an edited file is probed again. Thread-safe.
+class MediaProbeCache {
+public:
+    struct Entry {
+        bool media = false; // false: probed, but nothing playable in it
+        double duration = 0.0;
+        int width = 0;
+        int height = 0;
+        QString videoCodec;
+        QString audioCodec;
+        QImage poster;
+    };
+
+    static MediaProbeCache& instance();
+
+    // Also the poster's image provider id
+    static QString key(const QString& path, qint64 size, qint64 modifiedMs);
+
+    // Memory only: cheap enough for QAbstractItemModel::data()
+    bool find(const QString& key, Entry& entry) const;
+    // Memory, then disk. Worker threads.
+    bool load(const QString& key, Entry& entry);
+    // Memory and disk. Worker threads.
+    void store(const QString& key, const Entry& entry);
+
+private:
+    MediaProbeCache();
+
+    QString diskPath(const QString& key) const;
+    void insert(const QString& key, const Entry& entry);
+
+    mutable QMutex m_mutex;
+    QCache<QString, Entry> m_entries; // Cost in KiB of poster
+    QString m_directory;
+};
+
+// image://mediaprobe/<key>
+class MediaPosterProvider : public QQuickImageProvider {
+public:
+    MediaPosterProvider();
+
+    QImage requestImage(const QString& id, QSize* size, const QSize& requestedSize) override;
+};
@@ -0,0 +1,192 @@
+#include "MediaProbeModel.h"
+#include "MediaProbeCache.h"
+#include "../core/MediaProbe.h"
+#include <QDateTime>
+#include <QThread>
+#include <QUrl>
+#include <algorithm>
+
+namespace {
+constexpr int PosterWidth = 160;
+constexpr int MaxPending = 256;
+} // namespace
+
+MediaProbeModel::MediaProbeModel(QObject* parent)
+    : QIdentityProxyModel(parent) {
+    // Stays out of the way of decoding and the render thread while a video plays behind the dialog
+    m_pool.setMaxThreadCount(std::clamp(QThread::idealThreadCount() / 2, 1, 4));
+    m_pool.setThreadPriority(QThread::LowPriority);
+
+    connect(this, &QAbstractItemModel::modelAboutToBeReset, this, &MediaProbeModel::cancelAll);
+    connect(this, &QAbstractProxyModel::sourceModelChanged, this, [this]() {
+        cancelAll();
+        resolveSourceRoles();
+    });
+}
+
+MediaProbeModel::~MediaProbeModel() {
+    cancelAll();
+    // Cancelled probes return from their next demuxer read
+    m_pool.waitForDone();
+}
+
+void MediaProbeModel::resolveSourceRoles() {
+    m_pathRole = m_sizeRole = m_modifiedRole = m_isDirRole = -1;
+    if (!sourceModel()) return;
+
+    const QHash<int, QByteArray> roles = sourceModel()->roleNames();
+    for (auto it = roles.cbegin(); it != roles.cend(); ++it) {
+        if (it.value() == "filePath") m_pathRole = it.key();
+        else if (it.value() == "fileSize") m_sizeRole = it.key();
+        else if (it.value() == "fileModified") m_modifiedRole = it.key();
+        else if (it.value() == "fileIsDir") m_isDirRole = it.key();
+    }
+}
+
+QHash<int, QByteArray> MediaProbeModel::roleNames() const {
+    QHash<int, QByteArray> roles = QIdentityProxyModel::roleNames();
+    roles[MediaProbedRole] = "mediaProbed";
+    roles[MediaDurationRole] = "mediaDuration";
+    roles[MediaResolutionRole] = "mediaResolution";
+    roles[MediaCodecRole] = "mediaCodec";
+    roles[MediaPosterRole] = "mediaPoster";
+    return roles;
+}
+
+QVariant MediaProbeModel::data(const QModelIndex& index, int role) const {
+    if (role < MediaProbedRole || role > MediaPosterRole) return QIdentityProxyModel::data(index, role);
+    if (!index.isValid() || m_pathRole < 0) return QVariant();
+
+    const QModelIndex source = mapToSource(index);
+    if (m_isDirRole >= 0 && source.data(m_isDirRole).toBool()) return QVariant();
+    const QString path = source.data(m_pathRole).toString();
+    if (path.isEmpty()) return QVariant();
+
+    const qint64 size = m_sizeRole >= 0 ? source.data(m_sizeRole).toLongLong() : 0;
+    const qint64 modified = m_modifiedRole >= 0 ? source.data(m_modifiedRole).toDateTime().toMSecsSinceEpoch() : 0;
+    const QString key = MediaProbeCache::key(path, size, modified);
+
+    MediaProbeCache::Entry entry;
+    if (!MediaProbeCache::instance().find(key, entry)) {
+        request(index, path, key);
+        return role == MediaProbedRole ? QVariant(false) : QVariant();
+    }
+
+    switch (role) {
+    case MediaProbedRole:
+        return true;
+    case MediaDurationRole:
+        return entry.duration;
+    case MediaResolutionRole:
+        if (entry.width <= 0 || entry.height <= 0) return QString();
+        return QStringLiteral("%1×%2").arg(entry.width).arg(entry.height);
+    case MediaCodecRole:
+        if (entry.videoCodec.isEmpty()) return entry.audioCodec;
+        if (entry.audioCodec.isEmpty()) return entry.videoCodec;
+        return entry.videoCodec + " / " + entry.audioCodec;
+    case MediaPosterRole:
+        if (entry.poster.isNull()) return QUrl();
+        return QUrl("image://mediaprobe/" + key);
+    }
+    return QVariant();
+}
+
+void MediaProbeModel::request(const QModelIndex& index, const QString& path, const QString& key) const {
+    if (m_jobs.contains(key)) return;
+
+    auto job = std::make_shared<Job>();
+    job->index = QPersistentModelIndex(index);
+    job->path = path;
+    job->key = key;
+    m_jobs.insert(key, job);
+    m_pending.push_front(job);
+
+    // A fling through a huge folder: the oldest requests are long off screen
+    while ((int)m_pending.size() > MaxPending) {
+        m_jobs.remove(m_pending.back()->key);
+        m_pending.pop_back();
+    }
+    startJobs();
+}
+
+void MediaProbeModel::startJobs() const {
+    while (m_running < m_pool.maxThreadCount() && !m_pending.empty()) {
+        JobPtr job = m_pending.front();
+        m_pending.pop_front();
+        job->running = true;
+        ++m_running;
+
+        auto* self = const_cast<MediaProbeModel*>(this);
+        m_pool.start([self, job, cancel = job->stop.get_token()]() {
+            MediaProbeCache& cache = MediaProbeCache::instance();
+            MediaProbeCache::Entry entry;
+            if (!cancel.stop_requested() && !cache.load(job->key, entry)) {
+                MediaInfo info;
+                entry.media = probeMedia(job->path.toStdString(), cancel, PosterWidth, info);
+                // Cancelled results are incomplete; leave them out of the cache
+                if (!cancel.stop_requested()) {
+                    entry.duration = info.duration;
+                    entry.width = info.width;
+                    entry.height = info.height;
+                    entry.videoCodec = QString::fromStdString(info.videoCodec);
+                    entry.audioCodec = QString::fromStdString(info.audioCodec);
+                    if (!info.poster.empty()) {
+                        entry.poster = QImage(info.poster.data(), info.posterWidth, info.posterHeight,
+                                              info.posterWidth * 4, QImage::Format_RGBA8888).copy();
+                    }
+                    cache.store(job->key, entry);
+                }
+            }
+            QMetaObject::invokeMethod(self, [self, job]() { self->onJobFinished(job); }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void MediaProbeModel::onJobFinished(const JobPtr& job) {
+    --m_running;
+    auto it = m_jobs.find(job->key);
+    if (it != m_jobs.end() && it.value() == job) m_jobs.erase(it);
+
+    if (job->index.isValid()) {
+        if (!job->stop.stop_requested()) {
+            const QModelIndex index = job->index;
+            emit dataChanged(index, index, {MediaProbedRole, MediaDurationRole, MediaResolutionRole,
+                                            MediaCodecRole, MediaPosterRole});
+        } else if (wanted(job->index)) {
+            // Cancelled while off screen, scrolled back before it returned
+            request(job->index, job->path, job->key);
+        }
+    }
+    startJobs();
+}
+
+bool MediaProbeModel::wanted(const QPersistentModelIndex& index) const {
+    if (!index.isValid()) return false;
+    if (m_first < 0 || m_last < m_first) return true;
+    // One screen of slack on either side keeps short scroll reversals from thrashing
+    const int margin = m_last - m_first + 1;
+    return index.row() >= m_first - margin && index.row() <= m_last + margin;
+}
+
+void MediaProbeModel::setVisibleRange(int first, int last) {
+    m_first = first;
+    m_last = last;
+
+    std::erase_if(m_pending, [this](const JobPtr& job) {
+        if (wanted(job->index)) return false;
+        m_jobs.remove(job->key);
+        return true;
+    });
+    for (const JobPtr& job : std::as_const(m_jobs)) {
+        if (job->running && !wanted(job->index)) job->stop.request_stop();
+    }
+}
+
+void MediaProbeModel::cancelAll() {
+    for (const JobPtr& job : std::as_const(m_jobs)) {
+        job->stop.request_stop();
+    }
+    m_jobs.clear();
+    m_pending.clear();
+    m_first = m_last = -1;
+}
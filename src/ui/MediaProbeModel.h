@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QIdentityProxyModel>
+#include <QPersistentModelIndex>
+#include <QThreadPool>
+#include <deque>
+#include <memory>
+#include <stop_token>
+
+// Adds media metadata and a poster to a file listing such as the FolderListModel of
+// RFileDialog (needs its filePath, fileSize, fileModified and fileIsDir roles). Rows are
+// probed when a view first asks for their data, newest request first, on a small low-priority
+// pool; setVisibleRange() drops and cancels work for rows scrolled out of view.
+class MediaProbeModel : public QIdentityProxyModel {
+    Q_OBJECT
+
+public:
+    enum Roles {
+        MediaProbedRole = Qt::UserRole + 1000,
+        MediaDurationRole,   // seconds
+        MediaResolutionRole, // "1920×1080"
+        MediaCodecRole,      // "h264 / aac"
+        MediaPosterRole      // image://mediaprobe/... url, empty without a poster
+    };
+
+    explicit MediaProbeModel(QObject* parent = nullptr);
+    ~MediaProbeModel();
+
+    QVariant data(const QModelIndex& index, int role) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    // Rows currently on screen; -1 for unknown
+    Q_INVOKABLE void setVisibleRange(int first, int last);
+
+private:
+    struct Job {
+        QPersistentModelIndex index;
+        QString path;
+        QString key;
+        std::stop_source stop;
+        bool running = false;
+    };
+    using JobPtr = std::shared_ptr<Job>;
+
+    void resolveSourceRoles();
+    void request(const QModelIndex& index, const QString& path, const QString& key) const;
+    void startJobs() const;
+    void onJobFinished(const JobPtr& job);
+    bool wanted(const QPersistentModelIndex& index) const;
+    void cancelAll();
+
+    int m_pathRole = -1;
+    int m_sizeRole = -1;
+    int m_modifiedRole = -1;
+    int m_isDirRole = -1;
+
+    int m_first = -1;
+    int m_last = -1;
+
+    // data() is const but is where rows get requested
+    mutable QThreadPool m_pool;
+    mutable std::deque<JobPtr> m_pending; // Newest first
+    mutable QHash<QString, JobPtr> m_jobs; // Pending and running, by cache key
+    mutable int m_running = 0;
+};
@@ -0,0 +1,314 @@
+#include "PacingHarness.h"
+#include "MediaPlayerEngine.h"
+#include "PanoramaRenderItem.h"
+#include "VideoRenderItem.h"
+#include "../core/TimecodeClip.h"
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QQuickWindow>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QTimer>
+#include <QUrl>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct Presentation {
+    qint64 swapNs = 0;
+    int code = -1; // Timecode on screen, -1 when none could be read
+};
+
+struct Click {
+    qint64 audibleNs = 0;
+    int second = 0; // Media time of the click
+};
+
+struct Samples {
+    std::mutex mutex;
+    std::vector<Presentation> presentations;
+    std::vector<Click> clicks;
+};
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    const size_t index = std::min(values.size() - 1, (size_t)std::lround(p * (values.size() - 1)));
+    return values[index];
+}
+
+void printDistribution(const char* name, const std::vector<double>& values) {
+    if (values.empty()) {
+        std::printf("  %-22s n/a\n", name);
+        return;
+    }
+    std::printf("  %-22s min %7.2f  median %7.2f  p95 %7.2f  max %7.2f ms  (n=%zu)\n", name,
+                percentile(values, 0.0), percentile(values, 0.5), percentile(values, 0.95),
+                percentile(values, 1.0), values.size());
+}
+
+// Peak of one interleaved sample frame, normalised to 16-bit full scale
+double peakAt(const uint8_t* data, int frame, const VideoDecoder::AudioFormat& format) {
+    double peak = 0.0;
+    for (int channel = 0; channel < format.channels; ++channel) {
+        const uint8_t* sample = data + (size_t)frame * format.bytesPerFrame() + channel * format.bytesPerSample();
+        double value = 0.0;
+        switch (format.sampleType) {
+        case VideoDecoder::AudioFormat::SampleType::Int16: {
+            int16_t v;
+            std::memcpy(&v, sample, sizeof(v));
+            value = v;
+            break;
+        }
+        case VideoDecoder::AudioFormat::SampleType::Int32: {
+            int32_t v;
+            std::memcpy(&v, sample, sizeof(v));
+            value = v / 65536.0;
+            break;
+        }
+        case VideoDecoder::AudioFormat::SampleType::Float: {
+            float v;
+            std::memcpy(&v, sample, sizeof(v));
+            value = v * 32768.0;
+            break;
+        }
+        }
+        peak = std::max(peak, std::abs(value));
+    }
+    return peak;
+}
+
+// Plays the clip through one view and collects presentations and clicks
+bool measure(const QString& clip, bool panorama, int seconds, Samples& samples) {
+    MediaPlayerEngine engine;
+    QQuickWindow window;
+    window.resize(640, 360);
+    window.setColor(Qt::black);
+
+    QQuickItem* view = nullptr;
+    if (panorama) {
+        auto* item = new PanoramaRenderItem(window.contentItem());
+        item->setEngine(&engine);
+        view = item;
+    } else {
+        auto* item = new VideoRenderItem(window.contentItem());
+        item->setEngine(&engine);
+        view = item;
+    }
+    view->setSize(window.size());
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Render thread: read back the finished frame, stamp it when it reaches the screen
+    int pendingCode = -1;
+    QObject::connect(&window, &QQuickWindow::afterRendering, &window, [&]() {
+        QOpenGLContext* context = QOpenGLContext::currentContext();
+        if (!context) return;
+        // Flushes the commands the scene graph has queued, so the readback sees this frame
+        window.beginExternalCommands();
+        QOpenGLFunctions* gl = context->functions();
+        gl->glBindFramebuffer(GL_FRAMEBUFFER, context->defaultFramebufferObject());
+        const QSize size = window.size() * window.effectiveDevicePixelRatio();
+        uchar pixel[4] = {0, 0, 0, 0};
+        gl->glReadPixels(size.width() / 2, size.height() / 2, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+        window.endExternalCommands();
+        // Black (letterbox, nothing decoded yet) is code 0 too; only count it once playback runs
+        pendingCode = engine.decoder().clock().isStarted() ? readTimecode(pixel[0], pixel[1], pixel[2]) : -1;
+    }, Qt::DirectConnection);
+    QObject::connect(&window, &QQuickWindow::frameSwapped, &window, [&]() {
+        std::lock_guard<std::mutex> lock(samples.mutex);
+        samples.presentations.push_back({timer.nsecsElapsed(), pendingCode});
+    }, Qt::DirectConnection);
+
+    // Audio thread: find click onsets in what the device is handed
+    int quietFrames = 0;
+    engine.audioOutput().setConsumeObserver([&](const uint8_t* data, int bytes, double delaySeconds) {
+        const qint64 now = timer.nsecsElapsed();
+        const VideoDecoder::AudioFormat format = engine.decoder().audioFormat();
+        const int frames = bytes / format.bytesPerFrame();
+        // The audio clock is the PTS just after this block
+        const double blockStart = engine.decoder().getAudioClock() - (double)frames / format.sampleRate;
+        for (int i = 0; i < frames; ++i) {
+            if (peakAt(data, i, format) < TimecodeClickThreshold) {
+                ++quietFrames;
+                continue;
+            }
+            if (quietFrames > format.sampleRate / 2) {
+                const double offset = delaySeconds + (double)i / format.sampleRate;
+                std::lock_guard<std::mutex> lock(samples.mutex);
+                samples.clicks.push_back({now + (qint64)(offset * 1e9),
+                                          (int)std::lround(blockStart + (double)i / format.sampleRate)});
+            }
+            quietFrames = 0;
+        }
+    });
+
+    QEventLoop loop;
+    bool started = false;
+    QObject::connect(&engine, &MediaPlayerEngine::playingChanged, &loop, [&]() {
+        if (!engine.isPlaying() || started) return;
+        started = true;
+        // Playback holds the last frame at the end of the clip; stop shortly after it
+        QTimer::singleShot(seconds * 1000 + 1500, &loop, &QEventLoop::quit);
+    });
+    QObject::connect(&engine, &MediaPlayerEngine::errorOccurred, &loop, [&](const QString& message) {
+        std::fprintf(stderr, "Playback error: %s\n", qPrintable(message));
+        loop.quit();
+    });
+    QTimer::singleShot((seconds + 10) * 1000, &loop, &QEventLoop::quit); // Open never finished
+
+    window.show();
+    engine.setSource(QUrl::fromLocalFile(clip).toString());
+    engine.play();
+    loop.exec();
+
+    engine.audioOutput().setConsumeObserver(nullptr);
+    engine.stop();
+    window.hide();
+    return started;
+}
+
+void report(const char* name, const Samples& samples, int fps, const QString& csvPrefix) {
+    // Unwrap the timecodes into frame numbers; a jump of half the modulus or more is a misread
+    struct Shown {
+        qint64 swapNs;
+        int64_t frame;
+    };
+    std::vector<Shown> shown;
+    int unreadable = 0;
+    int64_t previous = -1;
+    for (const Presentation& p : samples.presentations) {
+        if (p.code < 0) continue;
+        int64_t frame = p.code;
+        if (previous >= 0) {
+            const int64_t delta = ((p.code - previous) % TimecodeModulus + TimecodeModulus) % TimecodeModulus;
+            if (delta >= TimecodeModulus / 2) {
+                ++unreadable;
+                continue;
+            }
+            frame = previous + delta;
+        }
+        shown.push_back({p.swapNs, frame});
+        previous = frame;
+    }
+
+    std::printf("%s view\n", name);
+    if (shown.size() < 2) {
+        std::printf("  no frames identified on screen\n");
+        return;
+    }
+
+    std::vector<double> swapIntervals;
+    for (size_t i = 1; i < shown.size(); ++i) swapIntervals.push_back((shown[i].swapNs - shown[i - 1].swapNs) / 1e6);
+    const double displayMs = percentile(swapIntervals, 0.5);
+    const double frameMs = 1000.0 / fps;
+    // Swaps a frame should stay up for, e.g. 2.5 for 24 fps on 60 Hz: holds of 2 and 3 are cadence, not repeats
+    const int maxHold = std::max(1, (int)std::ceil(frameMs / displayMs - 0.01));
+
+    int64_t dropped = 0;
+    int repeated = 0;
+    int hold = 1;
+    std::vector<double> judder;
+    qint64 changeNs = shown.front().swapNs;
+    for (size_t i = 1; i < shown.size(); ++i) {
+        const int64_t delta = shown[i].frame - shown[i - 1].frame;
+        if (delta == 0) {
+            ++hold;
+            continue;
+        }
+        if (hold > maxHold) ++repeated;
+        hold = 1;
+        if (delta > 1) dropped += delta - 1;
+        // How far the change landed from where the content cadence puts it
+        judder.push_back(std::abs((shown[i].swapNs - changeNs) / 1e6 - delta * frameMs));
+        changeNs = shown[i].swapNs;
+    }
+    const int64_t first = shown.front().frame;
+    const int64_t last = shown.back().frame;
+
+    std::vector<double> offsets;
+    size_t cursor = 0;
+    for (const Click& click : samples.clicks) {
+        const int64_t frame = (int64_t)click.second * fps;
+        if (frame < first) continue;
+        while (cursor < shown.size() && shown[cursor].frame < frame) ++cursor;
+        if (cursor == shown.size()) break;
+        offsets.push_back((shown[cursor].swapNs - click.audibleNs) / 1e6);
+    }
+
+    std::printf("  display interval       %.2f ms, frames %lld..%lld over %zu swaps\n", displayMs,
+                (long long)first, (long long)last, shown.size());
+    std::printf("  dropped frames         %lld of %lld (%.2f%%)\n", (long long)dropped, (long long)(last - first + 1),
+                100.0 * dropped / std::max<int64_t>(1, last - first + 1));
+    std::printf("  repeated frames        %d (held longer than %d swaps)\n", repeated, maxHold);
+    std::printf("  unreadable swaps       %d\n", unreadable);
+    printDistribution("swap interval", swapIntervals);
+    printDistribution("judder", judder);
+    if (samples.clicks.empty()) {
+        std::printf("  A/V offset             n/a (no audio reached a device)\n");
+    } else {
+        printDistribution("A/V offset (video-audio)", offsets);
+    }
+
+    if (csvPrefix.isEmpty()) return;
+    QFile frames(QStringLiteral("%1-%2-frames.csv").arg(csvPrefix, QString::fromLatin1(name)));
+    if (frames.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        QTextStream out(&frames);
+        out << "swap_ns,frame\n";
+        for (const Shown& s : shown) out << s.swapNs << ',' << s.frame << '\n';
+    }
+    QFile audio(QStringLiteral("%1-%2-audio.csv").arg(csvPrefix, QString::fromLatin1(name)));
+    if (audio.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        QTextStream out(&audio);
+        out << "audible_ns,media_second\n";
+        for (const Click& c : samples.clicks) out << c.audibleNs << ',' << c.second << '\n';
+    }
+}
+
+} // namespace
+
+int runPacingHarness(const QStringList& arguments) {
+    TimecodeClipSpec spec;
+    QString views = QStringLiteral("both");
+    QString csvPrefix;
+    for (int i = 0; i + 1 < arguments.size(); ++i) {
+        if (arguments[i] == QLatin1String("--seconds")) spec.seconds = std::max(2, arguments[i + 1].toInt());
+        else if (arguments[i] == QLatin1String("--fps")) spec.fps = std::clamp(arguments[i + 1].toInt(), 1, 240);
+        else if (arguments[i] == QLatin1String("--view")) views = arguments[i + 1];
+        else if (arguments[i] == QLatin1String("--csv")) csvPrefix = arguments[i + 1];
+    }
+
+    QTemporaryDir directory;
+    const QString clip = directory.filePath(QStringLiteral("timecode.nut"));
+    std::string error;
+    if (!directory.isValid() || !writeTimecodeClip(clip.toStdString(), spec, error)) {
+        std::fprintf(stderr, "Could not generate the test clip: %s\n", error.c_str());
+        return 1;
+    }
+    std::printf("Timecode clip %dx%d, %d fps, %d s\n", spec.width, spec.height, spec.fps, spec.seconds);
+
+    int identified = 0;
+    for (bool panorama : {false, true}) {
+        const char* name = panorama ? "panorama" : "flat";
+        if (views != QLatin1String("both") && views != QLatin1String(name)) continue;
+        Samples samples;
+        if (!measure(clip, panorama, spec.seconds, samples)) {
+            std::printf("%s view\n  playback did not start\n", name);
+            continue;
+        }
+        report(name, samples, spec.fps, csvPrefix);
+        const bool any = std::any_of(samples.presentations.begin(), samples.presentations.end(),
+                                     [](const Presentation& p) { return p.code >= 0; });
+        if (any) ++identified;
+    }
+    return identified > 0 ? 0 : 2;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <QStringList>
+
+// `RenkoPlayer --pacing-harness [--seconds N] [--fps N] [--view flat|panorama|both] [--csv PREFIX]`
+//
+// Plays a generated timecode clip (see TimecodeClip.h) through VideoRenderItem and
+// PanoramaRenderItem in a window of their own and measures what actually happens:
+//  - after every frame the centre pixel of the window is read back and its timecode decoded,
+//    and stamped when the buffers are swapped, giving the frame on display at every swap
+//  - every audio click handed to the device is stamped with when it will be heard (the sink's
+//    queued audio included), via AudioOutput's consume observer
+// It prints display interval, judder (error of each frame change against the content cadence),
+// dropped and repeated frames, and the A/V offset distribution (video minus audio, per click).
+// With --csv the raw samples are written to PREFIX-<view>-frames.csv and PREFIX-<view>-audio.csv.
+//
+// Headless, e.g. in CI with Mesa's software rasteriser:
+//     QT_QPA_PLATFORM=offscreen LIBGL_ALWAYS_SOFTWARE=1 RenkoPlayer --pacing-harness
+// or under xvfb-run with the xcb platform. Without an audio device only video is measured;
+// a null sink (e.g. PulseAudio's module-null-sink) gives the audio side too.
+// Returns non-zero when no frame could be identified on screen.
+int runPacingHarness(const QStringList& arguments);
@@ -1,22 +1,120 @@
 #include "PanoramaRenderItem.h"
+#include "VideoFrameTexture.h"
 #include <QOpenGLFunctions>
 #include <QOpenGLFramebufferObject>
+#include <QOpenGLContext>
+#include <QOpenGLTimerQuery>
 #include <QQuickWindow>
+#include <array>
 #include <cmath>
-#include <QUrl>
+#include <QtMath>
 #include <QDebug>
+#include <cstring>
+
+#ifndef GL_RG32F
+#define GL_RG32F 0x8230
+#endif
+
+// View ray -> packed frame UV mapping shared by the lookup pass and the direct fallback.
+// coords are viewport NDC in [-1, 1]. Layout coordinates are computed with v running from the
+// top of the packed frame and flipped once at the end, the same way for every projection.
+// World frame: +x is the frame centre (front), +y up, +z right.
+static const char* kPanoramaMappingGlsl =
+    "uniform float yaw;"
+    "uniform float pitch;"
+    "uniform float fov;"
+    "uniform float aspect;"
+    "uniform int projection;"   // 0 equirect, 1 cubemap 3x2, 2 equi-angular cubemap 3x2
+    "uniform int stereoMode;"   // 0 mono, 1 top-bottom, 2 side-by-side
+    "uniform int eye;"          // 0 first (left) view, 1 second (right) view
+    "uniform vec4 bounds;"      // Equirect tile: left, top, right, bottom share cropped from the sphere
+    "const float PI = 3.14159265359;"
+    "vec3 viewDir(vec2 coords) {"
+    "    float tanHalfFov = tan(radians(fov) / 2.0);"
+    "    vec3 ray = vec3(coords.x * aspect * tanHalfFov, coords.y * tanHalfFov, -1.0);"
+    "    ray = normalize(ray);"
+    "    float cp = cos(radians(pitch));"
+    "    float sp = sin(radians(pitch));"
+    "    vec3 r1 = vec3(ray.x, ray.y * cp - ray.z * sp, ray.y * sp + ray.z * cp);"
+    "    float cy = cos(radians(yaw));"
+    "    float sy = sin(radians(yaw));"
+    "    vec3 r2 = vec3(r1.x * cy + r1.z * sy, r1.y, -r1.x * sy + r1.z * cy);"
+    "    return normalize(r2);"
+    "}"
+    // Face coordinates a (right) / b (up) in [-1, 1] as seen from inside the cube
+    "vec2 cubeLayoutUV(vec3 d) {"
+    "    vec3 ad = abs(d);"
+    "    int face;"
+    "    vec2 ab;"
+    "    if (ad.x >= ad.y && ad.x >= ad.z) {"
+    "        if (d.x > 0.0) { face = 0; ab = vec2(d.z, d.y) / ad.x; }"   // front
+    "        else { face = 1; ab = vec2(-d.z, d.y) / ad.x; }"           // back
+    "    } else if (ad.z >= ad.y) {"
+    "        if (d.z > 0.0) { face = 2; ab = vec2(-d.x, d.y) / ad.z; }" // right
+    "        else { face = 3; ab = vec2(d.x, d.y) / ad.z; }"            // left
+    "    } else {"
+    "        if (d.y > 0.0) { face = 4; ab = vec2(d.z, -d.x) / ad.y; }" // up
+    "        else { face = 5; ab = vec2(d.z, d.x) / ad.y; }"            // down
+    "    }"
+    "    if (projection == 2) ab = atan(ab) * (4.0 / PI);"
+    "    vec2 f = vec2(ab.x, -ab.y);"
+    "    vec2 cell;"
+    "    int rotation = 0;"
+    "    if (projection == 2) {"
+    // YouTube EAC: left front right / down back up, bottom row rotated (same as ffmpeg v360 'eac')
+    "        if (face == 3) cell = vec2(0.0, 0.0);"
+    "        else if (face == 0) cell = vec2(1.0, 0.0);"
+    "        else if (face == 2) cell = vec2(2.0, 0.0);"
+    "        else if (face == 5) { cell = vec2(0.0, 1.0); rotation = 270; }"
+    "        else if (face == 1) { cell = vec2(1.0, 1.0); rotation = 90; }"
+    "        else { cell = vec2(2.0, 1.0); rotation = 270; }"
+    "    } else {"
+    // Plain 3x2 cubemap: right left up / down front back (ffmpeg v360 'c3x2' default)
+    "        if (face == 2) cell = vec2(0.0, 0.0);"
+    "        else if (face == 3) cell = vec2(1.0, 0.0);"
+    "        else if (face == 4) cell = vec2(2.0, 0.0);"
+    "        else if (face == 5) cell = vec2(0.0, 1.0);"
+    "        else if (face == 0) cell = vec2(1.0, 1.0);"
+    "        else cell = vec2(2.0, 1.0);"
+    "    }"
+    "    if (rotation == 90) f = vec2(-f.y, f.x);"
+    "    else if (rotation == 270) f = vec2(f.y, -f.x);"
+    // Stay half a texel-ish inside the face so linear filtering does not bleed into neighbours
+    "    f = clamp(f, -0.998, 0.998);"
+    "    return vec2((cell.x + (f.x + 1.0) * 0.5) / 3.0, (cell.y + (f.y + 1.0) * 0.5) / 2.0);"
+    "}"
+    "vec2 panoramaUV(vec2 coords) {"
+    "    vec3 dir = viewDir(coords);"
+    "    vec2 uv;"
+    "    if (projection == 0) {"
+    "        uv = vec2(0.5 + atan(dir.z, dir.x) / (2.0 * PI), 0.5 - asin(dir.y) / PI);"
+    "        uv = (uv - bounds.xy) / (1.0 - bounds.xy - bounds.zw);"
+    // Outside the tile there is no picture; negative UV is drawn black
+    "        if (uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0) return vec2(-1.0);"
+    "    } else {"
+    "        uv = cubeLayoutUV(dir);"
+    "    }"
+    "    if (stereoMode == 1) uv.y = uv.y * 0.5 + float(eye) * 0.5;"
+    "    else if (stereoMode == 2) uv.x = uv.x * 0.5 + float(eye) * 0.5;"
+    "    return vec2(uv.x, 1.0 - uv.y);"
+    "}";
 
 class PanoramaRenderer : public QQuickFramebufferObject::Renderer, protected QOpenGLFunctions {
 public:
     PanoramaRenderer() {
         initializeOpenGLFunctions();
+        // RENKO_PANORAMA_DIRECT=1 keeps the per-pixel trig path, for A/B timing against the lookup
+        m_useLookup = qEnvironmentVariableIntValue("RENKO_PANORAMA_DIRECT") == 0 && canRenderFloatLookup();
         initShaders();
         initGeometry();
+        initTimerQueries();
     }
 
     ~PanoramaRenderer() {
-        if (m_texture) delete m_texture;
         if (m_program) delete m_program;
+        if (m_lookupProgram) delete m_lookupProgram;
+        if (m_lookupFbo) delete m_lookupFbo;
+        for (QOpenGLTimerQuery* query : m_timerQueries) delete query;
     }
 
     void render() override {
@@ -29,36 +127,46 @@ public:
         glDisable(GL_DEPTH_TEST);
         glDisable(GL_CULL_FACE);
 
-        if (!m_texture) return;
+        if (!m_texture.isValid()) return;
+
+        beginTimerQuery();
 
-        m_program->bind();
-        
-        // Bind texture to unit 0
-        glActiveTexture(GL_TEXTURE0);
-        m_texture->bind();
-        m_program->setUniformValue("texture", 0);
-        
-        m_program->setUniformValue("yaw", (float)m_yaw);
-        m_program->setUniformValue("pitch", (float)m_pitch);
-        m_program->setUniformValue("fov", (float)m_fov);
-        
         // Calculate aspect ratio from viewport
         GLint viewport[4];
         glGetIntegerv(GL_VIEWPORT, viewport);
         float aspect = (float)viewport[2] / (float)viewport[3];
-        m_program->setUniformValue("aspect", aspect);
 
-        m_vbo.bind();
-        int vertexLocation = m_program->attributeLocation("vertices");
-        m_program->enableAttributeArray(vertexLocation);
-        m_program->setAttributeBuffer(vertexLocation, GL_FLOAT, 0, 2);
+        if (m_useLookup) {
+            QSize viewportSize(viewport[2], viewport[3]);
+            if (m_lookupDirty || !m_lookupFbo || m_lookupFbo->size() != viewportSize) {
+                updateLookup(viewportSize, aspect);
+                glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+            }
+        }
 
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        m_program->bind();
+        
+        // Video textures take units 0-3 (RGBA or the 16-bit planes)
+        m_texture.bind(m_program, 0);
+
+        if (m_useLookup) {
+            // Per-pixel cost is a single dependent fetch through the direction lookup
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_2D, m_lookupFbo->texture());
+            m_program->setUniformValue("lookup", 4);
+        } else {
+            setMappingUniforms(m_program, aspect);
+        }
 
-        m_program->disableAttributeArray(vertexLocation);
-        m_vbo.release();
-        m_texture->release();
+        drawQuad(m_program);
+
+        if (m_useLookup) {
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        m_texture.release(0);
         m_program->release();
+
+        endTimerQuery();
     }
 
     QOpenGLFramebufferObject* createFramebufferObject(const QSize &size) override {
@@ -69,105 +177,132 @@ public:
 
     void synchronize(QQuickFramebufferObject *item) override {
         PanoramaRenderItem *pItem = static_cast<PanoramaRenderItem*>(item);
-        
+        pItem->setHighBitDepthOutput(m_texture.supportsHighBitDepth());
+
         if (pItem->takeResetTexture()) {
-            if (m_texture) {
-                delete m_texture;
-                m_texture = nullptr;
-            }
+            m_texture.reset();
         }
         
-        m_yaw = pItem->yaw();
-        m_pitch = pItem->pitch();
-        m_fov = pItem->fov();
+        if (m_yaw != pItem->yaw() || m_pitch != pItem->pitch() || m_fov != pItem->fov()) {
+            m_yaw = pItem->yaw();
+            m_pitch = pItem->pitch();
+            m_fov = pItem->fov();
+            m_lookupDirty = true;
+        }
+
+        const GLint projection = pItem->effectiveProjection() == PanoramaRenderItem::Cubemap ? 1
+                               : pItem->effectiveProjection() == PanoramaRenderItem::EquiAngularCubemap ? 2 : 0;
+        const GLint stereoMode = pItem->effectiveStereoMode() == PanoramaRenderItem::TopBottom ? 1
+                               : pItem->effectiveStereoMode() == PanoramaRenderItem::SideBySide ? 2 : 0;
+        const GLint eye = pItem->effectiveEye() == PanoramaRenderItem::RightEye ? 1 : 0;
+        const QVector4D bounds = pItem->effectiveBounds();
+        if (m_projection != projection || m_stereoMode != stereoMode || m_eye != eye || m_bounds != bounds) {
+            m_projection = projection;
+            m_stereoMode = stereoMode;
+            m_eye = eye;
+            m_bounds = bounds;
+            m_lookupDirty = true;
+        }
 
         if (pItem->hasNewFrame()) {
-            QImage img = pItem->getFrame();
-            if (!img.isNull()) {
-                if (!m_texture) {
-                    m_texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
-                    m_texture->setSize(img.width(), img.height());
-                    m_texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
-                    m_texture->allocateStorage();
-                    m_texture->setMinificationFilter(QOpenGLTexture::Linear);
-                    m_texture->setMagnificationFilter(QOpenGLTexture::Linear);
-                    m_texture->setWrapMode(QOpenGLTexture::Repeat);
-                    m_texture->setData(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, img.constBits());
-                } else {
-                    // Recreate if size changed, otherwise update
-                    if (m_texture->width() != img.width() || m_texture->height() != img.height()) {
-                        delete m_texture;
-                        m_texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
-                        m_texture->setSize(img.width(), img.height());
-                        m_texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
-                        m_texture->allocateStorage();
-                        m_texture->setMinificationFilter(QOpenGLTexture::Linear);
-                        m_texture->setMagnificationFilter(QOpenGLTexture::Linear);
-                        m_texture->setWrapMode(QOpenGLTexture::Repeat);
-                        m_texture->setData(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, img.constBits());
-                    } else {
-                        m_texture->setData(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, img.constBits());
-                    }
-                }
+            QList<QRect> dirtyRegions;
+            VideoDecoder::FramePtr planar;
+            QImage img = pItem->takeFrame(dirtyRegions, planar);
+            if (planar) {
+                // 16-bit planes; YUV conversion and tone mapping happen in the fragment shader
+                m_texture.uploadPlanar(*planar);
+            } else if (!img.isNull()) {
+                // Storage is only reallocated on size change; content goes through the PBO ring.
+                // With a view window only the freshly converted tiles are uploaded.
+                m_texture.uploadRgba(img.constBits(), img.width(), img.height(), img.bytesPerLine(), dirtyRegions);
             }
         }
-        
-        // Force update if texture exists but no new frame (e.g. camera rotation)
-        if (m_texture) {
-            // No explicit update needed for QQuickFramebufferObject, 
-            // but we need to ensure the window knows we want to draw.
-            // The update() call in PanoramaRenderItem handles this.
-        }
+
+        pItem->reportRendererStats(m_texture.lastUploadMs(), m_lastRenderMs);
     }
 
 private:
+    // RG32F as a colour attachment: core in desktop GL 3.0, an extension on GLES 3.x
+    static bool canRenderFloatLookup() {
+        QOpenGLContext* context = QOpenGLContext::currentContext();
+        if (context->format().majorVersion() < 3) return false;
+        return !context->isOpenGLES() || context->hasExtension("GL_EXT_color_buffer_float");
+    }
+
+    void fallBackToDirect() {
+        qDebug() << "Panorama lookup framebuffer incomplete, using the direct mapping shader";
+        delete m_lookupFbo;
+        m_lookupFbo = nullptr;
+        delete m_lookupProgram;
+        m_lookupProgram = nullptr;
+        delete m_program;
+        m_program = nullptr;
+        m_useLookup = false;
+        initShaders();
+    }
+
     void initShaders() {
-        m_program = new QOpenGLShaderProgram();
-        
         // Vertex Shader
         // Use standard GLSL 1.10 which is widely supported in Compatibility Profile
-        if (!m_program->addShaderFromSourceCode(QOpenGLShader::Vertex,
+        const char* vertexSource =
             "#version 110\n"
             "attribute vec4 vertices;"
             "varying vec2 coords;"
             "void main() {"
             "    gl_Position = vertices;"
             "    coords = vertices.xy;"
-            "}")) {
+            "}";
+
+        m_program = new QOpenGLShaderProgram();
+        if (!m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource)) {
             qDebug() << "Vertex Shader Error:" << m_program->log();
         }
 
         // Fragment Shader
-        if (!m_program->addShaderFromSourceCode(QOpenGLShader::Fragment,
-            "#version 110\n"
-            "uniform sampler2D texture;"
-            "uniform float yaw;"
-            "uniform float pitch;"
-            "uniform float fov;"
-            "uniform float aspect;"
-            "varying vec2 coords;"
-            "const float PI = 3.14159265359;"
-            "void main() {"
-            "    float tanHalfFov = tan(radians(fov) / 2.0);"
-            "    vec3 ray = vec3(coords.x * aspect * tanHalfFov, coords.y * tanHalfFov, -1.0);"
-            "    ray = normalize(ray);"
-            "    float cp = cos(radians(pitch));"
-            "    float sp = sin(radians(pitch));"
-            "    vec3 r1 = vec3(ray.x, ray.y * cp - ray.z * sp, ray.y * sp + ray.z * cp);"
-            "    float cy = cos(radians(yaw));"
-            "    float sy = sin(radians(yaw));"
-            "    vec3 r2 = vec3(r1.x * cy + r1.z * sy, r1.y, -r1.x * sy + r1.z * cy);"
-            "    vec3 dir = normalize(r2);"
-            "    float u = 0.5 + atan(dir.z, dir.x) / (2.0 * PI);"
-            "    float v = 0.5 - asin(dir.y) / PI;"
-            "    gl_FragColor = texture2D(texture, vec2(u, 1.0 - v));"
-            "}")) {
+        QByteArray fragmentSource;
+        if (m_useLookup) {
+            fragmentSource = QByteArray("#version 110\n") + VideoFrameTexture::samplingGlsl() +
+                "uniform sampler2D lookup;"
+                "varying vec2 coords;"
+                "void main() {"
+                "    vec2 uv = texture2D(lookup, coords * 0.5 + 0.5).xy;"
+                "    gl_FragColor = uv.x < 0.0 ? vec4(0.0, 0.0, 0.0, 1.0) : sampleVideo(uv);"
+                "}";
+        } else {
+            fragmentSource = QByteArray("#version 110\n") + kPanoramaMappingGlsl + VideoFrameTexture::samplingGlsl() +
+                "varying vec2 coords;"
+                "void main() {"
+                "    vec2 uv = panoramaUV(coords);"
+                "    gl_FragColor = uv.x < 0.0 ? vec4(0.0, 0.0, 0.0, 1.0) : sampleVideo(uv);"
+                "}";
+        }
+        if (!m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource)) {
             qDebug() << "Fragment Shader Error:" << m_program->log();
         }
 
         if (!m_program->link()) {
             qDebug() << "Shader Link Error:" << m_program->log();
         }
+
+        if (!m_useLookup) return;
+
+        // Lookup pass: writes the frame UV of every viewport pixel into a float texture.
+        // Only runs when yaw, pitch, fov, the frame layout or the viewport size change.
+        m_lookupProgram = new QOpenGLShaderProgram();
+        if (!m_lookupProgram->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource)) {
+            qDebug() << "Lookup Vertex Shader Error:" << m_lookupProgram->log();
+        }
+        if (!m_lookupProgram->addShaderFromSourceCode(QOpenGLShader::Fragment,
+            QByteArray("#version 110\n") + kPanoramaMappingGlsl +
+            "varying vec2 coords;"
+            "void main() {"
+            "    gl_FragColor = vec4(panoramaUV(coords), 0.0, 1.0);"
+            "}")) {
+            qDebug() << "Lookup Fragment Shader Error:" << m_lookupProgram->log();
+        }
+        if (!m_lookupProgram->link()) {
+            qDebug() << "Lookup Shader Link Error:" << m_lookupProgram->log();
+        }
     }
 
     void initGeometry() {
@@ -183,121 +318,181 @@ private:
         m_vbo.release();
     }
 
+    void initTimerQueries() {
+        for (QOpenGLTimerQuery*& query : m_timerQueries) {
+            query = new QOpenGLTimerQuery();
+            if (!query->create()) {
+                // GL_ARB_timer_query not available, render time stays unreported
+                for (QOpenGLTimerQuery*& q : m_timerQueries) {
+                    delete q;
+                    q = nullptr;
+                }
+                return;
+            }
+        }
+    }
+
+    void beginTimerQuery() {
+        QOpenGLTimerQuery* query = m_timerQueries[m_timerSlot];
+        if (!query) return;
+        // Read back the result from two frames ago without stalling the pipeline
+        if (m_timerPending[m_timerSlot] && query->isResultAvailable()) {
+            m_lastRenderMs = query->waitForResult() / 1e6;
+            m_timerPending[m_timerSlot] = false;
+        }
+        if (!m_timerPending[m_timerSlot]) {
+            query->begin();
+        }
+    }
+
+    void endTimerQuery() {
+        QOpenGLTimerQuery* query = m_timerQueries[m_timerSlot];
+        if (query && !m_timerPending[m_timerSlot]) {
+            query->end();
+            m_timerPending[m_timerSlot] = true;
+        }
+        m_timerSlot = (m_timerSlot + 1) % (int)m_timerQueries.size();
+    }
+
+    void setMappingUniforms(QOpenGLShaderProgram* program, float aspect) {
+        program->setUniformValue("yaw", (float)m_yaw);
+        program->setUniformValue("pitch", (float)m_pitch);
+        program->setUniformValue("fov", (float)m_fov);
+        program->setUniformValue("aspect", aspect);
+        program->setUniformValue("projection", m_projection);
+        program->setUniformValue("stereoMode", m_stereoMode);
+        program->setUniformValue("eye", m_eye);
+        program->setUniformValue("bounds", m_bounds);
+    }
+
+    void drawQuad(QOpenGLShaderProgram* program) {
+        m_vbo.bind();
+        int vertexLocation = program->attributeLocation("vertices");
+        program->enableAttributeArray(vertexLocation);
+        program->setAttributeBuffer(vertexLocation, GL_FLOAT, 0, 2);
+
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        program->disableAttributeArray(vertexLocation);
+        m_vbo.release();
+    }
+
+    void updateLookup(const QSize& size, float aspect) {
+        if (!m_lookupFbo || m_lookupFbo->size() != size) {
+            delete m_lookupFbo;
+            // 32-bit float keeps sub-texel precision even for 8K equirect frames
+            m_lookupFbo = new QOpenGLFramebufferObject(size, QOpenGLFramebufferObject::NoAttachment,
+                                                       GL_TEXTURE_2D, GL_RG32F);
+            if (!m_lookupFbo->isValid()) {
+                framebufferObject()->bind();
+                fallBackToDirect();
+                return;
+            }
+            // One lookup texel per viewport pixel, sampled exactly at texel centres
+            glBindTexture(GL_TEXTURE_2D, m_lookupFbo->texture());
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        m_lookupFbo->bind();
+        glViewport(0, 0, size.width(), size.height());
+
+        m_lookupProgram->bind();
+        setMappingUniforms(m_lookupProgram, aspect);
+        drawQuad(m_lookupProgram);
+        m_lookupProgram->release();
+
+        framebufferObject()->bind();
+        m_lookupDirty = false;
+    }
+
     QOpenGLShaderProgram* m_program = nullptr;
-    QOpenGLTexture* m_texture = nullptr;
+    QOpenGLShaderProgram* m_lookupProgram = nullptr;
+    QOpenGLFramebufferObject* m_lookupFbo = nullptr;
+    VideoFrameTexture m_texture;
     QOpenGLBuffer m_vbo;
+    bool m_useLookup = true;
+    bool m_lookupDirty = true;
+
+    std::array<QOpenGLTimerQuery*, 2> m_timerQueries{};
+    std::array<bool, 2> m_timerPending{};
+    int m_timerSlot = 0;
+    double m_lastRenderMs = 0.0;
     
     qreal m_yaw = 0;
     qreal m_pitch = 0;
     qreal m_fov = 90;
+    GLint m_projection = 0;
+    GLint m_stereoMode = 0;
+    GLint m_eye = 0;
+    QVector4D m_bounds;
 };
 
 // --- PanoramaRenderItem Implementation ---
 
 PanoramaRenderItem::PanoramaRenderItem(QQuickItem* parent) : QQuickFramebufferObject(parent) {
-    m_decoder.setFrameCallback([this](const VideoDecoder::Frame& frame) {
-        this->updateFrame(frame);
-    });
-    
-    m_decoder.setErrorCallback([this](const std::string& msg) {
-        this->handleError(msg);
-    });
-
-    m_audioTimer = new QTimer(this);
-    m_audioTimer->setInterval(10);
-    connect(m_audioTimer, &QTimer::timeout, this, &PanoramaRenderItem::updateAudio);
 }
 
 PanoramaRenderItem::~PanoramaRenderItem() {
-    m_decoder.stop();
-    if (m_audioSink) {
-        m_audioSink->stop();
-        delete m_audioSink;
-    }
-    if (m_loadingThread.joinable()) {
-        m_loadingThread.join();
-    }
+    if (m_engine) m_engine->detachView(this);
 }
 
 QQuickFramebufferObject::Renderer* PanoramaRenderItem::createRenderer() const {
     return new PanoramaRenderer();
 }
 
-void PanoramaRenderItem::setSource(const QString& source) {
-    if (m_source == source) return;
-    m_source = source;
-    emit sourceChanged();
+void PanoramaRenderItem::setEngine(MediaPlayerEngine* engine) {
+    if (m_engine == engine) return;
+    if (m_engine) {
+        m_engine->detachView(this);
+        disconnect(m_engine, nullptr, this, nullptr);
+    }
+    m_engine = engine;
+    clearFrame();
+
+    if (m_engine) {
+        connect(m_engine, &MediaPlayerEngine::sourceChanged, this, &PanoramaRenderItem::clearFrame);
+        connect(m_engine, &MediaPlayerEngine::mediaInfoChanged, this, &PanoramaRenderItem::onMediaInfoChanged);
+        m_engine->attachView(this, [this](std::vector<VideoDecoder::FramePtr>& frames) {
+            this->presentFrames(frames);
+        });
+        onMediaInfoChanged();
+        updateOutputSize();
+    }
+    emit engineChanged();
+}
 
+void PanoramaRenderItem::setHighBitDepthOutput(bool enabled) {
+    // Called from the render thread while the GUI thread is blocked in synchronize()
+    if (m_engine) m_engine->setViewHighBitDepth(this, enabled);
+}
+
+void PanoramaRenderItem::clearFrame() {
     {
         QMutexLocker lock(&m_frameMutex);
         m_currentFrame = QImage();
+        m_planarFrame.reset();
         m_newFrameAvailable = false;
+        m_dirtyRegions.clear();
+        m_fullFrameDirty = false;
         m_resetTexture = true;
     }
-    
-    if (!m_source.isEmpty()) {
-        QString path = m_source;
-        QUrl url(m_source);
-        if (url.isLocalFile()) {
-            path = url.toLocalFile();
-        }
-        
-        // Stop Audio
-        if (m_audioSink) {
-            m_audioSink->stop();
-            delete m_audioSink;
-            m_audioSink = nullptr;
-        }
-        m_audioTimer->stop();
-        
-        if (m_loadingThread.joinable()) {
-            m_loadingThread.join();
-        }
+    update();
+}
 
-        std::string stdPath = path.toStdString();
-        m_loadingThread = std::thread([this, stdPath]() {
-            if (m_decoder.open(stdPath)) {
-                QMetaObject::invokeMethod(this, [this]() {
-                    m_duration = m_decoder.getDuration() * 1000;
-                    emit durationChanged();
-                    
-                    // Init Audio
-                    if (m_decoder.hasAudio()) {
-                        QAudioFormat format;
-                        format.setSampleRate(44100);
-                        format.setChannelConfig(QAudioFormat::ChannelConfigStereo);
-                        format.setSampleFormat(QAudioFormat::Int16);
-                        
-                        QAudioDevice device = QMediaDevices::defaultAudioOutput();
-                        if (!device.isFormatSupported(format)) {
-                            qWarning() << "Default format not supported";
-                        }
-                        
-                        m_audioSink = new QAudioSink(device, format, this);
-                        m_audioSink->setVolume(m_volume);
-                        m_audioOutputDevice = m_audioSink->start();
-                        m_audioTimer->start();
-                    }
-                    
-                    play(); // Auto play
-                });
-            }
-        });
-    } else {
-        m_decoder.stop();
-        if (m_audioSink) {
-            m_audioSink->stop();
-            delete m_audioSink;
-            m_audioSink = nullptr;
-        }
-        m_audioTimer->stop();
-    }
+void PanoramaRenderItem::onMediaInfoChanged() {
+    m_detectedLayout = m_engine ? m_engine->sphericalInfo() : VideoDecoder::SphericalInfo();
+    updateLayout();
 }
 
 void PanoramaRenderItem::setYaw(qreal yaw) {
     if (qFuzzyCompare(m_yaw, yaw)) return;
     m_yaw = yaw;
     emit yawChanged();
+    updateViewWindow();
     update();
 }
 
@@ -305,6 +500,7 @@ void PanoramaRenderItem::setPitch(qreal pitch) {
     if (qFuzzyCompare(m_pitch, pitch)) return;
     m_pitch = pitch;
     emit pitchChanged();
+    updateViewWindow();
     update();
 }
 
@@ -312,138 +508,181 @@ void PanoramaRenderItem::setFov(qreal fov) {
     if (qFuzzyCompare(m_fov, fov)) return;
     m_fov = fov;
     emit fovChanged();
+    updateOutputSize();
+    updateViewWindow();
     update();
 }
 
-void PanoramaRenderItem::setPosition(qint64 position) {
-    if (m_position == position) return;
-    m_decoder.seek(position / 1000.0);
+void PanoramaRenderItem::setProjection(Projection projection) {
+    if (m_projection == projection) return;
+    m_projection = projection;
+    emit projectionChanged();
+    updateLayout();
 }
 
-bool PanoramaRenderItem::isPlaying() const {
-    return m_decoder.isPlaying();
+void PanoramaRenderItem::setStereoMode(StereoMode mode) {
+    if (m_stereoMode == mode) return;
+    m_stereoMode = mode;
+    emit stereoModeChanged();
+    updateLayout();
 }
 
-void PanoramaRenderItem::play() {
-    if (m_decoder.isStopped() && !m_source.isEmpty()) {
-        QString path = m_source;
-        QUrl url(m_source);
-        if (url.isLocalFile()) {
-            path = url.toLocalFile();
-        }
-        std::string stdPath = path.toStdString();
-
-        if (m_loadingThread.joinable()) {
-            m_loadingThread.join();
-        }
+void PanoramaRenderItem::setEye(Eye eye) {
+    if (m_eye == eye) return;
+    m_eye = eye;
+    emit eyeChanged();
+    updateLayout();
+}
 
-        m_loadingThread = std::thread([this, stdPath]() {
-            if (m_decoder.open(stdPath)) {
-                QMetaObject::invokeMethod(this, [this]() {
-                    m_duration = m_decoder.getDuration() * 1000;
-                    emit durationChanged();
-                    
-                    // Init Audio
-                    if (m_decoder.hasAudio()) {
-                        QAudioFormat format;
-                        format.setSampleRate(44100);
-                        format.setChannelConfig(QAudioFormat::ChannelConfigStereo);
-                        format.setSampleFormat(QAudioFormat::Int16);
-                        
-                        QAudioDevice device = QMediaDevices::defaultAudioOutput();
-                        if (!device.isFormatSupported(format)) {
-                            qWarning() << "Default format not supported";
-                        }
-                        
-                        if (m_audioSink) {
-                            m_audioSink->stop();
-                            delete m_audioSink;
-                        }
-                        
-                        m_audioSink = new QAudioSink(device, format, this);
-                        m_audioSink->setVolume(m_volume);
-                        m_audioOutputDevice = m_audioSink->start();
-                        m_audioTimer->start();
-                    }
-                    
-                    m_decoder.play();
-                    emit playingChanged();
-                });
-            }
-        });
-    } else {
-        m_decoder.play();
-        if (m_audioSink && m_audioSink->state() == QAudio::SuspendedState) {
-            m_audioSink->resume();
-        }
-        emit playingChanged();
+PanoramaRenderItem::Projection PanoramaRenderItem::effectiveProjection() const {
+    if (m_projection != AutoProjection) return m_projection;
+    switch (m_detectedLayout.projection) {
+    case VideoDecoder::Projection::Cubemap: return Cubemap;
+    case VideoDecoder::Projection::EquiAngularCubemap: return EquiAngularCubemap;
+    default: return Equirectangular;
     }
 }
 
-void PanoramaRenderItem::pause() {
-    m_decoder.pause();
-    if (m_audioSink && m_audioSink->state() == QAudio::ActiveState) {
-        m_audioSink->suspend();
+QVector4D PanoramaRenderItem::effectiveBounds() const {
+    if (m_projection != AutoProjection || m_detectedLayout.projection != VideoDecoder::Projection::Equirectangular) {
+        return QVector4D();
     }
-    emit playingChanged();
+    return QVector4D(m_detectedLayout.boundLeft, m_detectedLayout.boundTop,
+                     m_detectedLayout.boundRight, m_detectedLayout.boundBottom);
 }
 
-void PanoramaRenderItem::stop() {
-    m_decoder.stop();
-    if (m_audioSink) {
-        m_audioSink->stop();
+PanoramaRenderItem::StereoMode PanoramaRenderItem::effectiveStereoMode() const {
+    if (m_stereoMode != AutoStereo) return m_stereoMode;
+    switch (m_detectedLayout.stereo) {
+    case VideoDecoder::StereoLayout::TopBottom: return TopBottom;
+    case VideoDecoder::StereoLayout::SideBySide: return SideBySide;
+    default: return Mono;
     }
-    emit playingChanged();
 }
 
-void PanoramaRenderItem::setResolution(int width, int height) {
-    m_decoder.setTargetResolution(width, height);
+PanoramaRenderItem::Eye PanoramaRenderItem::effectiveEye() const {
+    // Streams flagged as inverted store the right view first
+    bool swap = m_stereoMode == AutoStereo && m_detectedLayout.rightEyeFirst;
+    return swap ? (m_eye == LeftEye ? RightEye : LeftEye) : m_eye;
 }
 
-void PanoramaRenderItem::updateAudio() {
-    if (!m_audioSink || !m_audioOutputDevice || m_audioSink->state() == QAudio::StoppedState) return;
-    
-    int chunks = m_audioSink->bytesFree();
-    if (chunks > 0) {
-        std::vector<uint8_t> buf(chunks);
-        int read = m_decoder.getAudioData(buf.data(), chunks);
-        if (read > 0) {
-            m_audioOutputDevice->write((const char*)buf.data(), read);
-        }
+void PanoramaRenderItem::updateLayout() {
+    emit layoutChanged();
+    updateViewWindow();
+    update();
+}
+
+void PanoramaRenderItem::updateOutputSize() {
+    if (!m_engine || height() <= 0) return;
+
+    // Match the equirect texel density to the screen density at the view centre:
+    // the viewport spans fov vertically, so 2*pi radians need pi * H / tan(fov/2) texels.
+    qreal dpr = window() ? window()->effectiveDevicePixelRatio() : 1.0;
+    qreal viewportHeight = height() * dpr;
+    qreal tanHalfFov = qTan(qDegreesToRadians(m_fov) / 2.0);
+    if (tanHalfFov <= 0.0) return;
+
+    int equirectWidth = qCeil(M_PI * viewportHeight / tanHalfFov);
+    m_engine->setViewOutputSize(this, QSize(equirectWidth, equirectWidth / 2));
+}
+
+void PanoramaRenderItem::geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry) {
+    QQuickFramebufferObject::geometryChange(newGeometry, oldGeometry);
+    if (newGeometry.size() != oldGeometry.size()) {
+        updateOutputSize();
+        updateViewWindow();
     }
 }
 
-void PanoramaRenderItem::setVolume(qreal volume) {
-    if (qFuzzyCompare(m_volume, volume)) return;
-    m_volume = volume;
-    if (m_audioSink) m_audioSink->setVolume(m_volume);
-    emit volumeChanged();
+void PanoramaRenderItem::itemChange(ItemChange change, const ItemChangeData& value) {
+    QQuickFramebufferObject::itemChange(change, value);
+    if (change == ItemDevicePixelRatioHasChanged || change == ItemSceneChange) {
+        updateOutputSize();
+    }
 }
 
-void PanoramaRenderItem::updateFrame(const VideoDecoder::Frame& frame) {
-    QImage img(frame.rgba.data(), frame.width, frame.height, frame.linesize, QImage::Format_RGBA8888);
-    // Deep copy because buffer is reused by decoder
-    QImage copy = img.copy(); 
-    
+void PanoramaRenderItem::presentFrames(std::vector<VideoDecoder::FramePtr>& frames) {
+    if (frames.back()->format != VideoDecoder::Frame::PixelFormat::Rgba8) {
+        // 16-bit planar frames are always complete; the renderer uploads the newest one as is
+        const VideoDecoder::Frame& frame = *frames.back();
+        {
+            QMutexLocker lock(&m_frameMutex);
+            m_planarFrame = frames.back();
+            m_currentFrame = QImage();
+            m_newFrameAvailable = true;
+        }
+        update();
+        return;
+    }
+
+    // Only the newest complete frame needs copying; partial frames after it are applied on top
+    size_t first = 0;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if (frames[i]->regions.empty()) first = i;
+    }
+
     {
         QMutexLocker lock(&m_frameMutex);
-        m_currentFrame = copy;
+        m_planarFrame.reset();
+        for (size_t i = first; i < frames.size(); ++i) {
+            const VideoDecoder::Frame& frame = *frames[i];
+            // Pooled buffers are recycled, so pixels are copied into our persistent frame.
+            // With a view window only the regions that were converted are valid (and uploaded).
+            if (m_currentFrame.size() != QSize(frame.width, frame.height)) {
+                m_currentFrame = QImage(frame.width, frame.height, QImage::Format_RGBA8888);
+                m_currentFrame.fill(Qt::black); // Tiles that have not been converted yet show as black
+                m_dirtyRegions.clear();
+                m_fullFrameDirty = true;
+            }
+
+            uchar* dst = m_currentFrame.bits();
+            const qsizetype dstStride = m_currentFrame.bytesPerLine();
+            if (frame.regions.empty()) {
+                for (int y = 0; y < frame.height; ++y) {
+                    std::memcpy(dst + y * dstStride, frame.pixels.data() + (size_t)y * frame.linesize, (size_t)frame.width * 4);
+                }
+                m_dirtyRegions.clear();
+                m_fullFrameDirty = true;
+            } else {
+                for (const VideoDecoder::Frame::Region& r : frame.regions) {
+                    for (int y = r.y; y < r.y + r.height; ++y) {
+                        std::memcpy(dst + y * dstStride + r.x * 4, frame.pixels.data() + (size_t)y * frame.linesize + r.x * 4,
+                                    (size_t)r.width * 4);
+                    }
+                    if (!m_fullFrameDirty) {
+                        m_dirtyRegions.append(QRect(r.x, r.y, r.width, r.height));
+                    }
+                }
+            }
+        }
         m_newFrameAvailable = true;
-        m_position = frame.pts * 1000;
     }
-    
-    QMetaObject::invokeMethod(this, [this]() {
-        emit positionChanged();
-        update(); // Trigger render
-    });
+
+    update(); // Trigger render
 }
 
-QImage PanoramaRenderItem::getFrame() {
+QImage PanoramaRenderItem::takeFrame(QList<QRect>& dirtyRegions, VideoDecoder::FramePtr& planarFrame) {
     QMutexLocker lock(&m_frameMutex);
     m_newFrameAvailable = false;
+    planarFrame = m_planarFrame;
+    // An empty region list means the whole frame has to be uploaded
+    dirtyRegions = m_fullFrameDirty ? QList<QRect>() : m_dirtyRegions;
+    m_dirtyRegions.clear();
+    m_fullFrameDirty = false;
     return m_currentFrame;
 }
 
+void PanoramaRenderItem::updateViewWindow() {
+    if (!m_engine) return;
+    // Tile culling only understands monoscopic equirect frames of the full sphere
+    if (effectiveProjection() != Equirectangular || effectiveStereoMode() != Mono || !effectiveBounds().isNull()) {
+        m_engine->clearViewWindow(this);
+        return;
+    }
+    if (width() <= 0 || height() <= 0) return;
+    m_engine->setViewWindow(this, m_yaw, m_pitch, m_fov, width() / height());
+}
+
 bool PanoramaRenderItem::takeResetTexture() {
     QMutexLocker lock(&m_frameMutex);
     if (m_resetTexture) {
@@ -453,6 +692,10 @@ bool PanoramaRenderItem::takeResetTexture() {
     return false;
 }
 
-void PanoramaRenderItem::handleError(const std::string& message) {
-    emit errorOccurred(QString::fromStdString(message));
+void PanoramaRenderItem::reportRendererStats(qreal uploadTimeMs, qreal renderTimeMs) {
+    // Called from the render thread while the GUI thread is blocked in synchronize()
+    if (qFuzzyCompare(m_uploadTimeMs, uploadTimeMs) && qFuzzyCompare(m_renderTimeMs, renderTimeMs)) return;
+    m_uploadTimeMs = uploadTimeMs;
+    m_renderTimeMs = renderTimeMs;
+    QMetaObject::invokeMethod(this, &PanoramaRenderItem::statsChanged, Qt::QueuedConnection);
 }
@@ -4,33 +4,43 @@
 #include <QOpenGLTexture>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLBuffer>
+#include <QPointer>
 #include <QMutex>
 #include <QImage>
-#include <QAudioSink>
-#include <QMediaDevices>
-#include <QAudioDevice>
-#include <QTimer>
-#include "../core/VideoDecoder.h"
+#include <QVector4D>
+#include "MediaPlayerEngine.h"
 
+// 360 view of a MediaPlayerEngine
 class PanoramaRenderItem : public QQuickFramebufferObject {
     Q_OBJECT
-    Q_PROPERTY(QString source READ source WRITE setSource NOTIFY sourceChanged)
+    Q_PROPERTY(MediaPlayerEngine* engine READ engine WRITE setEngine NOTIFY engineChanged)
     Q_PROPERTY(qreal yaw READ yaw WRITE setYaw NOTIFY yawChanged)
     Q_PROPERTY(qreal pitch READ pitch WRITE setPitch NOTIFY pitchChanged)
     Q_PROPERTY(qreal fov READ fov WRITE setFov NOTIFY fovChanged)
-    Q_PROPERTY(qint64 duration READ duration NOTIFY durationChanged)
-    Q_PROPERTY(qint64 position READ position WRITE setPosition NOTIFY positionChanged)
-    Q_PROPERTY(qreal volume READ volume WRITE setVolume NOTIFY volumeChanged)
-    Q_PROPERTY(bool playing READ isPlaying NOTIFY playingChanged)
+    Q_PROPERTY(Projection projection READ projection WRITE setProjection NOTIFY projectionChanged)
+    Q_PROPERTY(StereoMode stereoMode READ stereoMode WRITE setStereoMode NOTIFY stereoModeChanged)
+    Q_PROPERTY(Eye eye READ eye WRITE setEye NOTIFY eyeChanged)
+    Q_PROPERTY(Projection effectiveProjection READ effectiveProjection NOTIFY layoutChanged)
+    Q_PROPERTY(StereoMode effectiveStereoMode READ effectiveStereoMode NOTIFY layoutChanged)
+    Q_PROPERTY(qreal uploadTimeMs READ uploadTimeMs NOTIFY statsChanged)
+    Q_PROPERTY(qreal renderTimeMs READ renderTimeMs NOTIFY statsChanged)
 
 public:
+    // Auto values follow the stream's spherical / stereo 3D side data
+    enum Projection { AutoProjection, Equirectangular, Cubemap, EquiAngularCubemap };
+    Q_ENUM(Projection)
+    enum StereoMode { AutoStereo, Mono, TopBottom, SideBySide };
+    Q_ENUM(StereoMode)
+    enum Eye { LeftEye, RightEye };
+    Q_ENUM(Eye)
+
     PanoramaRenderItem(QQuickItem* parent = nullptr);
     ~PanoramaRenderItem();
 
     Renderer* createRenderer() const override;
 
-    QString source() const { return m_source; }
-    void setSource(const QString& source);
+    MediaPlayerEngine* engine() const { return m_engine; }
+    void setEngine(MediaPlayerEngine* engine);
 
     qreal yaw() const { return m_yaw; }
     void setYaw(qreal yaw);
@@ -41,59 +51,74 @@ public:
     qreal fov() const { return m_fov; }
     void setFov(qreal fov);
 
-    qint64 duration() const { return m_duration; }
-    qint64 position() const { return m_position; }
-    void setPosition(qint64 position);
+    Projection projection() const { return m_projection; }
+    void setProjection(Projection projection);
+
+    StereoMode stereoMode() const { return m_stereoMode; }
+    void setStereoMode(StereoMode mode);
 
-    qreal volume() const { return m_volume; }
-    void setVolume(qreal volume);
+    Eye eye() const { return m_eye; }
+    void setEye(Eye eye);
 
-    bool isPlaying() const;
+    Projection effectiveProjection() const;
+    StereoMode effectiveStereoMode() const;
+    Eye effectiveEye() const;
+    // Detected equirect tile bounds (left, top, right, bottom), zero for a full sphere or a
+    // manually chosen projection
+    QVector4D effectiveBounds() const;
 
-    Q_INVOKABLE void play();
-    Q_INVOKABLE void pause();
-    Q_INVOKABLE void stop();
-    Q_INVOKABLE void setResolution(int width, int height);
+    qreal uploadTimeMs() const { return m_uploadTimeMs; }
+    qreal renderTimeMs() const { return m_renderTimeMs; }
 
     // Internal use for Renderer
-    QImage getFrame();
+    // Either an RGBA image (with dirty regions) or, for high-bit-depth sources, the 16-bit planar frame
+    QImage takeFrame(QList<QRect>& dirtyRegions, VideoDecoder::FramePtr& planarFrame);
     bool hasNewFrame() const { return m_newFrameAvailable; }
     bool takeResetTexture();
+    void reportRendererStats(qreal uploadTimeMs, qreal renderTimeMs);
+    void setHighBitDepthOutput(bool enabled);
 
 signals:
-    void sourceChanged();
+    void engineChanged();
     void yawChanged();
     void pitchChanged();
     void fovChanged();
-    void durationChanged();
-    void positionChanged();
-    void volumeChanged();
-    void playingChanged();
-    void errorOccurred(QString message);
+    void projectionChanged();
+    void stereoModeChanged();
+    void eyeChanged();
+    void layoutChanged();
+    void statsChanged();
 
-private:
-    void updateFrame(const VideoDecoder::Frame& frame);
-    void handleError(const std::string& message);
-    void updateAudio();
+protected:
+    void geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry) override;
+    void itemChange(ItemChange change, const ItemChangeData& value) override;
 
-    QString m_source;
+private:
+    void clearFrame();
+    void onMediaInfoChanged();
+    void updateOutputSize();
+    void updateViewWindow();
+    void updateLayout();
+    void presentFrames(std::vector<VideoDecoder::FramePtr>& frames);
+
+    QPointer<MediaPlayerEngine> m_engine;
     qreal m_yaw = 0.0;
     qreal m_pitch = 0.0;
     qreal m_fov = 90.0;
-    qreal m_volume = 1.0;
+    Projection m_projection = AutoProjection;
+    StereoMode m_stereoMode = AutoStereo;
+    Eye m_eye = LeftEye;
+    VideoDecoder::SphericalInfo m_detectedLayout;
 
-    VideoDecoder m_decoder;
     QImage m_currentFrame;
+    VideoDecoder::FramePtr m_planarFrame;
     bool m_newFrameAvailable = false;
+    QList<QRect> m_dirtyRegions;
+    bool m_fullFrameDirty = false;
     bool m_resetTexture = false;
-    
-    qint64 m_duration = 0;
-    qint64 m_position = 0;
-    
-    mutable QMutex m_frameMutex;
-    std::thread m_loadingThread;
 
-    QAudioSink* m_audioSink = nullptr;
-    QIODevice* m_audioOutputDevice = nullptr;
-    QTimer* m_audioTimer = nullptr;
+    qreal m_uploadTimeMs = 0.0;
+    qreal m_renderTimeMs = 0.0;
+
+    mutable QMutex m_frameMutex;
 };
@@ -0,0 +1,39 @@
+#include "StartupTrace.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace {
+std::atomic<bool> g_enabled{false};
+std::chrono::steady_clock::time_point g_start;
+std::mutex g_mutex;
+std::vector<const char*> g_marked;
+} // namespace
+
+namespace StartupTrace {
+
+void begin(bool enabled) {
+    g_start = std::chrono::steady_clock::now();
+    g_enabled = enabled;
+}
+
+bool enabled() {
+    return g_enabled;
+}
+
+void mark(const char* phase) {
+    if (!g_enabled) return;
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - g_start).count();
+    std::lock_guard<std::mutex> lock(g_mutex);
+    for (const char* marked : g_marked) {
+        if (std::strcmp(marked, phase) == 0) return;
+    }
+    g_marked.push_back(phase);
+    std::printf("[startup] %9.1f ms  %s\n", ms, phase);
+    std::fflush(stdout);
+}
+
+} // namespace StartupTrace
@@ -0,0 +1,13 @@
+#pragma once
+
+// `RenkoPlayer --startup-trace`: prints when each startup phase is reached, in milliseconds since
+// main() began, e.g. time to the first window frame and, for the first source opened, time to its
+// first video frame. Each phase is printed once; later opens do not repeat it.
+// `--startup-trace <file>` opens and plays the file as soon as the UI is loaded.
+namespace StartupTrace {
+// First thing in main(); a disabled trace costs one atomic load per mark
+void begin(bool enabled);
+bool enabled();
+// Any thread
+void mark(const char* phase);
+} // namespace StartupTrace
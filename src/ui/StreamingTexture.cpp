@@ -0,0 +1,248 @@
+#include "StreamingTexture.h"
+#include <QOpenGLContext>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <cstring>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+StreamingTexture::StreamingTexture() {
+    initializeOpenGLFunctions();
+
+    QOpenGLContext* ctx = QOpenGLContext::currentContext();
+    const QSurfaceFormat format = ctx->format();
+
+    // glMapBufferRange needs desktop GL 3.0 or GLES 3.0; older contexts upload directly
+    m_rowLengthSupported = format.majorVersion() >= 3;
+    if (!m_rowLengthSupported) {
+        m_mode = Mode::Direct;
+        return;
+    }
+
+    m_mode = Mode::Orphan;
+    if (!ctx->isOpenGLES()
+        && (ctx->hasExtension("GL_ARB_buffer_storage") || format.version() >= qMakePair(4, 4))) {
+        m_bufferStorage = reinterpret_cast<BufferStorageFn>(ctx->getProcAddress("glBufferStorage"));
+        if (m_bufferStorage) {
+            m_mode = Mode::Persistent;
+        }
+    }
+
+    // Allows exercising every path on one driver (e.g. llvmpipe in CI)
+    const QString forced = qEnvironmentVariable("RENKO_PBO_MODE");
+    if (forced == QLatin1String("direct")) {
+        m_mode = Mode::Direct;
+    } else if (forced == QLatin1String("orphan")) {
+        m_mode = Mode::Orphan;
+    }
+}
+
+StreamingTexture::~StreamingTexture() {
+    reset();
+}
+
+void StreamingTexture::reset() {
+    destroyBuffers();
+    delete m_texture;
+    m_texture = nullptr;
+    m_width = 0;
+    m_height = 0;
+}
+
+void StreamingTexture::setWrapMode(QOpenGLTexture::WrapMode mode) {
+    m_wrapMode = mode;
+    if (m_texture) m_texture->setWrapMode(mode);
+}
+
+void StreamingTexture::bind() {
+    if (m_texture) m_texture->bind();
+}
+
+void StreamingTexture::release() {
+    if (m_texture) m_texture->release();
+}
+
+void StreamingTexture::ensureTexture(int width, int height) {
+    if (m_texture && m_width == width && m_height == height) return;
+
+    delete m_texture;
+    m_texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+    m_texture->setSize(width, height);
+    m_texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+    m_texture->allocateStorage();
+    m_texture->setMinificationFilter(QOpenGLTexture::Linear);
+    m_texture->setMagnificationFilter(QOpenGLTexture::Linear);
+    m_texture->setWrapMode(m_wrapMode);
+    m_width = width;
+    m_height = height;
+}
+
+void StreamingTexture::ensureBuffers(qsizetype size) {
+    if (m_buffers[0] && m_bufferSize == size) return;
+
+    destroyBuffers();
+    glGenBuffers(RingSize, m_buffers.data());
+
+    for (int i = 0; i < RingSize; ++i) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffers[i]);
+        if (m_mode == Mode::Persistent) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            m_bufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+            m_persistentPtr[i] = static_cast<uchar*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+            if (!m_persistentPtr[i]) {
+                // Driver refused persistent mapping, fall back to orphaning for good
+                qWarning() << "Persistent PBO mapping failed, falling back to buffer orphaning";
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                destroyBuffers();
+                m_mode = Mode::Orphan;
+                ensureBuffers(size);
+                return;
+            }
+        } else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    m_bufferSize = size;
+    m_slot = 0;
+}
+
+void StreamingTexture::destroyBuffers() {
+    if (!m_buffers[0]) return;
+
+    for (int i = 0; i < RingSize; ++i) {
+        if (m_fences[i]) {
+            glDeleteSync(m_fences[i]);
+            m_fences[i] = nullptr;
+        }
+        if (m_persistentPtr[i]) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffers[i]);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            m_persistentPtr[i] = nullptr;
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(RingSize, m_buffers.data());
+    m_buffers.fill(0);
+    m_bufferSize = 0;
+}
+
+uchar* StreamingTexture::mapSlot(int slot, qsizetype size) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffers[slot]);
+
+    if (m_mode == Mode::Persistent) {
+        // The GPU may still be reading this slot from a previous frame
+        if (m_fences[slot]) {
+            glClientWaitSync(m_fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 100000000); // 100 ms
+            glDeleteSync(m_fences[slot]);
+            m_fences[slot] = nullptr;
+        }
+        return m_persistentPtr[slot];
+    }
+
+    // Orphan the previous storage so the driver never stalls on an in-flight transfer
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    return static_cast<uchar*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+}
+
+void StreamingTexture::unmapSlot() {
+    // Persistent slots stay mapped for the lifetime of the buffer
+    if (m_mode != Mode::Persistent) {
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+}
+
+void StreamingTexture::copyRows(uchar* dst, const uchar* src, int rowBytes, int height, int stride) {
+    if (stride == rowBytes) {
+        std::memcpy(dst, src, (size_t)rowBytes * height);
+        return;
+    }
+    for (int y = 0; y < height; ++y) {
+        std::memcpy(dst + (size_t)y * rowBytes, src + (size_t)y * stride, rowBytes);
+    }
+}
+
+void StreamingTexture::upload(const uchar* data, int width, int height, int stride) {
+    uploadRegions(data, width, height, stride, {});
+}
+
+void StreamingTexture::uploadRegions(const uchar* data, int width, int height, int stride, const QList<QRect>& regions) {
+    if (!data || width <= 0 || height <= 0) return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // A (re)allocated texture has no valid content yet, so it always gets the whole image
+    bool fresh = !m_texture || m_width != width || m_height != height;
+    ensureTexture(width, height);
+    m_texture->bind();
+
+    QList<QRect> rects = regions;
+    if (fresh || rects.isEmpty()) {
+        rects = { QRect(0, 0, width, height) };
+    }
+
+    qsizetype total = 0;
+    for (const QRect& r : rects) total += (qsizetype)r.width() * r.height() * 4;
+
+    bool uploaded = false;
+
+    if (m_mode != Mode::Direct) {
+        // Slots are sized for a whole frame; partial updates pack their regions back to back
+        ensureBuffers((qsizetype)width * height * 4);
+        const int slot = m_slot;
+        m_slot = (m_slot + 1) % RingSize;
+
+        if (uchar* dst = mapSlot(slot, m_bufferSize)) {
+            qsizetype offset = 0;
+            for (const QRect& r : rects) {
+                const uchar* src = data + (size_t)r.y() * stride + (size_t)r.x() * 4;
+                copyRows(dst + offset, src, r.width() * 4, r.height(), stride);
+                offset += (qsizetype)r.width() * r.height() * 4;
+            }
+            unmapSlot();
+
+            // Source is the bound PBO, so the transfers are queued instead of blocking the CPU
+            offset = 0;
+            for (const QRect& r : rects) {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, r.x(), r.y(), r.width(), r.height(), GL_RGBA, GL_UNSIGNED_BYTE,
+                                reinterpret_cast<const void*>(offset));
+                offset += (qsizetype)r.width() * r.height() * 4;
+            }
+            if (m_mode == Mode::Persistent) {
+                m_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            }
+            uploaded = true;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    if (!uploaded) {
+        for (const QRect& r : rects) {
+            const uchar* src = data + (size_t)r.y() * stride + (size_t)r.x() * 4;
+            if (stride == r.width() * 4) {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, r.x(), r.y(), r.width(), r.height(), GL_RGBA, GL_UNSIGNED_BYTE, src);
+            } else if (m_rowLengthSupported) {
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / 4);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, r.x(), r.y(), r.width(), r.height(), GL_RGBA, GL_UNSIGNED_BYTE, src);
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            } else {
+                for (int y = 0; y < r.height(); ++y) {
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, r.x(), r.y() + y, r.width(), 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                                    src + (size_t)y * stride);
+                }
+            }
+        }
+    }
+
+    m_texture->release();
+    m_lastUploadBytes = total;
+    m_lastUploadMs = timer.nsecsElapsed() / 1e6;
+}
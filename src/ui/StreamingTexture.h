@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLTexture>
+#include <QList>
+#include <QRect>
+#include <array>
+
+// Streams CPU frames into a GL texture through a small ring of pixel buffer objects.
+// Upload becomes a memcpy into mapped memory plus an asynchronous glTexSubImage2D;
+// texture storage is only reallocated when the frame size changes.
+// Must be created, used and destroyed with the owning GL context current.
+class StreamingTexture : protected QOpenGLExtraFunctions {
+public:
+    StreamingTexture();
+    ~StreamingTexture();
+
+    // Upload a tightly or loosely packed RGBA8 image (stride in bytes)
+    void upload(const uchar* data, int width, int height, int stride);
+    // Upload only the given rectangles of the image; the rest of the texture keeps its content.
+    // Falls back to a full upload when the texture has to be (re)allocated.
+    void uploadRegions(const uchar* data, int width, int height, int stride, const QList<QRect>& regions);
+    void reset();
+    void setWrapMode(QOpenGLTexture::WrapMode mode);
+
+    bool isValid() const { return m_texture != nullptr; }
+    void bind();
+    void release();
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    // CPU-side cost of the last upload (copy + command submission) in milliseconds
+    double lastUploadMs() const { return m_lastUploadMs; }
+    qsizetype lastUploadBytes() const { return m_lastUploadBytes; }
+
+private:
+    enum class Mode { Direct, Orphan, Persistent };
+
+    static constexpr int RingSize = 3;
+
+    void ensureTexture(int width, int height);
+    void ensureBuffers(qsizetype size);
+    void destroyBuffers();
+    uchar* mapSlot(int slot, qsizetype size);
+    void unmapSlot();
+    static void copyRows(uchar* dst, const uchar* src, int rowBytes, int height, int stride);
+
+    Mode m_mode = Mode::Direct;
+    bool m_rowLengthSupported = false;
+    QOpenGLTexture* m_texture = nullptr;
+    QOpenGLTexture::WrapMode m_wrapMode = QOpenGLTexture::Repeat;
+    int m_width = 0;
+    int m_height = 0;
+
+    std::array<GLuint, RingSize> m_buffers{};
+    std::array<uchar*, RingSize> m_persistentPtr{};
+    std::array<GLsync, RingSize> m_fences{};
+    qsizetype m_bufferSize = 0;
+    int m_slot = 0;
+
+    using BufferStorageFn = void (QOPENGLF_APIENTRYP)(GLenum, GLsizeiptr, const void*, GLbitfield);
+    BufferStorageFn m_bufferStorage = nullptr;
+
+    double m_lastUploadMs = 0.0;
+    qsizetype m_lastUploadBytes = 0;
+};
@@ -0,0 +1,50 @@
+#include "SubtitleAtlas.h"
+#include <QPainter>
+
+SubtitleAtlas::SubtitleAtlas(const QSize& size) : m_image(size, QImage::Format_ARGB32_Premultiplied) {
+    clear();
+}
+
+void SubtitleAtlas::clear() {
+    m_image.fill(Qt::transparent);
+    m_entries.clear();
+    m_shelfX = 0;
+    m_shelfY = 0;
+    m_shelfHeight = 0;
+    m_dirty = true;
+}
+
+QRect SubtitleAtlas::insert(const QString& key, const QImage& image) {
+    const QRect existing = m_entries.value(key);
+    if (!existing.isNull()) return existing;
+
+    const int w = image.width() + Padding;
+    const int h = image.height() + Padding;
+    if (w > m_image.width() || h > m_image.height()) return QRect();
+
+    // Start a new shelf when the current one is out of width
+    if (m_shelfX + w > m_image.width()) {
+        m_shelfY += m_shelfHeight;
+        m_shelfX = 0;
+        m_shelfHeight = 0;
+    }
+    if (m_shelfY + h > m_image.height()) return QRect();
+
+    const QRect rect(m_shelfX, m_shelfY, image.width(), image.height());
+    QPainter painter(&m_image);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.drawImage(rect.topLeft(), image);
+    painter.end();
+
+    m_shelfX += w;
+    m_shelfHeight = qMax(m_shelfHeight, h);
+    m_entries.insert(key, rect);
+    m_dirty = true;
+    return rect;
+}
+
+bool SubtitleAtlas::takeDirty() {
+    const bool dirty = m_dirty;
+    m_dirty = false;
+    return dirty;
+}
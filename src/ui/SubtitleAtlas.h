@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QHash>
+#include <QImage>
+#include <QRect>
+#include <QString>
+
+// Rasterized subtitle lines and bitmaps packed into one image (shelf packing), so the
+// overlay draws everything from a single texture. Each entry is rasterized once and
+// reused while it stays on screen; when the atlas is full it is cleared and refilled.
+class SubtitleAtlas {
+public:
+    explicit SubtitleAtlas(const QSize& size = QSize(2048, 1024));
+
+    // Null rect when the key is not in the atlas
+    QRect find(const QString& key) const { return m_entries.value(key); }
+    // Null rect when the image does not fit (the caller clears and retries)
+    QRect insert(const QString& key, const QImage& image);
+    void clear();
+
+    const QImage& image() const { return m_image; }
+    QSize size() const { return m_image.size(); }
+    // True once after the image changed, so the texture is only re-uploaded when needed
+    bool takeDirty();
+
+private:
+    static constexpr int Padding = 1; // Keeps linear filtering from picking up neighbours
+
+    QImage m_image;
+    QHash<QString, QRect> m_entries;
+    int m_shelfX = 0;
+    int m_shelfY = 0;
+    int m_shelfHeight = 0;
+    bool m_dirty = true;
+};
@@ -0,0 +1,184 @@
+#include "SubtitleOverlay.h"
+#include <QFontMetricsF>
+#include <QPainter>
+#include <QPainterPath>
+#include <QQuickWindow>
+#include <QSGGeometryNode>
+#include <QSGTextureMaterial>
+#include <QtMath>
+#include <memory>
+
+namespace {
+
+// Textured quads over the atlas; owns the atlas texture it samples
+class SubtitleNode : public QSGGeometryNode {
+public:
+    SubtitleNode() : m_geometry(QSGGeometry::defaultAttributes_TexturedPoint2D(), 0) {
+        m_geometry.setDrawingMode(QSGGeometry::DrawTriangles);
+        setGeometry(&m_geometry);
+        m_material.setFiltering(QSGTexture::Linear);
+        setMaterial(&m_material);
+    }
+
+    QSGGeometry m_geometry;
+    QSGTextureMaterial m_material;
+    std::unique_ptr<QSGTexture> m_texture;
+};
+
+} // namespace
+
+SubtitleOverlay::SubtitleOverlay(QQuickItem* parent) : QQuickItem(parent) {
+    setFlag(ItemHasContents, true);
+}
+
+void SubtitleOverlay::setEvents(const std::vector<SubtitleQueue::EventPtr>& events) {
+    bool same = events.size() == m_events.size();
+    for (size_t i = 0; same && i < events.size(); ++i) {
+        same = events[i]->id == m_events[i]->id;
+    }
+    if (same) return;
+
+    m_events = events;
+    relayout();
+}
+
+void SubtitleOverlay::setVideoRect(const QRectF& rect) {
+    if (m_videoRect == rect) return;
+    m_videoRect = rect;
+    relayout();
+}
+
+void SubtitleOverlay::clear() {
+    m_events.clear();
+    m_atlas.clear();
+    relayout();
+}
+
+void SubtitleOverlay::relayout() {
+    std::vector<Quad> quads;
+    if (!layoutQuads(quads)) {
+        // Out of atlas space: start over with only what is on screen now
+        m_atlas.clear();
+        quads.clear();
+        layoutQuads(quads);
+    }
+    m_quads = std::move(quads);
+    update();
+}
+
+bool SubtitleOverlay::layoutQuads(std::vector<Quad>& quads) {
+    if (m_events.empty() || m_videoRect.isEmpty()) return true;
+
+    bool fitted = true;
+    const qreal dpr = window() ? window()->effectiveDevicePixelRatio() : 1.0;
+
+    QStringList lines;
+    for (const SubtitleQueue::EventPtr& event : m_events) {
+        if (!event->text.empty()) {
+            lines += QString::fromStdString(event->text).split(QLatin1Char('\n'), Qt::SkipEmptyParts);
+        }
+
+        // Bitmaps keep their position on the subtitle canvas, scaled onto the picture
+        if (event->bitmaps.empty() || event->canvasWidth <= 0 || event->canvasHeight <= 0) continue;
+
+        const qreal sx = m_videoRect.width() / event->canvasWidth;
+        const qreal sy = m_videoRect.height() / event->canvasHeight;
+        for (size_t i = 0; i < event->bitmaps.size(); ++i) {
+            const SubtitleBitmap& bitmap = event->bitmaps[i];
+            const QString key = QStringLiteral("b%1:%2").arg(event->id).arg(i);
+            QRect source = m_atlas.find(key);
+            if (source.isNull()) {
+                const QImage image(reinterpret_cast<const uchar*>(bitmap.pixels.data()), bitmap.width, bitmap.height,
+                                   bitmap.width * 4, QImage::Format_ARGB32_Premultiplied);
+                source = m_atlas.insert(key, image);
+                if (source.isNull()) {
+                    fitted = false;
+                    continue;
+                }
+            }
+            quads.push_back({QRectF(m_videoRect.x() + bitmap.x * sx, m_videoRect.y() + bitmap.y * sy,
+                                    bitmap.width * sx, bitmap.height * sy), source});
+        }
+    }
+
+    // Text lines are centred and stacked upwards from the bottom margin of the picture
+    const int pixelSize = qMax(12, qRound(m_videoRect.height() * 0.055 * dpr));
+    qreal y = m_videoRect.bottom() - m_videoRect.height() * 0.06;
+    for (qsizetype i = lines.size() - 1; i >= 0; --i) {
+        const QString key = QStringLiteral("t%1:").arg(pixelSize) + lines[i];
+        QRect source = m_atlas.find(key);
+        if (source.isNull()) {
+            source = m_atlas.insert(key, renderLine(lines[i], pixelSize));
+            if (source.isNull()) {
+                fitted = false;
+                continue;
+            }
+        }
+        const QSizeF size = QSizeF(source.size()) / dpr;
+        y -= size.height();
+        quads.push_back({QRectF(QPointF(m_videoRect.center().x() - size.width() / 2, y), size), source});
+    }
+    return fitted;
+}
+
+QImage SubtitleOverlay::renderLine(const QString& line, int pixelSize) {
+    QFont font;
+    font.setPixelSize(pixelSize);
+    font.setWeight(QFont::DemiBold);
+    const QFontMetricsF metrics(font);
+    const qreal outline = qMax<qreal>(1.0, pixelSize / 16.0);
+
+    // Fixed line height from the font metrics so stacked lines are evenly spaced
+    QImage image(qCeil(metrics.horizontalAdvance(line) + 2 * outline), qCeil(metrics.height() + 2 * outline),
+                 QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+
+    QPainterPath path;
+    path.addText(outline, outline + metrics.ascent(), font, line);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.strokePath(path, QPen(QColor(0, 0, 0, 220), outline * 2, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+    painter.fillPath(path, Qt::white);
+    return image;
+}
+
+QSGNode* SubtitleOverlay::updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData* data) {
+    Q_UNUSED(data);
+    SubtitleNode* node = static_cast<SubtitleNode*>(oldNode);
+    if (m_quads.empty()) {
+        delete node;
+        return nullptr;
+    }
+    if (!node) {
+        node = new SubtitleNode();
+    }
+
+    // Re-uploaded only when new lines or bitmaps were rasterized
+    if (m_atlas.takeDirty() || !node->m_texture) {
+        node->m_texture.reset(window()->createTextureFromImage(m_atlas.image(), QQuickWindow::TextureHasAlphaChannel));
+        node->m_material.setTexture(node->m_texture.get());
+        node->markDirty(QSGNode::DirtyMaterial);
+    }
+
+    const QSizeF atlasSize = m_atlas.size();
+    QSGGeometry& geometry = node->m_geometry;
+    geometry.allocate((int)m_quads.size() * 6);
+    QSGGeometry::TexturedPoint2D* v = geometry.vertexDataAsTexturedPoint2D();
+    for (const Quad& quad : m_quads) {
+        const QRectF& t = quad.target;
+        const float u0 = quad.source.left() / atlasSize.width();
+        const float v0 = quad.source.top() / atlasSize.height();
+        const float u1 = (quad.source.left() + quad.source.width()) / atlasSize.width();
+        const float v1 = (quad.source.top() + quad.source.height()) / atlasSize.height();
+        v[0].set(t.left(), t.top(), u0, v0);
+        v[1].set(t.right(), t.top(), u1, v0);
+        v[2].set(t.left(), t.bottom(), u0, v1);
+        v[3].set(t.right(), t.top(), u1, v0);
+        v[4].set(t.right(), t.bottom(), u1, v1);
+        v[5].set(t.left(), t.bottom(), u0, v1);
+        v += 6;
+    }
+    node->markDirty(QSGNode::DirtyGeometry);
+    return node;
+}
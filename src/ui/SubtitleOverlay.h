@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QQuickItem>
+#include <vector>
+#include "../core/SubtitleQueue.h"
+#include "SubtitleAtlas.h"
+
+// Scene graph overlay that draws the visible subtitle events on top of a video item.
+// Subtitles are never burned into the video frame: lines and bitmaps are rasterized once
+// into a SubtitleAtlas and composited as textured quads from that single texture.
+class SubtitleOverlay : public QQuickItem {
+    Q_OBJECT
+
+public:
+    explicit SubtitleOverlay(QQuickItem* parent = nullptr);
+
+    // Events visible now; only a change in the set of events triggers a relayout
+    void setEvents(const std::vector<SubtitleQueue::EventPtr>& events);
+    // Area of the item covered by the picture (letterbox excluded), in item coordinates
+    void setVideoRect(const QRectF& rect);
+    void clear();
+
+protected:
+    QSGNode* updatePaintNode(QSGNode* oldNode, UpdatePaintNodeData* data) override;
+
+private:
+    struct Quad {
+        QRectF target;
+        QRect source;
+    };
+
+    void relayout();
+    bool layoutQuads(std::vector<Quad>& quads);
+    static QImage renderLine(const QString& line, int pixelSize);
+
+    std::vector<SubtitleQueue::EventPtr> m_events;
+    QRectF m_videoRect;
+    SubtitleAtlas m_atlas;
+    std::vector<Quad> m_quads;
+};
@@ -0,0 +1,233 @@
+#include "VideoFrameTexture.h"
+#include <QOpenGLContext>
+#include <QOpenGLPixelTransferOptions>
+#include <QElapsedTimer>
+#include <QGenericMatrix>
+#include <QVector3D>
+
+// Output is SDR with reference white at 203 cd/m2 (ITU-R BT.2408); linear values are relative to it.
+static const char* kVideoSamplingGlsl =
+    "uniform sampler2D videoRgba;"
+    "uniform sampler2D videoPlaneY;"
+    "uniform sampler2D videoPlaneU;"   // U, or interleaved UV
+    "uniform sampler2D videoPlaneV;"
+    "uniform int videoMode;"           // 0 RGBA, 1 three planes, 2 Y + interleaved UV
+    "uniform float videoSampleScale;"  // normalized 16-bit word -> normalized code value
+    "uniform mat3 videoYuvMatrix;"     // range expansion folded in
+    "uniform vec3 videoYuvOffset;"
+    "uniform int videoTransfer;"       // 0 SDR, 1 PQ, 2 HLG
+    "uniform int videoGamut;"          // 1 BT.2020 primaries
+    "uniform float videoPeak;"         // content peak relative to SDR white
+    "const mat3 kBt2020To709 = mat3(1.6605, -0.1246, -0.0182,"
+    "                               -0.5876, 1.1329, -0.1006,"
+    "                               -0.0728, -0.0083, 1.1187);"
+    "vec3 pqToLinear(vec3 e) {"
+    "    vec3 p = pow(e, vec3(1.0 / 78.84375));"
+    "    vec3 l = pow(max(p - 0.8359375, 0.0) / (18.8515625 - 18.6875 * p), vec3(1.0 / 0.1593017578125));"
+    "    return l * (10000.0 / 203.0);"
+    "}"
+    // HLG inverse OETF, then the reference OOTF (system gamma 1.2 for a 1000 cd/m2 display)
+    "vec3 hlgToLinear(vec3 e) {"
+    "    vec3 scene = mix(e * e / 3.0, (exp((e - 0.55991073) / 0.17883277) + 0.28466892) / 12.0, step(0.5, e));"
+    "    float y = dot(scene, vec3(0.2627, 0.6780, 0.0593));"
+    "    return scene * pow(max(y, 1e-6), 0.2) * (1000.0 / 203.0);"
+    "}"
+    // Extended Reinhard on the largest channel keeps hue and maps videoPeak to white
+    "vec3 toneMap(vec3 c) {"
+    "    float m = max(max(c.r, c.g), c.b);"
+    "    if (m <= 0.0) return c;"
+    "    float w = max(videoPeak, 1.0);"
+    "    return c * ((1.0 + m / (w * w)) / (1.0 + m));"
+    "}"
+    "vec4 sampleVideo(vec2 uv) {"
+    "    if (videoMode == 0) return texture2D(videoRgba, uv);"
+    "    vec3 yuv;"
+    "    yuv.x = texture2D(videoPlaneY, uv).r;"
+    "    if (videoMode == 1) yuv.yz = vec2(texture2D(videoPlaneU, uv).r, texture2D(videoPlaneV, uv).r);"
+    "    else yuv.yz = texture2D(videoPlaneU, uv).rg;"
+    "    vec3 rgb = clamp(videoYuvMatrix * (yuv * videoSampleScale - videoYuvOffset), 0.0, 1.0);"
+    "    if (videoTransfer == 0) {"
+    "        if (videoGamut == 1) {"
+    "            rgb = pow(clamp(kBt2020To709 * pow(rgb, vec3(2.4)), 0.0, 1.0), vec3(1.0 / 2.4));"
+    "        }"
+    "        return vec4(rgb, 1.0);"
+    "    }"
+    "    vec3 lin = videoTransfer == 1 ? pqToLinear(rgb) : hlgToLinear(rgb);"
+    "    if (videoGamut == 1) lin = max(kBt2020To709 * lin, 0.0);"
+    "    return vec4(pow(clamp(toneMap(lin), 0.0, 1.0), vec3(1.0 / 2.2)), 1.0);"
+    "}";
+
+VideoFrameTexture::VideoFrameTexture() {
+    initializeOpenGLFunctions();
+
+    QOpenGLContext* ctx = QOpenGLContext::currentContext();
+    if (ctx->isOpenGLES()) {
+        m_highBitDepth = ctx->format().majorVersion() >= 3 && ctx->hasExtension("GL_EXT_texture_norm16");
+    } else {
+        m_highBitDepth = ctx->format().majorVersion() >= 3;
+    }
+    if (qEnvironmentVariable("RENKO_HIGH_BIT_DEPTH") == QLatin1String("0")) {
+        m_highBitDepth = false;
+    }
+}
+
+VideoFrameTexture::~VideoFrameTexture() {
+    destroyPlanes();
+}
+
+const char* VideoFrameTexture::samplingGlsl() {
+    return kVideoSamplingGlsl;
+}
+
+void VideoFrameTexture::reset() {
+    m_rgba.reset();
+    destroyPlanes();
+    m_mode = Mode::Rgba;
+}
+
+void VideoFrameTexture::setWrapMode(QOpenGLTexture::WrapMode mode) {
+    m_wrapMode = mode;
+    m_rgba.setWrapMode(mode);
+    for (QOpenGLTexture* plane : m_planes) {
+        if (plane) plane->setWrapMode(mode);
+    }
+}
+
+void VideoFrameTexture::destroyPlanes() {
+    for (QOpenGLTexture*& plane : m_planes) {
+        delete plane;
+        plane = nullptr;
+    }
+    m_width = 0;
+    m_height = 0;
+}
+
+void VideoFrameTexture::uploadRgba(const uchar* data, int width, int height, int stride, const QList<QRect>& regions) {
+    if (m_mode != Mode::Rgba) {
+        destroyPlanes();
+        m_mode = Mode::Rgba;
+    }
+    m_rgba.uploadRegions(data, width, height, stride, regions);
+}
+
+void VideoFrameTexture::ensurePlane(int index, int width, int height, QOpenGLTexture::TextureFormat format) {
+    QOpenGLTexture*& plane = m_planes[index];
+    if (plane && plane->width() == width && plane->height() == height && plane->format() == format) return;
+
+    delete plane;
+    plane = new QOpenGLTexture(QOpenGLTexture::Target2D);
+    plane->setSize(width, height);
+    plane->setFormat(format);
+    plane->allocateStorage(format == QOpenGLTexture::RG16_UNorm ? QOpenGLTexture::RG : QOpenGLTexture::Red,
+                           QOpenGLTexture::UInt16);
+    plane->setMinificationFilter(QOpenGLTexture::Linear);
+    plane->setMagnificationFilter(QOpenGLTexture::Linear);
+    plane->setWrapMode(m_wrapMode);
+}
+
+void VideoFrameTexture::uploadPlanar(const VideoFrame& frame) {
+    if (frame.format == VideoFrame::PixelFormat::Rgba8 || frame.width <= 0 || frame.height <= 0) return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (m_mode == Mode::Rgba) {
+        m_rgba.reset();
+    }
+    const bool interleaved = frame.format == VideoFrame::PixelFormat::P016;
+    m_mode = interleaved ? Mode::Interleaved : Mode::Planar;
+
+    const int chromaWidth = (frame.width + 1) / 2;
+    const int chromaHeight = (frame.height + 1) / 2;
+    ensurePlane(0, frame.width, frame.height, QOpenGLTexture::R16_UNorm);
+    if (interleaved) {
+        ensurePlane(1, chromaWidth, chromaHeight, QOpenGLTexture::RG16_UNorm);
+        delete m_planes[2];
+        m_planes[2] = nullptr;
+    } else {
+        ensurePlane(1, chromaWidth, chromaHeight, QOpenGLTexture::R16_UNorm);
+        ensurePlane(2, chromaWidth, chromaHeight, QOpenGLTexture::R16_UNorm);
+    }
+
+    const int planes = interleaved ? 2 : 3;
+    for (int i = 0; i < planes; ++i) {
+        const int components = (interleaved && i == 1) ? 2 : 1;
+        QOpenGLPixelTransferOptions options;
+        options.setAlignment(2);
+        options.setRowLength(frame.planeStride[i] / (2 * components));
+        m_planes[i]->setData(0, components == 2 ? QOpenGLTexture::RG : QOpenGLTexture::Red, QOpenGLTexture::UInt16,
+                             frame.pixels.data() + frame.planeOffset[i], &options);
+    }
+
+    m_width = frame.width;
+    m_height = frame.height;
+    m_color = frame.color;
+    m_bitDepth = frame.bitDepth;
+    m_msbAligned = frame.msbAligned;
+    m_lastUploadMs = timer.nsecsElapsed() / 1e6;
+}
+
+void VideoFrameTexture::bind(QOpenGLShaderProgram* program, int firstUnit) {
+    program->setUniformValue("videoMode", (GLint)m_mode);
+    if (m_mode == Mode::Rgba) {
+        glActiveTexture(GL_TEXTURE0 + firstUnit);
+        m_rgba.bind();
+        program->setUniformValue("videoRgba", firstUnit);
+        return;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        glActiveTexture(GL_TEXTURE0 + firstUnit + 1 + i);
+        if (m_planes[i]) m_planes[i]->bind();
+    }
+    glActiveTexture(GL_TEXTURE0 + firstUnit);
+    // Unused samplers still need distinct units
+    program->setUniformValue("videoRgba", firstUnit);
+    program->setUniformValue("videoPlaneY", firstUnit + 1);
+    program->setUniformValue("videoPlaneU", firstUnit + 2);
+    program->setUniformValue("videoPlaneV", firstUnit + 3);
+
+    // Texels are word / 65535; bring them back to code value / (2^depth - 1)
+    const float maxCode = float((1 << m_bitDepth) - 1);
+    const float wordScale = m_msbAligned ? float(1 << (16 - m_bitDepth)) : 1.0f;
+    program->setUniformValue("videoSampleScale", 65535.0f / (maxCode * wordScale));
+
+    using Matrix = VideoFrame::Colorimetry::Matrix;
+    const float kr = m_color.matrix == Matrix::Bt2020 ? 0.2627f : m_color.matrix == Matrix::Bt709 ? 0.2126f : 0.299f;
+    const float kb = m_color.matrix == Matrix::Bt2020 ? 0.0593f : m_color.matrix == Matrix::Bt709 ? 0.0722f : 0.114f;
+    const float kg = 1.0f - kr - kb;
+
+    // Limited range: 16..235 luma, 16..240 chroma, scaled to the bit depth
+    const float step = float(1 << (m_bitDepth - 8));
+    const float lumaScale = m_color.fullRange ? 1.0f : maxCode / (219.0f * step);
+    const float chromaScale = m_color.fullRange ? 1.0f : maxCode / (224.0f * step);
+    const float lumaOffset = m_color.fullRange ? 0.0f : 16.0f * step / maxCode;
+    const float chromaOffset = 128.0f * step / maxCode;
+
+    const float values[9] = {
+        lumaScale, 0.0f, 2.0f * (1.0f - kr) * chromaScale,
+        lumaScale, -2.0f * kb * (1.0f - kb) / kg * chromaScale, -2.0f * kr * (1.0f - kr) / kg * chromaScale,
+        lumaScale, 2.0f * (1.0f - kb) * chromaScale, 0.0f
+    };
+    program->setUniformValue("videoYuvMatrix", QMatrix3x3(values));
+    program->setUniformValue("videoYuvOffset", QVector3D(lumaOffset, chromaOffset, chromaOffset));
+
+    using Transfer = VideoFrame::Colorimetry::Transfer;
+    program->setUniformValue("videoTransfer", (GLint)(m_color.transfer == Transfer::Pq ? 1
+                                                     : m_color.transfer == Transfer::Hlg ? 2 : 0));
+    program->setUniformValue("videoGamut", (GLint)(m_color.bt2020Primaries ? 1 : 0));
+    program->setUniformValue("videoPeak", m_color.peakLuminance / 203.0f);
+}
+
+void VideoFrameTexture::release(int firstUnit) {
+    if (m_mode == Mode::Rgba) {
+        glActiveTexture(GL_TEXTURE0 + firstUnit);
+        m_rgba.release();
+        return;
+    }
+    for (int i = 3; i-- > 0;) {
+        glActiveTexture(GL_TEXTURE0 + firstUnit + 1 + i);
+        if (m_planes[i]) m_planes[i]->release();
+    }
+    glActiveTexture(GL_TEXTURE0 + firstUnit);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "StreamingTexture.h"
+#include "../core/FrameQueue.h"
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+
+// Video frame on the GPU: either CPU-converted RGBA streamed through StreamingTexture,
+// or high-bit-depth 4:2:0 planes kept as 16-bit textures and converted in the shader,
+// including PQ/HLG tone mapping and BT.2020 -> BT.709 gamut mapping to SDR output.
+// Fragment shaders include samplingGlsl() and call sampleVideo(uv); bind() sets its uniforms.
+// Must be created, used and destroyed with the owning GL context current.
+class VideoFrameTexture : protected QOpenGLExtraFunctions {
+public:
+    VideoFrameTexture();
+    ~VideoFrameTexture();
+
+    // R16/RG16 textures need desktop GL 3.0 or GLES with GL_EXT_texture_norm16.
+    // RENKO_HIGH_BIT_DEPTH=0 forces the 8-bit CPU path, for A/B comparison.
+    bool supportsHighBitDepth() const { return m_highBitDepth; }
+
+    void uploadRgba(const uchar* data, int width, int height, int stride, const QList<QRect>& regions = {});
+    void uploadPlanar(const VideoFrame& frame);
+    void setWrapMode(QOpenGLTexture::WrapMode mode);
+    void reset();
+
+    bool isValid() const { return m_mode == Mode::Rgba ? m_rgba.isValid() : m_planes[0] != nullptr; }
+    int width() const { return m_mode == Mode::Rgba ? m_rgba.width() : m_width; }
+    int height() const { return m_mode == Mode::Rgba ? m_rgba.height() : m_height; }
+    double lastUploadMs() const { return m_mode == Mode::Rgba ? m_rgba.lastUploadMs() : m_lastUploadMs; }
+
+    // Binds the textures to firstUnit.. firstUnit+3 and sets the sampling uniforms
+    void bind(QOpenGLShaderProgram* program, int firstUnit = 0);
+    void release(int firstUnit = 0);
+
+    static const char* samplingGlsl();
+
+private:
+    enum class Mode { Rgba = 0, Planar = 1, Interleaved = 2 };
+
+    void ensurePlane(int index, int width, int height, QOpenGLTexture::TextureFormat format);
+    void destroyPlanes();
+
+    Mode m_mode = Mode::Rgba;
+    bool m_highBitDepth = false;
+    QOpenGLTexture::WrapMode m_wrapMode = QOpenGLTexture::Repeat;
+    StreamingTexture m_rgba;
+    QOpenGLTexture* m_planes[3] = {nullptr, nullptr, nullptr};
+    int m_width = 0;
+    int m_height = 0;
+    VideoFrame::Colorimetry m_color;
+    int m_bitDepth = 8;
+    bool m_msbAligned = false;
+    double m_lastUploadMs = 0.0;
+};
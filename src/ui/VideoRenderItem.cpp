@@ -1,295 +1,285 @@
 #include "VideoRenderItem.h"
+#include "VideoFrameTexture.h"
+#include <QOpenGLFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLBuffer>
 #include <QPainter>
 #include <QDebug>
-#include <QUrl> // Add this
-
-VideoRenderItem::VideoRenderItem(QQuickItem* parent) : QQuickPaintedItem(parent) {
-    // Optimize for video
-    setRenderTarget(QQuickPaintedItem::FramebufferObject);
-    setOpaquePainting(true);
-    
-    m_decoder.setFrameCallback([this](const VideoDecoder::Frame& frame) {
-        this->updateFrame(frame);
-    });
-    
-    m_decoder.setErrorCallback([this](const std::string& msg) {
-        this->handleError(msg);
-    });
-
-    m_audioTimer = new QTimer(this);
-    m_audioTimer->setInterval(10);
-    connect(m_audioTimer, &QTimer::timeout, this, &VideoRenderItem::updateAudio);
-}
+#include <QQuickWindow>
+#include <QtMath>
 
-VideoRenderItem::~VideoRenderItem() {
-    // Stop decoder first
-    m_decoder.stop();
-    
-    if (m_audioSink) {
-        m_audioSink->stop();
-        delete m_audioSink;
+// Draws the current frame letterboxed into the item. Frames are sampled through
+// VideoFrameTexture, so high-bit-depth sources are converted and tone mapped on the GPU.
+class VideoRenderer : public QQuickFramebufferObject::Renderer, protected QOpenGLFunctions {
+public:
+    VideoRenderer() {
+        initializeOpenGLFunctions();
+        m_texture.setWrapMode(QOpenGLTexture::ClampToEdge);
+        initShaders();
+        initGeometry();
     }
-    
-    // Wait for any loading thread to finish
-    if (m_loadingThread.joinable()) {
-        m_loadingThread.join();
+
+    ~VideoRenderer() {
+        delete m_program;
     }
-}
 
-QString VideoRenderItem::source() const {
-    return m_source;
-}
+    void render() override {
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
 
-void VideoRenderItem::setSource(const QString& source) {
-    if (m_source == source) return;
-    m_source = source;
-    emit sourceChanged();
+        if (!m_texture.isValid()) return;
 
-    // Clear previous error
-    {
-        QMutexLocker lock(&m_frameMutex);
-        m_lastError.clear();
-        m_currentFrame = QImage(); // Clear previous frame
-        m_duration = 0;
-        m_position = 0;
+        // Fit the frame into the viewport while preserving its aspect ratio
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        float scaleX = 1.0f;
+        float scaleY = 1.0f;
+        if (!m_showingStatus && viewport[2] > 0 && viewport[3] > 0) {
+            float frameAspect = (float)m_texture.width() / m_texture.height();
+            float viewAspect = (float)viewport[2] / viewport[3];
+            if (frameAspect > viewAspect) {
+                scaleY = viewAspect / frameAspect;
+            } else {
+                scaleX = frameAspect / viewAspect;
+            }
+        }
+
+        m_program->bind();
+        m_texture.bind(m_program, 0);
+        m_program->setUniformValue("scale", scaleX, scaleY);
+
+        m_vbo.bind();
+        int vertexLocation = m_program->attributeLocation("vertices");
+        m_program->enableAttributeArray(vertexLocation);
+        m_program->setAttributeBuffer(vertexLocation, GL_FLOAT, 0, 2);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        m_program->disableAttributeArray(vertexLocation);
+        m_vbo.release();
+
+        m_texture.release(0);
+        m_program->release();
+    }
+
+    QOpenGLFramebufferObject* createFramebufferObject(const QSize& size) override {
+        m_statusSize = QSize(); // Status text is rendered at the framebuffer size
+        return new QOpenGLFramebufferObject(size);
     }
-    emit durationChanged();
-    emit positionChanged();
-    update(); // Trigger repaint to clear screen
 
-    if (!m_source.isEmpty()) {
-        // Handle file:// URLs
-        QString path = m_source;
-        QUrl url(m_source);
-        if (url.isLocalFile()) {
-            path = url.toLocalFile();
+    void synchronize(QQuickFramebufferObject* item) override {
+        VideoRenderItem* vItem = static_cast<VideoRenderItem*>(item);
+        vItem->setHighBitDepthOutput(m_texture.supportsHighBitDepth());
+
+        if (vItem->hasNewFrame()) {
+            VideoDecoder::FramePtr frame = vItem->takeFrame(m_error);
+            if (frame && frame->format != VideoDecoder::Frame::PixelFormat::Rgba8) {
+                m_texture.uploadPlanar(*frame);
+                m_showingStatus = false;
+            } else if (frame) {
+                m_texture.uploadRgba(frame->pixels.data(), frame->width, frame->height, frame->linesize);
+                m_showingStatus = false;
+            } else {
+                m_showingStatus = true;
+                m_statusSize = QSize();
+            }
+        }
+
+        if (m_showingStatus && framebufferObject() && m_statusSize != framebufferObject()->size()) {
+            m_statusSize = framebufferObject()->size();
+            qreal dpr = item->window() ? item->window()->effectiveDevicePixelRatio() : 1.0;
+            QImage status = renderStatus(m_statusSize, dpr);
+            m_texture.uploadRgba(status.constBits(), status.width(), status.height(), status.bytesPerLine());
         }
-        
-        // Stop Audio
-        if (m_audioSink) {
-            m_audioSink->stop();
-            delete m_audioSink;
-            m_audioSink = nullptr;
+    }
+
+private:
+    void initShaders() {
+        m_program = new QOpenGLShaderProgram();
+        if (!m_program->addShaderFromSourceCode(QOpenGLShader::Vertex,
+            "#version 110\n"
+            "attribute vec4 vertices;"
+            "uniform vec2 scale;"
+            "varying vec2 coords;"
+            "void main() {"
+            "    gl_Position = vec4(vertices.xy * scale, 0.0, 1.0);"
+            "    coords = vertices.xy;"
+            "}")) {
+            qDebug() << "Vertex Shader Error:" << m_program->log();
         }
-        m_audioTimer->stop();
-        
-        // Join previous thread if running
-        if (m_loadingThread.joinable()) {
-            m_loadingThread.join();
+        // Same texture orientation as the panorama view
+        if (!m_program->addShaderFromSourceCode(QOpenGLShader::Fragment,
+            QByteArray("#version 110\n") + VideoFrameTexture::samplingGlsl() +
+            "varying vec2 coords;"
+            "void main() {"
+            "    gl_FragColor = sampleVideo(coords * 0.5 + 0.5);"
+            "}")) {
+            qDebug() << "Fragment Shader Error:" << m_program->log();
         }
+        if (!m_program->link()) {
+            qDebug() << "Shader Link Error:" << m_program->log();
+        }
+    }
 
-        // Run in background to avoid blocking UI
-        std::string stdPath = path.toStdString();
-        m_loadingThread = std::thread([this, stdPath]() {
-            if (m_decoder.open(stdPath)) {
-                QMetaObject::invokeMethod(this, [this]() {
-                    m_duration = m_decoder.getDuration() * 1000;
-                    emit durationChanged();
-                    
-                    // Init Audio
-                    if (m_decoder.hasAudio()) {
-                        QAudioFormat format;
-                        format.setSampleRate(44100);
-                        format.setChannelConfig(QAudioFormat::ChannelConfigStereo);
-                        format.setSampleFormat(QAudioFormat::Int16);
-                        
-                        QAudioDevice device = QMediaDevices::defaultAudioOutput();
-                        if (!device.isFormatSupported(format)) {
-                            qWarning() << "Default format not supported, trying to find nearest";
-                            // format = device.preferredFormat(); // Qt6 might not have this exact method, check docs or assume standard
-                        }
-                        
-                        m_audioSink = new QAudioSink(device, format, this);
-                        m_audioSink->setVolume(m_volume);
-                        m_audioOutputDevice = m_audioSink->start();
-                        m_audioTimer->start();
-                    }
-                });
-            }
-        });
-    } else {
-        m_decoder.stop();
-        if (m_audioSink) {
-            m_audioSink->stop();
-            delete m_audioSink;
-            m_audioSink = nullptr;
+    void initGeometry() {
+        float vertices[] = {
+            -1.0f, -1.0f,
+             1.0f, -1.0f,
+            -1.0f,  1.0f,
+             1.0f,  1.0f
+        };
+        m_vbo.create();
+        m_vbo.bind();
+        m_vbo.allocate(vertices, sizeof(vertices));
+        m_vbo.release();
+    }
+
+    QImage renderStatus(const QSize& size, qreal dpr) const {
+        QImage image(size, QImage::Format_RGBA8888);
+        image.setDevicePixelRatio(dpr);
+        image.fill(Qt::black);
+        QPainter painter(&image);
+        QRectF rect(QPointF(0, 0), QSizeF(size) / dpr);
+        if (!m_error.isEmpty()) {
+            painter.setPen(Qt::red);
+            painter.drawText(rect, Qt::AlignCenter, "Error:\n" + m_error);
+        } else {
+            painter.setPen(Qt::white);
+            painter.drawText(rect, Qt::AlignCenter, "No Signal / Loading...");
         }
-        m_audioTimer->stop();
+        return image;
     }
-}
 
-qint64 VideoRenderItem::duration() const {
-    return m_duration;
-}
+    QOpenGLShaderProgram* m_program = nullptr;
+    QOpenGLBuffer m_vbo;
+    VideoFrameTexture m_texture;
+    QString m_error;
+    bool m_showingStatus = false;
+    QSize m_statusSize;
+};
 
-qint64 VideoRenderItem::position() const {
-    return m_position;
+VideoRenderItem::VideoRenderItem(QQuickItem* parent) : QQuickFramebufferObject(parent) {
+    // Composited by the scene graph above the video, never burned into the frame
+    m_subtitleOverlay = new SubtitleOverlay(this);
 }
 
-void VideoRenderItem::setPosition(qint64 position) {
-    if (m_position == position) return;
-    // Don't update m_position here, let the decoder update it via callback
-    // But we do need to tell decoder to seek
-    m_decoder.seek(position / 1000.0);
+VideoRenderItem::~VideoRenderItem() {
+    if (m_engine) m_engine->detachView(this);
 }
 
-bool VideoRenderItem::isPlaying() const {
-    return m_decoder.isPlaying();
+QQuickFramebufferObject::Renderer* VideoRenderItem::createRenderer() const {
+    return new VideoRenderer();
 }
 
-void VideoRenderItem::play() {
-    // If stopped, we need to re-open, which might block, so do it in thread if needed
-    if (m_decoder.isStopped() && !m_source.isEmpty()) {
-        QString path = m_source;
-        QUrl url(m_source);
-        if (url.isLocalFile()) {
-            path = url.toLocalFile();
-        }
-        std::string stdPath = path.toStdString();
-
-        // Join previous thread if running
-        if (m_loadingThread.joinable()) {
-            m_loadingThread.join();
-        }
+void VideoRenderItem::setEngine(MediaPlayerEngine* engine) {
+    if (m_engine == engine) return;
+    if (m_engine) {
+        m_engine->detachView(this);
+        disconnect(m_engine, nullptr, this, nullptr);
+    }
+    m_engine = engine;
+    clearFrame();
 
-        m_loadingThread = std::thread([this, stdPath]() {
-            if (m_decoder.open(stdPath)) {
-                QMetaObject::invokeMethod(this, [this]() {
-                    m_duration = m_decoder.getDuration() * 1000;
-                    emit durationChanged();
-                    
-                    // Init Audio
-                    if (m_decoder.hasAudio()) {
-                        QAudioFormat format;
-                        format.setSampleRate(44100);
-                        format.setChannelConfig(QAudioFormat::ChannelConfigStereo);
-                        format.setSampleFormat(QAudioFormat::Int16);
-                        
-                        QAudioDevice device = QMediaDevices::defaultAudioOutput();
-                        if (!device.isFormatSupported(format)) {
-                            qWarning() << "Default format not supported";
-                        }
-                        
-                        if (m_audioSink) {
-                            m_audioSink->stop();
-                            delete m_audioSink;
-                        }
-                        
-                        m_audioSink = new QAudioSink(device, format, this);
-                        m_audioSink->setVolume(m_volume);
-                        m_audioOutputDevice = m_audioSink->start();
-                        m_audioTimer->start();
-                    }
-
-                    m_decoder.play();
-                    emit playingChanged();
-                });
-            }
+    if (m_engine) {
+        connect(m_engine, &MediaPlayerEngine::sourceChanged, this, &VideoRenderItem::clearFrame);
+        connect(m_engine, &MediaPlayerEngine::subtitleTrackChanged, m_subtitleOverlay, &SubtitleOverlay::clear);
+        connect(m_engine, &MediaPlayerEngine::errorOccurred, this, &VideoRenderItem::showError);
+        m_engine->attachView(this, [this](std::vector<VideoDecoder::FramePtr>& frames) {
+            this->presentFrames(frames);
         });
-    } else {
-        m_decoder.play();
-        if (m_audioSink && m_audioSink->state() == QAudio::SuspendedState) {
-            m_audioSink->resume();
-        }
-        emit playingChanged();
+        updateOutputSize();
     }
+    emit engineChanged();
+}
+
+void VideoRenderItem::setHighBitDepthOutput(bool enabled) {
+    // Called from the render thread while the GUI thread is blocked in synchronize()
+    if (m_engine) m_engine->setViewHighBitDepth(this, enabled);
 }
 
-void VideoRenderItem::pause() {
-    m_decoder.pause();
-    if (m_audioSink && m_audioSink->state() == QAudio::ActiveState) {
-        m_audioSink->suspend();
+void VideoRenderItem::clearFrame() {
+    {
+        QMutexLocker lock(&m_frameMutex);
+        m_lastError.clear();
+        m_currentFrame.reset();
+        m_newFrameAvailable = true;
     }
-    emit playingChanged();
+    m_subtitleOverlay->clear();
+    update(); // Trigger repaint to clear screen
 }
 
-void VideoRenderItem::stop() {
-    m_decoder.stop();
-    if (m_audioSink) {
-        m_audioSink->stop();
+void VideoRenderItem::updateSubtitleRect() {
+    int frameWidth = 0;
+    int frameHeight = 0;
+    {
+        QMutexLocker lock(&m_frameMutex);
+        if (!m_currentFrame) return;
+        frameWidth = m_currentFrame->width;
+        frameHeight = m_currentFrame->height;
     }
-    emit playingChanged();
+    if (frameWidth <= 0 || frameHeight <= 0) return;
+
+    // Same letterboxing as the renderer
+    const qreal scale = std::min(width() / frameWidth, height() / frameHeight);
+    const QSizeF size(frameWidth * scale, frameHeight * scale);
+    m_subtitleOverlay->setVideoRect(QRectF(QPointF((width() - size.width()) / 2, (height() - size.height()) / 2), size));
 }
 
-void VideoRenderItem::setResolution(int width, int height) {
-    m_decoder.setTargetResolution(width, height);
+void VideoRenderItem::updateOutputSize() {
+    if (!m_engine || width() <= 0 || height() <= 0) return;
+
+    // Decode at the physical pixel size of the item; the decoder keeps the source aspect
+    qreal dpr = window() ? window()->effectiveDevicePixelRatio() : 1.0;
+    m_engine->setViewOutputSize(this, QSize(qCeil(width() * dpr), qCeil(height() * dpr)));
 }
 
-void VideoRenderItem::updateAudio() {
-    if (!m_audioSink || !m_audioOutputDevice || m_audioSink->state() == QAudio::StoppedState) return;
-    
-    int chunks = m_audioSink->bytesFree();
-    if (chunks > 0) {
-        std::vector<uint8_t> buf(chunks);
-        int read = m_decoder.getAudioData(buf.data(), chunks);
-        if (read > 0) {
-            m_audioOutputDevice->write((const char*)buf.data(), read);
-        }
+void VideoRenderItem::geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry) {
+    QQuickFramebufferObject::geometryChange(newGeometry, oldGeometry);
+    if (newGeometry.size() != oldGeometry.size()) {
+        m_subtitleOverlay->setSize(newGeometry.size());
+        updateSubtitleRect();
+        updateOutputSize();
     }
 }
 
-qreal VideoRenderItem::volume() const { return m_volume; }
-void VideoRenderItem::setVolume(qreal volume) {
-    if (qFuzzyCompare(m_volume, volume)) return;
-    m_volume = volume;
-    if (m_audioSink) m_audioSink->setVolume(m_volume);
-    emit volumeChanged();
+void VideoRenderItem::itemChange(ItemChange change, const ItemChangeData& value) {
+    QQuickFramebufferObject::itemChange(change, value);
+    if (change == ItemDevicePixelRatioHasChanged || change == ItemSceneChange) {
+        updateOutputSize();
+    }
 }
 
-void VideoRenderItem::updateFrame(const VideoDecoder::Frame& frame) {
-    QMutexLocker lock(&m_frameMutex);
-    // Deep copy the data to a QImage
-    // Note: In a real high-perf player, you'd avoid this copy by using OpenGL textures directly
-    m_currentFrame = QImage(frame.rgba.data(), frame.width, frame.height, frame.linesize, QImage::Format_RGBA8888).copy();
-    m_lastError.clear(); // Clear error on successful frame
-    
-    m_position = frame.pts * 1000;
-    
-    // Schedule a redraw on the main thread
-    QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);
-    QMetaObject::invokeMethod(this, "positionChanged", Qt::QueuedConnection);
+void VideoRenderItem::presentFrames(std::vector<VideoDecoder::FramePtr>& frames) {
+    {
+        QMutexLocker lock(&m_frameMutex);
+        // Without a view window every frame is complete, so only the newest one matters
+        m_currentFrame = frames.back();
+        m_newFrameAvailable = true;
+        m_lastError.clear(); // Clear error on successful frame
+    }
+
+    // Subtitles follow the playback clock, or the frame itself until the clock starts
+    VideoDecoder& decoder = m_engine->decoder();
+    const double time = decoder.clock().isStarted() ? decoder.clock().time() : frames.back()->pts;
+    updateSubtitleRect();
+    m_subtitleOverlay->setEvents(decoder.subtitles().active(time));
+
+    update();
 }
 
-void VideoRenderItem::handleError(const std::string& message) {
-    QMutexLocker lock(&m_frameMutex);
-    m_lastError = QString::fromStdString(message);
-    qDebug() << "Video Error:" << m_lastError;
-    emit errorOccurred(m_lastError);
-    
-    // Schedule a redraw to show error
-    QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);
+void VideoRenderItem::showError(const QString& message) {
+    {
+        QMutexLocker lock(&m_frameMutex);
+        m_lastError = message;
+        m_newFrameAvailable = true;
+    }
+    update(); // Redraw to show the error
 }
 
-void VideoRenderItem::paint(QPainter* painter) {
+VideoDecoder::FramePtr VideoRenderItem::takeFrame(QString& error) {
     QMutexLocker lock(&m_frameMutex);
-    
-    // Fill background with black to handle aspect ratio borders
-    painter->fillRect(0, 0, width(), height(), Qt::black);
-
-    if (!m_currentFrame.isNull()) {
-        // Calculate aspect ratio to fit the item while preserving ratio
-        float rw = (float)width() / m_currentFrame.width();
-        float rh = (float)height() / m_currentFrame.height();
-        float ratio = std::min(rw, rh);
-        
-        float newW = m_currentFrame.width() * ratio;
-        float newH = m_currentFrame.height() * ratio;
-        
-        float x = (width() - newW) / 2.0f;
-        float y = (height() - newH) / 2.0f;
-        
-        QRectF targetRect(x, y, newW, newH);
-        
-        painter->setRenderHint(QPainter::SmoothPixmapTransform);
-        painter->drawImage(targetRect, m_currentFrame);
-    } else {
-        painter->setPen(Qt::white);
-        
-        if (!m_lastError.isEmpty()) {
-            painter->setPen(Qt::red);
-            painter->drawText(boundingRect(), Qt::AlignCenter, "Error:\n" + m_lastError);
-        } else {
-            painter->drawText(boundingRect(), Qt::AlignCenter, "No Signal / Loading...");
-        }
-    }
+    m_newFrameAvailable = false;
+    error = m_lastError;
+    return m_currentFrame;
 }
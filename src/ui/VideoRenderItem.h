@@ -1,69 +1,48 @@
 #pragma once
 
-#include <QQuickPaintedItem>
-#include <QImage>
+#include <QQuickFramebufferObject>
+#include <QPointer>
 #include <QMutex>
-#include <QAudioSink>
-#include <QMediaDevices>
-#include <QAudioDevice>
-#include <QTimer>
-#include "../core/VideoDecoder.h"
+#include "MediaPlayerEngine.h"
+#include "SubtitleOverlay.h"
 
-class VideoRenderItem : public QQuickPaintedItem {
+// Flat view of a MediaPlayerEngine: the frame letterboxed into the item, with subtitles on top
+class VideoRenderItem : public QQuickFramebufferObject {
     Q_OBJECT
-    Q_PROPERTY(QString source READ source WRITE setSource NOTIFY sourceChanged)
-    Q_PROPERTY(qint64 duration READ duration NOTIFY durationChanged)
-    Q_PROPERTY(qint64 position READ position WRITE setPosition NOTIFY positionChanged)
-    Q_PROPERTY(qreal volume READ volume WRITE setVolume NOTIFY volumeChanged)
-    Q_PROPERTY(bool playing READ isPlaying NOTIFY playingChanged)
+    Q_PROPERTY(MediaPlayerEngine* engine READ engine WRITE setEngine NOTIFY engineChanged)
 
 public:
     VideoRenderItem(QQuickItem* parent = nullptr);
     ~VideoRenderItem();
 
-    void paint(QPainter* painter) override;
+    Renderer* createRenderer() const override;
 
-    QString source() const;
-    void setSource(const QString& source);
+    MediaPlayerEngine* engine() const { return m_engine; }
+    void setEngine(MediaPlayerEngine* engine);
 
-    qint64 duration() const;
-    qint64 position() const;
-    void setPosition(qint64 position);
-
-    qreal volume() const;
-    void setVolume(qreal volume);
-
-    bool isPlaying() const;
-
-    Q_INVOKABLE void play();
-    Q_INVOKABLE void pause();
-    Q_INVOKABLE void stop();
-    Q_INVOKABLE void setResolution(int width, int height);
+    // Internal use for Renderer
+    bool hasNewFrame() const { return m_newFrameAvailable; }
+    VideoDecoder::FramePtr takeFrame(QString& error);
+    void setHighBitDepthOutput(bool enabled);
 
 signals:
-    void sourceChanged();
-    void durationChanged();
-    void positionChanged();
-    void volumeChanged();
-    void playingChanged();
-    void errorOccurred(QString message);
+    void engineChanged();
 
-private:
-    void updateFrame(const VideoDecoder::Frame& frame);
-    void handleError(const std::string& message);
-    void updateAudio();
+protected:
+    void geometryChange(const QRectF& newGeometry, const QRectF& oldGeometry) override;
+    void itemChange(ItemChange change, const ItemChangeData& value) override;
 
-    QString m_source;
-    VideoDecoder m_decoder;
-    QImage m_currentFrame;
+private:
+    void clearFrame();
+    void updateOutputSize();
+    void updateSubtitleRect();
+    void presentFrames(std::vector<VideoDecoder::FramePtr>& frames);
+    void showError(const QString& message);
+
+    QPointer<MediaPlayerEngine> m_engine;
+    SubtitleOverlay* m_subtitleOverlay = nullptr;
+    VideoDecoder::FramePtr m_currentFrame; // Pooled decoder buffer, uploaded without a copy
+    bool m_newFrameAvailable = true;
     QString m_lastError;
-    qint64 m_duration = 0;
-    qint64 m_position = 0;
-    qreal m_volume = 1.0;
     QMutex m_frameMutex;
-    std::thread m_loadingThread;
-    
-    QAudioSink* m_audioSink = nullptr;
-    QIODevice* m_audioOutputDevice = nullptr;
-    QTimer* m_audioTimer = nullptr;
 };